@@ -0,0 +1,204 @@
+/**
+ * Benchmark of the associativity of the operation cache.
+ *
+ * Runs the circuits in qasm/circuits and the Grover, supremacy and Shor
+ * workloads of alg_run with a direct-mapped, 2-way and 4-way set-associative
+ * operation cache (sylvan_set_cache_associativity), and reports the wall time
+ * and the hit rates for every run. The cache is small by default, so that the
+ * workloads do not fit and collisions matter. Every workload is run once
+ * before it is timed (so that the edge weight table already contains its
+ * weights), and the operation cache is cleared before every run.
+ *
+ * The hit rates come from the Sylvan statistics, so they are only reported when
+ * Sylvan is built with SYLVAN_STATS.
+ *
+ * Usage: bench_cache_assoc [log2 cache size] [workers] [qasm directory]
+ */
+#include <qsylvan.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "../qasm/qsylvan_qasm_parser.h"
+#include "grover.h"
+#include "shor.h"
+#include "supremacy.h"
+
+#ifndef QASM_CIRCUITS_DIR
+#define QASM_CIRCUITS_DIR "qasm/circuits"
+#endif
+
+static double
+wctime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + 1E-6 * tv.tv_usec);
+}
+
+/**************************<qasm/circuits workload>***************************/
+
+static const char *qasm_dir = QASM_CIRCUITS_DIR;
+static quantum_circuit_t **circuits = NULL;
+static int n_circuits = 0;
+
+static void
+load_circuits()
+{
+    DIR *dir = opendir(qasm_dir);
+    if (dir == NULL) {
+        fprintf(stderr, "bench_cache_assoc: cannot open %s, skipping qasm circuits\n", qasm_dir);
+        return;
+    }
+    struct dirent *entry;
+    char path[1024];
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len < 5 || strcmp(entry->d_name + len - 5, ".qasm") != 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", qasm_dir, entry->d_name);
+        circuits = realloc(circuits, (n_circuits + 1) * sizeof(quantum_circuit_t*));
+        circuits[n_circuits++] = parse_qasm_file(path);
+    }
+    closedir(dir);
+}
+
+static QMDD
+apply_gate(QMDD state, quantum_op_t *gate, BDDVAR nqubits)
+{
+    const char *name = gate->name;
+    const int t = gate->targets[0];
+    if (strcmp(name, "id") == 0) return state;
+    if (strcmp(name, "x") == 0) return qmdd_gate(state, GATEID_X, t);
+    if (strcmp(name, "y") == 0) return qmdd_gate(state, GATEID_Y, t);
+    if (strcmp(name, "z") == 0) return qmdd_gate(state, GATEID_Z, t);
+    if (strcmp(name, "h") == 0) return qmdd_gate(state, GATEID_H, t);
+    if (strcmp(name, "s") == 0) return qmdd_gate(state, GATEID_S, t);
+    if (strcmp(name, "sdg") == 0) return qmdd_gate(state, GATEID_Sdag, t);
+    if (strcmp(name, "t") == 0) return qmdd_gate(state, GATEID_T, t);
+    if (strcmp(name, "tdg") == 0) return qmdd_gate(state, GATEID_Tdag, t);
+    if (strcmp(name, "sx") == 0) return qmdd_gate(state, GATEID_sqrtX, t);
+    if (strcmp(name, "sxdg") == 0) return qmdd_gate(state, GATEID_sqrtXdag, t);
+    if (strcmp(name, "rx") == 0) return qmdd_gate(state, GATEID_Rx(gate->angle[0]), t);
+    if (strcmp(name, "ry") == 0) return qmdd_gate(state, GATEID_Ry(gate->angle[0]), t);
+    if (strcmp(name, "rz") == 0) return qmdd_gate(state, GATEID_Rz(gate->angle[0]), t);
+    if (strcmp(name, "p") == 0) return qmdd_gate(state, GATEID_Phase(gate->angle[0]), t);
+    if (strcmp(name, "u") == 0) return qmdd_gate(state, GATEID_U(gate->angle[0], gate->angle[1], gate->angle[2]), t);
+
+    const int c = gate->ctrls[0];
+    if (strcmp(name, "cx") == 0) return qmdd_cgate(state, GATEID_X, c, t, nqubits);
+    if (strcmp(name, "cy") == 0) return qmdd_cgate(state, GATEID_Y, c, t, nqubits);
+    if (strcmp(name, "cz") == 0) return qmdd_cgate(state, GATEID_Z, c, t, nqubits);
+    if (strcmp(name, "ch") == 0) return qmdd_cgate(state, GATEID_H, c, t, nqubits);
+    if (strcmp(name, "cp") == 0) return qmdd_cgate(state, GATEID_Phase(gate->angle[0]), c, t, nqubits);
+    if (strcmp(name, "ccx") == 0) return qmdd_cgate2(state, GATEID_X, c, gate->ctrls[1], t, nqubits);
+    if (strcmp(name, "swap") == 0) return qmdd_circuit_swap(state, t, gate->targets[1]);
+
+    fprintf(stderr, "bench_cache_assoc: gate '%s' currently unsupported\n", name);
+    return state;
+}
+
+static void
+run_qasm_circuits()
+{
+    for (int k = 0; k < n_circuits; k++) {
+        BDDVAR nqubits = circuits[k]->qreg_size;
+        QMDD state = qmdd_create_all_zero_state(nqubits);
+        evbdd_protect(&state);
+        for (quantum_op_t *op = circuits[k]->operations; op != NULL; op = op->next) {
+            if (op->type == op_gate) state = apply_gate(state, op, nqubits);
+        }
+        evbdd_unprotect(&state);
+    }
+}
+
+/*************************</qasm/circuits workload>***************************/
+
+static void
+run_grover()
+{
+    bool *flag = qmdd_grover_ones_flag(16);
+    qmdd_grover(15, flag);
+    free(flag);
+}
+
+static void
+run_supremacy()
+{
+    supremacy_5_4_circuit(8);
+}
+
+static void
+run_shor()
+{
+    srand(42);
+    shor_run(21, 2, false);
+}
+
+typedef struct workload {
+    const char *name;
+    void (*run)(void);
+} workload_t;
+
+static void
+bench(workload_t *w)
+{
+    w->run(); // warm-up
+    printf("%s\n", w->name);
+    printf("  ways  time (s)   lookups          hit rate   gate/cgate hits\n");
+    for (int ways = 1; ways <= 4; ways *= 2) {
+        sylvan_set_cache_associativity(ways);
+        sylvan_clear_cache();
+        wgt_cache_clear();
+        sylvan_stats_reset();
+
+        double t_start = wctime();
+        w->run();
+        double time = wctime() - t_start;
+
+        sylvan_stats_t stats;
+        sylvan_stats_snapshot(&stats);
+        uint64_t lookups = stats.counters[OPCACHE_LOOKUP];
+        uint64_t gate_hits = stats.counters[QMDD_GATE_CACHED] + stats.counters[QMDD_CGATE_CACHED];
+        if (lookups > 0) {
+            printf("  %-4d  %-9.3lf  %-15" PRIu64 "  %6.2lf%%    %" PRIu64 "\n", ways, time,
+                   lookups, 100.0 * stats.counters[OPCACHE_HIT] / lookups, gate_hits);
+        } else {
+            printf("  %-4d  %-9.3lf  (hit rates need SYLVAN_STATS)\n", ways, time);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int log_cache = (argc > 1) ? atoi(argv[1]) : 12;
+    int workers   = (argc > 2) ? atoi(argv[2]) : 1;
+    if (argc > 3) qasm_dir = argv[3];
+
+    lace_start(workers, 0);
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<log_cache, 1LL<<log_cache);
+    sylvan_init_package();
+    qsylvan_init_simulator(1LL<<23, 1LL<<23, -1, COMP_HASHMAP, NORM_MAX);
+
+    printf("cache size: 2^%d, workers: %d\n", log_cache, workers);
+
+    load_circuits();
+
+    workload_t workloads[] = {
+        {"qasm/circuits", run_qasm_circuits},
+        {"grover (15 qubits + 1 ancilla)", run_grover},
+        {"supremacy (20 qubits, depth 8)", run_supremacy},
+        {"shor (N = 21, a = 2)", run_shor},
+    };
+    for (size_t k = 0; k < sizeof(workloads) / sizeof(workloads[0]); k++) {
+        if (k == 0 && n_circuits == 0) continue;
+        bench(&workloads[k]);
+    }
+
+    for (int k = 0; k < n_circuits; k++) free_quantum_circuit(circuits[k]);
+    free(circuits);
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
@@ -0,0 +1,159 @@
+/**
+ * Benchmark of controlled gates with controls after the target.
+ *
+ * Runs adder_n4, simon_n6 and dnn_n8 from qasm/circuits, once with the
+ * controlled gates applied directly on the state (qmdd_cgate_rec, which also
+ * handles up to 2 controls after the target) and once with the gates that have
+ * a control after the target applied as matrices (qmdd_create_multi_cgate and
+ * evbdd_matvec_mult, as before the direct kernel). For both it reports the
+ * wall time over a number of repetitions (with the operation cache cleared in
+ * between), the part of it spent in the gates with a control after the target
+ * and the speedup of these gates, and it checks that the final states agree.
+ *
+ * Usage: bench_cgate_below [repetitions] [workers] [qasm directory]
+ */
+#include <qsylvan.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "../qasm/qsylvan_qasm_parser.h"
+
+#ifndef QASM_CIRCUITS_DIR
+#define QASM_CIRCUITS_DIR "qasm/circuits"
+#endif
+
+static double
+wctime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + 1E-6 * tv.tv_usec);
+}
+
+static uint64_t n_below;  // number of controlled gates with a control after the target
+static double time_below; // time spent in these gates
+
+static QMDD
+cgate(QMDD state, gate_id_t g, int c1, int c2, int t, BDDVAR nqubits, bool native)
+{
+    if (c1 < t && c2 < t) {
+        if (c2 == -1) return qmdd_cgate(state, g, c1, t);
+        return qmdd_cgate2(state, g, c1, c2, t);
+    }
+    n_below++;
+    double t_start = wctime();
+    QMDD res;
+    if (native) {
+        if (c2 == -1) res = qmdd_cgate(state, g, c1, t, nqubits);
+        else res = qmdd_cgate2(state, g, c1, c2, t, nqubits);
+    }
+    else {
+        int c_options[nqubits];
+        for (BDDVAR k = 0; k < nqubits; k++) c_options[k] = -1;
+        c_options[c1] = 1;
+        if (c2 != -1) c_options[c2] = 1;
+        c_options[t] = 2;
+        QMDD matrix = qmdd_create_multi_cgate(nqubits, c_options, g);
+        res = evbdd_matvec_mult(matrix, state, nqubits);
+    }
+    time_below += wctime() - t_start;
+    return res;
+}
+
+static QMDD
+apply_gate(QMDD state, quantum_op_t *gate, BDDVAR nqubits, bool native)
+{
+    const char *name = gate->name;
+    const int t = gate->targets[0];
+    if (strcmp(name, "id") == 0) return state;
+    if (strcmp(name, "x") == 0) return qmdd_gate(state, GATEID_X, t);
+    if (strcmp(name, "y") == 0) return qmdd_gate(state, GATEID_Y, t);
+    if (strcmp(name, "z") == 0) return qmdd_gate(state, GATEID_Z, t);
+    if (strcmp(name, "h") == 0) return qmdd_gate(state, GATEID_H, t);
+    if (strcmp(name, "s") == 0) return qmdd_gate(state, GATEID_S, t);
+    if (strcmp(name, "sdg") == 0) return qmdd_gate(state, GATEID_Sdag, t);
+    if (strcmp(name, "t") == 0) return qmdd_gate(state, GATEID_T, t);
+    if (strcmp(name, "tdg") == 0) return qmdd_gate(state, GATEID_Tdag, t);
+    if (strcmp(name, "rx") == 0) return qmdd_gate(state, GATEID_Rx(gate->angle[0]), t);
+    if (strcmp(name, "ry") == 0) return qmdd_gate(state, GATEID_Ry(gate->angle[0]), t);
+    if (strcmp(name, "rz") == 0) return qmdd_gate(state, GATEID_Rz(gate->angle[0]), t);
+    if (strcmp(name, "p") == 0) return qmdd_gate(state, GATEID_Phase(gate->angle[0]), t);
+    if (strcmp(name, "u") == 0) return qmdd_gate(state, GATEID_U(gate->angle[0], gate->angle[1], gate->angle[2]), t);
+
+    const int c = gate->ctrls[0];
+    if (strcmp(name, "cx") == 0) return cgate(state, GATEID_X, c, -1, t, nqubits, native);
+    if (strcmp(name, "cy") == 0) return cgate(state, GATEID_Y, c, -1, t, nqubits, native);
+    if (strcmp(name, "cz") == 0) return cgate(state, GATEID_Z, c, -1, t, nqubits, native);
+    if (strcmp(name, "ch") == 0) return cgate(state, GATEID_H, c, -1, t, nqubits, native);
+    if (strcmp(name, "cp") == 0) return cgate(state, GATEID_Phase(gate->angle[0]), c, -1, t, nqubits, native);
+    if (strcmp(name, "ccx") == 0) return cgate(state, GATEID_X, c, gate->ctrls[1], t, nqubits, native);
+
+    fprintf(stderr, "bench_cgate_below: gate '%s' currently unsupported\n", name);
+    return state;
+}
+
+static QMDD
+run_circuit(quantum_circuit_t *circuit, bool native)
+{
+    BDDVAR nqubits = circuit->qreg_size;
+    QMDD state = qmdd_create_all_zero_state(nqubits);
+    evbdd_protect(&state);
+    for (quantum_op_t *op = circuit->operations; op != NULL; op = op->next) {
+        if (op->type == op_gate) state = apply_gate(state, op, nqubits, native);
+    }
+    evbdd_unprotect(&state);
+    return state;
+}
+
+int main(int argc, char **argv)
+{
+    int reps         = (argc > 1) ? atoi(argv[1]) : 100;
+    int workers      = (argc > 2) ? atoi(argv[2]) : 1;
+    const char *dir  = (argc > 3) ? argv[3] : QASM_CIRCUITS_DIR;
+
+    lace_start(workers, 0);
+    sylvan_set_sizes(1LL<<22, 1LL<<26, 1LL<<20, 1LL<<22);
+    sylvan_init_package();
+    qsylvan_init_simulator(1LL<<16, 1LL<<20, -1, COMP_HASHMAP, NORM_MAX);
+
+    printf("repetitions: %d, workers: %d\n", reps, workers);
+    printf("  %-10s %-7s %-6s %-11s %-11s %-13s %-13s %-8s %-8s\n", "circuit", "qubits", "below",
+           "direct (s)", "matrix (s)", "below direct", "below matrix", "speedup", "fidelity");
+
+    const char *names[] = {"adder_n4", "simon_n6", "dnn_n8"};
+    for (size_t k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s.qasm", dir, names[k]);
+        quantum_circuit_t *circuit = parse_qasm_file(path);
+        BDDVAR nqubits = circuit->qreg_size;
+
+        double time[2], below[2];
+        QMDD res[2];
+        for (int native = 1; native >= 0; native--) {
+            run_circuit(circuit, native); // warm-up
+            time[native] = time_below = 0;
+            for (int r = 0; r < reps; r++) {
+                sylvan_clear_cache();
+                n_below = 0;
+                double t_start = wctime();
+                res[native] = run_circuit(circuit, native);
+                time[native] += wctime() - t_start;
+            }
+            below[native] = time_below;
+            evbdd_protect(&res[native]);
+        }
+
+        double fid = qmdd_fidelity(res[0], res[1], nqubits);
+        printf("  %-10s %-7u %-6lu %-11.4lf %-11.4lf %-13.4lf %-13.4lf %-8.2lf %-8.6lf\n", names[k],
+               nqubits, (unsigned long) n_below, time[1], time[0], below[1], below[0],
+               below[1] > 0 ? below[0] / below[1] : 1.0, fid);
+        evbdd_unprotect(&res[0]);
+        evbdd_unprotect(&res[1]);
+        free_quantum_circuit(circuit);
+    }
+
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
@@ -0,0 +1,199 @@
+/**
+ * Benchmark of diagonal (phase) gates.
+ *
+ * Runs circuits which are dominated by diagonal gates: the QFT (on a random
+ * basis state and on a GHZ state) and QAOA for MaxCut on a ring, with the cost
+ * layer applied as native RZZ gates (qmdd_gate2) and as CX RZ CX, and layers
+ * of only diagonal gates (Rz, CP and RZZ) on a dense state. For every
+ * workload it reports the wall time (the best of a number of runs), the time
+ * per gate and the peak number of nodes of the state. Build it with and
+ * without QMDD_FAST_DIAGONAL_GATES to compare applying diagonal gates by
+ * rescaling edges with applying them as general 2x2 (or 4x4) gates.
+ *
+ * Usage: bench_diagonal [qubits] [layers] [runs] [workers]
+ */
+#include <qsylvan.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+static double
+wctime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + 1E-6 * tv.tv_usec);
+}
+
+static BDDVAR n_qubits;
+static BDDVAR n_layers;
+static uint64_t n_gates;
+static uint64_t peak_nodes;
+static double gate_time;
+static double t_gate;
+
+// (only the gates are timed, not the node counting)
+static void
+count(QMDD state, uint64_t gates)
+{
+    gate_time += wctime() - t_gate;
+    n_gates += gates;
+    uint64_t nodes = evbdd_countnodes(state);
+    if (nodes > peak_nodes) peak_nodes = nodes;
+    t_gate = wctime();
+}
+
+/**
+ * QFT on a random basis state.
+ */
+static void
+run_qft_basis()
+{
+    bool x[n_qubits];
+    srand(42);
+    for (BDDVAR k = 0; k < n_qubits; k++) x[k] = rand() & 1;
+    QMDD state = qmdd_create_basis_state(n_qubits, x);
+    evbdd_protect(&state);
+    t_gate = wctime();
+    state = qmdd_circuit_QFT(state, 0, n_qubits-1);
+    count(state, n_qubits * (n_qubits + 1) / 2);
+    evbdd_unprotect(&state);
+}
+
+/**
+ * QFT on a GHZ state.
+ */
+static void
+run_qft_ghz()
+{
+    QMDD state = qmdd_create_all_zero_state(n_qubits);
+    evbdd_protect(&state);
+    t_gate = wctime();
+    state = qmdd_gate(state, GATEID_H, 0);
+    for (BDDVAR k = 0; k < n_qubits-1; k++) state = qmdd_cgate(state, GATEID_X, k, k+1);
+    count(state, n_qubits);
+    state = qmdd_circuit_QFT(state, 0, n_qubits-1);
+    count(state, n_qubits * (n_qubits + 1) / 2);
+    evbdd_unprotect(&state);
+}
+
+/**
+ * QAOA for MaxCut on a ring, with cost layer exp(-i gamma Z_a Z_b / 2) per
+ * edge (a, b) and mixer layer Rx(2 beta) per qubit.
+ */
+static void
+run_qaoa(bool native_rzz)
+{
+    QMDD state = qmdd_create_all_zero_state(n_qubits);
+    evbdd_protect(&state);
+    t_gate = wctime();
+    for (BDDVAR k = 0; k < n_qubits; k++) state = qmdd_gate(state, GATEID_H, k);
+    count(state, n_qubits);
+    for (BDDVAR p = 0; p < n_layers; p++) {
+        fl_t gamma = 0.4 + 0.1*p, beta = 0.7 - 0.1*p;
+        complex_t rzz[16];
+        for (int k = 0; k < 16; k++) rzz[k] = czero();
+        rzz[0] = rzz[15] = cmake(flt_cos(gamma/2), -flt_sin(gamma/2));
+        rzz[5] = rzz[10] = cmake(flt_cos(gamma/2),  flt_sin(gamma/2));
+        uint32_t rzz_id = GATE2ID_custom(rzz);
+        for (BDDVAR a = 0; a < n_qubits; a++) {
+            BDDVAR b = (a + 1) % n_qubits;
+            if (native_rzz) {
+                state = qmdd_gate2(state, rzz_id, a, b);
+                count(state, 1);
+            }
+            else {
+                state = qmdd_cgate(state, GATEID_X, a, b, n_qubits);
+                state = qmdd_gate(state, GATEID_Rz(gamma), b);
+                state = qmdd_cgate(state, GATEID_X, a, b, n_qubits);
+                count(state, 3);
+            }
+        }
+        for (BDDVAR k = 0; k < n_qubits; k++) state = qmdd_gate(state, GATEID_Rx(2*beta), k);
+        count(state, n_qubits);
+    }
+    evbdd_unprotect(&state);
+}
+
+/**
+ * Layers of only diagonal gates (Rz on every qubit, CP and RZZ on every pair
+ * of neighbouring qubits) on a dense state. The preparation is not timed.
+ */
+static void
+run_phase_layers()
+{
+    QMDD state = qmdd_create_all_zero_state(n_qubits);
+    evbdd_protect(&state);
+    for (BDDVAR k = 0; k < n_qubits; k++) state = qmdd_gate(state, GATEID_Ry(0.3 + 0.4*k), k);
+    for (BDDVAR k = 0; k < n_qubits-1; k++) state = qmdd_cgate(state, GATEID_Rx(0.2 + k), k, k+1);
+    for (BDDVAR k = 0; k < n_qubits; k++) state = qmdd_gate(state, GATEID_Rx(0.3 + 0.1*k), k);
+    for (BDDVAR k = 0; k < n_qubits-1; k++) state = qmdd_cgate(state, GATEID_Ry(0.2 + k), k, k+1);
+    count(state, 0);
+    gate_time = 0;
+    t_gate = wctime();
+    for (BDDVAR p = 0; p < n_layers; p++) {
+        complex_t rzz[16];
+        for (int k = 0; k < 16; k++) rzz[k] = czero();
+        rzz[0] = rzz[15] = cmake(flt_cos(0.2 + 0.1*p), -flt_sin(0.2 + 0.1*p));
+        rzz[5] = rzz[10] = cmake(flt_cos(0.2 + 0.1*p),  flt_sin(0.2 + 0.1*p));
+        uint32_t rzz_id = GATE2ID_custom(rzz);
+        for (BDDVAR k = 0; k < n_qubits; k++) state = qmdd_gate(state, GATEID_Rz(0.7 + p + 0.1*k), k);
+        count(state, n_qubits);
+        for (BDDVAR k = 0; k < n_qubits; k++) {
+            state = qmdd_cgate(state, GATEID_Phase(0.5 + p + 0.1*k), k, (k+1) % n_qubits, n_qubits);
+        }
+        count(state, n_qubits);
+        for (BDDVAR k = 0; k < n_qubits; k++) state = qmdd_gate2(state, rzz_id, k, (k+1) % n_qubits);
+        count(state, n_qubits);
+    }
+    evbdd_unprotect(&state);
+}
+
+static void run_qaoa_rzz() { run_qaoa(true); }
+static void run_qaoa_cx_rz_cx() { run_qaoa(false); }
+
+typedef struct workload {
+    const char *name;
+    void (*run)();
+} workload_t;
+
+int main(int argc, char **argv)
+{
+    n_qubits    = (argc > 1) ? (BDDVAR) atoi(argv[1]) : 16;
+    n_layers    = (argc > 2) ? (BDDVAR) atoi(argv[2]) : 2;
+    int runs    = (argc > 3) ? atoi(argv[3]) : 3;
+    int workers = (argc > 4) ? atoi(argv[4]) : 1;
+
+    lace_start(workers, 0);
+    sylvan_set_sizes(1LL<<22, 1LL<<26, 1LL<<20, 1LL<<22);
+    sylvan_init_package();
+    qsylvan_init_simulator(1LL<<16, 1LL<<20, -1, COMP_HASHMAP, NORM_MAX);
+
+    printf("qubits: %u, layers: %u, runs: %d, workers: %d, fast diagonal gates: %d\n",
+           n_qubits, n_layers, runs, workers, QMDD_FAST_DIAGONAL_GATES);
+    workload_t workloads[] = {
+        {"qft (basis state)", run_qft_basis},
+        {"qft (ghz state)", run_qft_ghz},
+        {"qaoa (rzz)", run_qaoa_rzz},
+        {"qaoa (cx rz cx)", run_qaoa_cx_rz_cx},
+        {"phase layers", run_phase_layers},
+    };
+    printf("  %-20s %-8s %-9s %-12s %-12s\n", "workload", "gates", "time (s)", "us per gate", "peak nodes");
+    for (size_t k = 0; k < sizeof(workloads) / sizeof(workloads[0]); k++) {
+        double best = 0;
+        for (int r = 0; r < runs; r++) {
+            sylvan_clear_cache();
+            n_gates = peak_nodes = 0;
+            gate_time = 0;
+            workloads[k].run();
+            if (r == 0 || gate_time < best) best = gate_time;
+        }
+
+        printf("  %-20s %-8" PRIu64 " %-9.3lf %-12.2lf %-12" PRIu64 "\n", workloads[k].name,
+               n_gates, best, 1E6 * best / n_gates, peak_nodes);
+    }
+
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
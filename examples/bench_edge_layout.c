@@ -0,0 +1,113 @@
+/**
+ * Benchmark of the EVBDD edge layouts.
+ *
+ * Runs the Grover, supremacy and Shor workloads of alg_run with an operation
+ * cache of a fixed size (adaptive resizing is off), and reports the wall time,
+ * the hit rate of the operation cache, the number of cache buckets in use
+ * afterwards and the peak resident memory of the process. Build it with
+ * the default [23,40] layout, with SYLVAN_EVBDD_LARGE_WGT_INDICES and with
+ * SYLVAN_EVBDD_WIDE_EDGES to compare the layouts: the nodes are 16 bytes in all
+ * of them, but with 128 bit edges every cached EVBDD or QMDD result takes two
+ * buckets, and the edges on the stacks and in the Lace tasks are twice as big.
+ * Every workload is run once before it is timed (so that the edge weight table
+ * already contains its weights), and the operation cache is cleared before
+ * every run.
+ *
+ * The hit rates come from the Sylvan statistics, so they are only reported when
+ * Sylvan is built with SYLVAN_STATS.
+ *
+ * Usage: bench_edge_layout [log2 cache size] [workers]
+ */
+#include <qsylvan.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include "grover.h"
+#include "shor.h"
+#include "supremacy.h"
+
+static double
+wctime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + 1E-6 * tv.tv_usec);
+}
+
+static void
+run_grover()
+{
+    bool *flag = qmdd_grover_ones_flag(16);
+    qmdd_grover(15, flag);
+    free(flag);
+}
+
+static void
+run_supremacy()
+{
+    supremacy_5_4_circuit(8);
+}
+
+static void
+run_shor()
+{
+    srand(42);
+    shor_run(21, 2, false);
+}
+
+typedef struct workload {
+    const char *name;
+    void (*run)(void);
+} workload_t;
+
+int main(int argc, char **argv)
+{
+    int log_cache = (argc > 1) ? atoi(argv[1]) : 18;
+    int workers   = (argc > 2) ? atoi(argv[2]) : 1;
+
+    lace_start(workers, 0);
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<log_cache, 1LL<<log_cache);
+    sylvan_init_package();
+    sylvan_set_cache_adaptive(0, 0);
+    qsylvan_init_simulator(1LL<<23, 1LL<<23, -1, COMP_HASHMAP, NORM_MAX);
+
+    printf("cache size: 2^%d, workers: %d\n", log_cache, workers);
+    printf("edge layout: %d bit edge weight indices, %d bit node indices, %zu byte edges\n",
+           EVBDD_WGT_BITS, EVBDD_PTR_BITS, sizeof(EVBDD));
+
+    workload_t workloads[] = {
+        {"grover (15 qubits + 1 ancilla)", run_grover},
+        {"supremacy (20 qubits, depth 8)", run_supremacy},
+        {"shor (N = 21, a = 2)", run_shor},
+    };
+    printf("  %-32s %-9s %-9s %-12s\n", "workload", "time (s)", "hit rate", "buckets used");
+    for (size_t k = 0; k < sizeof(workloads) / sizeof(workloads[0]); k++) {
+        workloads[k].run(); // warm-up
+        sylvan_clear_cache();
+        wgt_cache_clear();
+        sylvan_stats_reset();
+
+        double t_start = wctime();
+        workloads[k].run();
+        double time = wctime() - t_start;
+
+        sylvan_stats_t stats;
+        sylvan_stats_snapshot(&stats);
+        uint64_t lookups = stats.counters[OPCACHE_LOOKUP];
+        if (lookups > 0) {
+            printf("  %-32s %-9.3lf %6.2lf%%   %-12zu\n", workloads[k].name, time,
+                   100.0 * stats.counters[OPCACHE_HIT] / lookups, cache_getused());
+        } else {
+            printf("  %-32s %-9.3lf %-9s %-12zu\n", workloads[k].name, time, "-", cache_getused());
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("peak resident memory: %ld KiB\n", usage.ru_maxrss);
+
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
@@ -0,0 +1,124 @@
+/**
+ * Microbenchmark for heap allocations during gate application.
+ *
+ * Applies a layered circuit of H, T, Ry, Rz and CZ gates to an n-qubit state
+ * and reports the number of malloc/calloc/realloc calls per gate, together
+ * with the time per gate. The edge weight arithmetic (wgt_add, wgt_mul, ...)
+ * is called many times per gate, so any per-call allocation shows up here.
+ *
+ * Usage: bench_wgt_alloc [nqubits] [depth] [workers]
+ */
+#include <qsylvan.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#ifdef __GLIBC__
+/* Count allocations by interposing the allocator (glibc only). */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static _Atomic(uint64_t) n_allocs = 0;
+static _Atomic(bool) count_allocs = false;
+
+void *malloc(size_t size)
+{
+    if (count_allocs) n_allocs++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    if (count_allocs) n_allocs++;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (count_allocs) n_allocs++;
+    return __libc_realloc(ptr, size);
+}
+#define ALLOC_COUNTING 1
+#else
+static uint64_t n_allocs = 0;
+static bool count_allocs = false;
+#define ALLOC_COUNTING 0
+#endif
+
+static double
+wctime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + 1E-6 * tv.tv_usec);
+}
+
+static uint64_t
+run_circuit(int nqubits, int depth)
+{
+    uint64_t n_gates = 0;
+    QMDD state = qmdd_create_all_zero_state(nqubits);
+    evbdd_protect(&state);
+
+    for (int n = 0; n < nqubits; n++) {
+        state = qmdd_gate(state, GATEID_H, n);
+        n_gates++;
+    }
+    for (int d = 0; d < depth; d++) {
+        for (int n = 0; n < nqubits; n++) {
+            fl_t theta = (fl_t)rand() / (fl_t)RAND_MAX;
+            state = qmdd_gate(state, GATEID_Ry(theta), n);
+            state = qmdd_gate(state, GATEID_T, n);
+            state = qmdd_gate(state, GATEID_Rz(theta), n);
+            n_gates += 3;
+        }
+        for (int n = 0; n < nqubits - 1; n++) {
+            state = qmdd_cgate(state, GATEID_Z, n, n+1);
+            n_gates++;
+        }
+    }
+
+    evbdd_unprotect(&state);
+    return n_gates;
+}
+
+int main(int argc, char **argv)
+{
+    int nqubits = (argc > 1) ? atoi(argv[1]) : 12;
+    int depth   = (argc > 2) ? atoi(argv[2]) : 20;
+    int workers = (argc > 3) ? atoi(argv[3]) : 1;
+
+    lace_start(workers, 0);
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<16, 1LL<<16);
+    sylvan_init_package();
+    qsylvan_init_defaults(1LL<<23);
+
+    srand(42);
+    // warm-up run, so one-time allocations (e.g. refs stacks) are not counted
+    run_circuit(nqubits, 1);
+
+    n_allocs = 0;
+    count_allocs = true;
+    double t_start = wctime();
+    uint64_t n_gates = run_circuit(nqubits, depth);
+    double t_end = wctime();
+    count_allocs = false;
+
+    printf("qubits:                %d\n", nqubits);
+    printf("depth:                 %d\n", depth);
+    printf("workers:               %d\n", workers);
+    printf("gates:                 %" PRIu64 "\n", n_gates);
+    if (ALLOC_COUNTING) {
+        printf("allocations:           %" PRIu64 "\n", (uint64_t)n_allocs);
+        printf("allocations per gate:  %.3lf\n", (double)n_allocs / (double)n_gates);
+    }
+    else {
+        printf("allocations per gate:  n/a (requires glibc)\n");
+    }
+    printf("time per gate (us):    %.3lf\n", 1e6 * (t_end - t_start) / (double)n_gates);
+
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
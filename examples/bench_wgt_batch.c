@@ -0,0 +1,150 @@
+/**
+ * Benchmark of batched edge weight lookups in evbdd_matvec_mult.
+ *
+ * The gates of a QFT circuit and of a random supremacy-style circuit (layers
+ * of random sqrt(X), sqrt(Y) and T gates on all qubits, followed by CZ gates
+ * between neighbouring qubits) are built as matrix QMDDs first, and then
+ * applied to a state with evbdd_matvec_mult. This is done with the four
+ * products which matvec and plus propagate to the children looked up one by
+ * one, and with them looked up together (wgt_mul4, wgt_set_batched_lookups).
+ * Both are timed after a warm-up run (so that the edge weight table contains
+ * the same weights for both), with the operation cache cleared before every
+ * run. Whether both runs give the same final state is reported as a check.
+ *
+ * Usage: bench_wgt_batch [nqubits] [depth] [workers]
+ */
+#include <qsylvan.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+static double
+wctime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + 1E-6 * tv.tv_usec);
+}
+
+// the matrices are protected as soon as they are created, since creating the
+// next ones can trigger gc
+
+static uint64_t
+qft_matrices(QMDD *mats, BDDVAR nqubits)
+{
+    uint64_t n = 0;
+    for (BDDVAR a = 0; a < nqubits; a++) {
+        mats[n] = qmdd_create_single_qubit_gate(nqubits, a, GATEID_H);
+        evbdd_protect(&mats[n++]);
+        for (BDDVAR b = a+1; b < nqubits; b++) {
+            mats[n] = qmdd_create_cgate(nqubits, a, b, GATEID_Rk((b - a) + 1));
+            evbdd_protect(&mats[n++]);
+        }
+    }
+    return n;
+}
+
+static uint64_t
+supremacy_matrices(QMDD *mats, BDDVAR nqubits, int depth)
+{
+    uint64_t n = 0;
+    gate_id_t *gates = malloc(nqubits * sizeof(gate_id_t));
+    for (BDDVAR k = 0; k < nqubits; k++) gates[k] = GATEID_H;
+    mats[n] = qmdd_create_single_qubit_gates(nqubits, gates);
+    evbdd_protect(&mats[n++]);
+    for (int d = 0; d < depth; d++) {
+        for (BDDVAR k = 0; k < nqubits; k++) {
+            switch (rand() % 3) {
+                case 0: gates[k] = GATEID_sqrtX; break;
+                case 1: gates[k] = GATEID_sqrtY; break;
+                case 2: gates[k] = GATEID_T; break;
+            }
+        }
+        mats[n] = qmdd_create_single_qubit_gates(nqubits, gates);
+        evbdd_protect(&mats[n++]);
+        for (BDDVAR k = d % 2; k+1 < nqubits; k += 2) {
+            mats[n] = qmdd_create_cgate(nqubits, k, k+1, GATEID_Z);
+            evbdd_protect(&mats[n++]);
+        }
+    }
+    free(gates);
+    return n;
+}
+
+static QMDD
+run(QMDD state, QMDD *mats, uint64_t n_mats, BDDVAR nqubits, bool batched, double *time)
+{
+    wgt_set_batched_lookups(batched);
+    sylvan_clear_cache();
+    wgt_cache_clear();
+    evbdd_protect(&state);
+    double t_start = wctime();
+    for (uint64_t m = 0; m < n_mats; m++) {
+        state = evbdd_matvec_mult(mats[m], state, nqubits);
+    }
+    *time = wctime() - t_start;
+    evbdd_unprotect(&state);
+    return state;
+}
+
+static void
+bench(const char *name, QMDD state, QMDD *mats, uint64_t n_mats, BDDVAR nqubits)
+{
+    double t_seq, t_batch;
+    run(state, mats, n_mats, nqubits, true, &t_batch); // warm-up
+    QMDD res_seq = run(state, mats, n_mats, nqubits, false, &t_seq);
+    evbdd_protect(&res_seq);
+    QMDD res_batch = run(state, mats, n_mats, nqubits, true, &t_batch);
+    evbdd_unprotect(&res_seq);
+    bool same = evbdd_equivalent(res_seq, res_batch, nqubits, false, false);
+
+    printf("%s (%" PRIu64 " gate matrices, %" PRIu64 " nodes in final state)\n",
+           name, n_mats, (uint64_t) evbdd_countnodes(res_batch));
+    printf("  sequential lookups (s):   %.3lf\n", t_seq);
+    printf("  batched lookups (s):      %.3lf\n", t_batch);
+    printf("  speedup:                  %.2lf\n", t_seq / t_batch);
+    printf("  same final state:         %s\n", same ? "yes" : "no");
+}
+
+int main(int argc, char **argv)
+{
+    int nqubits = (argc > 1) ? atoi(argv[1]) : 12;
+    int depth   = (argc > 2) ? atoi(argv[2]) : 10;
+    int workers = (argc > 3) ? atoi(argv[3]) : 1;
+
+    lace_start(workers, 0);
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<16, 1LL<<16);
+    sylvan_init_package();
+    // (with the NORM_LOW default the random circuit loses its norm to rounding
+    // errors after a few layers)
+    qsylvan_init_simulator(1LL<<23, 1LL<<23, -1, COMP_HASHMAP, NORM_MAX);
+
+    uint64_t max_mats = nqubits * nqubits + (depth + 1) * nqubits;
+    QMDD *mats = malloc(max_mats * sizeof(QMDD));
+    uint64_t n_mats;
+
+    printf("qubits: %d, depth: %d, workers: %d\n", nqubits, depth, workers);
+
+    // QFT on a random basis state
+    srand(42);
+    bool *x = malloc(nqubits * sizeof(bool));
+    for (int k = 0; k < nqubits; k++) x[k] = rand() % 2;
+    QMDD state = qmdd_create_basis_state(nqubits, x);
+    evbdd_protect(&state);
+    n_mats = qft_matrices(mats, nqubits);
+    bench("QFT", state, mats, n_mats, nqubits);
+    for (uint64_t m = 0; m < n_mats; m++) evbdd_unprotect(&mats[m]);
+
+    // supremacy-style circuit on |0..0>
+    state = qmdd_create_all_zero_state(nqubits);
+    n_mats = supremacy_matrices(mats, nqubits, depth);
+    bench("supremacy", state, mats, n_mats, nqubits);
+    for (uint64_t m = 0; m < n_mats; m++) evbdd_unprotect(&mats[m]);
+    evbdd_unprotect(&state);
+
+    free(x);
+    free(mats);
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
@@ -0,0 +1,138 @@
+/**
+ * Benchmark of exact (WGT_RATIONAL_128) against complex (WGT_COMPLEX_128) 
+ * edge weights on random Clifford+T circuits.
+ *
+ * The single qubit gates are T with probability t_ratio, and otherwise drawn
+ * with random_cliff7() (X, Y, Z, H, sqrtX, sqrtY, S). A fraction cgate_ratio of
+ * the gates is a CZ (as in qmdd_run_random_circuit()). The circuit is applied
+ * followed by its inverse, and for both edge weight types the time, the number
+ * of nodes and edge weights of the intermediate state, and whether the final
+ * state is exactly |0..0> again are reported. With complex edge weights,
+ * rounding errors can make the intermediate state larger than necessary and
+ * the final state differ from |0..0>.
+ *
+ * Usage: bench_wgt_exact [nqubits] [ngates] [t_ratio] [seed] [workers]
+ */
+#include <qsylvan.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "random_circuit.h"
+
+static const double cgate_ratio = 0.3;
+
+static double
+wctime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + 1E-6 * tv.tv_usec);
+}
+
+typedef struct gate_s {
+    uint32_t gateid;
+    BDDVAR c, t; // c == t for single qubit gates
+} gate_t;
+
+static void
+random_clifford_t_circuit(gate_t *gates, BDDVAR nqubits, uint64_t ngates, double t_ratio, uint64_t rseed)
+{
+    srand(rseed);
+    for (uint64_t g = 0; g < ngates; g++) {
+        double r = ((double)rand() / (double)RAND_MAX);
+        if (r < cgate_ratio) {
+            random_control_target(nqubits, &gates[g].c, &gates[g].t);
+            gates[g].gateid = GATEID_Z;
+        }
+        else {
+            random_qubit(nqubits, &gates[g].t);
+            gates[g].c = gates[g].t;
+            r = ((double)rand() / (double)RAND_MAX);
+            if (r < t_ratio) gates[g].gateid = GATEID_T;
+            else random_cliff7(&gates[g].gateid);
+        }
+    }
+}
+
+static uint32_t
+inverse_gate(uint32_t gateid)
+{
+    if (gateid == GATEID_T)     return GATEID_Tdag;
+    if (gateid == GATEID_S)     return GATEID_Sdag;
+    if (gateid == GATEID_sqrtX) return GATEID_sqrtXdag;
+    if (gateid == GATEID_sqrtY) return GATEID_sqrtYdag;
+    return gateid; // X, Y, Z, H
+}
+
+static QMDD
+apply(QMDD state, gate_t *gate, uint32_t gateid)
+{
+    if (gate->c == gate->t) return qmdd_gate(state, gateid, gate->t);
+    else return qmdd_cgate(state, gateid, gate->c, gate->t);
+}
+
+static void
+run(int wgt_type, gate_t *gates, BDDVAR nqubits, uint64_t ngates)
+{
+    sylvan_init_package();
+    qsylvan_init_simulator_wgt(1LL<<23, 1LL<<23, -1, wgt_type, COMP_HASHMAP, NORM_MAX);
+
+    bool *x = calloc(nqubits, sizeof(bool));
+    QMDD zero = qmdd_create_basis_state(nqubits, x);
+    QMDD state = zero;
+    evbdd_protect(&zero);
+    evbdd_protect(&state);
+
+    double t_start = wctime();
+    for (uint64_t g = 0; g < ngates; g++) {
+        state = apply(state, &gates[g], gates[g].gateid);
+    }
+    double t_mid = wctime();
+    uint64_t nodes = evbdd_countnodes(state);
+    uint64_t wgts = sylvan_edge_weights_count_entries();
+    double norm = qmdd_get_norm(state, nqubits);
+    for (uint64_t g = ngates; g > 0; g--) {
+        state = apply(state, &gates[g-1], inverse_gate(gates[g-1].gateid));
+    }
+    double t_end = wctime();
+
+    printf("%-8s  %12.3lf  %12.3lf  %10" PRIu64 "  %10" PRIu64 "  %10.2e  %10s  %10.2e\n",
+           (wgt_type == WGT_RATIONAL_128) ? "exact" : "complex",
+           1e6 * (t_mid - t_start) / (double)ngates,
+           1e6 * (t_end - t_mid) / (double)ngates,
+           nodes, wgts, fabs(norm - 1.0),
+           (state == zero) ? "yes" : "no",
+           fabs(qmdd_fidelity(state, zero, nqubits) - 1.0));
+
+    evbdd_unprotect(&zero);
+    evbdd_unprotect(&state);
+    free(x);
+    sylvan_quit();
+}
+
+int main(int argc, char **argv)
+{
+    int nqubits    = (argc > 1) ? atoi(argv[1]) : 10;
+    uint64_t ngates= (argc > 2) ? strtoull(argv[2], NULL, 10) : 300;
+    double t_ratio = (argc > 3) ? atof(argv[3]) : 0.2;
+    uint64_t rseed = (argc > 4) ? strtoull(argv[4], NULL, 10) : 42;
+    int workers    = (argc > 5) ? atoi(argv[5]) : 1;
+
+    gate_t *gates = malloc(ngates * sizeof(gate_t));
+    random_clifford_t_circuit(gates, nqubits, ngates, t_ratio, rseed);
+
+    printf("qubits: %d, gates: %" PRIu64 ", T ratio: %.2lf, CZ ratio: %.2lf, seed: %" PRIu64 ", workers: %d\n",
+           nqubits, ngates, t_ratio, cgate_ratio, rseed, workers);
+    printf("%-8s  %12s  %12s  %10s  %10s  %10s  %10s  %10s\n", "weights",
+           "us/gate", "us/gate inv", "nodes", "wgts", "|norm-1|", "exact inv", "1-fid");
+
+    lace_start(workers, 0);
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<16, 1LL<<16);
+    run(WGT_COMPLEX_128,  gates, nqubits, ngates);
+    run(WGT_RATIONAL_128, gates, nqubits, ngates);
+    lace_stop();
+
+    free(gates);
+    return 0;
+}
@@ -0,0 +1,221 @@
+/**
+ * Benchmark of QMDDs on wide (200+ qubit) registers.
+ *
+ * Runs sparse workloads on registers which need more than 8 bit variables:
+ * a GHZ state, a ripple-carry adder (of which the controls above the target
+ * are applied as matrices on 2n variables) and the syndrome extraction of a
+ * repetition code. For every workload it reports the wall time, the time per
+ * gate, the peak number of nodes of the state and the memory these nodes and
+ * the new edge weights take. With a register size of at most 127 qubits the
+ * workloads also run on builds with 8 bit variables, for a comparison of the
+ * speed per gate. Build it with and without SYLVAN_EVBDD_LARGE_WGT_INDICES (or
+ * SYLVAN_EVBDD_WIDE_EDGES) to compare the edge layouts.
+ *
+ * Usage: bench_wide_registers [register size] [workers]
+ */
+#include <qsylvan.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static double
+wctime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + 1E-6 * tv.tv_usec);
+}
+
+static BDDVAR n_qubits;
+static uint64_t n_gates;
+static uint64_t peak_nodes;
+static double gate_time;
+static double t_gate;
+
+// (only the gates are timed, not the node counting)
+static QMDD
+count(QMDD state)
+{
+    gate_time += wctime() - t_gate;
+    n_gates++;
+    uint64_t nodes = evbdd_countnodes(state);
+    if (nodes > peak_nodes) peak_nodes = nodes;
+    return state;
+}
+
+static QMDD
+gate(QMDD state, gate_id_t g, BDDVAR t)
+{
+    t_gate = wctime();
+    return count(qmdd_gate(state, g, t));
+}
+
+static QMDD
+cgate(QMDD state, gate_id_t g, BDDVAR c, BDDVAR t)
+{
+    t_gate = wctime();
+    return count(qmdd_cgate(state, g, c, t, n_qubits));
+}
+
+static QMDD
+cgate2(QMDD state, gate_id_t g, BDDVAR c1, BDDVAR c2, BDDVAR t)
+{
+    t_gate = wctime();
+    return count(qmdd_cgate2(state, g, c1, c2, t, n_qubits));
+}
+
+/**
+ * GHZ state on all qubits.
+ */
+static bool
+run_ghz(BDDVAR n)
+{
+    n_qubits = n;
+    QMDD state = qmdd_create_all_zero_state(n);
+    evbdd_protect(&state);
+    state = gate(state, GATEID_H, 0);
+    for (BDDVAR k = 0; k < n-1; k++) state = cgate(state, GATEID_X, k, k+1);
+
+    bool x[n];
+    memset(x, 1, sizeof(x));
+    bool ok = evbdd_getvalue(state, x) != EVBDD_ZERO;
+    evbdd_unprotect(&state);
+    return ok;
+}
+
+/**
+ * Cuccaro ripple-carry adder b := a + b on two (n-2)/2 bit registers, with
+ * the qubits interleaved as c_in, b_0, a_0, b_1, a_1, ..., z (carry out).
+ */
+#define A(i) (2 + 2*(i))
+#define B(i) (1 + 2*(i))
+
+static QMDD
+maj(QMDD s, BDDVAR c, BDDVAR b, BDDVAR a)
+{
+    s = cgate(s, GATEID_X, a, b);
+    s = cgate(s, GATEID_X, a, c);
+    return cgate2(s, GATEID_X, c, b, a);
+}
+
+static QMDD
+uma(QMDD s, BDDVAR c, BDDVAR b, BDDVAR a)
+{
+    s = cgate2(s, GATEID_X, c, b, a);
+    s = cgate(s, GATEID_X, a, c);
+    return cgate(s, GATEID_X, c, b);
+}
+
+static bool
+run_adder(BDDVAR n)
+{
+    const BDDVAR m = (n - 2) / 2;
+    const BDDVAR z = 2*m + 1;
+    n_qubits = 2*m + 2;
+
+    bool a[m], b[m], x[n_qubits];
+    memset(x, 0, sizeof(x));
+    srand(42);
+    for (BDDVAR i = 0; i < m; i++) {
+        a[i] = rand() & 1;
+        b[i] = rand() & 1;
+        x[A(i)] = a[i];
+        x[B(i)] = b[i];
+    }
+
+    QMDD state = qmdd_create_basis_state(n_qubits, x);
+    evbdd_protect(&state);
+    state = maj(state, 0, B(0), A(0));
+    for (BDDVAR i = 1; i < m; i++) state = maj(state, A(i-1), B(i), A(i));
+    state = cgate(state, GATEID_X, A(m-1), z);
+    for (BDDVAR i = m-1; i > 0; i--) state = uma(state, A(i-1), B(i), A(i));
+    state = uma(state, 0, B(0), A(0));
+
+    // a is restored, b holds the sum and z the carry
+    bool carry = 0;
+    for (BDDVAR i = 0; i < m; i++) {
+        x[B(i)] = a[i] ^ b[i] ^ carry;
+        carry = (a[i] & b[i]) | (carry & (a[i] ^ b[i]));
+    }
+    x[z] = carry;
+    bool ok = evbdd_getvalue(state, x) != EVBDD_ZERO;
+    evbdd_unprotect(&state);
+    return ok;
+}
+
+/**
+ * Syndrome extraction of a bit flip repetition code with (n+1)/2 data qubits
+ * (on the even qubits) and (n-1)/2 ancillas in between, on the logical |+>
+ * state with bit flips on some data qubits.
+ */
+static bool
+run_repetition_code(BDDVAR n)
+{
+    const BDDVAR d = (n + 1) / 2;
+    n_qubits = 2*d - 1;
+
+    QMDD state = qmdd_create_all_zero_state(n_qubits);
+    evbdd_protect(&state);
+    state = gate(state, GATEID_H, 0);
+    for (BDDVAR i = 1; i < d; i++) state = cgate(state, GATEID_X, 2*(i-1), 2*i);
+    for (BDDVAR i = 0; i < d; i += 7) state = gate(state, GATEID_X, 2*i);
+    for (BDDVAR i = 0; i < d-1; i++) {
+        state = cgate(state, GATEID_X, 2*i, 2*i+1);
+        state = cgate(state, GATEID_X, 2*i+2, 2*i+1);
+    }
+
+    // every ancilla next to a flipped data qubit detects it
+    bool x[n_qubits];
+    for (BDDVAR i = 0; i < d; i++) x[2*i] = (i % 7 == 0);
+    for (BDDVAR i = 0; i < d-1; i++) x[2*i+1] = x[2*i] ^ x[2*i+2];
+    bool ok = evbdd_getvalue(state, x) != EVBDD_ZERO;
+    evbdd_unprotect(&state);
+    return ok;
+}
+
+typedef struct workload {
+    const char *name;
+    bool (*run)(BDDVAR n);
+} workload_t;
+
+int main(int argc, char **argv)
+{
+    BDDVAR n    = (argc > 1) ? (BDDVAR) atoi(argv[1]) : 300;
+    int workers = (argc > 2) ? atoi(argv[2]) : 1;
+
+    lace_start(workers, 0);
+    sylvan_set_sizes(1LL<<22, 1LL<<26, 1LL<<20, 1LL<<22);
+    sylvan_init_package();
+    qsylvan_init_simulator(1LL<<16, 1LL<<20, -1, COMP_HASHMAP, NORM_MAX);
+
+    printf("register size: %u, workers: %d\n", n, workers);
+    printf("edge layout: %d bit edge weight indices, %d bit node indices\n",
+           EVBDD_WGT_BITS, EVBDD_PTR_BITS);
+    workload_t workloads[] = {
+        {"ghz", run_ghz},
+        {"ripple-carry adder", run_adder},
+        {"repetition code", run_repetition_code},
+    };
+    printf("  %-20s %-7s %-8s %-9s %-12s %-12s %-10s\n", "workload", "qubits",
+           "gates", "time (s)", "us per gate", "peak nodes", "mem (KiB)");
+    for (size_t k = 0; k < sizeof(workloads) / sizeof(workloads[0]); k++) {
+        sylvan_clear_cache();
+        n_gates = peak_nodes = 0;
+        gate_time = 0;
+        uint64_t wgts_before = sylvan_edge_weights_count_entries();
+
+        bool ok = workloads[k].run(n);
+
+        // nodes are 2 x 64 bits, complex edge weights 2 doubles
+        uint64_t wgts = sylvan_edge_weights_count_entries() - wgts_before;
+        double mem = (peak_nodes * 2*sizeof(uint64_t) + wgts * 2*sizeof(double)) / 1024.0;
+        printf("  %-20s %-7u %-8" PRIu64 " %-9.3lf %-12.2lf %-12" PRIu64 " %-10.1lf%s\n",
+               workloads[k].name, n_qubits, n_gates, gate_time, 1E6 * gate_time / n_gates,
+               peak_nodes, mem, ok ? "" : "  WRONG RESULT");
+    }
+
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
@@ -2,5 +2,6 @@
 
 void random_qubit(BDDVAR nqubits, BDDVAR *t);
 void random_control_target(BDDVAR nqubits, BDDVAR *c, BDDVAR *t);
+void random_cliff7(uint32_t *gateid);
 QMDD qmdd_run_random_circuit(BDDVAR nqubits, uint64_t ngates, double cgate_ratio, uint64_t rseed);
 QMDD qmdd_run_random_single_qubit_gates(BDDVAR nqubits, uint64_t ngates, uint64_t rseed);
\ No newline at end of file
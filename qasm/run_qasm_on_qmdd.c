@@ -27,6 +27,7 @@
 static int workers = 1;
 static int rseed = 0;
 static bool count_nodes = false;
+static bool count_near_duplicates = false;
 static bool output_vector = false;
 static size_t min_tablesize = 1LL<<25;
 static size_t max_tablesize = 1LL<<25;
@@ -36,8 +37,13 @@ static size_t min_wgt_tab_size = 1LL<<23;
 static size_t max_wgt_tab_size = 1LL<<23;
 static double tolerance = 1e-14;
 static int wgt_table_type = COMP_HASHMAP;
+static int wgt_type = WGT_COMPLEX_128;
+static bool wgt_type_auto = false;
 static int wgt_norm_strat = NORM_MAX;
 static bool wgt_inv_caching = true;
+static int caching_granularity = 1;
+static bool caching_autotune = false;
+static char* caching_levels[EVBDD_CACHE_N_OPS] = {NULL};
 static int reorder_qubits = 0;
 static char* qasm_inputfile = NULL;
 static char* json_outputfile = NULL;
@@ -52,11 +58,17 @@ static struct argp_option options[] =
     {"json", 'j', "<filename>", 0, "Write stats to given filename as json", 0},
     {"count-nodes", 'c', 0, 0, "Track maximum number of nodes", 0},
     {"state-vector", 'v', 0, 0, "Also output the complete state vector", 0},
-    {"node-tab-size", 1000, "<size>", 0, "log2 of max node table size (max 40)", 0},
-    {"wgt-tab-size", 1001, "<size>", 0, "log2 of max edge weigth table size (max 30 (23 if node table >2^30))", 0},
+    {"node-tab-size", 1000, "<size>", 0, "log2 of max node table size (max 40, 30 if built with SYLVAN_EVBDD_LARGE_WGT_INDICES, 38 with SYLVAN_EVBDD_WIDE_EDGES)", 0},
+    {"wgt-tab-size", 1001, "<size>", 0, "log2 of max edge weigth table size (max 23, 30 if built with SYLVAN_EVBDD_LARGE_WGT_INDICES)", 0},
     {"reorder", 1002, 0, 0, "Reorders the qubits once such that (most) controls occur before targets in the variable order.", 0},
     {"reorder-swaps", 1003, 0, 0, "Reorders the qubits such that all controls occur before targets (requires inserting SWAP gates).", 0},
     {"disable-inv-caching", 1004, 0, 0, "Disable storing inverse of MUL and DIV in cache.", 0},
+    {"wgt-backend", 1005, "<cmap|rmap|tmap>", 0, "Edge weight table: fixed size (cmap, default), growing without gc (rmap), or fixed size without near-duplicate weights (tmap).", 0},
+    {"wgt-type", 1006, "<complex|real|exact|auto>", 0, "Edge weight type: complex (default), real, exact (Clifford+T circuits only, with norm-strat low or max), or auto (real iff the circuit only contains real gates).", 0},
+    {"caching-granularity", 1007, "<g>", 0, "Only cache results of operations at levels which are a multiple of g (default=1).", 0},
+    {"caching-autotune", 1008, 0, 0, "Tune the levels at which the results of each operation are cached during the run.", 0},
+    {"caching-levels", 1009, "<op>=<levels>", 0, "Only cache results of <op> (gate, cgate, plus, matvec, matmat, inprod) at the levels k with character k of <levels> '1', e.g. as reported in the json output. Can be given for several operations.", 0},
+    {"count-near-duplicates", 1010, 0, 0, "Count the edge weights in the table which are within tolerance of another one after the run (expensive for large tables).", 0},
     {0, 0, 0, 0, 0, 0}
 };
 
@@ -106,6 +118,39 @@ parse_opt(int key, char *arg, struct argp_state *state)
     case 1004:
         wgt_inv_caching = false;
         break;
+    case 1005:
+        if (strcmp(arg, "cmap")==0) wgt_table_type = COMP_HASHMAP;
+        else if (strcmp(arg, "rmap")==0) wgt_table_type = COMP_RESIZABLE_HASHMAP;
+        else if (strcmp(arg, "tmap")==0) wgt_table_type = COMP_TOLERANT_HASHMAP;
+        else argp_usage(state);
+        break;
+    case 1006:
+        if (strcmp(arg, "complex")==0) wgt_type = WGT_COMPLEX_128;
+        else if (strcmp(arg, "real")==0) wgt_type = WGT_DOUBLE;
+        else if (strcmp(arg, "exact")==0) wgt_type = WGT_RATIONAL_128;
+        else if (strcmp(arg, "auto")==0) wgt_type_auto = true;
+        else argp_usage(state);
+        break;
+    case 1007:
+        caching_granularity = atoi(arg);
+        if (caching_granularity < 1) argp_usage(state);
+        break;
+    case 1008:
+        caching_autotune = true;
+        break;
+    case 1009: {
+        char *levels = strchr(arg, '=');
+        if (levels == NULL) argp_usage(state);
+        *levels = '\0';
+        int op = 0;
+        while (op < EVBDD_CACHE_N_OPS && strcmp(arg, evbdd_cache_op_name(op)) != 0) op++;
+        if (op == EVBDD_CACHE_N_OPS) argp_usage(state);
+        caching_levels[op] = levels + 1;
+        break;
+    }
+    case 1010:
+        count_near_duplicates = true;
+        break;
     case ARGP_KEY_ARG:
         if (state->arg_num >= 1) argp_usage(state);
         qasm_inputfile = arg;
@@ -131,6 +176,8 @@ typedef struct stats_s {
     uint64_t final_nodes;
     uint64_t max_nodes;
     uint64_t shots;
+    uint64_t wgt_entries;
+    uint64_t wgt_near_duplicates;
     double simulation_time;
     double norm;
     QMDD final_state;
@@ -164,6 +211,17 @@ void fprint_stats(FILE *stream, quantum_circuit_t* circuit)
     fprintf(stream, "  \"statistics\": {\n");
     fprintf(stream, "    \"applied_gates\": %" PRIu64 ",\n", stats.applied_gates);
     fprintf(stream, "    \"benchmark\": \"%s\",\n", circuit->name);
+    fprintf(stream, "    \"caching_autotune\": %d,\n", caching_autotune);
+    fprintf(stream, "    \"caching_granularity\": %d,\n", caching_granularity);
+    fprintf(stream, "    \"caching_levels\": {\n");
+    char *levels = malloc(circuit->qreg_size + 1);
+    for (int op = 0; op < EVBDD_CACHE_N_OPS; op++) {
+        evbdd_get_caching_levels(op, levels, circuit->qreg_size);
+        fprintf(stream, "      \"%s\": \"%s\"%s\n", evbdd_cache_op_name(op), levels,
+                (op == EVBDD_CACHE_N_OPS - 1) ? "" : ",");
+    }
+    free(levels);
+    fprintf(stream, "    },\n");
     fprintf(stream, "    \"final_nodes\": %" PRIu64 ",\n", stats.final_nodes);
     fprintf(stream, "    \"max_nodes\": %" PRIu64 ",\n", stats.max_nodes);
     fprintf(stream, "    \"n_qubits\": %d,\n", circuit->qreg_size);
@@ -173,8 +231,17 @@ void fprint_stats(FILE *stream, quantum_circuit_t* circuit)
     fprintf(stream, "    \"shots\": %" PRIu64 ",\n", stats.shots);
     fprintf(stream, "    \"simulation_time\": %lf,\n", stats.simulation_time);
     fprintf(stream, "    \"tolerance\": %.5e,\n", tolerance);
+    fprintf(stream, "    \"wgt_backend\": %d,\n", wgt_table_type);
+    fprintf(stream, "    \"wgt_entries\": %" PRIu64 ",\n", stats.wgt_entries);
+    if (count_near_duplicates) {
+        fprintf(stream, "    \"wgt_near_duplicates\": %" PRIu64 ",\n", stats.wgt_near_duplicates);
+        fprintf(stream, "    \"wgt_duplicate_rate\": %.5e,\n", (stats.wgt_entries == 0) ? 0.0 :
+                                      (double) stats.wgt_near_duplicates / (double) stats.wgt_entries);
+    }
     fprintf(stream, "    \"wgt_inv_caching\": %d,\n", wgt_inv_caching);
     fprintf(stream, "    \"wgt_norm_strat\": %d,\n", wgt_norm_strat);
+    fprintf(stream, "    \"wgt_type\": \"%s\",\n", (wgt_type == WGT_DOUBLE) ? "real" :
+                                            (wgt_type == WGT_RATIONAL_128) ? "exact" : "complex");
     fprintf(stream, "    \"min_node_tab_size\": %" PRId64 ",\n", min_tablesize);
     fprintf(stream, "    \"max_node_tab_size\": %" PRId64 ",\n", max_tablesize);
     fprintf(stream, "    \"min_wgt_tab_size\": %" PRId64 ",\n", min_wgt_tab_size);
@@ -192,6 +259,46 @@ wctime()
     return (tv.tv_sec + 1E-6 * tv.tv_usec);
 }
 
+static bool
+is_multiple_of_pi(double angle)
+{
+    double pi = flt_acos(0.0) * 2;
+    double k = angle / pi;
+    return (fabs(k - round(k)) < 1e-12);
+}
+
+/**
+ * Returns true iff all gates in the circuit have real matrices, i.e. iff the
+ * circuit can be simulated with WGT_DOUBLE edge weights. Should be kept in 
+ * sync with apply_gate() below.
+ */
+static bool
+circuit_is_real(quantum_circuit_t *circuit)
+{
+    static const char *real_gates[] = {"id", "x", "z", "h", "ry", "cx", "cz", 
+        "ch", "cry", "ccx", "c3x", "swap", "cswap", "rccx", NULL};
+    for (quantum_op_t *op = circuit->operations; op != NULL; op = op->next) {
+        if (op->type != op_gate) continue;
+        bool real = false;
+        for (int k = 0; real_gates[k] != NULL; k++) {
+            if (strcmp(op->name, real_gates[k]) == 0) real = true;
+        }
+        // phase gates are real for angles 0 and pi
+        if (strcmp(op->name, "p") == 0 || strcmp(op->name, "cp") == 0 ||
+            strcmp(op->name, "rzz") == 0) {
+            real = is_multiple_of_pi(op->angle[0]);
+        }
+        else if (strcmp(op->name, "u") == 0 || strcmp(op->name, "cu") == 0) {
+            real = is_multiple_of_pi(op->angle[1]) && is_multiple_of_pi(op->angle[2]);
+        }
+        else if (strcmp(op->name, "u2") == 0) {
+            real = is_multiple_of_pi(op->angle[0]) && is_multiple_of_pi(op->angle[1]);
+        }
+        if (!real) return false;
+    }
+    return true;
+}
+
 /**
  * Here we match the name of a gate in QASM to
  * the GATEID 
@@ -295,12 +402,13 @@ QMDD apply_gate(QMDD state, quantum_op_t* gate, BDDVAR nqubits)
         return qmdd_cgate3(state, GATEID_sqrtX, gate->ctrls[0], gate->ctrls[1], gate->ctrls[2], gate->targets[0], nqubits);
     }
     else if (strcmp(gate->name, "swap") == 0) {
-        // no native SWAP gates in Q-Sylvan
-        stats.applied_gates += 4;
-        return qmdd_circuit_swap(state, gate->targets[0], gate->targets[1]);
+        return qmdd_gate2(state, GATE2ID_swap(), gate->targets[0], gate->targets[1]);
     }
     else if (strcmp(gate->name, "cswap") == 0) {
-        // no native CSWAP gates in Q-Sylvan
+        if (gate->ctrls[0] < gate->targets[0] && gate->ctrls[0] < gate->targets[1]) {
+            return qmdd_controlled_gate2(state, GATE2ID_swap(), gate->ctrls[0], gate->targets[0], gate->targets[1]);
+        }
+        // (the control needs to come before the swapped qubits)
         stats.applied_gates += 4;
         // CCNOT
         state = qmdd_cgate2(state, GATEID_X, gate->ctrls[0], gate->targets[0], gate->targets[1], nqubits);
@@ -323,26 +431,16 @@ QMDD apply_gate(QMDD state, quantum_op_t* gate, BDDVAR nqubits)
         return state;
     }
     else if (strcmp(gate->name, "rzz") == 0 ) {
-        // no native RZZ gates in Q-Sylvan
-        stats.applied_gates += 2;
-        state = qmdd_cgate(state, GATEID_X, gate->targets[0], gate->targets[1], nqubits);
-        state = qmdd_gate(state, GATEID_Phase(gate->angle[0]), gate->targets[1]);
-        state = qmdd_cgate(state, GATEID_X, gate->targets[0], gate->targets[1], nqubits);
-
-        return state;
+        // diag(1, e^(i theta), e^(i theta), 1), i.e. CX P(theta) CX, which is
+        // Rzz(theta) up to global phase (and real for theta = k*pi)
+        complex_t u[16];
+        for (int k = 0; k < 16; k++) u[k] = czero();
+        u[4*0 + 0] = u[4*3 + 3] = cmake(1.0, 0.0);
+        u[4*1 + 1] = u[4*2 + 2] = cmake_angle(gate->angle[0], 1);
+        return qmdd_gate2(state, GATE2ID_custom(u), gate->targets[0], gate->targets[1]);
     }
     else if (strcmp(gate->name, "rxx") == 0) {
-        // no native RXX gates in Q-Sylvan
-        fl_t pi = flt_acos(0.0) * 2;
-        stats.applied_gates += 6;
-        state = qmdd_gate(state, GATEID_U(pi/2.0, gate->angle[0], 0), gate->targets[0]);
-        state = qmdd_gate(state, GATEID_H, gate->targets[1]);
-        state = qmdd_cgate(state, GATEID_X, gate->targets[0], gate->targets[1], nqubits);
-        state = qmdd_gate(state, GATEID_Phase(-(gate->angle[0])), gate->targets[1]);
-        state = qmdd_cgate(state, GATEID_X, gate->targets[0], gate->targets[1], nqubits);
-        state = qmdd_gate(state, GATEID_H, gate->targets[1]);
-        state = qmdd_gate(state, GATEID_U(pi/2.0, -pi, pi-gate->angle[0]), gate->targets[0]);
-        return state;
+        return qmdd_gate2(state, GATE2ID_Rxx(gate->angle[0]), gate->targets[0], gate->targets[1]);
     }
     else {
         fprintf(stderr, "Gate '%s' currently unsupported\n", gate->name);
@@ -397,6 +495,9 @@ void simulate_circuit(quantum_circuit_t* circuit)
     stats.shots = 1;
     stats.final_nodes = evbdd_countnodes(state);
     stats.norm = qmdd_get_norm(state, circuit->qreg_size);
+    stats.wgt_entries = sylvan_edge_weights_count_entries();
+    // this re-inserts every weight into a temporary table, so only on request
+    if (count_near_duplicates) stats.wgt_near_duplicates = sylvan_edge_weights_count_near_duplicates();
 }
 
 
@@ -416,8 +517,16 @@ int main(int argc, char *argv[])
     // Simple Sylvan initialization
     sylvan_set_sizes(min_tablesize, max_tablesize, min_cachesize, max_cachesize);
     sylvan_init_package();
-    qsylvan_init_simulator(min_wgt_tab_size, max_wgt_tab_size, tolerance, COMP_HASHMAP, wgt_norm_strat);
+    if (wgt_type_auto) {
+        wgt_type = circuit_is_real(circuit) ? WGT_DOUBLE : WGT_COMPLEX_128;
+    }
+    qsylvan_init_simulator_wgt(min_wgt_tab_size, max_wgt_tab_size, tolerance, wgt_type, wgt_table_type, wgt_norm_strat);
     wgt_set_inverse_chaching(wgt_inv_caching);
+    evbdd_set_caching_granularity(caching_granularity);
+    for (int op = 0; op < EVBDD_CACHE_N_OPS; op++) {
+        if (caching_levels[op] != NULL) evbdd_set_caching_levels(op, caching_levels[op]);
+    }
+    evbdd_set_caching_autotune(caching_autotune);
 
     simulate_circuit(circuit);
 
@@ -10,55 +10,25 @@
 #include <math.h>
 
 #include "atomics.h"
-#include "cmap.h"
+#include "cmap_int.h"
 #include "fast_hash.h"
+#include "tmap.h"
 #include "util.h"
 
-#undef CACHE_LINE
-#undef CACHE_LINE_SIZE
-
-#define CACHE_LINE 8
-#define CACHE_LINE_SIZE 256
-
-// how many "blocks" of 64 bits for a single table entry
-#define entry_size (2*sizeof(fl_t)/8)
-
-typedef union {
-    complex_t       c;
-    uint64_t        d[entry_size];
-} bucket_t;
-
 // float "equality" tolerance
 static long double TOLERANCE = 1e-14l;
-static const uint64_t EMPTY = 14738995463583502973ull;
-static const uint64_t LOCK  = 14738995463583502974ull;
-static const uint64_t CL_MASK = -(1ULL << CACHE_LINE);
-
-/**
-\typedef Lockless hastable database.
-*/
-typedef struct cmap_s cmap_t;
-struct cmap_s {
-    size_t              size;
-    size_t              mask;
-    size_t              threshold;
-    int                 seen_0;
-    bucket_t  __attribute__(( __aligned__(32)))       *table;
-    // Q: should this 32 change to 16 now that we use doubles instead of
-    // long doubles for the real and imaginary components?
-};
 
 static void __attribute__((unused))
-print_bucket_floats(bucket_t *b)
+print_bucket_floats(cmap_bucket_t *b)
 {
     printf("%.60Lf, %.60Lf\n", (long double) b->c.r, (long double) b->c.i);
 }
 
 static void __attribute__((unused))
-print_bucket_bits(bucket_t* b)
+print_bucket_bits(cmap_bucket_t* b)
 {
     printf("%016" PRIu64, b->d[0]);
-    for (unsigned int k = 1; k < entry_size; k++) {
+    for (unsigned int k = 1; k < CMAP_ENTRY_SIZE; k++) {
         printf(" %016" PRIu64, b->d[k]);
     }
     printf("\n");
@@ -70,118 +40,73 @@ cmap_get_tolerance()
     return TOLERANCE;
 }
 
-static bool
-complex_close(complex_t *in_table, const complex_t* to_insert)
+int
+cmap_find_or_put(const void *dbs, const void *v, uint64_t *ret)
 {
-    if (TOLERANCE == 0.0) {
-         return ((in_table->r == to_insert->r) && 
-                 (in_table->i == to_insert->i));
-    }
-    else {
-        return ((flt_abs(in_table->r - to_insert->r) < TOLERANCE) && 
-                (flt_abs(in_table->i - to_insert->i) < TOLERANCE));
-    }
-    
+    return cmap_find_or_put_inline(dbs, (const complex_t *) v, ret);
 }
 
-int
-cmap_find_or_put(const void *dbs, const void *_v, uint64_t *ret)
+void
+cmap_find_or_put_batch(const void *dbs, const void *v, int n, uint64_t *ret, int *found)
 {
-    complex_t *v = (complex_t *) _v;
-    cmap_t *cmap = (cmap_t *) dbs;
-    bucket_t *val  = (bucket_t *) v;
-
-    // Round the value to compute the hash with, but store the actual value v
-    bucket_t round_v;
-    if (TOLERANCE == 0.0) {
-        round_v.c.r = v->r;
-        round_v.c.i = v->i;
-    }
-    else {
-        round_v.c.r = flt_round(v->r / TOLERANCE) * TOLERANCE;
-        round_v.c.i = flt_round(v->i / TOLERANCE) * TOLERANCE;
-    }
-
-    // fix 0 possibly having a sign
-    if(round_v.c.r == 0.0) round_v.c.r = 0.0;
-    if(round_v.c.i == 0.0) round_v.c.i = 0.0;
-
-    //printf("(%.3f,%.3f) ",(float)round_v.c.r,(float)round_v.c.i);
-    //print_bucket_bits(&round_v); 
-    
-    uint32_t hash  = SuperFastHash(&round_v, sizeof(complex_t), 0);
-    uint32_t prime = odd_primes[hash & PRIME_MASK];
-
-    assert (val->d[0] != LOCK);
-    assert (val->d[0] != EMPTY);
-
-    // Insert/lookup `v`
-    for (unsigned int c = 0; c < cmap->threshold; c++) {
-        uint64_t            ref = hash & cmap->mask;
-        uint64_t            line_end = (ref & CL_MASK) + CACHE_LINE_SIZE;
-        for (size_t i = 0; i < CACHE_LINE_SIZE; i++) {
-            
-            // 1. Get bucket
-            bucket_t *bucket = &cmap->table[ref];
-
-            // 2. If bucket empty, insert new value here
-            if (bucket->d[0] == EMPTY) {
-                if (cas(&bucket->d[0], EMPTY, LOCK)) {
-                    *ret = ref;
-                    // write backwards (overwrite bucket->d[0] last)
-                    for (int k = entry_size-1; k >= 0; k--) {
-                        atomic_write (&bucket->d[k], val->d[k]);
-                    }
-                    return 0;
-                }
-            }
-
-            // 3. Bucket not empty, wait for lock
-            while (atomic_read(&bucket->d[0]) == LOCK) {}
-
-            // 4. Bucket contains some complex value, check if close to `v`
-            complex_t *in_table = (complex_t *)bucket;
-            if (complex_close(in_table, v)) {
-                *ret = ref;
-                return 1;
-            }
-
-            // If unsuccessful, try next
-            ref += 1;
-            ref = ref == line_end ? line_end - CACHE_LINE_SIZE : ref;
-        }
-        hash += prime << CACHE_LINE;
-    }
-    // amplitude table full, unable to add
-    return -1;
+    cmap_find_or_put_batch_inline(dbs, (const complex_t *) v, n, ret, found);
 }
 
 void *
 cmap_get(const void *dbs, const uint64_t ref)
 {
-    cmap_t *cmap = (cmap_t *) dbs;
-    return &(cmap->table[ref].c);
+    return cmap_get_inline(dbs, ref);
 }
 
 uint64_t
-cmap_count_entries(const void *dbs)
+cmap_count_entries_range(const void *dbs, uint64_t first, uint64_t last)
 {
     cmap_t *cmap = (cmap_t *) dbs;
+    last = min(last, cmap->size);
     uint64_t entries = 0;
-    for (unsigned int c = 0; c < cmap->size; c++) {
-        if (cmap->table[c].d[0] != EMPTY)
+    uint64_t c = first;
+    while (c < last) {
+        if (!lazy_line_ready(cmap->line_states, c >> cmap->line_bits)) {
+            c = ((c >> cmap->line_bits) + 1) << cmap->line_bits;
+            continue;
+        }
+        if (cmap->table[c].d[0] != CMAP_EMPTY)
             entries++;
+        c++;
     }
     return entries;
 }
 
+uint64_t
+cmap_count_entries(const void *dbs)
+{
+    return cmap_count_entries_range(dbs, 0, ((cmap_t *) dbs)->size);
+}
+
+uint64_t
+cmap_count_near_duplicates(const void *dbs)
+{
+    cmap_t *cmap = (cmap_t *) dbs;
+    tmap_dup_counter_t counter;
+    tmap_dup_counter_init(&counter, cmap_count_entries(cmap), cmap->tolerance);
+    for (unsigned int c = 0; c < cmap->size; c++) {
+        if (!lazy_line_ready(cmap->line_states, c >> cmap->line_bits)) {
+            c += (1ULL << cmap->line_bits) - 1;
+            continue;
+        }
+        if (cmap->table[c].d[0] != CMAP_EMPTY)
+            tmap_dup_counter_add(&counter, &cmap->table[c].c);
+    }
+    return tmap_dup_counter_finish(&counter);
+}
+
 void
 print_bitvalues(const void *dbs, const uint64_t ref)
 {
     cmap_t *cmap = (cmap_t *) dbs;
-    bucket_t* b = cmap_get(cmap, ref);
+    cmap_bucket_t* b = cmap_get(cmap, ref);
     printf("%016" PRIu64, b->d[0]);
-    for (unsigned int k = 1; k < entry_size; k++) {
+    for (unsigned int k = 1; k < CMAP_ENTRY_SIZE; k++) {
         printf(" %016" PRIu64, b->d[k]);
     }
 }
@@ -192,12 +117,18 @@ cmap_create(uint64_t size, double tolerance)
     TOLERANCE = tolerance;
     cmap_t  *cmap = calloc (1, sizeof(cmap_t));
     cmap->size = size;
-    cmap->mask = cmap->size - 1;
-    cmap->table = calloc (cmap->size, sizeof(bucket_t));
-    for (unsigned int c = 0; c < cmap->size; c++) {
-        cmap->table[c].d[0] = EMPTY;
+    cmap->tolerance = tolerance;
+    cmap->mask = hash_table_mask(cmap->size);
+    cmap->line_bits = hash_line_bits(cmap->size, CMAP_CACHE_LINE);
+    cmap->table = calloc (cmap->size, sizeof(cmap_bucket_t));
+    // buckets are only marked as empty when their line is first used
+    cmap->line_states = lazy_line_states_create(max(cmap->size >> cmap->line_bits, 1ULL));
+    if (cmap->table == NULL || cmap->line_states == NULL) {
+        fprintf(stderr, "cmap: unable to allocate %" PRIu64 " buckets\n", size);
+        exit(1);
     }
     cmap->threshold = cmap->size / 100;
+    cmap->threshold = max(cmap->threshold, 1ULL);
     cmap->threshold = min(cmap->threshold, 1ULL << 16);
     cmap->seen_0 = 0;
     return (void *) cmap;
@@ -208,5 +139,6 @@ cmap_free(void *dbs)
 {
     cmap_t * cmap = (cmap_t *) dbs;
     free (cmap->table);
+    free (cmap->line_states);
     free (cmap);
 }
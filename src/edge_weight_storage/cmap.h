@@ -51,10 +51,29 @@ und.
 */
 extern int cmap_find_or_put(const void *dbs, const void *v, uint64_t *ret);
 
+/**
+\brief Same as cmap_find_or_put for the `n` values v[0..n-1], with the results
+in ret[k] and found[k]. The buckets of several values are prefetched before they
+are probed, so that their cache misses overlap.
+*/
+extern void cmap_find_or_put_batch(const void *dbs, const void *v, int n, uint64_t *ret, int *found);
+
 extern void * cmap_get(const void *dbs, const uint64_t ref);
 
 extern uint64_t cmap_count_entries(const void *dbs);
 
+/**
+\brief Number of entries in buckets first, ..., last-1 (last is capped at the
+size of the table). Disjoint ranges can be counted in parallel.
+*/
+extern uint64_t cmap_count_entries_range(const void *dbs, uint64_t first, uint64_t last);
+
+/**
+\brief Number of values which are within tolerance of another value in the
+table (with a lower index), i.e. values which a tmap would not have added.
+*/
+extern uint64_t cmap_count_near_duplicates(const void *dbs);
+
 extern void print_bitvalues(const void *dbs, const uint64_t ref);
 
 #endif // CMAP
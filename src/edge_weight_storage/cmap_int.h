@@ -0,0 +1,203 @@
+/**
+\file cmap_int.h
+\brief Internals of the cmap hash table, exposed so that lookups can be inlined
+       by callers that know at compile time that the edge weight storage is a
+       cmap (see SYLVAN_WGT_COMPLEX_INLINE). Other code should use cmap.h.
+*/
+
+#ifndef CMAP_INT_H
+#define CMAP_INT_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "atomics.h"
+#include "cmap.h"
+#include "fast_hash.h"
+#include "lazy_line.h"
+#include "flt.h"
+
+#define CMAP_CACHE_LINE 8
+
+// number of lookups cmap_find_or_put_batch prefetches ahead
+#define CMAP_BATCH_SIZE 8
+
+// how many "blocks" of 64 bits for a single table entry
+#define CMAP_ENTRY_SIZE (2*sizeof(fl_t)/8)
+
+typedef union {
+    complex_t       c;
+    uint64_t        d[CMAP_ENTRY_SIZE];
+} cmap_bucket_t;
+
+static const uint64_t CMAP_EMPTY = 14738995463583502973ull;
+static const uint64_t CMAP_LOCK  = 14738995463583502974ull;
+
+/**
+\typedef Lockless hastable database.
+*/
+typedef struct cmap_s cmap_t;
+struct cmap_s {
+    size_t              size;
+    size_t              mask;
+    unsigned int        line_bits; // log2 of the buckets per probe line
+    size_t              threshold;
+    int                 seen_0;
+    long double         tolerance; // float "equality" tolerance
+    cmap_bucket_t  __attribute__(( __aligned__(32)))       *table;
+    uint8_t            *line_states; // see lazy_line.h
+    // Q: should this 32 change to 16 now that we use doubles instead of
+    // long doubles for the real and imaginary components?
+};
+
+static inline bool
+cmap_complex_close(const cmap_t *cmap, const complex_t *in_table, const complex_t* to_insert)
+{
+    if (cmap->tolerance == 0.0) {
+         return ((in_table->r == to_insert->r) &&
+                 (in_table->i == to_insert->i));
+    }
+    else {
+        return ((flt_abs(in_table->r - to_insert->r) < cmap->tolerance) &&
+                (flt_abs(in_table->i - to_insert->i) < cmap->tolerance));
+    }
+}
+
+/**
+\brief Hash of (the rounded value of) `v`, which determines where the probing
+for `v` starts.
+*/
+static inline uint32_t
+cmap_hash_inline(const cmap_t *cmap, const complex_t *v)
+{
+    // Round the value to compute the hash with, but store the actual value v
+    cmap_bucket_t round_v;
+    if (cmap->tolerance == 0.0) {
+        round_v.c.r = v->r;
+        round_v.c.i = v->i;
+    }
+    else {
+        round_v.c.r = flt_round(v->r / cmap->tolerance) * cmap->tolerance;
+        round_v.c.i = flt_round(v->i / cmap->tolerance) * cmap->tolerance;
+    }
+
+    // fix 0 possibly having a sign
+    if(round_v.c.r == 0.0) round_v.c.r = 0.0;
+    if(round_v.c.i == 0.0) round_v.c.i = 0.0;
+
+    return SuperFastHash_inline(&round_v, sizeof(complex_t), 0);
+}
+
+/**
+\brief Prefetches the first bucket `hash` probes.
+*/
+static inline void
+cmap_prefetch_inline(const cmap_t *cmap, uint32_t hash)
+{
+    uint64_t ref = hash_bucket(hash, cmap->mask, cmap->size);
+    prefetch(&cmap->line_states[ref >> cmap->line_bits]);
+    prefetch(&cmap->table[ref]);
+}
+
+/**
+\brief Finds or inserts `v`, starting at `hash` = cmap_hash_inline(cmap, v).
+*/
+static inline int
+cmap_probe_inline(cmap_t *cmap, const complex_t *v, uint32_t hash, uint64_t *ret)
+{
+    const cmap_bucket_t *val = (const cmap_bucket_t *) v;
+    uint32_t prime = odd_primes[hash & PRIME_MASK];
+
+    assert (val->d[0] != CMAP_LOCK);
+    assert (val->d[0] != CMAP_EMPTY);
+
+    // Insert/lookup `v`
+    for (unsigned int c = 0; c < cmap->threshold; c++) {
+        uint64_t            ref = hash_bucket(hash, cmap->mask, cmap->size);
+        uint64_t            line_size = 1ULL << cmap->line_bits;
+        uint64_t            line_start = ref & -line_size;
+        uint64_t            line_end = line_start + line_size;
+        lazy_line_ensure(cmap->line_states, ref >> cmap->line_bits,
+                         &cmap->table[line_start].d[0], CMAP_ENTRY_SIZE,
+                         line_size, CMAP_EMPTY);
+        for (size_t i = 0; i < line_size; i++) {
+
+            // 1. Get bucket
+            cmap_bucket_t *bucket = &cmap->table[ref];
+
+            // 2. If bucket empty, insert new value here
+            if (bucket->d[0] == CMAP_EMPTY) {
+                if (cas(&bucket->d[0], CMAP_EMPTY, CMAP_LOCK)) {
+                    *ret = ref;
+                    // write backwards (overwrite bucket->d[0] last)
+                    for (int k = CMAP_ENTRY_SIZE-1; k >= 0; k--) {
+                        atomic_write (&bucket->d[k], val->d[k]);
+                    }
+                    return 0;
+                }
+            }
+
+            // 3. Bucket not empty, wait for lock
+            while (atomic_read(&bucket->d[0]) == CMAP_LOCK) {}
+
+            // 4. Bucket contains some complex value, check if close to `v`
+            complex_t *in_table = (complex_t *)bucket;
+            if (cmap_complex_close(cmap, in_table, v)) {
+                *ret = ref;
+                return 1;
+            }
+
+            // If unsuccessful, try next
+            ref += 1;
+            ref = ref == line_end ? line_start : ref;
+        }
+        hash += prime << CMAP_CACHE_LINE;
+    }
+    // amplitude table full, unable to add
+    return -1;
+}
+
+/**
+\brief Inline version of cmap_find_or_put (same semantics).
+*/
+static inline int
+cmap_find_or_put_inline(const void *dbs, const complex_t *v, uint64_t *ret)
+{
+    cmap_t *cmap = (cmap_t *) dbs;
+    return cmap_probe_inline(cmap, v, cmap_hash_inline(cmap, v), ret);
+}
+
+/**
+\brief Inline version of cmap_find_or_put_batch (same semantics).
+*/
+static inline void
+cmap_find_or_put_batch_inline(const void *dbs, const complex_t *v, int n, uint64_t *ret, int *found)
+{
+    cmap_t *cmap = (cmap_t *) dbs;
+    uint32_t hash[CMAP_BATCH_SIZE];
+    for (int start = 0; start < n; start += CMAP_BATCH_SIZE) {
+        int end = (n < start + CMAP_BATCH_SIZE) ? n : start + CMAP_BATCH_SIZE;
+        // first compute all hashes and request all buckets, so that the cache
+        // misses on the table overlap, ...
+        for (int k = start; k < end; k++) {
+            hash[k - start] = cmap_hash_inline(cmap, &v[k]);
+            cmap_prefetch_inline(cmap, hash[k - start]);
+        }
+        // ... then probe
+        for (int k = start; k < end; k++) {
+            found[k] = cmap_probe_inline(cmap, &v[k], hash[k - start], &ret[k]);
+        }
+    }
+}
+
+/**
+\brief Inline version of cmap_get.
+*/
+static inline complex_t *
+cmap_get_inline(const void *dbs, const uint64_t ref)
+{
+    return &(((const cmap_t *) dbs)->table[ref].c);
+}
+
+#endif // CMAP_INT_H
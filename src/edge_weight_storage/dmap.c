@@ -0,0 +1,211 @@
+#include "dmap.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "atomics.h"
+#include "fast_hash.h"
+#include "lazy_line.h"
+#include "tmap.h"
+#include "util.h"
+
+#define DMAP_CACHE_LINE 8
+
+// how many "blocks" of 64 bits for a single table entry
+#define DMAP_ENTRY_SIZE (sizeof(fl_t)/8)
+
+typedef union {
+    fl_t            r;
+    uint64_t        d[DMAP_ENTRY_SIZE];
+} dmap_bucket_t;
+
+static const uint64_t DMAP_EMPTY = 14738995463583502973ull;
+static const uint64_t DMAP_LOCK  = 14738995463583502974ull;
+
+// float "equality" tolerance
+static long double TOLERANCE = 1e-14l;
+
+typedef struct dmap_s dmap_t;
+struct dmap_s {
+    size_t              size;
+    size_t              mask;
+    unsigned int        line_bits; // log2 of the buckets per probe line
+    size_t              threshold;
+    long double         tolerance; // float "equality" tolerance
+    dmap_bucket_t      *table;
+    uint8_t            *line_states; // see lazy_line.h
+};
+
+static inline bool
+dmap_real_close(const dmap_t *dmap, fl_t in_table, fl_t to_insert)
+{
+    if (dmap->tolerance == 0.0) {
+        return (in_table == to_insert);
+    }
+    else {
+        return (flt_abs(in_table - to_insert) < dmap->tolerance);
+    }
+}
+
+double
+dmap_get_tolerance()
+{
+    return TOLERANCE;
+}
+
+int
+dmap_find_or_put(const void *dbs, const void *v, uint64_t *ret)
+{
+    dmap_t *dmap = (dmap_t *) dbs;
+    const dmap_bucket_t *val = (const dmap_bucket_t *) v;
+
+    // Round the value to compute the hash with, but store the actual value v
+    dmap_bucket_t round_v;
+    if (dmap->tolerance == 0.0) {
+        round_v.r = val->r;
+    }
+    else {
+        round_v.r = flt_round(val->r / dmap->tolerance) * dmap->tolerance;
+    }
+
+    // fix 0 possibly having a sign
+    if (round_v.r == 0.0) round_v.r = 0.0;
+
+    uint32_t hash  = SuperFastHash_inline(&round_v, sizeof(fl_t), 0);
+    uint32_t prime = odd_primes[hash & PRIME_MASK];
+
+    assert (val->d[0] != DMAP_LOCK);
+    assert (val->d[0] != DMAP_EMPTY);
+
+    // Insert/lookup `v`
+    for (unsigned int c = 0; c < dmap->threshold; c++) {
+        uint64_t            ref = hash_bucket(hash, dmap->mask, dmap->size);
+        uint64_t            line_size = 1ULL << dmap->line_bits;
+        uint64_t            line_start = ref & -line_size;
+        uint64_t            line_end = line_start + line_size;
+        lazy_line_ensure(dmap->line_states, ref >> dmap->line_bits,
+                         &dmap->table[line_start].d[0], DMAP_ENTRY_SIZE,
+                         line_size, DMAP_EMPTY);
+        for (size_t i = 0; i < line_size; i++) {
+
+            // 1. Get bucket
+            dmap_bucket_t *bucket = &dmap->table[ref];
+
+            // 2. If bucket empty, insert new value here
+            if (bucket->d[0] == DMAP_EMPTY) {
+                if (cas(&bucket->d[0], DMAP_EMPTY, DMAP_LOCK)) {
+                    *ret = ref;
+                    // write backwards (overwrite bucket->d[0] last)
+                    for (int k = DMAP_ENTRY_SIZE-1; k >= 0; k--) {
+                        atomic_write (&bucket->d[k], val->d[k]);
+                    }
+                    return 0;
+                }
+            }
+
+            // 3. Bucket not empty, wait for lock
+            while (atomic_read(&bucket->d[0]) == DMAP_LOCK) {}
+
+            // 4. Bucket contains some value, check if close to `v`
+            if (dmap_real_close(dmap, bucket->r, val->r)) {
+                *ret = ref;
+                return 1;
+            }
+
+            // If unsuccessful, try next
+            ref += 1;
+            ref = ref == line_end ? line_start : ref;
+        }
+        hash += prime << DMAP_CACHE_LINE;
+    }
+    // table full, unable to add
+    return -1;
+}
+
+void *
+dmap_get(const void *dbs, const uint64_t ref)
+{
+    return &(((const dmap_t *) dbs)->table[ref].r);
+}
+
+uint64_t
+dmap_count_entries_range(const void *dbs, uint64_t first, uint64_t last)
+{
+    dmap_t *dmap = (dmap_t *) dbs;
+    last = min(last, dmap->size);
+    uint64_t entries = 0;
+    uint64_t c = first;
+    while (c < last) {
+        if (!lazy_line_ready(dmap->line_states, c >> dmap->line_bits)) {
+            c = ((c >> dmap->line_bits) + 1) << dmap->line_bits;
+            continue;
+        }
+        if (dmap->table[c].d[0] != DMAP_EMPTY)
+            entries++;
+        c++;
+    }
+    return entries;
+}
+
+uint64_t
+dmap_count_entries(const void *dbs)
+{
+    return dmap_count_entries_range(dbs, 0, ((dmap_t *) dbs)->size);
+}
+
+uint64_t
+dmap_count_near_duplicates(const void *dbs)
+{
+    dmap_t *dmap = (dmap_t *) dbs;
+    tmap_dup_counter_t counter;
+    tmap_dup_counter_init(&counter, dmap_count_entries(dmap), dmap->tolerance);
+    for (unsigned int c = 0; c < dmap->size; c++) {
+        if (!lazy_line_ready(dmap->line_states, c >> dmap->line_bits)) {
+            c += (1ULL << dmap->line_bits) - 1;
+            continue;
+        }
+        if (dmap->table[c].d[0] != DMAP_EMPTY) {
+            complex_t v = cmake(dmap->table[c].r, 0.0);
+            tmap_dup_counter_add(&counter, &v);
+        }
+    }
+    return tmap_dup_counter_finish(&counter);
+}
+
+void *
+dmap_create(uint64_t size, double tolerance)
+{
+    TOLERANCE = tolerance;
+    dmap_t  *dmap = calloc (1, sizeof(dmap_t));
+    dmap->size = size;
+    dmap->tolerance = tolerance;
+    dmap->mask = hash_table_mask(dmap->size);
+    dmap->line_bits = hash_line_bits(dmap->size, DMAP_CACHE_LINE);
+    dmap->table = calloc (dmap->size, sizeof(dmap_bucket_t));
+    if (dmap->table == NULL) {
+        fprintf(stderr, "dmap: unable to allocate %" PRIu64 " buckets\n", size);
+        exit(1);
+    }
+    // buckets are only marked as empty when their line is first used
+    dmap->line_states = lazy_line_states_create(max(dmap->size >> dmap->line_bits, 1ULL));
+    if (dmap->line_states == NULL) {
+        fprintf(stderr, "dmap: unable to allocate %" PRIu64 " buckets\n", size);
+        exit(1);
+    }
+    dmap->threshold = dmap->size / 100;
+    dmap->threshold = max(dmap->threshold, 1ULL);
+    dmap->threshold = min(dmap->threshold, 1ULL << 16);
+    return (void *) dmap;
+}
+
+void
+dmap_free(void *dbs)
+{
+    dmap_t * dmap = (dmap_t *) dbs;
+    free (dmap->table);
+    free (dmap->line_states);
+    free (dmap);
+}
@@ -0,0 +1,59 @@
+#ifndef DMAP_H
+#define DMAP_H
+
+/**
+\file dmap.h
+\brief Lockless non-resizing hash table for real values.
+
+Same design as the cmap (see cmap.h), but the buckets hold a single fl_t
+instead of a complex_t. This halves the memory of the table, and twice as many
+buckets fit in a cache line, which makes probing cheaper. Used to store the
+edge weights when the edge weight type is WGT_DOUBLE.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "flt.h"
+
+
+/**
+\brief Create a new table.
+\param size The number of buckets (power of 2)
+\param tolerance Values which are this close are considered equal
+\return the hashtable
+*/
+extern void *dmap_create(uint64_t size, double tolerance);
+
+extern double dmap_get_tolerance();
+
+/**
+\brief Free the memory used by the table.
+*/
+extern void dmap_free(void *dbs);
+
+/**
+\brief Find a value in the table and insert it if it cannot be found.
+\param dbs The table
+\param v Pointer to the fl_t value
+\retval ret The index the value was found or inserted at
+\return 1 if the value was present, 0 if it was added, -1 if table was full
+*/
+extern int dmap_find_or_put(const void *dbs, const void *v, uint64_t *ret);
+
+extern void * dmap_get(const void *dbs, const uint64_t ref);
+
+extern uint64_t dmap_count_entries(const void *dbs);
+
+/**
+\brief Number of entries in buckets first, ..., last-1 (last is capped at the
+size of the table). Disjoint ranges can be counted in parallel.
+*/
+extern uint64_t dmap_count_entries_range(const void *dbs, uint64_t first, uint64_t last);
+
+/**
+\brief Number of values which are within tolerance of another value in the
+table (with a lower index), i.e. values which a tmap would not have added.
+*/
+extern uint64_t dmap_count_near_duplicates(const void *dbs);
+
+#endif // DMAP_H
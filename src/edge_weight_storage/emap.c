@@ -0,0 +1,168 @@
+#include "emap.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "atomics.h"
+#include "fast_hash.h"
+#include "util.h"
+
+#define EMAP_CACHE_LINE 8
+
+// how many "blocks" of 64 bits for a single table entry
+#define EMAP_ENTRY_SIZE (sizeof(qomega_t)/8)
+
+typedef union {
+    qomega_t        q;
+    uint64_t        d[EMAP_ENTRY_SIZE];
+} emap_bucket_t;
+
+// d[0] holds the denominator, which is > 0 for any value in canonical form
+static const uint64_t EMAP_EMPTY = 0;
+static const uint64_t EMAP_LOCK  = UINT64_MAX;
+
+// only reported, for checks on the values after conversion to floating point
+static double TOLERANCE = 1e-14;
+
+typedef struct emap_s emap_t;
+struct emap_s {
+    size_t              size;
+    size_t              mask;
+    unsigned int        line_bits; // log2 of the buckets per probe line
+    size_t              threshold;
+    emap_bucket_t      *table;
+};
+
+static inline bool
+emap_equal(const emap_bucket_t *in_table, const emap_bucket_t *to_insert)
+{
+    for (size_t k = 0; k < EMAP_ENTRY_SIZE; k++) {
+        if (in_table->d[k] != to_insert->d[k]) return false;
+    }
+    return true;
+}
+
+double
+emap_get_tolerance()
+{
+    return TOLERANCE;
+}
+
+int
+emap_find_or_put(const void *dbs, const void *v, uint64_t *ret)
+{
+    emap_t *emap = (emap_t *) dbs;
+    const emap_bucket_t *val = (const emap_bucket_t *) v;
+
+    uint32_t hash  = SuperFastHash_inline(val, sizeof(qomega_t), 0);
+    uint32_t prime = odd_primes[hash & PRIME_MASK];
+
+    assert (val->d[0] != EMAP_LOCK);
+    assert (val->d[0] != EMAP_EMPTY);
+
+    // Insert/lookup `v`
+    for (unsigned int c = 0; c < emap->threshold; c++) {
+        uint64_t            ref = hash_bucket(hash, emap->mask, emap->size);
+        uint64_t            line_size = 1ULL << emap->line_bits;
+        uint64_t            line_start = ref & -line_size;
+        uint64_t            line_end = line_start + line_size;
+        for (size_t i = 0; i < line_size; i++) {
+
+            // 1. Get bucket
+            emap_bucket_t *bucket = &emap->table[ref];
+
+            // 2. If bucket empty, insert new value here
+            if (bucket->d[0] == EMAP_EMPTY) {
+                if (cas(&bucket->d[0], EMAP_EMPTY, EMAP_LOCK)) {
+                    *ret = ref;
+                    // write backwards (overwrite bucket->d[0] last)
+                    for (int k = EMAP_ENTRY_SIZE-1; k >= 0; k--) {
+                        atomic_write (&bucket->d[k], val->d[k]);
+                    }
+                    return 0;
+                }
+            }
+
+            // 3. Bucket not empty, wait for lock
+            while (atomic_read(&bucket->d[0]) == EMAP_LOCK) {}
+
+            // 4. Bucket contains some value, check if equal to `v`
+            if (emap_equal(bucket, val)) {
+                *ret = ref;
+                return 1;
+            }
+
+            // If unsuccessful, try next
+            ref += 1;
+            ref = ref == line_end ? line_start : ref;
+        }
+        hash += prime << EMAP_CACHE_LINE;
+    }
+    // table full, unable to add
+    return -1;
+}
+
+void *
+emap_get(const void *dbs, const uint64_t ref)
+{
+    return &(((const emap_t *) dbs)->table[ref].q);
+}
+
+uint64_t
+emap_count_entries_range(const void *dbs, uint64_t first, uint64_t last)
+{
+    emap_t *emap = (emap_t *) dbs;
+    last = min(last, emap->size);
+    uint64_t entries = 0;
+    uint64_t c = first;
+    while (c < last) {
+        if (emap->table[c].d[0] != EMAP_EMPTY)
+            entries++;
+        c++;
+    }
+    return entries;
+}
+
+uint64_t
+emap_count_entries(const void *dbs)
+{
+    return emap_count_entries_range(dbs, 0, ((emap_t *) dbs)->size);
+}
+
+uint64_t
+emap_count_near_duplicates(const void *dbs)
+{
+    (void) dbs;
+    return 0;
+}
+
+void *
+emap_create(uint64_t size, double tolerance)
+{
+    TOLERANCE = tolerance;
+    emap_t  *emap = calloc (1, sizeof(emap_t));
+    emap->size = size;
+    emap->mask = hash_table_mask(emap->size);
+    emap->line_bits = hash_line_bits(emap->size, EMAP_CACHE_LINE);
+    // calloc also marks all buckets as empty (EMAP_EMPTY = 0)
+    emap->table = calloc (emap->size, sizeof(emap_bucket_t));
+    if (emap->table == NULL) {
+        fprintf(stderr, "emap: unable to allocate %" PRIu64 " buckets\n", size);
+        exit(1);
+    }
+    emap->threshold = emap->size / 100;
+    emap->threshold = max(emap->threshold, 1ULL);
+    emap->threshold = min(emap->threshold, 1ULL << 16);
+    return (void *) emap;
+}
+
+void
+emap_free(void *dbs)
+{
+    emap_t * emap = (emap_t *) dbs;
+    free (emap->table);
+    free (emap);
+}
@@ -0,0 +1,59 @@
+#ifndef EMAP_H
+#define EMAP_H
+
+/**
+\file emap.h
+\brief Lockless non-resizing hash table for exact (qomega_t) values.
+
+Same design as the cmap (see cmap.h), but the buckets hold a qomega_t. Since
+these values are exact and stored in canonical form, two values are equal iff
+their bits are equal, so there is no tolerance (and no rounding before hashing).
+Used to store the edge weights when the edge weight type is WGT_RATIONAL_128.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "flt.h"
+
+
+/**
+\brief Create a new table.
+\param size The number of buckets (power of 2)
+\param tolerance Only reported by emap_get_tolerance() (for checks on the values
+after conversion to floating point), the values themselves are compared exactly
+\return the hashtable
+*/
+extern void *emap_create(uint64_t size, double tolerance);
+
+extern double emap_get_tolerance();
+
+/**
+\brief Free the memory used by the table.
+*/
+extern void emap_free(void *dbs);
+
+/**
+\brief Find a value in the table and insert it if it cannot be found.
+\param dbs The table
+\param v Pointer to the qomega_t value (in canonical form)
+\retval ret The index the value was found or inserted at
+\return 1 if the value was present, 0 if it was added, -1 if table was full
+*/
+extern int emap_find_or_put(const void *dbs, const void *v, uint64_t *ret);
+
+extern void * emap_get(const void *dbs, const uint64_t ref);
+
+extern uint64_t emap_count_entries(const void *dbs);
+
+/**
+\brief Number of entries in buckets first, ..., last-1 (last is capped at the
+size of the table). Disjoint ranges can be counted in parallel.
+*/
+extern uint64_t emap_count_entries_range(const void *dbs, uint64_t first, uint64_t last);
+
+/**
+\brief Always 0, since values are compared exactly.
+*/
+extern uint64_t emap_count_near_duplicates(const void *dbs);
+
+#endif // EMAP_H
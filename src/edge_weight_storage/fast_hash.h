@@ -1,6 +1,7 @@
 #ifndef FAST_HASH_H
 #define FAST_HASH_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "MurmurHash3.h"
@@ -13,6 +14,102 @@ typedef hash64_t (*hash64_f)(const char *key, int len, unsigned int seed);
 
 extern uint32_t SuperFastHash (const void *data, int len, uint32_t hash);
 
+#undef get16bits
+#if (defined(__GNUC__) && defined(__i386__)) || defined(__WATCOMC__) \
+  || defined(_MSC_VER) || defined (__BORLANDC__) || defined (__TURBOC__)
+#define get16bits(d) (*((const uint16_t *) (d)))
+#endif
+
+#if !defined (get16bits)
+#define get16bits(d) ((((uint32_t)(((const uint8_t *)(d))[1])) << 8)\
+                       +(uint32_t)(((const uint8_t *)(d))[0]) )
+#endif
+
+/* Inline version of SuperFastHash, for callers hashing fixed-length keys */
+static inline uint32_t
+SuperFastHash_inline (const void *data_, int len, uint32_t hash)
+{
+    const unsigned char *data = data_;
+    uint32_t tmp;
+    int rem;
+
+    if (len <= 0 || data == NULL) return 0;
+
+    rem = len & 3;
+    len >>= 2;
+
+    /* Main loop */
+    for (;len > 0; len--) {
+        hash  += get16bits (data);
+        tmp    = (get16bits (data+2) << 11) ^ hash;
+        hash   = (hash << 16) ^ tmp;
+        data  += 2*sizeof (uint16_t);
+        hash  += hash >> 11;
+    }
+
+    /* Handle end cases */
+    switch (rem) {
+        case 3: hash += get16bits (data);
+                hash ^= hash << 16;
+                hash ^= data[sizeof (uint16_t)] << 18;
+                hash += hash >> 11;
+                break;
+        case 2: hash += get16bits (data);
+                hash ^= hash << 11;
+                hash += hash >> 17;
+                break;
+        case 1: hash += *data;
+                hash ^= hash << 10;
+                hash += hash >> 1;
+    }
+
+    /* Force "avalanching" of final 127 bits */
+    hash ^= hash << 3;
+    hash += hash >> 5;
+    hash ^= hash << 4;
+    hash += hash >> 17;
+    hash ^= hash << 25;
+    hash += hash >> 6;
+
+    return hash;
+}
+
+/**
+ * Mask of a hash table of `size` buckets: the smallest power of 2 of at least
+ * `size`, minus 1. See hash_bucket().
+ */
+static inline uint64_t
+hash_table_mask (uint64_t size)
+{
+    uint64_t pow2 = 1;
+    while (pow2 < size) pow2 <<= 1;
+    return pow2 - 1;
+}
+
+/**
+ * Bucket at which probing for `hash` starts in a table of `size` buckets with
+ * `mask` = hash_table_mask(size). If `size` is not a power of 2, the hashes
+ * beyond it fold back onto the lower half of the table.
+ */
+static inline uint64_t
+hash_bucket (uint32_t hash, uint64_t mask, uint64_t size)
+{
+    uint64_t ref = hash & mask;
+    return (ref < size) ? ref : (ref & (mask >> 1));
+}
+
+/**
+ * log2 of the number of buckets per probe line in a table of `size` buckets:
+ * `line_bits`, unless the table is too small (or not a multiple of such a
+ * line), in which case the lines shrink until they tile the table exactly.
+ */
+static inline unsigned int
+hash_line_bits (uint64_t size, unsigned int line_bits)
+{
+    while (line_bits > 0 && (size & ((1ULL << line_bits) - 1)) != 0) line_bits--;
+    return line_bits;
+}
+
 extern uint64_t MurmurHash64 (const void * key, int len, unsigned int seed);
 
 extern uint32_t oat_hash(const void *data, int len, uint32_t seed);
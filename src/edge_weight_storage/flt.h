@@ -20,6 +20,7 @@
 #if flt_quad
     #define flt_abs(a) fabsq(a)
     #define flt_round(a) lroundq(a)
+    #define flt_floor(a) floorq(a)
     #define flt_cos(a) cosq(a)
     #define flt_acos(a) acosq(a)
     #define flt_sin(a) sinq(a)
@@ -31,6 +32,7 @@
 #else
     #define flt_abs(a) fabs(a)
     #define flt_round(a) round(a)
+    #define flt_floor(a) floor(a)
     #define flt_cos(a) cos(a)
     #define flt_acos(a) acos(a)
     #define flt_sin(a) sin(a)
@@ -105,4 +107,19 @@ static inline complex_t cdiv(complex_t a, complex_t b)
 /****************************< /complex_t >************************************/
 
 
+/*****************************< qomega_t >*************************************/
+/**
+ * Exact element (c[0] + c[1] w + c[2] w^2 + c[3] w^3) / den of the field Q(w),
+ * with w = e^(i pi/4) the 8th root of unity. Contains all amplitudes of
+ * Clifford+T circuits. Canonical form: den > 0 and gcd(den, c[0..3]) = 1, so
+ * two values are equal iff their bits are equal (0 is {1, {0,0,0,0}}).
+ */
+typedef struct qomega_s {
+    int64_t den;
+    int64_t c[4];
+} qomega_t;
+
+/****************************< /qomega_t >*************************************/
+
+
 #endif // FLT
@@ -0,0 +1,72 @@
+#ifndef LAZY_LINE_H
+#define LAZY_LINE_H
+
+/**
+\file lazy_line.h
+\brief Lazy initialisation of the probe lines of a hash table.
+
+The cmap, dmap and tmap mark empty buckets with a NaN bit pattern, since all
+other bit patterns (including all-zero, i.e. +0.0) are valid values. Writing
+this pattern into every bucket when the table is created touches the whole
+table, which for large tables takes seconds, and happens again for every new
+table during edge weight gc. Instead, every line of buckets (the unit of linear
+probing) has a state byte, and the buckets of a line are only marked as empty
+the first time the line is probed. The table and the states are allocated with
+calloc, so untouched lines cost no time (and no memory) at all.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "atomics.h"
+#include "util.h"
+
+#define LAZY_LINE_UNINIT 0
+#define LAZY_LINE_BUSY   1
+#define LAZY_LINE_READY  2
+
+/**
+\brief Allocate (zeroed) states for a table with `n_lines` lines.
+*/
+static inline uint8_t *
+lazy_line_states_create(uint64_t n_lines)
+{
+    return calloc(n_lines, sizeof(uint8_t));
+}
+
+/**
+\brief Make sure line `line` is initialised: if not, the first word of each of
+its `n` buckets (starting at `words`, `stride` words apart) is set to `empty`.
+Threads probing a line which is being initialised wait until it is ready.
+*/
+static inline void
+lazy_line_ensure(uint8_t *states, uint64_t line, uint64_t *words, size_t stride,
+                 size_t n, uint64_t empty)
+{
+    uint8_t s = atomic_read(&states[line]);
+    if (expect_true(s == LAZY_LINE_READY)) return;
+
+    if (s == LAZY_LINE_UNINIT && cas(&states[line], LAZY_LINE_UNINIT, LAZY_LINE_BUSY)) {
+        for (size_t k = 0; k < n; k++) {
+            words[k * stride] = empty;
+        }
+        compile_barrier();
+        atomic_write(&states[line], LAZY_LINE_READY);
+        return;
+    }
+
+    while (atomic_read(&states[line]) != LAZY_LINE_READY) cpu_relax();
+}
+
+/**
+\brief Whether line `line` has been initialised (lines which are not contain no
+values).
+*/
+static inline bool
+lazy_line_ready(const uint8_t *states, uint64_t line)
+{
+    return atomic_read(&states[line]) == LAZY_LINE_READY;
+}
+
+#endif // LAZY_LINE_H
@@ -0,0 +1,390 @@
+#include "rmap.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "atomics.h"
+#include "fast_hash.h"
+#include "tmap.h"
+#include "util.h"
+
+// probe 2^RMAP_LINE consecutive buckets (one cache line) before rehashing
+#define RMAP_LINE 3
+#define RMAP_LINE_SIZE (1ULL << RMAP_LINE)
+static const uint64_t RMAP_LINE_MASK = -(1ULL << RMAP_LINE);
+
+// number of buckets of the hash table we start with
+#define RMAP_INITIAL_INDEX_SIZE (1ULL << 12)
+// number of buckets migrated per call to rmap_find_or_put during a resize
+#define RMAP_MIGRATE_CHUNK 16
+
+// A bucket contains 0 (empty), RMAP_LOCK, or (index of the value + 1). Buckets
+// which have been migrated to the next index get the RMAP_MOVED bit set, an
+// empty bucket which has been migrated is equal to RMAP_MOVED.
+static const uint64_t RMAP_EMPTY = 0;
+static const uint64_t RMAP_LOCK  = 1ULL << 62;
+static const uint64_t RMAP_MOVED = 1ULL << 63;
+
+// return values of rmap_index_find_or_put besides 1, 0, -1
+static const int RMAP_REDIRECT = 2;
+
+// float "equality" tolerance
+static long double TOLERANCE = 1e-14l;
+
+typedef struct rmap_index_s rmap_index_t;
+struct rmap_index_s {
+    uint64_t            size;
+    uint64_t            mask;
+    uint64_t            threshold;
+    uint64_t           *buckets;
+    rmap_index_t       *next;     // larger index this one is migrated to
+    rmap_index_t       *retired;  // the (fully migrated) index before this one
+    uint64_t            migrate_claimed; // buckets claimed for migration
+    uint64_t            migrate_done;    // buckets migrated
+};
+
+typedef struct rmap_s rmap_t;
+struct rmap_s {
+    uint64_t            size;       // capacity of values
+    uint64_t            entries;    // next free position in values
+    uint64_t            max_index_size;
+    long double         tolerance;
+    complex_t          *values;
+    rmap_index_t       *index;      // index used for new lookups
+};
+
+static rmap_index_t *
+rmap_index_create(uint64_t size)
+{
+    rmap_index_t *index = calloc(1, sizeof(rmap_index_t));
+    index->size = size;
+    index->mask = size - 1;
+    index->threshold = max(size >> RMAP_LINE, 1ULL);
+    index->threshold = min(index->threshold, 1ULL << 16);
+    index->buckets = calloc(size, sizeof(uint64_t)); // all RMAP_EMPTY
+    if (index->buckets == NULL) {
+        fprintf(stderr, "rmap: unable to allocate index of %" PRIu64 " buckets\n", size);
+        exit(1);
+    }
+    return index;
+}
+
+static uint32_t
+rmap_hash(const rmap_t *rmap, const complex_t *v)
+{
+    // Round the value to compute the hash with (same as the cmap)
+    complex_t round_v;
+    if (rmap->tolerance == 0.0) {
+        round_v = *v;
+    }
+    else {
+        round_v.r = flt_round(v->r / rmap->tolerance) * rmap->tolerance;
+        round_v.i = flt_round(v->i / rmap->tolerance) * rmap->tolerance;
+    }
+
+    // fix 0 possibly having a sign
+    if(round_v.r == 0.0) round_v.r = 0.0;
+    if(round_v.i == 0.0) round_v.i = 0.0;
+
+    return SuperFastHash_inline(&round_v, sizeof(complex_t), 0);
+}
+
+static bool
+rmap_complex_close(const rmap_t *rmap, const complex_t *in_table, const complex_t *to_insert)
+{
+    if (rmap->tolerance == 0.0) {
+         return ((in_table->r == to_insert->r) &&
+                 (in_table->i == to_insert->i));
+    }
+    else {
+        return ((flt_abs(in_table->r - to_insert->r) < rmap->tolerance) &&
+                (flt_abs(in_table->i - to_insert->i) < rmap->tolerance));
+    }
+}
+
+/**
+ * Find or put `v` in the given index. Returns RMAP_REDIRECT if the search
+ * reached a bucket that has been frozen by a migration, in which case `v` is
+ * not in this index and the search should continue in index->next.
+ */
+static int
+rmap_index_find_or_put(rmap_t *rmap, rmap_index_t *index, uint32_t hash,
+                       const complex_t *v, uint64_t *ret)
+{
+    uint32_t prime = odd_primes[hash & PRIME_MASK];
+
+    for (unsigned int c = 0; c < index->threshold; c++) {
+        uint64_t ref = hash & index->mask;
+        uint64_t line_end = (ref & RMAP_LINE_MASK) + RMAP_LINE_SIZE;
+        for (size_t i = 0; i < RMAP_LINE_SIZE; i++) {
+            uint64_t *bucket = &index->buckets[ref];
+            uint64_t b = atomic_read(bucket);
+
+            // 1. If bucket empty, claim it and append `v` to the values
+            if (b == RMAP_EMPTY) {
+                if (cas(bucket, RMAP_EMPTY, RMAP_LOCK)) {
+                    uint64_t idx = fetch_add(&rmap->entries, 1);
+                    if (idx >= rmap->size) {
+                        // values full, release bucket again
+                        atomic_write(bucket, RMAP_EMPTY);
+                        return -1;
+                    }
+                    rmap->values[idx] = *v;
+                    compile_barrier();
+                    atomic_write(bucket, idx + 1);
+                    *ret = idx;
+                    return 0;
+                }
+                b = atomic_read(bucket);
+            }
+
+            // 2. Bucket not empty, wait for lock
+            while (b == RMAP_LOCK) b = atomic_read(bucket);
+
+            // 3. Frozen empty bucket: `v` is not in this index
+            if (b == RMAP_MOVED) return RMAP_REDIRECT;
+
+            // 4. Bucket refers to some value, check if close to `v`
+            uint64_t idx = (b & ~RMAP_MOVED) - 1;
+            if (rmap_complex_close(rmap, &rmap->values[idx], v)) {
+                *ret = idx;
+                return 1;
+            }
+
+            // If unsuccessful, try next
+            ref += 1;
+            ref = ref == line_end ? line_end - RMAP_LINE_SIZE : ref;
+        }
+        hash += prime << RMAP_LINE;
+    }
+    // index full, unable to add
+    return -1;
+}
+
+/**
+ * Put (migrated) value index `idx` in `index`. The value is known to not be in
+ * `index` yet, so this only needs to find an empty bucket.
+ */
+static void
+rmap_index_put_migrated(rmap_t *rmap, rmap_index_t *index, uint64_t idx)
+{
+    uint32_t hash  = rmap_hash(rmap, &rmap->values[idx]);
+    uint32_t prime = odd_primes[hash & PRIME_MASK];
+
+    for (unsigned int c = 0; c < index->threshold; c++) {
+        uint64_t ref = hash & index->mask;
+        uint64_t line_end = (ref & RMAP_LINE_MASK) + RMAP_LINE_SIZE;
+        for (size_t i = 0; i < RMAP_LINE_SIZE; i++) {
+            uint64_t *bucket = &index->buckets[ref];
+            if (atomic_read(bucket) == RMAP_EMPTY && cas(bucket, RMAP_EMPTY, idx + 1)) {
+                return;
+            }
+            ref += 1;
+            ref = ref == line_end ? line_end - RMAP_LINE_SIZE : ref;
+        }
+        hash += prime << RMAP_LINE;
+    }
+    // cannot happen, the new index is twice as large as the old one
+    fprintf(stderr, "rmap: unable to migrate value %" PRIu64 "\n", idx);
+    exit(1);
+}
+
+/**
+ * Migrate one chunk of buckets from `index` to `index->next`. The thread that
+ * completes the migration makes `index->next` the index for new lookups.
+ */
+static void
+rmap_migrate_chunk(rmap_t *rmap, rmap_index_t *index)
+{
+    uint64_t start = fetch_add(&index->migrate_claimed, RMAP_MIGRATE_CHUNK);
+    if (start >= index->size) return;
+    uint64_t end = min(start + RMAP_MIGRATE_CHUNK, index->size);
+
+    for (uint64_t ref = start; ref < end; ref++) {
+        uint64_t *bucket = &index->buckets[ref];
+        while (1) {
+            uint64_t b = atomic_read(bucket);
+            if (b == RMAP_EMPTY) {
+                if (cas(bucket, RMAP_EMPTY, RMAP_MOVED)) break;
+            }
+            else if (b != RMAP_LOCK) {
+                // only the migrating thread modifies filled buckets
+                atomic_write(bucket, b | RMAP_MOVED);
+                rmap_index_put_migrated(rmap, index->next, b - 1);
+                break;
+            }
+        }
+    }
+
+    if (add_fetch(&index->migrate_done, end - start) == index->size) {
+        // Threads might still be reading the old index, so it is only freed
+        // together with the rmap.
+        index->next->retired = index;
+        atomic_write(&rmap->index, index->next);
+    }
+}
+
+/**
+ * Start migrating `index` to one twice its size, if it is at least half full
+ * (or `force` is set), unless that is already happening or the index is as
+ * large as it gets. Returns false iff the index cannot grow any further.
+ */
+static bool
+rmap_grow(rmap_t *rmap, rmap_index_t *index, bool force)
+{
+    if (index->next != NULL) return true;
+    if (index->size >= rmap->max_index_size) return false;
+    if (!force && 2 * atomic_read(&rmap->entries) <= index->size) return true;
+
+    rmap_index_t *next = rmap_index_create(2 * index->size);
+    if (!cas(&index->next, NULL, next)) {
+        free(next->buckets);
+        free(next);
+    }
+    return true;
+}
+
+/**
+ * Help migrating `index` until it is done. Only a thread that got preempted
+ * while migrating a chunk can make this wait.
+ */
+static void
+rmap_finish_migration(rmap_t *rmap, rmap_index_t *index)
+{
+    while (atomic_read(&rmap->index) == index) {
+        rmap_migrate_chunk(rmap, index);
+        cpu_relax();
+    }
+}
+
+double
+rmap_get_tolerance()
+{
+    return TOLERANCE;
+}
+
+int
+rmap_find_or_put(const void *dbs, const void *v, uint64_t *ret)
+{
+    rmap_t *rmap = (rmap_t *) dbs;
+    uint32_t hash = rmap_hash(rmap, (const complex_t *) v);
+
+    while (1) {
+        rmap_index_t *index = atomic_read(&rmap->index);
+
+        // help with an ongoing resize, but don't let the new index fill up
+        // before the migration to it is done
+        if (index->next != NULL) {
+            rmap_migrate_chunk(rmap, index);
+            if (4 * atomic_read(&rmap->entries) >= 3 * index->next->size) {
+                rmap_finish_migration(rmap, index);
+                continue;
+            }
+        }
+
+        rmap_index_t *search = index;
+        int res;
+        while ((res = rmap_index_find_or_put(rmap, search, hash, v, ret)) == RMAP_REDIRECT) {
+            search = search->next;
+        }
+
+        if (res == 0 && search == index) rmap_grow(rmap, index, false);
+        if (res >= 0) return res;
+
+        // No room in the values, or in an index which cannot grow any further
+        if (atomic_read(&rmap->entries) >= rmap->size) return -1;
+        if (!rmap_grow(rmap, index, true)) return -1;
+
+        // The index we searched is full, grow it before trying again
+        rmap_finish_migration(rmap, index);
+    }
+}
+
+int
+rmap_find_or_put_real(const void *dbs, const void *v, uint64_t *ret)
+{
+    complex_t c = cmake(*(const fl_t *) v, 0.0);
+    return rmap_find_or_put(dbs, &c, ret);
+}
+
+void *
+rmap_get(const void *dbs, const uint64_t ref)
+{
+    return &((const rmap_t *) dbs)->values[ref];
+}
+
+uint64_t
+rmap_count_entries(const void *dbs)
+{
+    rmap_t *rmap = (rmap_t *) dbs;
+    return min(rmap->entries, rmap->size);
+}
+
+uint64_t
+rmap_count_entries_range(const void *dbs, uint64_t first, uint64_t last)
+{
+    // the values are stored at indices 0, ..., entries-1
+    uint64_t entries = rmap_count_entries(dbs);
+    last = min(last, entries);
+    return (last > first) ? last - first : 0;
+}
+
+uint64_t
+rmap_count_near_duplicates(const void *dbs)
+{
+    rmap_t *rmap = (rmap_t *) dbs;
+    uint64_t entries = rmap_count_entries(rmap);
+    tmap_dup_counter_t counter;
+    tmap_dup_counter_init(&counter, entries, rmap->tolerance);
+    for (uint64_t idx = 0; idx < entries; idx++) {
+        tmap_dup_counter_add(&counter, &rmap->values[idx]);
+    }
+    return tmap_dup_counter_finish(&counter);
+}
+
+uint64_t
+rmap_get_index_size(const void *dbs)
+{
+    rmap_t *rmap = (rmap_t *) dbs;
+    return atomic_read(&rmap->index)->size;
+}
+
+void *
+rmap_create(uint64_t size, double tolerance)
+{
+    TOLERANCE = tolerance;
+    rmap_t *rmap = calloc(1, sizeof(rmap_t));
+    rmap->size = size;
+    rmap->tolerance = tolerance;
+    rmap->values = calloc(size, sizeof(complex_t));
+    if (rmap->values == NULL) {
+        fprintf(stderr, "rmap: unable to allocate %" PRIu64 " values\n", size);
+        exit(1);
+    }
+    // keep the load factor of the index below 1/2, also when values is full
+    rmap->max_index_size = 2 * size;
+    rmap->index = rmap_index_create(min(RMAP_INITIAL_INDEX_SIZE, rmap->max_index_size));
+    return (void *) rmap;
+}
+
+void
+rmap_free(void *dbs)
+{
+    rmap_t *rmap = (rmap_t *) dbs;
+    rmap_index_t *index = rmap->index;
+    // an index which is being migrated to is only reachable through 'next'
+    if (index->next != NULL) {
+        free(index->next->buckets);
+        free(index->next);
+    }
+    while (index != NULL) {
+        rmap_index_t *retired = index->retired;
+        free(index->buckets);
+        free(index);
+        index = retired;
+    }
+    free(rmap->values);
+    free(rmap);
+}
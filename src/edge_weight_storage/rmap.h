@@ -0,0 +1,77 @@
+#ifndef RMAP_H
+#define RMAP_H
+
+/**
+\file rmap.h
+\brief Lockless hash table for complex values which grows online.
+
+Unlike the cmap, the index of a value is not its bucket in the hash table, but
+its position in a separate (append-only) array of values. The hash table only
+stores these indices, which means it can be replaced by a larger one while it
+is in use without changing the index of any value. When the hash table gets
+half full, a table of twice the size is allocated and the old table is migrated
+to the new one in small chunks, by the threads that call rmap_find_or_put.
+Buckets of the old table are frozen as they are migrated, and a thread which
+runs into a frozen empty bucket continues its search in the new table.
+
+The capacity (number of values) is fixed at creation. The values array is
+allocated with calloc, so memory is only committed for the part that is used.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "flt.h"
+
+
+/**
+\brief Create a new table.
+\param size The maximum number of values which can be stored (power of 2)
+\param tolerance Values which are this close are considered equal
+\return the hashtable
+*/
+extern void *rmap_create(uint64_t size, double tolerance);
+
+extern double rmap_get_tolerance();
+
+/**
+\brief Free the memory used by the table (including all its retired indices).
+*/
+extern void rmap_free(void *dbs);
+
+/**
+\brief Find a value in the table and insert it if it cannot be found.
+\param dbs The table
+\param v Pointer to the complex_t value
+\retval ret The index the value was found or inserted at
+\return 1 if the value was present, 0 if it was added, -1 if table was full
+*/
+extern int rmap_find_or_put(const void *dbs, const void *v, uint64_t *ret);
+
+/**
+\brief Same as rmap_find_or_put, but for a pointer to a fl_t value, which is
+stored as a complex value with imaginary part 0. Since the real part comes
+first in a complex_t, rmap_get can then be read as a pointer to a fl_t.
+*/
+extern int rmap_find_or_put_real(const void *dbs, const void *v, uint64_t *ret);
+
+extern void * rmap_get(const void *dbs, const uint64_t ref);
+
+extern uint64_t rmap_count_entries(const void *dbs);
+
+/**
+\brief Number of entries with an index in first, ..., last-1.
+*/
+extern uint64_t rmap_count_entries_range(const void *dbs, uint64_t first, uint64_t last);
+
+/**
+\brief Number of values which are within tolerance of another value in the
+table (with a lower index), i.e. values which a tmap would not have added.
+*/
+extern uint64_t rmap_count_near_duplicates(const void *dbs);
+
+/**
+\brief Number of buckets in the hash table which is currently used for lookups.
+*/
+extern uint64_t rmap_get_index_size(const void *dbs);
+
+#endif // RMAP_H
@@ -71,15 +71,339 @@ int test_cmap()
     val3 = *(complex_t*)cmap_get(ctable, index1);
     test_assert(val3.r == val1.r && val3.i == val1.i);
 
+    // large table, with buckets (lazily) marked as empty on first use: zeroed
+    // memory is not mistaken for the value 0
+    cmap_free(ctable);
+    ctable = cmap_create(1<<24, 1e-14);
+    test_assert(cmap_count_entries(ctable) == 0);
+    val1 = cmake(0.0, 0.0);
+    val2 = cmake(0.0, 1.0);
+    found = cmap_find_or_put(ctable, &val1, &index1); test_assert(found == 0);
+    found = cmap_find_or_put(ctable, &val2, &index2); test_assert(found == 0);
+    test_assert(index1 != index2);
+    for (int k = 0; k < 1000; k++) {
+        val3 = cmake(k / 1000.0, 0.5);
+        found = cmap_find_or_put(ctable, &val3, &index2); test_assert(found == 0);
+    }
+    found = cmap_find_or_put(ctable, &val1, &index2); test_assert(found == 1);
+    test_assert(index1 == index2);
+    test_assert(cmap_count_entries(ctable) == 1002);
+
+    // counting in parts (e.g. in parallel), also with parts which do not
+    // start at the beginning of a line of buckets
+    uint64_t parts = 0;
+    for (uint64_t first = 0; first < (1<<24); first += 1000003) {
+        parts += cmap_count_entries_range(ctable, first, first + 1000003);
+    }
+    test_assert(parts == 1002);
+
+    cmap_free(ctable);
+
+    // size which is not a power of 2 (a power of 2 minus room for pinned
+    // weights): all references stay below it
+    ctable = cmap_create((1<<12) - 1024, 0);
+    for (int k = 0; k < 2000; k++) {
+        val1 = cmake(k, -k/3.0);
+        found = cmap_find_or_put(ctable, &val1, &index1); test_assert(found == 0);
+        test_assert(index1 < (1<<12) - 1024);
+        found = cmap_find_or_put(ctable, &val1, &index2); test_assert(found == 1);
+        test_assert(index1 == index2);
+    }
+    test_assert(cmap_count_entries(ctable) == 2000);
     cmap_free(ctable);
     if(VERBOSE) printf("cmap tests:               ok\n");
     return 0;
 }
 
+int test_rmap()
+{
+    void *ctable = rmap_create(1<<10, 1e-14);
+
+    uint64_t index1, index2;
+    complex_t val1, val2, val3;
+    int found;
+
+    val1 = cmake(0.9, 2./3.);
+    val2 = cmake(0.9, 2./3.);
+    found = rmap_find_or_put(ctable, &val1, &index1); test_assert(found == 0);
+    found = rmap_find_or_put(ctable, &val2, &index2); test_assert(found == 1);
+    test_assert(index1 == index2);
+
+    val1 = cmake(2.99999999999999855, 0.0);
+    val2 = cmake(3.00000000000000123, 0.0);
+    found = rmap_find_or_put(ctable, &val1, &index1); test_assert(found == 0);
+    found = rmap_find_or_put(ctable, &val2, &index2); test_assert(found == 1);
+    test_assert(index1 == index2);
+    val3 = *(complex_t*)rmap_get(ctable, index1);
+    test_assert(val3.r == val1.r && val3.i == val1.i);
+    test_assert(rmap_count_entries(ctable) == 2);
+    rmap_free(ctable);
+
+    // grow the index several times, indices of values should not change
+    uint64_t n = 1<<16;
+    uint64_t indices[1<<16];
+    ctable = rmap_create(n, 1e-14);
+    uint64_t initial_index_size = rmap_get_index_size(ctable);
+    for (uint64_t k = 0; k < n; k++) {
+        val1 = cmake(1.0/(k+1), (fl_t)k);
+        found = rmap_find_or_put(ctable, &val1, &indices[k]); test_assert(found == 0);
+        // check some earlier values while the index is being migrated
+        val2 = cmake(1.0/(k/2+1), (fl_t)(k/2));
+        found = rmap_find_or_put(ctable, &val2, &index2); test_assert(found == 1);
+        test_assert(index2 == indices[k/2]);
+    }
+    test_assert(rmap_get_index_size(ctable) > initial_index_size);
+    test_assert(rmap_count_entries(ctable) == n);
+    for (uint64_t k = 0; k < n; k++) {
+        val1 = cmake(1.0/(k+1), (fl_t)k);
+        found = rmap_find_or_put(ctable, &val1, &index1); test_assert(found == 1);
+        test_assert(index1 == indices[k]);
+        val3 = *(complex_t*)rmap_get(ctable, index1);
+        test_assert(val3.r == val1.r && val3.i == val1.i);
+    }
+
+    // table is full
+    val1 = cmake(-1.0, -1.0);
+    found = rmap_find_or_put(ctable, &val1, &index1); test_assert(found == -1);
+
+    rmap_free(ctable);
+    if(VERBOSE) printf("rmap tests:               ok\n");
+    return 0;
+}
+
+int test_dmap()
+{
+    void *dtable = dmap_create(1<<10, 1e-14);
+
+    uint64_t index1, index2;
+    fl_t val1, val2, val3;
+    int found;
+
+    val1 = -3.5;
+    found = dmap_find_or_put(dtable, &val1, &index1); test_assert(found == 0);
+    for(int k=0; k<10; k++){
+        found = dmap_find_or_put(dtable, &val1, &index2);
+        test_assert(found == 1);
+        test_assert(index1 == index2);
+    }
+
+    val1 = 1.0/flt_sqrt(2.0);
+    val2 = 1.0/flt_sqrt(2.0);
+    found = dmap_find_or_put(dtable, &val1, &index1); test_assert(found == 0);
+    found = dmap_find_or_put(dtable, &val2, &index2); test_assert(found == 1);
+    test_assert(index1 == index2);
+    val3 = *(fl_t*)dmap_get(dtable, index1);
+    test_assert(val3 == val1);
+
+    val1 = 2.99999999999999855;
+    val2 = 3.00000000000000123;
+    found = dmap_find_or_put(dtable, &val1, &index1); test_assert(found == 0);
+    found = dmap_find_or_put(dtable, &val2, &index2); test_assert(found == 1);
+    test_assert(index1 == index2);
+
+    // 0 and -0 are the same value
+    val1 = 0.0;
+    val2 = -0.0;
+    found = dmap_find_or_put(dtable, &val1, &index1); test_assert(found == 0);
+    found = dmap_find_or_put(dtable, &val2, &index2); test_assert(found == 1);
+    test_assert(index1 == index2);
+    test_assert(dmap_count_entries(dtable) == 4);
+
+    // test with tolerance = 0
+    dmap_free(dtable);
+    dtable = dmap_create(1<<10, 0.0);
+    val1 = 2.99999999999999855;
+    val2 = 3.00000000000000123;
+    found = dmap_find_or_put(dtable, &val1, &index1); test_assert(found == 0);
+    found = dmap_find_or_put(dtable, &val2, &index2); test_assert(found == 0);
+    test_assert(index1 != index2);
+
+    // real values in an rmap
+    dmap_free(dtable);
+    dtable = rmap_create(1<<10, 1e-14);
+    val1 = -0.25;
+    found = rmap_find_or_put_real(dtable, &val1, &index1); test_assert(found == 0);
+    found = rmap_find_or_put_real(dtable, &val1, &index2); test_assert(found == 1);
+    test_assert(index1 == index2);
+    test_assert(*(fl_t*)rmap_get(dtable, index1) == val1);
+    rmap_free(dtable);
+
+    if(VERBOSE) printf("dmap tests:               ok\n");
+    return 0;
+}
+
+int test_tmap()
+{
+    void *ctable = cmap_create(1<<10, 1e-14);
+    void *ttable = tmap_create(1<<10, 1e-14);
+
+    uint64_t index1, index2;
+    complex_t val1, val2, val3;
+    int found;
+
+    val1 = cmake(3.5, 4.7);
+    found = tmap_find_or_put(ttable, &val1, &index1); test_assert(found == 0);
+    for(int k=0; k<10; k++){
+        found = tmap_find_or_put(ttable, &val1, &index2);
+        test_assert(found == 1);
+        test_assert(index1 == index2);
+    }
+    val3 = *(complex_t*)tmap_get(ttable, index1);
+    test_assert(val3.r == val1.r && val3.i == val1.i);
+
+    // close values on different sides of a rounding boundary of the cmap
+    val1 = cmake(2.4e-14, 0.5);
+    val2 = cmake(2.6e-14, 0.5);
+    found = cmap_find_or_put(ctable, &val1, &index1); test_assert(found == 0);
+    found = cmap_find_or_put(ctable, &val2, &index2); test_assert(found == 0);
+    test_assert(index1 != index2);
+    found = tmap_find_or_put(ttable, &val1, &index1); test_assert(found == 0);
+    found = tmap_find_or_put(ttable, &val2, &index2); test_assert(found == 1);
+    test_assert(index1 == index2);
+    test_assert(tmap_get_neighbour_hits(ttable) == 0);
+
+    // close values in different cells of the tmap (in both dimensions)
+    val1 = cmake(0.5, 6.39e-13);
+    val2 = cmake(0.5, 6.41e-13);
+    found = tmap_find_or_put(ttable, &val1, &index1); test_assert(found == 0);
+    found = tmap_find_or_put(ttable, &val2, &index2); test_assert(found == 1);
+    test_assert(index1 == index2);
+    test_assert(tmap_get_neighbour_hits(ttable) == 1);
+    val1 = cmake(-6.39e-13, 1.279e-12);
+    val2 = cmake(-6.41e-13, 1.281e-12);
+    found = tmap_find_or_put(ttable, &val1, &index1); test_assert(found == 0);
+    found = tmap_find_or_put(ttable, &val2, &index2); test_assert(found == 1);
+    test_assert(index1 == index2);
+    test_assert(tmap_get_neighbour_hits(ttable) == 2);
+
+    // values which are not close
+    val2 = cmake(0.5, 6.55e-13);
+    found = tmap_find_or_put(ttable, &val2, &index2); test_assert(found == 0);
+    test_assert(tmap_count_entries(ttable) == 5);
+
+    // near-duplicates
+    test_assert(cmap_count_near_duplicates(ctable) == 1);
+    test_assert(tmap_count_near_duplicates(ttable) == 0);
+    test_assert(tmap_get_tolerance() == 1e-14);
+    cmap_free(ctable);
+
+    // test with tolerance = 0
+    tmap_free(ttable);
+    ttable = tmap_create(1<<10, 0.0);
+    val1 = cmake(2.99999999999999855, 0.0);
+    val2 = cmake(3.00000000000000123, 0.0);
+    found = tmap_find_or_put(ttable, &val1, &index1); test_assert(found == 0);
+    found = tmap_find_or_put(ttable, &val2, &index2); test_assert(found == 0);
+    test_assert(index1 != index2);
+    val1 = cmake(0.0, 1.0);
+    val2 = cmake(-0.0, 1.0);
+    found = tmap_find_or_put(ttable, &val1, &index1); test_assert(found == 0);
+    found = tmap_find_or_put(ttable, &val2, &index2); test_assert(found == 1);
+    test_assert(index1 == index2);
+    tmap_free(ttable);
+
+    if(VERBOSE) printf("tmap tests:               ok\n");
+    return 0;
+}
+
+int test_emap()
+{
+    void *etable = emap_create(1<<10, 1e-14);
+    test_assert(emap_get_tolerance() == 1e-14);
+
+    uint64_t index1, index2;
+    qomega_t val1 = {.den = 2, .c = {0, 1, 0, -1}}; // 1/sqrt(2)
+    qomega_t val2 = {.den = 2, .c = {0, 1, 0, -1}};
+    qomega_t val3 = {.den = 2, .c = {0, 1, 0,  1}}; // i/sqrt(2)
+    int found;
+
+    found = emap_find_or_put(etable, &val1, &index1); test_assert(found == 0);
+    for(int k=0; k<10; k++){
+        found = emap_find_or_put(etable, &val2, &index2);
+        test_assert(found == 1);
+        test_assert(index1 == index2);
+    }
+    test_assert(memcmp(emap_get(etable, index1), &val1, sizeof(qomega_t)) == 0);
+
+    found = emap_find_or_put(etable, &val3, &index2); test_assert(found == 0);
+    test_assert(index1 != index2);
+
+    // values are compared exactly, regardless of the tolerance
+    val1 = (qomega_t) {.den = INT64_MAX, .c = {1, 0, 0, 0}};
+    val2 = (qomega_t) {.den = INT64_MAX-1, .c = {1, 0, 0, 0}};
+    found = emap_find_or_put(etable, &val1, &index1); test_assert(found == 0);
+    found = emap_find_or_put(etable, &val2, &index2); test_assert(found == 0);
+    test_assert(index1 != index2);
+    test_assert(emap_count_entries(etable) == 4);
+
+    emap_free(etable);
+    if(VERBOSE) printf("emap tests:               ok\n");
+    return 0;
+}
+
+int test_small_tables()
+{
+    // tables of fewer buckets than a probe line (or not a multiple of one):
+    // probing and lazy initialization stay within the table
+    uint64_t sizes[] = {64, 100};
+    for (int s = 0; s < 2; s++) {
+        uint64_t size = sizes[s];
+        void *tables[4] = {cmap_create(size, 1e-14), tmap_create(size, 1e-14),
+                           dmap_create(size, 1e-14), emap_create(size, 1e-14)};
+        uint64_t inserted[4] = {0, 0, 0, 0};
+        for (int k = 0; k < 32; k++) {
+            complex_t c = cmake(k + 0.25, -k/3.0);
+            fl_t d = k + 0.25;
+            qomega_t q = {.den = 1, .c = {k, 0, 1, 0}};
+            for (int t = 0; t < 4; t++) {
+                uint64_t index1, index2;
+                int found;
+                switch (t) {
+                case 0: found = cmap_find_or_put(tables[t], &c, &index1); break;
+                case 1: found = tmap_find_or_put(tables[t], &c, &index1); break;
+                case 2: found = dmap_find_or_put(tables[t], &d, &index1); break;
+                default: found = emap_find_or_put(tables[t], &q, &index1); break;
+                }
+                if (found < 0) continue; // the (short) probe lines are full
+                test_assert(found == 0);
+                test_assert(index1 < size);
+                inserted[t]++;
+                switch (t) {
+                case 0: found = cmap_find_or_put(tables[t], &c, &index2); break;
+                case 1: found = tmap_find_or_put(tables[t], &c, &index2); break;
+                case 2: found = dmap_find_or_put(tables[t], &d, &index2); break;
+                default: found = emap_find_or_put(tables[t], &q, &index2); break;
+                }
+                test_assert(found == 1);
+                test_assert(index1 == index2);
+            }
+        }
+        // a table which is a single line holds all of them
+        if (size == 64) {
+            for (int t = 0; t < 4; t++) test_assert(inserted[t] == 32);
+        }
+        test_assert(cmap_count_entries(tables[0]) == inserted[0]);
+        test_assert(tmap_count_entries(tables[1]) == inserted[1]);
+        test_assert(dmap_count_entries(tables[2]) == inserted[2]);
+        test_assert(emap_count_entries(tables[3]) == inserted[3]);
+        cmap_free(tables[0]);
+        tmap_free(tables[1]);
+        dmap_free(tables[2]);
+        emap_free(tables[3]);
+    }
+    if(VERBOSE) printf("small table tests:        ok\n");
+    return 0;
+}
+
 
 int runtests()
 {
     if (test_cmap()) return 1;
+    if (test_rmap()) return 1;
+    if (test_dmap()) return 1;
+    if (test_tmap()) return 1;
+    if (test_emap()) return 1;
+    if (test_small_tables()) return 1;
     return 0;
 }
 
@@ -0,0 +1,319 @@
+#include "tmap.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "atomics.h"
+#include "fast_hash.h"
+#include "lazy_line.h"
+#include "util.h"
+
+#define TMAP_CACHE_LINE 8
+
+// how many "blocks" of 64 bits for a single table entry
+#define TMAP_ENTRY_SIZE (2*sizeof(fl_t)/8)
+
+typedef union {
+    complex_t       c;
+    uint64_t        d[TMAP_ENTRY_SIZE];
+} tmap_bucket_t;
+
+static const uint64_t TMAP_EMPTY = 14738995463583502973ull;
+static const uint64_t TMAP_LOCK  = 14738995463583502974ull;
+
+// width of a cell (in units of tolerance), values only need to be searched
+// for in a neighbouring cell if they are within tolerance of its border
+#define TMAP_CELL_SIZE 64
+
+// cells further out than this are merged (|v| > 2^62 * cell width)
+static const fl_t TMAP_MAX_CELL = 4611686018427387904.0; // 2^62
+
+// float "equality" tolerance
+static long double TOLERANCE = 1e-14l;
+
+typedef struct tmap_s tmap_t;
+struct tmap_s {
+    size_t              size;
+    size_t              mask;
+    unsigned int        line_bits; // log2 of the buckets per probe line
+    size_t              threshold;
+    long double         tolerance; // float "equality" tolerance
+    uint64_t            neighbour_hits;
+    tmap_bucket_t      *table;
+    uint8_t            *line_states; // see lazy_line.h
+};
+
+// a cell of the complex plane (or the exact value if tolerance is 0)
+typedef struct tmap_cell_s {
+    int64_t r, i;
+} tmap_cell_t;
+
+static inline bool
+tmap_complex_close(const tmap_t *tmap, const complex_t *in_table, const complex_t* to_insert)
+{
+    if (tmap->tolerance == 0.0) {
+         return ((in_table->r == to_insert->r) &&
+                 (in_table->i == to_insert->i));
+    }
+    else {
+        return ((flt_abs(in_table->r - to_insert->r) < tmap->tolerance) &&
+                (flt_abs(in_table->i - to_insert->i) < tmap->tolerance));
+    }
+}
+
+/**
+ * Cell index of x along one axis, and the direction (-1 or +1) of the
+ * neighbouring cell if x is within tolerance of its border (0 otherwise).
+ */
+static inline int64_t
+tmap_cell_1d(fl_t x, fl_t tolerance, int *dir)
+{
+    fl_t cell_size = TMAP_CELL_SIZE * tolerance;
+    fl_t k = x / cell_size;
+    if (k >  TMAP_MAX_CELL) k =  TMAP_MAX_CELL;
+    if (k < -TMAP_MAX_CELL) k = -TMAP_MAX_CELL;
+    fl_t k_floor = flt_floor(k);
+    fl_t offset = (k - k_floor) * cell_size;
+    if (offset < tolerance) *dir = -1;
+    else if (cell_size - offset < tolerance) *dir = 1;
+    else *dir = 0;
+    return (int64_t) k_floor;
+}
+
+/**
+ * Searches the probe sequence of `cell` for a value close to `val`. If `put`,
+ * `val` is inserted at the first empty bucket. Returns 1 if a close value was
+ * found, 0 if `val` was inserted (or, without `put`, if no close value is in
+ * this cell), and -1 if the table is full.
+ */
+static int
+tmap_probe(tmap_t *tmap, const tmap_cell_t *cell, const tmap_bucket_t *val, bool put, uint64_t *ret)
+{
+    uint32_t hash  = SuperFastHash_inline(cell, sizeof(tmap_cell_t), 0);
+    uint32_t prime = odd_primes[hash & PRIME_MASK];
+
+    for (unsigned int c = 0; c < tmap->threshold; c++) {
+        uint64_t            ref = hash_bucket(hash, tmap->mask, tmap->size);
+        uint64_t            line_size = 1ULL << tmap->line_bits;
+        uint64_t            line_start = ref & -line_size;
+        uint64_t            line_end = line_start + line_size;
+        lazy_line_ensure(tmap->line_states, ref >> tmap->line_bits,
+                         &tmap->table[line_start].d[0], TMAP_ENTRY_SIZE,
+                         line_size, TMAP_EMPTY);
+        for (size_t i = 0; i < line_size; i++) {
+
+            // 1. Get bucket
+            tmap_bucket_t *bucket = &tmap->table[ref];
+
+            // 2. If bucket empty, the value is not in this cell
+            if (atomic_read(&bucket->d[0]) == TMAP_EMPTY) {
+                if (!put) return 0;
+                if (cas(&bucket->d[0], TMAP_EMPTY, TMAP_LOCK)) {
+                    *ret = ref;
+                    // write backwards (overwrite bucket->d[0] last)
+                    for (int k = TMAP_ENTRY_SIZE-1; k >= 0; k--) {
+                        atomic_write (&bucket->d[k], val->d[k]);
+                    }
+                    return 0;
+                }
+            }
+
+            // 3. Bucket not empty, wait for lock
+            while (atomic_read(&bucket->d[0]) == TMAP_LOCK) {}
+
+            // 4. Bucket contains some complex value, check if close to `val`
+            if (tmap_complex_close(tmap, &bucket->c, &val->c)) {
+                *ret = ref;
+                return 1;
+            }
+
+            // If unsuccessful, try next
+            ref += 1;
+            ref = ref == line_end ? line_start : ref;
+        }
+        hash += prime << TMAP_CACHE_LINE;
+    }
+    // table full
+    return -1;
+}
+
+double
+tmap_get_tolerance()
+{
+    return TOLERANCE;
+}
+
+int
+tmap_find_or_put(const void *dbs, const void *v, uint64_t *ret)
+{
+    tmap_t *tmap = (tmap_t *) dbs;
+    const tmap_bucket_t *val = (const tmap_bucket_t *) v;
+
+    assert (val->d[0] != TMAP_LOCK);
+    assert (val->d[0] != TMAP_EMPTY);
+
+    tmap_cell_t home;
+    if (tmap->tolerance == 0.0) {
+        // the cell is the value itself (with 0 not having a sign)
+        complex_t c = val->c;
+        if (c.r == 0.0) c.r = 0.0;
+        if (c.i == 0.0) c.i = 0.0;
+        home.r = ((tmap_bucket_t *) &c)->d[0];
+        home.i = ((tmap_bucket_t *) &c)->d[TMAP_ENTRY_SIZE-1];
+        return tmap_probe(tmap, &home, val, true, ret);
+    }
+
+    // close values are in the cell of `v`, or in a neighbouring cell if `v`
+    // is within tolerance of its border
+    int dir_r, dir_i;
+    home.r = tmap_cell_1d(val->c.r, tmap->tolerance, &dir_r);
+    home.i = tmap_cell_1d(val->c.i, tmap->tolerance, &dir_i);
+
+    int res = tmap_probe(tmap, &home, val, false, ret);
+    if (res != 0) return res;
+
+    if (dir_r != 0 || dir_i != 0) {
+        tmap_cell_t neighbours[3];
+        int n = 0;
+        if (dir_r != 0) neighbours[n++] = (tmap_cell_t) {home.r + dir_r, home.i};
+        if (dir_i != 0) neighbours[n++] = (tmap_cell_t) {home.r, home.i + dir_i};
+        if (dir_r != 0 && dir_i != 0) neighbours[n++] = (tmap_cell_t) {home.r + dir_r, home.i + dir_i};
+        for (int k = 0; k < n; k++) {
+            res = tmap_probe(tmap, &neighbours[k], val, false, ret);
+            if (res == 1) {
+                fetch_add(&tmap->neighbour_hits, 1);
+                return 1;
+            }
+        }
+    }
+
+    return tmap_probe(tmap, &home, val, true, ret);
+}
+
+int
+tmap_find_or_put_real(const void *dbs, const void *v, uint64_t *ret)
+{
+    complex_t c = cmake(*(const fl_t *) v, 0.0);
+    return tmap_find_or_put(dbs, &c, ret);
+}
+
+void *
+tmap_get(const void *dbs, const uint64_t ref)
+{
+    return &(((const tmap_t *) dbs)->table[ref].c);
+}
+
+uint64_t
+tmap_count_entries_range(const void *dbs, uint64_t first, uint64_t last)
+{
+    tmap_t *tmap = (tmap_t *) dbs;
+    last = min(last, tmap->size);
+    uint64_t entries = 0;
+    uint64_t c = first;
+    while (c < last) {
+        if (!lazy_line_ready(tmap->line_states, c >> tmap->line_bits)) {
+            c = ((c >> tmap->line_bits) + 1) << tmap->line_bits;
+            continue;
+        }
+        if (tmap->table[c].d[0] != TMAP_EMPTY)
+            entries++;
+        c++;
+    }
+    return entries;
+}
+
+uint64_t
+tmap_count_entries(const void *dbs)
+{
+    return tmap_count_entries_range(dbs, 0, ((tmap_t *) dbs)->size);
+}
+
+uint64_t
+tmap_get_neighbour_hits(const void *dbs)
+{
+    return ((const tmap_t *) dbs)->neighbour_hits;
+}
+
+void *
+tmap_create(uint64_t size, double tolerance)
+{
+    TOLERANCE = tolerance;
+    tmap_t  *tmap = calloc (1, sizeof(tmap_t));
+    tmap->size = size;
+    tmap->tolerance = tolerance;
+    tmap->mask = hash_table_mask(tmap->size);
+    tmap->line_bits = hash_line_bits(tmap->size, TMAP_CACHE_LINE);
+    tmap->neighbour_hits = 0;
+    tmap->table = calloc (tmap->size, sizeof(tmap_bucket_t));
+    if (tmap->table == NULL) {
+        fprintf(stderr, "tmap: unable to allocate %" PRIu64 " buckets\n", size);
+        exit(1);
+    }
+    // buckets are only marked as empty when their line is first used
+    tmap->line_states = lazy_line_states_create(max(tmap->size >> tmap->line_bits, 1ULL));
+    if (tmap->line_states == NULL) {
+        fprintf(stderr, "tmap: unable to allocate %" PRIu64 " buckets\n", size);
+        exit(1);
+    }
+    tmap->threshold = tmap->size / 100;
+    tmap->threshold = max(tmap->threshold, 1ULL);
+    tmap->threshold = min(tmap->threshold, 1ULL << 16);
+    return (void *) tmap;
+}
+
+void
+tmap_free(void *dbs)
+{
+    tmap_t * tmap = (tmap_t *) dbs;
+    free (tmap->table);
+    free (tmap->line_states);
+    free (tmap);
+}
+
+void
+tmap_dup_counter_init(tmap_dup_counter_t *counter, uint64_t n_values, double tolerance)
+{
+    // at most 1/4 full
+    uint64_t size = 1024;
+    while (size < 4 * n_values) size *= 2;
+    // don't overwrite the tolerance of the table which is in use
+    long double tol = TOLERANCE;
+    counter->tmap = tmap_create(size, tolerance);
+    TOLERANCE = tol;
+    counter->duplicates = 0;
+}
+
+void
+tmap_dup_counter_add(tmap_dup_counter_t *counter, const complex_t *v)
+{
+    uint64_t ref;
+    if (tmap_find_or_put(counter->tmap, v, &ref) == 1) counter->duplicates++;
+}
+
+uint64_t
+tmap_dup_counter_finish(tmap_dup_counter_t *counter)
+{
+    tmap_free(counter->tmap);
+    counter->tmap = NULL;
+    return counter->duplicates;
+}
+
+uint64_t
+tmap_count_near_duplicates(const void *dbs)
+{
+    tmap_t *tmap = (tmap_t *) dbs;
+    tmap_dup_counter_t counter;
+    tmap_dup_counter_init(&counter, tmap_count_entries(tmap), tmap->tolerance);
+    for (unsigned int c = 0; c < tmap->size; c++) {
+        if (!lazy_line_ready(tmap->line_states, c >> tmap->line_bits)) {
+            c += (1ULL << tmap->line_bits) - 1;
+            continue;
+        }
+        if (tmap->table[c].d[0] != TMAP_EMPTY)
+            tmap_dup_counter_add(&counter, &tmap->table[c].c);
+    }
+    return tmap_dup_counter_finish(&counter);
+}
@@ -0,0 +1,90 @@
+#ifndef TMAP_H
+#define TMAP_H
+
+/**
+\file tmap.h
+\brief Lockless non-resizing hash table for complex values, which always finds
+a value within tolerance if there is one.
+
+The cmap hashes round(v / tolerance). Two values which are within tolerance of
+each other, but on different sides of a rounding boundary, end up in different
+buckets, and are stored as two different edge weights. The tmap divides the
+complex plane into square cells (of 64 times the tolerance) and hashes the cell
+of a value. A value within tolerance of v is then either in the cell of v, or,
+if v is within tolerance of a border of its cell, in one of the (at most 3)
+neighbouring cells across these borders. All of these are searched before v is
+inserted in its own cell.
+
+This guarantee holds for values which are inserted one after the other. Two
+close values which are inserted concurrently into different cells can still
+both be added.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "flt.h"
+
+
+/**
+\brief Create a new table.
+\param size The number of buckets (power of 2)
+\param tolerance Values which are this close are considered equal
+\return the hashtable
+*/
+extern void *tmap_create(uint64_t size, double tolerance);
+
+extern double tmap_get_tolerance();
+
+/**
+\brief Free the memory used by the table.
+*/
+extern void tmap_free(void *dbs);
+
+/**
+\brief Find a value in the table and insert it if it cannot be found.
+\param dbs The table
+\param v Pointer to the complex_t value
+\retval ret The index the value was found or inserted at
+\return 1 if the value was present, 0 if it was added, -1 if table was full
+*/
+extern int tmap_find_or_put(const void *dbs, const void *v, uint64_t *ret);
+
+/**
+\brief Same as tmap_find_or_put, but for a pointer to a fl_t value, which is
+stored as a complex value with imaginary part 0.
+*/
+extern int tmap_find_or_put_real(const void *dbs, const void *v, uint64_t *ret);
+
+extern void * tmap_get(const void *dbs, const uint64_t ref);
+
+extern uint64_t tmap_count_entries(const void *dbs);
+
+/**
+\brief Number of entries in buckets first, ..., last-1 (last is capped at the
+size of the table). Disjoint ranges can be counted in parallel.
+*/
+extern uint64_t tmap_count_entries_range(const void *dbs, uint64_t first, uint64_t last);
+
+/**
+\brief Number of lookups which found their value in a neighbouring cell, i.e.
+lookups which would have added a near-duplicate value to a cmap.
+*/
+extern uint64_t tmap_get_neighbour_hits(const void *dbs);
+
+/**
+\brief Counts near-duplicates in a sequence of values: the number of values
+which are within tolerance of an earlier value in the sequence. Used to compute
+the number of near-duplicates stored in the other tables.
+*/
+typedef struct tmap_dup_counter_s {
+    void     *tmap;
+    uint64_t  duplicates;
+} tmap_dup_counter_t;
+
+extern void tmap_dup_counter_init(tmap_dup_counter_t *counter, uint64_t n_values, double tolerance);
+extern void tmap_dup_counter_add(tmap_dup_counter_t *counter, const complex_t *v);
+extern uint64_t tmap_dup_counter_finish(tmap_dup_counter_t *counter);
+
+extern uint64_t tmap_count_near_duplicates(const void *dbs);
+
+#endif // TMAP_H
@@ -6,11 +6,32 @@
 void * (*wgt_store_create)(uint64_t size, double tolerance);
 void (*wgt_store_free)(void *wgt_storage);
 int (*wgt_store_find_or_put)(const void *dbs, const void *v, uint64_t *ret);
+void (*wgt_store_find_or_put_batch)(const void *dbs, const void *v, int n, uint64_t *ret, int *found);
 void * (*wgt_store_get)(const void *dbs, const uint64_t ref);
 uint64_t (*wgt_store_num_entries)(const void *dbs);
+uint64_t (*wgt_store_num_entries_range)(const void *dbs, uint64_t first, uint64_t last);
 double (*wgt_store_get_tol)();
+uint64_t (*wgt_store_num_near_duplicates)(const void *dbs);
 
 
+// find_or_put_batch for backends which don't have a batched lookup
+#define DEF_FIND_OR_PUT_BATCH_SEQ(name, value_t) \
+static void name(const void *dbs, const void *v, int n, uint64_t *ret, int *found) \
+{ \
+    for (int k = 0; k < n; k++) { \
+        found[k] = wgt_store_find_or_put(dbs, &((const value_t *) v)[k], &ret[k]); \
+    } \
+}
+DEF_FIND_OR_PUT_BATCH_SEQ(find_or_put_batch_complex, complex_t)
+DEF_FIND_OR_PUT_BATCH_SEQ(find_or_put_batch_real, fl_t)
+DEF_FIND_OR_PUT_BATCH_SEQ(find_or_put_batch_exact, qomega_t)
+
+
+bool wgt_storage_is_resizable(wgt_storage_backend_t backend)
+{
+    return (backend == COMP_RESIZABLE_HASHMAP);
+}
+
 void init_wgt_storage_functions(wgt_storage_backend_t backend)
 {
     switch (backend)
@@ -19,9 +40,105 @@ void init_wgt_storage_functions(wgt_storage_backend_t backend)
         wgt_store_create      = &cmap_create;
         wgt_store_free        = &cmap_free;
         wgt_store_find_or_put = &cmap_find_or_put;
+        wgt_store_find_or_put_batch = &cmap_find_or_put_batch;
         wgt_store_get         = &cmap_get;
         wgt_store_num_entries = &cmap_count_entries;
+        wgt_store_num_entries_range = &cmap_count_entries_range;
         wgt_store_get_tol     = &cmap_get_tolerance;
+        wgt_store_num_near_duplicates = &cmap_count_near_duplicates;
+        break;
+    case COMP_RESIZABLE_HASHMAP:
+        wgt_store_create      = &rmap_create;
+        wgt_store_free        = &rmap_free;
+        wgt_store_find_or_put = &rmap_find_or_put;
+        wgt_store_find_or_put_batch = &find_or_put_batch_complex;
+        wgt_store_get         = &rmap_get;
+        wgt_store_num_entries = &rmap_count_entries;
+        wgt_store_num_entries_range = &rmap_count_entries_range;
+        wgt_store_get_tol     = &rmap_get_tolerance;
+        wgt_store_num_near_duplicates = &rmap_count_near_duplicates;
+        break;
+    case COMP_TOLERANT_HASHMAP:
+        wgt_store_create      = &tmap_create;
+        wgt_store_free        = &tmap_free;
+        wgt_store_find_or_put = &tmap_find_or_put;
+        wgt_store_find_or_put_batch = &find_or_put_batch_complex;
+        wgt_store_get         = &tmap_get;
+        wgt_store_num_entries = &tmap_count_entries;
+        wgt_store_num_entries_range = &tmap_count_entries_range;
+        wgt_store_get_tol     = &tmap_get_tolerance;
+        wgt_store_num_near_duplicates = &tmap_count_near_duplicates;
+        break;
+    default:
+        fprintf(stderr, "Unrecognized edge weight type %d\n", backend);
+        exit(1);
+        break;
+    }
+}
+
+void init_real_wgt_storage_functions(wgt_storage_backend_t backend)
+{
+    switch (backend)
+    {
+    case COMP_HASHMAP:
+        wgt_store_create      = &dmap_create;
+        wgt_store_free        = &dmap_free;
+        wgt_store_find_or_put = &dmap_find_or_put;
+        wgt_store_find_or_put_batch = &find_or_put_batch_real;
+        wgt_store_get         = &dmap_get;
+        wgt_store_num_entries = &dmap_count_entries;
+        wgt_store_num_entries_range = &dmap_count_entries_range;
+        wgt_store_get_tol     = &dmap_get_tolerance;
+        wgt_store_num_near_duplicates = &dmap_count_near_duplicates;
+        break;
+    case COMP_RESIZABLE_HASHMAP:
+        wgt_store_create      = &rmap_create;
+        wgt_store_free        = &rmap_free;
+        wgt_store_find_or_put = &rmap_find_or_put_real;
+        wgt_store_find_or_put_batch = &find_or_put_batch_real;
+        wgt_store_get         = &rmap_get;
+        wgt_store_num_entries = &rmap_count_entries;
+        wgt_store_num_entries_range = &rmap_count_entries_range;
+        wgt_store_get_tol     = &rmap_get_tolerance;
+        wgt_store_num_near_duplicates = &rmap_count_near_duplicates;
+        break;
+    case COMP_TOLERANT_HASHMAP:
+        wgt_store_create      = &tmap_create;
+        wgt_store_free        = &tmap_free;
+        wgt_store_find_or_put = &tmap_find_or_put_real;
+        wgt_store_find_or_put_batch = &find_or_put_batch_real;
+        wgt_store_get         = &tmap_get;
+        wgt_store_num_entries = &tmap_count_entries;
+        wgt_store_num_entries_range = &tmap_count_entries_range;
+        wgt_store_get_tol     = &tmap_get_tolerance;
+        wgt_store_num_near_duplicates = &tmap_count_near_duplicates;
+        break;
+    default:
+        fprintf(stderr, "Unrecognized edge weight type %d\n", backend);
+        exit(1);
+        break;
+    }
+}
+
+void init_exact_wgt_storage_functions(wgt_storage_backend_t backend)
+{
+    switch (backend)
+    {
+    case COMP_HASHMAP:
+        wgt_store_create      = &emap_create;
+        wgt_store_free        = &emap_free;
+        wgt_store_find_or_put = &emap_find_or_put;
+        wgt_store_find_or_put_batch = &find_or_put_batch_exact;
+        wgt_store_get         = &emap_get;
+        wgt_store_num_entries = &emap_count_entries;
+        wgt_store_num_entries_range = &emap_count_entries_range;
+        wgt_store_get_tol     = &emap_get_tolerance;
+        wgt_store_num_near_duplicates = &emap_count_near_duplicates;
+        break;
+    case COMP_RESIZABLE_HASHMAP:
+    case COMP_TOLERANT_HASHMAP:
+        fprintf(stderr, "Exact edge weights are only supported by COMP_HASHMAP\n");
+        exit(1);
         break;
     default:
         fprintf(stderr, "Unrecognized edge weight type %d\n", backend);
@@ -3,9 +3,15 @@
 
 #include "flt.h"
 #include "cmap.h"
+#include "dmap.h"
+#include "emap.h"
+#include "rmap.h"
+#include "tmap.h"
 
 typedef enum wgt_storage_backend {
     COMP_HASHMAP,
+    COMP_RESIZABLE_HASHMAP,
+    COMP_TOLERANT_HASHMAP,
     n_wgt_storage_types
 } wgt_storage_backend_t;
 
@@ -18,15 +24,55 @@ extern void (*wgt_store_free)(void *wgt_storage);
 // find_or_put(void *dbs, void *v, int *ret)
 extern int (*wgt_store_find_or_put)(const void *dbs, const void *v, uint64_t *ret);
 
+// find_or_put_batch(void *dbs, void *v, int n, uint64_t *ret, int *found):
+// find_or_put of the n consecutive values at v, with results ret[k], found[k]
+extern void (*wgt_store_find_or_put_batch)(const void *dbs, const void *v, int n, uint64_t *ret, int *found);
+
 // get(void *dbs, int ref)
 extern void * (*wgt_store_get)(const void *dbs, const uint64_t ref);
 
 // num entries(void *dbs)
 extern uint64_t (*wgt_store_num_entries)(const void *dbs);
 
+// num entries range(void *dbs, uint64_t first, uint64_t last): the entries in
+// buckets first, ..., last-1, so that parts of the table can be counted in
+// parallel
+extern uint64_t (*wgt_store_num_entries_range)(const void *dbs, uint64_t first, uint64_t last);
+
 // get tolerance
 extern double (*wgt_store_get_tol)();
 
+// num near-duplicates(void *dbs): values within tolerance of another value
+extern uint64_t (*wgt_store_num_near_duplicates)(const void *dbs);
+
+/**
+ * True iff the backend can grow while in use without changing the indices of
+ * the stored values. Such a backend is created at its maximum size right away,
+ * and only allocates the memory it needs as it grows.
+ */
+bool wgt_storage_is_resizable(wgt_storage_backend_t backend);
+
+/**
+ * Sets the wgt_store_* functions for storing complex values. COMP_HASHMAP uses
+ * a cmap, COMP_RESIZABLE_HASHMAP an rmap, and COMP_TOLERANT_HASHMAP a tmap 
+ * (like the cmap, but always finds a stored value within tolerance, so it 
+ * stores no near-duplicate values).
+ */
 void init_wgt_storage_functions(wgt_storage_backend_t backend);
 
+/**
+ * Same as init_wgt_storage_functions, but for storing real (fl_t) values
+ * instead of complex ones. For COMP_HASHMAP this uses a dmap, which needs half
+ * the memory of a cmap. COMP_RESIZABLE_HASHMAP and COMP_TOLERANT_HASHMAP store
+ * the real values as complex values with imaginary part 0.
+ */
+void init_real_wgt_storage_functions(wgt_storage_backend_t backend);
+
+/**
+ * Same as init_wgt_storage_functions, but for storing exact (qomega_t) values.
+ * Only COMP_HASHMAP (an emap) is supported, since exact values have no
+ * near-duplicates.
+ */
+void init_exact_wgt_storage_functions(wgt_storage_backend_t backend);
+
 #endif // AMP_STORAGE_INTERFACE
@@ -1,128 +1,512 @@
 #include <qsylvan_gates.h>
 #include <sylvan_int.h>
 #include <sylvan_edge_weights_complex.h>
+#include <inttypes.h>
+#include <string.h>
 
 
 static long double Pi;    // set value of global Pi
 
-uint64_t gates[n_predef_gates+256+256][4];
+uint64_t (*gates)[4] = NULL;
+
+// false for static gates with complex entries when the edge weights are real
+// (size is num_static_gates)
+static bool static_gate_supported[n_predef_gates+256+256];
 
 /********************** <dynamic custom rotation gates> ***********************/
 
+/**
+ * Registry of parameterized gates. Slot i corresponds to gate ID
+ * num_static_gates + i. Gates are looked up by the edge weight indices of
+ * their matrix entries, so two gates get the same ID iff their entries are the
+ * same up to the tolerance of the edge weight table. Slots are kept in an LRU
+ * list; when the registry is full, the least recently used slots are recycled
+ * in batches so that the operation cache only needs to be scanned once per
+ * batch.
+ */
+#define DGATE_NONE UINT32_MAX
+
+typedef struct dynamic_gate_s {
+    complex_t values[4]; // complex values to re-initialize gate after gc
+    uint32_t lru_prev;   // towards more recently used
+    uint32_t lru_next;   // towards less recently used (or next free slot)
+    uint32_t hash_next;  // next slot in the same hash bucket
+    bool in_use;
+    bool recycled;       // set while its cache entries need to be removed
+} dynamic_gate_t;
+
+static uint32_t max_dynamic_gates = 1<<14;
+static uint32_t dgates_used = 0;
+static dynamic_gate_t *dgates = NULL;
+static uint32_t *dgates_buckets = NULL;
+static uint32_t dgates_mask = 0;    // num buckets - 1
+static uint32_t lru_head = DGATE_NONE; // most recently used
+static uint32_t lru_tail = DGATE_NONE; // least recently used
+static uint32_t free_head = DGATE_NONE;
+
+static inline uint32_t
+dgate_id(uint32_t slot)
+{
+    return num_static_gates + slot;
+}
+
+static inline uint64_t
+dgate_hash(uint64_t *u)
+{
+    return sylvan_fnvhash16(u[0], u[1], sylvan_fnvhash16(u[2], u[3], 14695981039346656037LLU));
+}
 
-// store complex values of dynamic gate to re-initialize gate after gc
-complex_t dynamic_gate[4];
+static void
+dgates_alloc_gates_table()
+{
+    size_t n = num_static_gates + max_dynamic_gates;
+    gates = realloc(gates, n * sizeof(uint64_t[4]));
+    if (gates == NULL) {
+        fprintf(stderr, "qmdd_gates: Unable to allocate memory for %zu gates\n", n);
+        exit(1);
+    }
+}
+
+void
+qmdd_dynamic_gates_reset()
+{
+    if (dgates == NULL) {
+        dgates = malloc(max_dynamic_gates * sizeof(dynamic_gate_t));
+        uint32_t n_buckets = 1;
+        while (n_buckets < max_dynamic_gates) n_buckets <<= 1;
+        dgates_mask = n_buckets - 1;
+        dgates_buckets = malloc(n_buckets * sizeof(uint32_t));
+        if (dgates == NULL || dgates_buckets == NULL) {
+            fprintf(stderr, "qmdd_gates: Unable to allocate memory for %u dynamic gates\n", max_dynamic_gates);
+            exit(1);
+        }
+        dgates_alloc_gates_table();
+    }
+    for (uint32_t b = 0; b <= dgates_mask; b++) dgates_buckets[b] = DGATE_NONE;
+    for (uint32_t i = 0; i < max_dynamic_gates; i++) {
+        dgates[i].in_use = false;
+        dgates[i].recycled = false;
+        dgates[i].lru_next = (i+1 < max_dynamic_gates) ? i+1 : DGATE_NONE;
+    }
+    free_head = 0;
+    lru_head = lru_tail = DGATE_NONE;
+    dgates_used = 0;
+}
+
+void
+qmdd_set_max_dynamic_gates(uint32_t max)
+{
+    if (max == 0 || (uint64_t)max > max_gate_ids - num_static_gates) {
+        fprintf(stderr, "qmdd_set_max_dynamic_gates: number of dynamic gates must be in [1, %" PRIu64 "]\n", 
+                max_gate_ids - num_static_gates);
+        exit(1);
+    }
+    if (dgates != NULL) {
+        // gate IDs of currently registered gates become invalid
+        free(dgates);
+        free(dgates_buckets);
+        dgates = NULL;
+        dgates_buckets = NULL;
+        cache_clear_opclass(CACHE_OPCLASS_QMDD);
+    }
+    max_dynamic_gates = max;
+    if (gates != NULL) qmdd_dynamic_gates_reset();
+}
 
 uint32_t
-GATEID_Rz(fl_t theta)
+qmdd_get_max_dynamic_gates()
+{
+    return max_dynamic_gates;
+}
+
+static void
+lru_unlink(uint32_t slot)
+{
+    dynamic_gate_t *g = &dgates[slot];
+    if (g->lru_prev != DGATE_NONE) dgates[g->lru_prev].lru_next = g->lru_next;
+    else lru_head = g->lru_next;
+    if (g->lru_next != DGATE_NONE) dgates[g->lru_next].lru_prev = g->lru_prev;
+    else lru_tail = g->lru_prev;
+}
+
+static void
+lru_push_front(uint32_t slot)
+{
+    dgates[slot].lru_prev = DGATE_NONE;
+    dgates[slot].lru_next = lru_head;
+    if (lru_head != DGATE_NONE) dgates[lru_head].lru_prev = slot;
+    lru_head = slot;
+    if (lru_tail == DGATE_NONE) lru_tail = slot;
+}
+
+static void
+hash_insert(uint32_t slot)
 {
-    // clear cache to invalidate cached results for GATEID_dynamic
-    sylvan_clear_cache();
+    uint32_t b = dgate_hash(gates[dgate_id(slot)]) & dgates_mask;
+    dgates[slot].hash_next = dgates_buckets[b];
+    dgates_buckets[b] = slot;
+}
 
-    // initialize (and store for gc)
-    dynamic_gate[0] = cmake_angle(-theta/2.0, 1);
-    dynamic_gate[1] = czero();
-    dynamic_gate[2] = czero();
-    dynamic_gate[3] = cmake_angle(theta/2.0, 1);
-    gates[GATEID_dynamic][0] = weight_lookup(&dynamic_gate[0]); // u00
-    gates[GATEID_dynamic][1] = weight_lookup(&dynamic_gate[1]); // u01
-    gates[GATEID_dynamic][2] = weight_lookup(&dynamic_gate[2]); // u10
-    gates[GATEID_dynamic][3] = weight_lookup(&dynamic_gate[3]); // u11
+static void
+hash_remove(uint32_t slot)
+{
+    uint32_t *p = &dgates_buckets[dgate_hash(gates[dgate_id(slot)]) & dgates_mask];
+    while (*p != slot) p = &dgates[*p].hash_next;
+    *p = dgates[slot].hash_next;
+}
 
-    // return (temporary) gate_id for this gate
-    return GATEID_dynamic;
+static int
+recycled_gate_filter(uint64_t a, uint64_t b, uint64_t c, void *ctx)
+{
+    // Cached QMDD gate applications have the gate ID in the lower 24 bits of
+    // the third key (see GATE_OPID_64 in qsylvan_simulator.c)
+    (void)b;
+    (void)ctx;
+    uint64_t opid = a & 0xffffff0000000000;
+    if (opid != CACHE_QMDD_GATE && opid != CACHE_QMDD_CGATE && 
+        opid != CACHE_QMDD_CGATE_RANGE && opid != CACHE_QMDD_CGATE_PAIR) return 0;
+    uint64_t gateid = c & 0xffffff;
+    if (gateid < num_static_gates || gateid >= num_static_gates + max_dynamic_gates) return 0;
+    return dgates[gateid - num_static_gates].recycled;
 }
 
+/**
+ * Move the least recently used slots to the free list, and remove the cached
+ * results of their gate IDs.
+ */
+static void
+recycle_lru_slots()
+{
+    uint32_t batch = max_dynamic_gates / 16;
+    if (batch == 0) batch = 1;
+    for (uint32_t k = 0; k < batch && lru_tail != DGATE_NONE; k++) {
+        uint32_t slot = lru_tail;
+        lru_unlink(slot);
+        hash_remove(slot);
+        dgates[slot].in_use = false;
+        dgates[slot].recycled = true;
+        dgates[slot].lru_next = free_head;
+        free_head = slot;
+        dgates_used--;
+    }
+    cache_clear_filter(recycled_gate_filter, NULL);
+    for (uint32_t slot = free_head; slot != DGATE_NONE; slot = dgates[slot].lru_next) {
+        dgates[slot].recycled = false;
+    }
+}
+
+/**
+ * Return the gate ID for the 2x2 gate with the given values, either an
+ * existing one if an equal gate is registered or a new (recycled) one.
+ */
+static uint32_t
+dynamic_gate_lookup(complex_t *values)
+{
+    if (dgates == NULL) qmdd_dynamic_gates_reset();
+
+    for (int i = 0; i < 4; i++) {
+        if (!weight_representable(&values[i])) {
+            fprintf(stderr, "qmdd_gates: gate has entries which cannot be represented by the edge weight type\n");
+            exit(1);
+        }
+    }
+
+    uint64_t u[4];
+    for (int i = 0; i < 4; i++) u[i] = weight_lookup_complex(&values[i]);
+
+    // existing gate (moved to front of LRU list)
+    uint32_t b = dgate_hash(u) & dgates_mask;
+    for (uint32_t slot = dgates_buckets[b]; slot != DGATE_NONE; slot = dgates[slot].hash_next) {
+        uint64_t *g = gates[dgate_id(slot)];
+        if (g[0] == u[0] && g[1] == u[1] && g[2] == u[2] && g[3] == u[3]) {
+            if (slot != lru_head) {
+                lru_unlink(slot);
+                lru_push_front(slot);
+            }
+            return dgate_id(slot);
+        }
+    }
+
+    // new gate
+    if (free_head == DGATE_NONE) recycle_lru_slots();
+    uint32_t slot = free_head;
+    free_head = dgates[slot].lru_next;
+    dgates_used++;
+
+    dgates[slot].in_use = true;
+    for (int i = 0; i < 4; i++) {
+        dgates[slot].values[i] = values[i];
+        gates[dgate_id(slot)][i] = u[i];
+    }
+    hash_insert(slot);
+    lru_push_front(slot);
+    return dgate_id(slot);
+}
+
+/**
+ * Re-initialize all registered dynamic gates after the edge weight table has
+ * been rebuilt (the weight indices, and thus the hash buckets, change).
+ */
+static void
+dynamic_gates_reinit()
+{
+    if (dgates == NULL) return;
+    for (uint32_t b = 0; b <= dgates_mask; b++) dgates_buckets[b] = DGATE_NONE;
+    for (uint32_t slot = lru_head; slot != DGATE_NONE; slot = dgates[slot].lru_next) {
+        for (int i = 0; i < 4; i++) {
+            gates[dgate_id(slot)][i] = weight_lookup_complex(&dgates[slot].values[i]);
+        }
+        hash_insert(slot);
+    }
+}
+
+uint32_t
+GATEID_Rz(fl_t theta)
+{
+    complex_t u[4];
+    u[0] = cmake_angle(-theta/2.0, 1);
+    u[1] = czero();
+    u[2] = czero();
+    u[3] = cmake_angle(theta/2.0, 1);
+    return dynamic_gate_lookup(u);
+}
 
 uint32_t
 GATEID_Rx(fl_t theta)
 {
-    // clear cache to invalidate cached results for GATEID_dynamic
-    sylvan_clear_cache();
+    complex_t u[4];
+    u[0] = cmake(flt_cos(theta/2.0), 0.0);
+    u[1] = cmake(0.0, -flt_sin(theta/2.0));
+    u[2] = cmake(0.0, -flt_sin(theta/2.0));
+    u[3] = cmake(flt_cos(theta/2.0), 0.0);
+    return dynamic_gate_lookup(u);
+}
 
-    // initialize (and store for gc)
-    dynamic_gate[0] = cmake(flt_cos(theta/2.0), 0.0);
-    dynamic_gate[1] = cmake(0.0, -flt_sin(theta/2.0));
-    dynamic_gate[2] = cmake(0.0, -flt_sin(theta/2.0));
-    dynamic_gate[3] = cmake(flt_cos(theta/2.0), 0.0);
-    gates[GATEID_dynamic][0] = weight_lookup(&dynamic_gate[0]); // u00
-    gates[GATEID_dynamic][1] = weight_lookup(&dynamic_gate[1]); // u01
-    gates[GATEID_dynamic][2] = weight_lookup(&dynamic_gate[2]); // u10
-    gates[GATEID_dynamic][3] = weight_lookup(&dynamic_gate[3]); // u11
+uint32_t
+GATEID_Ry(fl_t theta)
+{
+    complex_t u[4];
+    u[0] = cmake( flt_cos(theta/2.0), 0.0);
+    u[1] = cmake(-flt_sin(theta/2.0), 0.0);
+    u[2] = cmake( flt_sin(theta/2.0), 0.0);
+    u[3] = cmake( flt_cos(theta/2.0), 0.0);
+    return dynamic_gate_lookup(u);
+}
 
-    // return (temporary) gate_id for this gate
-    return GATEID_dynamic;
+uint32_t
+GATEID_Phase(fl_t theta)
+{
+    complex_t u[4];
+    u[0] = cmake(1.0, 0.0);
+    u[1] = cmake(0.0, 0.0);
+    u[2] = cmake(0.0, 0.0);
+    u[3] = cmake_angle(theta, 1);
+    return dynamic_gate_lookup(u);
 }
 
 uint32_t
-GATEID_Ry(fl_t theta)
+GATEID_U(fl_t theta, fl_t phi, fl_t lambda)
 {
-    // clear cache to invalidate cached results for GATEID_dynamic
-    sylvan_clear_cache();
+    complex_t u[4];
+    u[0] = cmake(flt_cos(theta/2.0), 0.0);
+    u[1] = cmul(cmake_angle(lambda,1), cmake(-flt_sin(theta/2.0), 0));
+    u[2] = cmul(cmake_angle(phi,1), cmake(flt_sin(theta/2.0), 0));
+    u[3] = cmul(cmake_angle(phi+lambda,1), cmake(flt_cos(theta/2.0), 0));
+    return dynamic_gate_lookup(u);
+}
+
+/********************* </dynamic custom rotation gates> ***********************/
+
+
+/***************************** <two-qubit gates> ******************************/
 
-    // initialize (and store for gc)
-    dynamic_gate[0] = cmake( flt_cos(theta/2.0), 0.0);
-    dynamic_gate[1] = cmake(-flt_sin(theta/2.0), 0.0);
-    dynamic_gate[2] = cmake( flt_sin(theta/2.0), 0.0);
-    dynamic_gate[3] = cmake( flt_cos(theta/2.0), 0.0);
-    gates[GATEID_dynamic][0] = weight_lookup(&dynamic_gate[0]); // u00
-    gates[GATEID_dynamic][1] = weight_lookup(&dynamic_gate[1]); // u01
-    gates[GATEID_dynamic][2] = weight_lookup(&dynamic_gate[2]); // u10
-    gates[GATEID_dynamic][3] = weight_lookup(&dynamic_gate[3]); // u11
+/**
+ * Registry of two-qubit gates. Like the parameterized gates above, they are
+ * looked up by the edge weight indices of their entries. Two-qubit gates are
+ * created far less often, so when the registry is full all of them are
+ * forgotten at once (together with their cached results), rather than in LRU
+ * order.
+ */
+uint64_t (*gates2)[16] = NULL;
 
-    // return (temporary) gate_id for this gate
-    return GATEID_dynamic;
+typedef struct gate2_s {
+    complex_t values[16]; // complex values to re-initialize gate after gc
+    uint32_t hash_next;   // next gate in the same hash bucket
+} gate2_t;
+
+static const uint32_t max_gates2 = 1<<10; // (power of 2)
+static uint32_t gates2_used = 0;
+static gate2_t *gates2_values = NULL;
+static uint32_t *gates2_buckets = NULL; // max_gates2 buckets
+
+static inline uint64_t
+gate2_hash(uint64_t *u)
+{
+    uint64_t h = 14695981039346656037LLU;
+    for (int i = 0; i < 16; i += 2) h = sylvan_fnvhash16(u[i], u[i+1], h);
+    return h;
+}
+
+static void
+gate2_hash_insert(uint32_t k)
+{
+    uint32_t b = gate2_hash(gates2[k]) & (max_gates2 - 1);
+    gates2_values[k].hash_next = gates2_buckets[b];
+    gates2_buckets[b] = k;
+}
+
+void
+qmdd_gates2_reset()
+{
+    if (gates2 == NULL) {
+        gates2 = malloc(max_gates2 * sizeof(uint64_t[16]));
+        gates2_values = malloc(max_gates2 * sizeof(gate2_t));
+        gates2_buckets = malloc(max_gates2 * sizeof(uint32_t));
+        if (gates2 == NULL || gates2_values == NULL || gates2_buckets == NULL) {
+            fprintf(stderr, "qmdd_gates: Unable to allocate memory for %u two-qubit gates\n", max_gates2);
+            exit(1);
+        }
+    }
+    for (uint32_t b = 0; b < max_gates2; b++) gates2_buckets[b] = DGATE_NONE;
+    gates2_used = 0;
 }
 
 uint32_t
-GATEID_Phase(fl_t theta)
+qmdd_get_max_gates2()
 {
-    // clear cache to invalidate cached results for GATEID_dynamic
-    sylvan_clear_cache();
-    
-    // initialize (and store for gc)
-    dynamic_gate[0] = cmake(1.0, 0.0);
-    dynamic_gate[1] = cmake(0.0, 0.0);
-    dynamic_gate[2] = cmake(0.0, 0.0);
-    dynamic_gate[3] = cmake_angle(theta, 1);
-    gates[GATEID_dynamic][0] = weight_lookup(&dynamic_gate[0]); // u00
-    gates[GATEID_dynamic][1] = weight_lookup(&dynamic_gate[1]); // u01
-    gates[GATEID_dynamic][2] = weight_lookup(&dynamic_gate[2]); // u10
-    gates[GATEID_dynamic][3] = weight_lookup(&dynamic_gate[3]); // u11
+    return max_gates2;
+}
 
-    // return (temporary) gate_id for this gate
-    return GATEID_dynamic;
+static int
+gate2_filter(uint64_t a, uint64_t b, uint64_t c, void *ctx)
+{
+    (void)b;
+    (void)c;
+    (void)ctx;
+    uint64_t opid = a & 0xffffff0000000000;
+    return opid == CACHE_QMDD_GATE2 || opid == CACHE_QMDD_GATE2_PAIR;
 }
 
 uint32_t
-GATEID_U(fl_t theta, fl_t phi, fl_t lambda)
+GATE2ID_custom(const complex_t *u)
 {
-    // clear cache to invalidate cached results for GATEID_dynamic
-    sylvan_clear_cache();
+    if (gates2 == NULL) qmdd_gates2_reset();
+
+    complex_t values[16];
+    for (int i = 0; i < 16; i++) {
+        values[i] = u[i];
+        if (!weight_representable(&values[i])) {
+            fprintf(stderr, "qmdd_gates: gate has entries which cannot be represented by the edge weight type\n");
+            exit(1);
+        }
+    }
 
-    // initialize (and store for gc)
-    dynamic_gate[0] = cmake(flt_cos(theta/2.0), 0.0);
-    dynamic_gate[1] = cmul(cmake_angle(lambda,1), cmake(-flt_sin(theta/2.0), 0));
-    dynamic_gate[2] = cmul(cmake_angle(phi,1), cmake(flt_sin(theta/2.0), 0));
-    dynamic_gate[3] = cmul(cmake_angle(phi+lambda,1), cmake(flt_cos(theta/2.0), 0));
-    gates[GATEID_dynamic][0] = weight_lookup(&dynamic_gate[0]); // u00
-    gates[GATEID_dynamic][1] = weight_lookup(&dynamic_gate[1]); // u01
-    gates[GATEID_dynamic][2] = weight_lookup(&dynamic_gate[2]); // u10
-    gates[GATEID_dynamic][3] = weight_lookup(&dynamic_gate[3]); // u11
+    uint64_t w[16];
+    for (int i = 0; i < 16; i++) w[i] = weight_lookup_complex(&values[i]);
+
+    // existing gate
+    uint32_t b = gate2_hash(w) & (max_gates2 - 1);
+    for (uint32_t k = gates2_buckets[b]; k != DGATE_NONE; k = gates2_values[k].hash_next) {
+        if (memcmp(gates2[k], w, sizeof(w)) == 0) return k;
+    }
 
-    // return (temporary) gate_id for this gate
-    return GATEID_dynamic;
+    // new gate (forget all gates if the registry is full)
+    if (gates2_used == max_gates2) {
+        cache_clear_filter(gate2_filter, NULL);
+        qmdd_gates2_reset();
+    }
+    uint32_t k = gates2_used++;
+    memcpy(gates2_values[k].values, values, sizeof(values));
+    memcpy(gates2[k], w, sizeof(w));
+    gate2_hash_insert(k);
+    return k;
 }
 
-/********************* </dynamic custom rotation gates> ***********************/
+/**
+ * Re-initialize all registered two-qubit gates after the edge weight table has
+ * been rebuilt.
+ */
+static void
+gates2_reinit()
+{
+    if (gates2 == NULL) return;
+    for (uint32_t b = 0; b < max_gates2; b++) gates2_buckets[b] = DGATE_NONE;
+    for (uint32_t k = 0; k < gates2_used; k++) {
+        for (int i = 0; i < 16; i++) {
+            gates2[k][i] = weight_lookup_complex(&gates2_values[k].values[i]);
+        }
+        gate2_hash_insert(k);
+    }
+}
+
+uint32_t
+GATE2ID_swap()
+{
+    complex_t u[16];
+    for (int i = 0; i < 16; i++) u[i] = czero();
+    u[4*0 + 0] = cmake(1.0, 0.0);
+    u[4*1 + 2] = cmake(1.0, 0.0);
+    u[4*2 + 1] = cmake(1.0, 0.0);
+    u[4*3 + 3] = cmake(1.0, 0.0);
+    return GATE2ID_custom(u);
+}
+
+uint32_t
+GATE2ID_Rxx(fl_t theta)
+{
+    complex_t u[16];
+    for (int i = 0; i < 16; i++) u[i] = czero();
+    for (int r = 0; r < 4; r++) {
+        u[4*r + r]     = cmake(flt_cos(theta/2.0), 0.0);
+        u[4*r + (3-r)] = cmake(0.0, -flt_sin(theta/2.0));
+    }
+    return GATE2ID_custom(u);
+}
+
+/***************************** </two-qubit gates> *****************************/
 
 
 /*************************** <dynamic custom gates> ***************************/
+/**
+ * Lookup of an entry of static gate k. Entries which cannot be represented by
+ * the edge weight type (e.g. complex values with WGT_DOUBLE) mark gate k as 
+ * unsupported, rather than failing on initialization.
+ */
+static EVBDD_WGT
+gate_lookup(uint32_t k, fl_t r, fl_t i)
+{
+    complex_t c = cmake(r, i);
+    if (!weight_representable(&c)) {
+        static_gate_supported[k] = false;
+        return EVBDD_ZERO;
+    }
+    return weight_lookup_complex(&c);
+}
+
+bool
+qmdd_gate_supported(uint32_t gateid)
+{
+    if (gateid < num_static_gates) return static_gate_supported[gateid];
+    return true; // dynamic gates are checked when they are created
+}
+
 void
 qmdd_gates_init()
 {
     Pi = 2.0 * flt_acos(0.0);
 
+    // The entries of the static gates are pinned edge weights, so after edge
+    // weight gc they still have the same index, and only the dynamic gates 
+    // need to be re-initialized
+    if (gates != NULL && wgt_table_gc_entries_pinned()) {
+        dynamic_gates_reinit();
+        gates2_reinit();
+        return;
+    }
+
+    if (gates == NULL) dgates_alloc_gates_table();
+    for (uint64_t k = 0; k < num_static_gates; k++) static_gate_supported[k] = true;
+
     // initialize 2x2 gates (complex values from gates currently stored in 
     // same table as complex amplitude values)
     uint32_t k;
@@ -144,58 +528,55 @@ qmdd_gates_init()
     gates[k][2] = EVBDD_ONE;  gates[k][3] = EVBDD_ZERO;
 
     k = GATEID_Y;
-    gates[k][0] = EVBDD_ZERO; gates[k][1] = complex_lookup(0.0, -1.0);
-    gates[k][2] = complex_lookup(0.0, 1.0);  gates[k][3] = EVBDD_ZERO;
+    gates[k][0] = EVBDD_ZERO; gates[k][1] = gate_lookup(k, 0.0, -1.0);
+    gates[k][2] = gate_lookup(k, 0.0, 1.0);  gates[k][3] = EVBDD_ZERO;
 
     k = GATEID_Z;
     gates[k][0] = EVBDD_ONE;  gates[k][1] = EVBDD_ZERO;
     gates[k][2] = EVBDD_ZERO; gates[k][3] = EVBDD_MIN_ONE;
 
     k = GATEID_H;
-    gates[k][0] = gates[k][1] = gates[k][2] = complex_lookup(1.0/flt_sqrt(2.0),0);
-    gates[k][3] = complex_lookup(-1.0/flt_sqrt(2.0),0);
+    gates[k][0] = gates[k][1] = gates[k][2] = gate_lookup(k, 1.0/flt_sqrt(2.0),0);
+    gates[k][3] = gate_lookup(k, -1.0/flt_sqrt(2.0),0);
 
     k = GATEID_S;
     gates[k][0] = EVBDD_ONE;  gates[k][1] = EVBDD_ZERO;
-    gates[k][2] = EVBDD_ZERO; gates[k][3] = complex_lookup(0.0, 1.0);
+    gates[k][2] = EVBDD_ZERO; gates[k][3] = gate_lookup(k, 0.0, 1.0);
 
     k = GATEID_Sdag;
     gates[k][0] = EVBDD_ONE;  gates[k][1] = EVBDD_ZERO;
-    gates[k][2] = EVBDD_ZERO; gates[k][3] = complex_lookup(0.0, -1.0);
+    gates[k][2] = EVBDD_ZERO; gates[k][3] = gate_lookup(k, 0.0, -1.0);
 
     k = GATEID_T;
     gates[k][0] = EVBDD_ONE;  gates[k][1] = EVBDD_ZERO;
-    gates[k][2] = EVBDD_ZERO; gates[k][3] = complex_lookup(1.0/flt_sqrt(2.0), 1.0/flt_sqrt(2.0));
+    gates[k][2] = EVBDD_ZERO; gates[k][3] = gate_lookup(k, 1.0/flt_sqrt(2.0), 1.0/flt_sqrt(2.0));
 
     k = GATEID_Tdag;
     gates[k][0] = EVBDD_ONE;  gates[k][1] = EVBDD_ZERO;
-    gates[k][2] = EVBDD_ZERO; gates[k][3] = complex_lookup(1.0/flt_sqrt(2.0), -1.0/flt_sqrt(2.0));
+    gates[k][2] = EVBDD_ZERO; gates[k][3] = gate_lookup(k, 1.0/flt_sqrt(2.0), -1.0/flt_sqrt(2.0));
 
     k = GATEID_sqrtX;
-    gates[k][0] = complex_lookup(0.5, 0.5); gates[k][1] = complex_lookup(0.5,-0.5);
-    gates[k][2] = complex_lookup(0.5,-0.5); gates[k][3] = complex_lookup(0.5, 0.5);
+    gates[k][0] = gate_lookup(k, 0.5, 0.5); gates[k][1] = gate_lookup(k, 0.5,-0.5);
+    gates[k][2] = gate_lookup(k, 0.5,-0.5); gates[k][3] = gate_lookup(k, 0.5, 0.5);
 
     k = GATEID_sqrtXdag;
-    gates[k][0] = complex_lookup(0.5,-0.5); gates[k][1] = complex_lookup(0.5, 0.5);
-    gates[k][2] = complex_lookup(0.5, 0.5); gates[k][3] = complex_lookup(0.5,-0.5);
+    gates[k][0] = gate_lookup(k, 0.5,-0.5); gates[k][1] = gate_lookup(k, 0.5, 0.5);
+    gates[k][2] = gate_lookup(k, 0.5, 0.5); gates[k][3] = gate_lookup(k, 0.5,-0.5);
 
     k = GATEID_sqrtY;
-    gates[k][0] = complex_lookup(0.5, 0.5); gates[k][1] = complex_lookup(-0.5,-0.5);
-    gates[k][2] = complex_lookup(0.5, 0.5); gates[k][3] = complex_lookup(0.5, 0.5);
+    gates[k][0] = gate_lookup(k, 0.5, 0.5); gates[k][1] = gate_lookup(k, -0.5,-0.5);
+    gates[k][2] = gate_lookup(k, 0.5, 0.5); gates[k][3] = gate_lookup(k, 0.5, 0.5);
 
     k = GATEID_sqrtYdag;
-    gates[k][0] = complex_lookup(0.5,-0.5); gates[k][1] = complex_lookup(0.5,-0.5);
-    gates[k][2] = complex_lookup(-0.5,0.5); gates[k][3] = complex_lookup(0.5,-0.5);
+    gates[k][0] = gate_lookup(k, 0.5,-0.5); gates[k][1] = gate_lookup(k, 0.5,-0.5);
+    gates[k][2] = gate_lookup(k, -0.5,0.5); gates[k][3] = gate_lookup(k, 0.5,-0.5);
 
     qmdd_phase_gates_init(255);
 
-    // init dynamic gate 
+    // re-init dynamic gates
     // (necessary when qmdd_gates_init() is called after gc to re-init all gates)
-    k = GATEID_dynamic;
-    gates[k][0] = weight_lookup(&dynamic_gate[0]);
-    gates[k][1] = weight_lookup(&dynamic_gate[1]);
-    gates[k][2] = weight_lookup(&dynamic_gate[2]);
-    gates[k][3] = weight_lookup(&dynamic_gate[3]);
+    dynamic_gates_reinit();
+    gates2_reinit();
 }
 
 void
@@ -212,13 +593,13 @@ qmdd_phase_gates_init(int n)
         cartesian = cmake_angle(angle, 1);
         gate_id = GATEID_Rk(k);
         gates[gate_id][0] = EVBDD_ONE;  gates[gate_id][1] = EVBDD_ZERO;
-        gates[gate_id][2] = EVBDD_ZERO; gates[gate_id][3] = weight_lookup(&cartesian);
+        gates[gate_id][2] = EVBDD_ZERO; gates[gate_id][3] = gate_lookup(gate_id, cartesian.r, cartesian.i);
 
         // backward rotation
         angle = -2*Pi / (fl_t)(1<<k);
         cartesian = cmake_angle(angle, 1);
         gate_id = GATEID_Rk_dag(k);
         gates[gate_id][0] = EVBDD_ONE;  gates[gate_id][1] = EVBDD_ZERO;
-        gates[gate_id][2] = EVBDD_ZERO; gates[gate_id][3] = weight_lookup(&cartesian);
+        gates[gate_id][2] = EVBDD_ZERO; gates[gate_id][3] = gate_lookup(gate_id, cartesian.r, cartesian.i);
     }
 }
@@ -1,6 +1,7 @@
 #ifndef SYLVAN_QMDD_GATES_H
 #define SYLVAN_QMDD_GATES_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <edge_weight_storage/flt.h>
 
@@ -24,73 +25,133 @@ typedef enum predef_gates {
     GATEID_sqrtXdag,
     GATEID_sqrtY,
     GATEID_sqrtYdag,
-    GATEID_dynamic, // used for Rz,Ry,Rz,Phase,U gates
     n_predef_gates
 } gate_id_t;
 
 static const uint64_t num_static_gates  = n_predef_gates+256+256; // predef gates + phase gates
 
+// gate IDs >= num_static_gates are parameterized gates (see GATEID_Rx etc.)
+static const uint64_t max_gate_ids      = 1LL<<24; // 24 bits (see GATE_OPID)
+
 // 2x2 gates, k := GATEID_U 
 // gates[k][0] = u00 (top left)
 // gates[k][1] = u01 (top right)
 // gates[k][2] = u10 (bottom left)
 // gates[k][3] = u11 (bottom right)
-extern uint64_t gates[n_predef_gates+256+256][4]; // max 2^24 gates atm
+extern uint64_t (*gates)[4]; // num_static_gates + qmdd_get_max_dynamic_gates()
 
 void qmdd_gates_init();
 // The next 255 gates are reserved for parameterized phase gates.
 // The reason why these are initialized beforhand instead of on-demand is that 
 // we would like a (for example) pi/16 gate to always have the same unique ID 
 // throughout the entire run of the circuit.
-// TODO: maybe just use GATEID_dynamic for this
 
 void qmdd_phase_gates_init(int n);
 
+/**
+ * Returns false iff the gate has entries which cannot be represented by the
+ * edge weight type: complex entries with real edge weights (WGT_DOUBLE), or 
+ * non Clifford+T entries with exact edge weights (WGT_RATIONAL_128). Creating
+ * a parameterized gate with such entries (e.g. Rz(theta)) is an error.
+ */
+bool qmdd_gate_supported(uint32_t gateid);
+
 static inline uint32_t GATEID_Rk(int k) { return k + n_predef_gates; };
 
 // Another 255 parameterized phase gates, but this time with negative angles.
 static inline uint32_t GATEID_Rk_dag(int k){ return k + (n_predef_gates+256); };
 
-// Reserve 'num_dynamic_gates' gate IDs (comibned) for of the following: 
-// Rx, Ry, Rz. These gate IDs are re-used when a user requires more than 
-// 'num_dynamic_gates' custom gates.
+// Parameterized gates (Rx, Ry, Rz, Phase, U) are interned by value: creating
+// a gate whose matrix equals (up to the edge weight tolerance) that of a gate
+// which is still registered returns the same gate ID, so cached results for
+// that gate ID remain usable. When all dynamic gate IDs are in use, the least
+// recently requested ones are recycled, and only the cached results for those
+// gate IDs are removed from the operation cache.
+
+/**
+ * Set the number of gate IDs reserved for parameterized gates. At most 
+ * max_gate_ids - num_static_gates. Changing this forgets all currently 
+ * registered parameterized gates.
+ */
+void qmdd_set_max_dynamic_gates(uint32_t max);
+
+uint32_t qmdd_get_max_dynamic_gates();
+
+/**
+ * Forget all registered parameterized gates. Called when the simulator is 
+ * (re-)initialized.
+ */
+void qmdd_dynamic_gates_reset();
 
 /**
  * Rotation around x-axis with angle theta.
- * NOTE: This GATEID is re-used for parametrized gates. The returned ID only
- * corresponds to the Rx(theta) gate until the next parametrized gate is created.
+ * NOTE: The returned ID corresponds to the Rx(theta) gate until it is recycled,
+ * which only happens after more than qmdd_get_max_dynamic_gates() other
+ * parameterized gates have been created.
  */
 uint32_t GATEID_Rx(fl_t theta);
 
 /**
  * Rotation around y-axis with angle theta.
- * NOTE: This GATEID is re-used for parametrized gates. The returned ID only
- * corresponds to the Ry(theta) gate until the next parametrized gate is created.
- * a custom gate id.
+ * NOTE: The returned ID corresponds to the Ry(theta) gate until it is recycled.
  */
 uint32_t GATEID_Ry(fl_t theta);
 
 /**
  * Rotation around z-axis with angle theta.
- * NOTE: This GATEID is re-used for parametrized gates. The returned ID only
- * corresponds to the Rz(theta) gate until the next parametrized gate is created.
+ * NOTE: The returned ID corresponds to the Rz(theta) gate until it is recycled.
  */
-
 uint32_t GATEID_Rz(fl_t theta);
+
 /**
  * Rotation around z-axis with angle theta (but different global phase than Rz)
- * NOTE: This GATEID is re-used for parametrized gates. The returned ID only
- * corresponds to the P(theta) gate until the next parametrized gate is created.
+ * NOTE: The returned ID corresponds to the P(theta) gate until it is recycled.
  */
-
 uint32_t GATEID_Phase(fl_t theta);
 
 /**
  * Generic single-qubit rotation gate with 3 Euler angles.
- * NOTE: This GATEID is re-used for parametrized gates. The returned ID only
- * corresponds to the U(theta,phi,lambda) gate until the next parametrized gate 
- * is created.
+ * NOTE: The returned ID corresponds to the U(theta,phi,lambda) gate until it 
+ * is recycled.
  */
 uint32_t GATEID_U(fl_t theta, fl_t phi, fl_t lambda);
 
+
+// Two-qubit gates are registered by value as well, in a registry of their own
+// (see qmdd_gate2()). Their IDs are not gate_id_t IDs.
+
+// 4x4 gates, k := GATE2ID
+// gates2[k][4*r + c] = entry in row r and column c, where r (and c) is
+// 2*q1 + q2 for the two qubits (q1, q2) to which the gate is applied
+extern uint64_t (*gates2)[16]; // qmdd_get_max_gates2()
+
+uint32_t qmdd_get_max_gates2();
+
+/**
+ * Forget all registered two-qubit gates. Called when the simulator is 
+ * (re-)initialized.
+ */
+void qmdd_gates2_reset();
+
+/**
+ * Two-qubit gate with the given 4x4 matrix, as 16 entries in row major order.
+ * NOTE: The returned ID corresponds to this gate until it is recycled, which
+ * only happens after more than qmdd_get_max_gates2() other two-qubit gates
+ * have been created. Recycling forgets all registered two-qubit gates.
+ */
+uint32_t GATE2ID_custom(const complex_t *u);
+
+/**
+ * SWAP gate.
+ * NOTE: The returned ID corresponds to the SWAP gate until it is recycled.
+ */
+uint32_t GATE2ID_swap();
+
+/**
+ * Ising XX coupling gate exp(-i theta/2 X(x)X).
+ * NOTE: The returned ID corresponds to the Rxx(theta) gate until it is 
+ * recycled.
+ */
+uint32_t GATE2ID_Rxx(fl_t theta);
+
 #endif
@@ -19,39 +19,183 @@
 #include <inttypes.h>
 
 static bool testing_mode = 0; // turns on/off (expensive) sanity checks
-static int granularity = 1; // operation cache access granularity
 
 
 /***************<Helper functions for chaching QMDD operations>****************/
 
-// Pack 2 BDDVARs (assumed max 8 bits each)
+// Pack 2 BDDVARs (assumed max 16 bits each)
 static inline uint32_t
-QMDD_PARAM_PACK_16(BDDVAR a, BDDVAR b) 
+QMDD_PARAM_PACK_32(BDDVAR a, BDDVAR b) 
 {
-    return b<<8 | a;
+    return b<<16 | a;
 }
 
-//Pack 24 bit gateid, 2 possible qubit parameters (e.g. control/target)
+// Pack 8 bit x w/ 2 qubit parameters (max 16 bits each), for the first key of
+// a cache entry, which has 40 bits
 static inline uint64_t
-GATE_OPID_40(uint32_t gateid, BDDVAR a, BDDVAR b)
+QMDD_PARAM_PACK_40(uint8_t x, BDDVAR a, BDDVAR b)
 {
-    uint64_t res = ((uint64_t)b)<<32 | ((uint64_t)a)<<24 | gateid;
+    uint64_t res = ((uint64_t)x)<<32 | ((uint64_t)b)<<16 | a;
     return res;
 }
 
-// Pack 24 bit gateid w/ 5 possible qubit parameters (e.g. target/control/range)
+// Pack 24 bit gateid w/ 2 qubit parameters (e.g. control/target, max 16 bits 
+// each) and 8 bit x
 static inline uint64_t
-GATE_OPID_64(uint32_t gateid, BDDVAR a, BDDVAR b, BDDVAR c, BDDVAR d, BDDVAR e)
+GATE_OPID_64(uint32_t gateid, BDDVAR a, BDDVAR b, uint8_t x)
 {
-    uint64_t res = ((uint64_t)e)<<56 | 
-                   ((uint64_t)d)<<48 | 
-                   ((uint64_t)c)<<40 | 
-                   ((uint64_t)b)<<32 | 
+    uint64_t res = ((uint64_t)x)<<56 | 
+                   ((uint64_t)b)<<40 | 
                    ((uint64_t)a)<<24 | 
                    gateid;
     return res;
 }
 
+/**
+ * Registry of the control lists of qmdd_cgate_rec(), so that its cache entries
+ * (and those of qmdd_cgate_pair_rec()) can be keyed on an exact ID of the remaining controls cs[ci], cs[ci+1], ...
+ * Every such "tail" is interned as (first control, ID of the tail after it),
+ * with ID 0 for the empty tail, and the lists themselves are stored in a pool
+ * together with the ID of the tail at each position. As for the two-qubit
+ * gates, when the pool is full all lists are forgotten at once (together with
+ * their cached results).
+ */
+#define CTRL_TAIL_NONE UINT32_MAX
+
+typedef struct ctrl_tail_s {
+    BDDVAR ctrl;        // first control (possibly marked with QMDD_CTRL_NEG)
+    uint32_t next;      // ID of the tail after it
+    uint32_t pos;       // position of this tail in ctrl_pool (or CTRL_TAIL_NONE)
+    uint32_t hash_next; // next tail in the same hash bucket
+} ctrl_tail_t;
+
+static uint32_t max_ctrl_lists = 1<<16; // entries of ctrl_pool (IDs fit in 16 bits)
+static uint32_t ctrl_buckets_mask = 0;  // num buckets - 1
+static ctrl_tail_t *ctrl_tails = NULL;  // at most max_ctrl_lists + 1 tails
+static uint32_t *ctrl_buckets = NULL;
+static uint32_t ctrl_tails_used = 0;
+static BDDVAR *ctrl_pool = NULL;
+static uint16_t *ctrl_pool_ids = NULL;  // ID of the tail at each position
+static uint32_t ctrl_pool_used = 0;
+
+void
+qmdd_ctrl_lists_reset()
+{
+    if (ctrl_tails == NULL) {
+        uint32_t n_buckets = 1;
+        while (n_buckets < max_ctrl_lists) n_buckets <<= 1;
+        ctrl_buckets_mask = n_buckets - 1;
+        ctrl_tails = malloc((max_ctrl_lists + 1) * sizeof(ctrl_tail_t));
+        ctrl_buckets = malloc(n_buckets * sizeof(uint32_t));
+        ctrl_pool = malloc(max_ctrl_lists * sizeof(BDDVAR));
+        ctrl_pool_ids = malloc(max_ctrl_lists * sizeof(uint16_t));
+        if (ctrl_tails == NULL || ctrl_buckets == NULL || ctrl_pool == NULL || ctrl_pool_ids == NULL) {
+            fprintf(stderr, "qmdd_ctrl_lists: Unable to allocate memory for %u controls\n", max_ctrl_lists);
+            exit(1);
+        }
+    }
+    for (uint32_t b = 0; b <= ctrl_buckets_mask; b++) ctrl_buckets[b] = CTRL_TAIL_NONE;
+    ctrl_tails[0] = (ctrl_tail_t) {EVBDD_INVALID_VAR, 0, CTRL_TAIL_NONE, CTRL_TAIL_NONE};
+    ctrl_tails_used = 1;
+    ctrl_pool_used = 0;
+}
+
+static int
+ctrl_lists_filter(uint64_t a, uint64_t b, uint64_t c, void *ctx)
+{
+    (void)b;
+    (void)c;
+    (void)ctx;
+    uint64_t opid = a & 0xffffff0000000000;
+    return opid == CACHE_QMDD_CGATE || opid == CACHE_QMDD_CGATE_PAIR;
+}
+
+void
+qmdd_set_max_ctrl_lists(uint32_t max)
+{
+    if (max == 0 || max > (1<<16)) {
+        fprintf(stderr, "qmdd_set_max_ctrl_lists: number of controls must be in [1, %u]\n", 1<<16);
+        exit(1);
+    }
+    if (ctrl_tails != NULL) {
+        // IDs of currently registered control lists become invalid
+        free(ctrl_tails);
+        free(ctrl_buckets);
+        free(ctrl_pool);
+        free(ctrl_pool_ids);
+        ctrl_tails = NULL;
+        cache_clear_filter(ctrl_lists_filter, NULL);
+    }
+    max_ctrl_lists = max;
+    qmdd_ctrl_lists_reset();
+}
+
+uint32_t
+qmdd_get_max_ctrl_lists()
+{
+    return max_ctrl_lists;
+}
+
+static uint32_t
+ctrl_tail_find_or_put(BDDVAR ctrl, uint32_t next)
+{
+    uint32_t b = sylvan_fnvhash16(ctrl, next, 14695981039346656037LLU) & ctrl_buckets_mask;
+    for (uint32_t k = ctrl_buckets[b]; k != CTRL_TAIL_NONE; k = ctrl_tails[k].hash_next) {
+        if (ctrl_tails[k].ctrl == ctrl && ctrl_tails[k].next == next) return k;
+    }
+    uint32_t k = ctrl_tails_used++;
+    ctrl_tails[k] = (ctrl_tail_t) {ctrl, next, CTRL_TAIL_NONE, ctrl_buckets[b]};
+    ctrl_buckets[b] = k;
+    return k;
+}
+
+BDDVAR *
+qmdd_ctrl_list_intern(const BDDVAR *cs)
+{
+    if (ctrl_tails == NULL) qmdd_ctrl_lists_reset();
+    if (cs >= ctrl_pool && cs < ctrl_pool + ctrl_pool_used) return (BDDVAR *) cs;
+
+    uint32_t n = 0;
+    while (cs[n] != EVBDD_INVALID_VAR) n++;
+    if (n + 1 > max_ctrl_lists) {
+        fprintf(stderr, "qmdd_ctrl_lists: %u controls do not fit in the registry of %u\n", n, max_ctrl_lists);
+        exit(1);
+    }
+
+    // forget all lists if this one might not fit (the new tails of a list
+    // never outnumber the entries it takes in the pool)
+    if (ctrl_pool_used + n + 1 > max_ctrl_lists) {
+        cache_clear_filter(ctrl_lists_filter, NULL);
+        qmdd_ctrl_lists_reset();
+    }
+
+    uint32_t ids[n+1];
+    ids[n] = 0;
+    for (uint32_t k = n; k > 0; k--) ids[k-1] = ctrl_tail_find_or_put(cs[k-1], ids[k]);
+
+    // existing list (or tail of a longer one)
+    if (ctrl_tails[ids[0]].pos != CTRL_TAIL_NONE) return &ctrl_pool[ctrl_tails[ids[0]].pos];
+
+    // new list
+    uint32_t pos = ctrl_pool_used;
+    ctrl_pool_used += n + 1;
+    for (uint32_t k = 0; k <= n; k++) {
+        ctrl_pool[pos + k] = cs[k];
+        ctrl_pool_ids[pos + k] = (uint16_t) ids[k];
+        if (ctrl_tails[ids[k]].pos == CTRL_TAIL_NONE) ctrl_tails[ids[k]].pos = pos + k;
+    }
+    return &ctrl_pool[pos];
+}
+
+// ID (16 bits) of the controls cs[ci], cs[ci+1], ... of an interned list cs
+static inline uint32_t
+QMDD_CTRL_TAIL_ID(const BDDVAR *cs, uint32_t ci)
+{
+    assert(cs >= ctrl_pool && cs + ci < ctrl_pool + ctrl_pool_used &&
+           "controls must be interned with qmdd_ctrl_list_intern()");
+    return ctrl_pool_ids[(cs - ctrl_pool) + ci];
+}
+
 /**************</Helper functions for chaching QMDD operations>****************/
 
 
@@ -63,7 +207,16 @@ GATE_OPID_64(uint32_t gateid, BDDVAR a, BDDVAR b, BDDVAR c, BDDVAR d, BDDVAR e)
 void
 qsylvan_init_simulator(size_t min_tablesize, size_t max_tablesize, double wgt_tab_tolerance, int edge_weigth_backend, int norm_strat)
 {
-    sylvan_init_evbdd(min_tablesize, max_tablesize, wgt_tab_tolerance, edge_weigth_backend, norm_strat, &qmdd_gates_init);
+    qsylvan_init_simulator_wgt(min_tablesize, max_tablesize, wgt_tab_tolerance, WGT_COMPLEX_128, edge_weigth_backend, norm_strat);
+}
+
+void
+qsylvan_init_simulator_wgt(size_t min_tablesize, size_t max_tablesize, double wgt_tab_tolerance, int edge_weight_type, int edge_weigth_backend, int norm_strat)
+{
+    qmdd_dynamic_gates_reset();
+    qmdd_gates2_reset();
+    qmdd_ctrl_lists_reset();
+    sylvan_init_evbdd(min_tablesize, max_tablesize, wgt_tab_tolerance, edge_weight_type, edge_weigth_backend, norm_strat, &qmdd_gates_init);
 }
 
 void
@@ -109,12 +262,22 @@ qmdd_create_basis_state(BDDVAR n, bool* x)
     return prev;
 }
 
+static void
+qmdd_check_gate(gate_id_t gate)
+{
+    if (!qmdd_gate_supported(gate)) {
+        fprintf(stderr, "Gate %u has entries which cannot be represented by the edge weight type\n", gate);
+        exit(1);
+    }
+}
+
 QMDD
 qmdd_stack_matrix(QMDD below, BDDVAR k, gate_id_t gateid)
 {
     // This function effectively does a Kronecker product gate \tensor below
     BDDVAR s, t;
     QMDD u00, u01, u10, u11, low, high, res;
+    qmdd_check_gate(gateid);
 
     // Even + uneven variable are used to encode the 4 values
     s = 2*k;
@@ -320,6 +483,12 @@ qmdd_do_before_gate(QMDD* qmdd)
         evbdd_unprotect(qmdd);
     }
 
+    // grow the operation cache if it is too small
+    sylvan_cache_adapt();
+
+    // adjust the levels at which results are cached
+    evbdd_caching_autotune();
+
     if (periodic_gc_nodetable) {
         gate_counter++;
         if (gate_counter % periodic_gc_nodetable == 0) {
@@ -333,31 +502,31 @@ qmdd_do_before_gate(QMDD* qmdd)
     qmdd_stats_log(*qmdd);
 }
 
-static void swap(BDDVAR *a, BDDVAR *b)
+// Diagonal gates only rescale amplitudes, so they can be applied without any
+// additions (see QMDD_FAST_DIAGONAL_GATES)
+static inline bool
+gate_is_diagonal(gate_id_t gate)
 {
-    BDDVAR tmp = *a;
-    *a = *b;
-    *b = tmp;
+    return QMDD_FAST_DIAGONAL_GATES &&
+           gates[gate][1] == EVBDD_ZERO && gates[gate][2] == EVBDD_ZERO;
 }
 
-static bool
-check_ctrls_before_targ(BDDVAR *c1, BDDVAR *c2, BDDVAR *c3, BDDVAR t)
+static inline bool
+gate2_is_diagonal(uint32_t gate2)
 {
-    // sort controls
-    if (*c1 > *c3) swap(c1, c2);
-    if (*c1 > *c2) swap(c1, c2);
-    if (*c2 > *c3) swap(c2, c3);
-
-    // check if controls before target
-    if (*c1 != EVBDD_INVALID_VAR && *c1 > t) return false;
-    if (*c2 != EVBDD_INVALID_VAR && *c2 > t) return false;
-    if (*c3 != EVBDD_INVALID_VAR && *c3 > t) return false;
+    if (!QMDD_FAST_DIAGONAL_GATES) return false;
+    for (uint32_t r = 0; r < 4; r++) {
+        for (uint32_t c = 0; c < 4; c++) {
+            if (r != c && gates2[gate2][4*r + c] != EVBDD_ZERO) return false;
+        }
+    }
     return true;
 }
 
 /* Wrapper for applying a single qubit gate. */
 TASK_IMPL_3(QMDD, qmdd_gate, QMDD, qmdd, gate_id_t, gate, BDDVAR, target)
 {
+    qmdd_check_gate(gate);
     qmdd_do_before_gate(&qmdd);
     evbdd_refs_push(qmdd);
     QMDD res = qmdd_gate_rec(qmdd, gate, target);
@@ -368,18 +537,38 @@ TASK_IMPL_3(QMDD, qmdd_gate, QMDD, qmdd, gate_id_t, gate, BDDVAR, target)
 /* Wrapper for applying controlled gates with 1, 2, or 3 control qubits. */
 QMDD _qmdd_cgate(QMDD state, gate_id_t gate, BDDVAR c1, BDDVAR c2, BDDVAR c3, BDDVAR t, BDDVAR n)
 {
-    if (check_ctrls_before_targ(&c1, &c2, &c3, t)) {
-        BDDVAR cs[4] = {c1, c2, c3, EVBDD_INVALID_VAR}; // last pos is to mark end
-        return RUN(qmdd_cgate, state, gate, cs, t);//qmdd_cgate_rec(state, gate, cs, t);
+    BDDVAR cs[MAX_CONTROLS] = {c1, c2, c3};
+    uint32_t nc = 0;
+    for (uint32_t k = 0; k < MAX_CONTROLS; k++) {
+        if (cs[k] != EVBDD_INVALID_VAR) cs[nc++] = cs[k];
     }
-    else {
-        assert(n != 0 && "ERROR: when ctrls > targ, nqubits must be passed to cgate() function.");
-        QMDD gate_matrix = _qmdd_create_cgate(n, c1, c2, c3, t, gate);
-        return evbdd_matvec_mult(gate_matrix, state, n);
+    return _qmdd_mcgate(state, gate, cs, nc, t, n);
+}
+
+/* Wrapper for applying controlled gates with any number of controls. */
+QMDD _qmdd_mcgate(QMDD state, gate_id_t gate, const BDDVAR *cs, uint32_t nc, BDDVAR t, BDDVAR n)
+{
+    // sort controls (insertion sort on their qubit), last pos is to mark end
+    BDDVAR sorted[nc+1];
+    for (uint32_t k = 0; k < nc; k++) {
+        BDDVAR c = cs[k];
+        assert(QMDD_CTRL_VAR(c) != t && "ERROR: control and target qubit must differ.");
+        uint32_t j = k;
+        for (; j > 0 && QMDD_CTRL_VAR(sorted[j-1]) > QMDD_CTRL_VAR(c); j--) {
+            sorted[j] = sorted[j-1];
+        }
+        sorted[j] = c;
+    }
+    sorted[nc] = EVBDD_INVALID_VAR;
+    for (uint32_t k = 1; k < nc; k++) {
+        assert(QMDD_CTRL_VAR(sorted[k-1]) != QMDD_CTRL_VAR(sorted[k]) && "ERROR: duplicate control qubit.");
     }
+    (void) n; // no longer needed, any number of controls can come after t
+    return RUN(qmdd_cgate, state, gate, sorted, t);
 }
 TASK_IMPL_4(QMDD, qmdd_cgate, QMDD, state, gate_id_t, gate, BDDVAR*, cs, BDDVAR, t)
 {
+    qmdd_check_gate(gate);
     qmdd_do_before_gate(&state);
     evbdd_refs_push(state);
     QMDD res = qmdd_cgate_rec(state, gate, cs, t);
@@ -390,6 +579,7 @@ TASK_IMPL_4(QMDD, qmdd_cgate, QMDD, state, gate_id_t, gate, BDDVAR*, cs, BDDVAR,
 /* Wrapper for applying a controlled gate where the controls are a range. */
 TASK_IMPL_5(QMDD, qmdd_cgate_range, QMDD, qmdd, gate_id_t, gate, BDDVAR, c_first, BDDVAR, c_last, BDDVAR, t)
 {
+    qmdd_check_gate(gate);
     qmdd_do_before_gate(&qmdd);
     return qmdd_cgate_range_rec(qmdd,gate,c_first,c_last,t);
 }
@@ -405,10 +595,12 @@ TASK_IMPL_3(QMDD, qmdd_gate_rec, QMDD, q, gate_id_t, gate, BDDVAR, target)
     assert(var <= target);
 
     // Check cache
-    bool cachenow = ((var % granularity) == 0);
+    uint64_t sample;
+    bool cachenow = evbdd_cachenow(EVBDD_CACHE_OP_GATE, var, EVBDD_TARGET(q), &sample);
     if (cachenow) {
-        if (cache_get3(CACHE_QMDD_GATE, sylvan_false, EVBDD_TARGET(q), GATE_OPID_40(gate, target, 0), &res)) {
+        if (evbdd_cache_get3(CACHE_QMDD_GATE, sylvan_false, EVBDD_TARGET(q), GATE_OPID_64(gate, target, 0, 0), &res)) {
             sylvan_stats_count(QMDD_GATE_CACHED);
+            evbdd_cache_sample_hit(EVBDD_CACHE_OP_GATE, var, sample);
             // Multiply root of res with root of input qmdd
             AMP new_root_amp = wgt_mul(EVBDD_WEIGHT(q), EVBDD_WEIGHT(res));
             res = evbdd_bundle(EVBDD_TARGET(res), new_root_amp);
@@ -416,7 +608,13 @@ TASK_IMPL_3(QMDD, qmdd_gate_rec, QMDD, q, gate_id_t, gate, BDDVAR, target)
         }
     }
 
-    if (var == target) {
+    if (var == target && gate_is_diagonal(gate)) {
+        // only rescale the low and high edges
+        low  = evbdd_bundle(EVBDD_TARGET(low),  wgt_mul(EVBDD_WEIGHT(low),  gates[gate][0]));
+        high = evbdd_bundle(EVBDD_TARGET(high), wgt_mul(EVBDD_WEIGHT(high), gates[gate][3]));
+        res = evbdd_makenode(target, low, high);
+    }
+    else if (var == target) {
         AMP a_u00 = wgt_mul(EVBDD_WEIGHT(low), gates[gate][0]);
         AMP a_u10 = wgt_mul(EVBDD_WEIGHT(low), gates[gate][2]);
         AMP b_u01 = wgt_mul(EVBDD_WEIGHT(high), gates[gate][1]);
@@ -442,9 +640,10 @@ TASK_IMPL_3(QMDD, qmdd_gate_rec, QMDD, q, gate_id_t, gate, BDDVAR, target)
 
     // Store not yet "root normalized" result in cache
     if (cachenow) {
-        if (cache_put3(CACHE_QMDD_GATE, sylvan_false, EVBDD_TARGET(q), GATE_OPID_40(gate, target, 0), res)) 
+        if (evbdd_cache_put3(CACHE_QMDD_GATE, sylvan_false, EVBDD_TARGET(q), GATE_OPID_64(gate, target, 0, 0), res)) 
             sylvan_stats_count(QMDD_GATE_CACHEDPUT);
     }
+    evbdd_cache_sample_miss(EVBDD_CACHE_OP_GATE, var, sample);
     // Multiply amp res with amp of input qmdd
     AMP new_root_amp = wgt_mul(EVBDD_WEIGHT(q), EVBDD_WEIGHT(res));
     res = evbdd_bundle(EVBDD_TARGET(res), new_root_amp);
@@ -454,27 +653,29 @@ TASK_IMPL_3(QMDD, qmdd_gate_rec, QMDD, q, gate_id_t, gate, BDDVAR, target)
 TASK_IMPL_5(QMDD, qmdd_cgate_rec, QMDD, q, gate_id_t, gate, BDDVAR*, cs, uint32_t, ci, BDDVAR, t)
 {
     // Get current control qubit. If no more control qubits, apply gate here
-    BDDVAR c = cs[ci];
-    if (c == EVBDD_INVALID_VAR || ci > MAX_CONTROLS) {
+    if (cs[ci] == EVBDD_INVALID_VAR) {
         return CALL(qmdd_gate_rec, q, gate, t);
     }
+    BDDVAR c = QMDD_CTRL_VAR(cs[ci]);
 
-    assert(c < t && "ctrl < target required");
+    assert(c != t && "ctrl != target required");
     if (ci > 0) 
-        assert(cs[ci-1] < cs[ci]  && "order required for multiple controls");
+        assert(QMDD_CTRL_VAR(cs[ci-1]) < c && "order required for multiple controls");
 
     BDDVAR var;
     QMDD res, low, high;
-    evbdd_get_topvar(q, c, &var, &low, &high);
-    assert(var <= c);
+    BDDVAR next = (c < t) ? c : t;
+    evbdd_get_topvar(q, next, &var, &low, &high);
+    assert(var <= next);
 
     // Check cache
-    bool cachenow = ((var % granularity) == 0);
+    uint64_t sample;
+    bool cachenow = evbdd_cachenow(EVBDD_CACHE_OP_CGATE, var, EVBDD_TARGET(q), &sample);
+    uint64_t opid = GATE_OPID_64(gate, QMDD_CTRL_TAIL_ID(cs, ci), t, 0);
     if (cachenow) {
-        if (cache_get3(CACHE_QMDD_CGATE, sylvan_false, EVBDD_TARGET(q),
-                    GATE_OPID_64(gate, ci, cs[0], cs[1], cs[2], t),
-                    &res)) {
+        if (evbdd_cache_get3(CACHE_QMDD_CGATE, sylvan_false, EVBDD_TARGET(q), opid, &res)) {
             sylvan_stats_count(QMDD_CGATE_CACHED);
+            evbdd_cache_sample_hit(EVBDD_CACHE_OP_CGATE, var, sample);
             // Multiply root amp of res with input root amp
             AMP new_root_amp = wgt_mul(EVBDD_WEIGHT(q), EVBDD_WEIGHT(res));
             res = evbdd_bundle(EVBDD_TARGET(res), new_root_amp);
@@ -482,10 +683,23 @@ TASK_IMPL_5(QMDD, qmdd_cgate_rec, QMDD, q, gate_id_t, gate, BDDVAR*, cs, uint32_
         }
     }
 
+    // If current node is the target and the remaining controls come after it,
+    // row 0 and row 1 of the target both depend on both children (or only on
+    // their own child, for diagonal gates)
+    if (var == t) {
+        QMDD zero = evbdd_bundle(EVBDD_TERMINAL, EVBDD_ZERO);
+        bool diag = gate_is_diagonal(gate);
+        evbdd_refs_spawn(SPAWN(qmdd_cgate_pair_rec, diag ? zero : low, high, gate, cs, ci, 1));
+        QMDD row0 = evbdd_refs_push(CALL(qmdd_cgate_pair_rec, low, diag ? zero : high, gate, cs, ci, 0));
+        high = evbdd_refs_sync(SYNC(qmdd_cgate_pair_rec));
+        low = row0;
+        evbdd_refs_pop(1);
+    }
     // If current node is (one of) the control qubit(s), 
-    // control on q_c = |1> (high edge)
-    if (var == c) {
-        high = CALL(qmdd_cgate_rec, high, gate, cs, ci+1, t);
+    // control on q_c = |1> (high edge), or on q_c = |0> (low edge) if negated
+    else if (var == c) {
+        if (QMDD_CTRL_IS_NEG(cs[ci])) low = CALL(qmdd_cgate_rec, low, gate, cs, ci+1, t);
+        else high = CALL(qmdd_cgate_rec, high, gate, cs, ci+1, t);
     }
     // Not at control qubit yet, apply to both childeren.
     else {
@@ -498,18 +712,111 @@ TASK_IMPL_5(QMDD, qmdd_cgate_rec, QMDD, q, gate_id_t, gate, BDDVAR*, cs, uint32_
 
     // Store not yet "root normalized" result in cache
     if (cachenow) {
-        if (cache_put3(CACHE_QMDD_CGATE, sylvan_false, EVBDD_TARGET(q),
-                    GATE_OPID_64(gate, ci, cs[0], cs[1], cs[2], t),
-                    res)) {
+        if (evbdd_cache_put3(CACHE_QMDD_CGATE, sylvan_false, EVBDD_TARGET(q), opid, res)) {
             sylvan_stats_count(QMDD_CGATE_CACHEDPUT);
         }
     }
+    evbdd_cache_sample_miss(EVBDD_CACHE_OP_CGATE, var, sample);
     // Multiply root amp of res with input root amp
     AMP new_root_amp = wgt_mul(EVBDD_WEIGHT(q), EVBDD_WEIGHT(res));
     res = evbdd_bundle(EVBDD_TARGET(res), new_root_amp);
     return res;
 }
 
+TASK_IMPL_6(QMDD, qmdd_cgate_pair_rec, QMDD, x0, QMDD, x1, gate_id_t, gate, BDDVAR*, cs, uint32_t, ci, uint32_t, row)
+{
+    // Trivial cases
+    if (EVBDD_WEIGHT(x0) == EVBDD_ZERO && EVBDD_WEIGHT(x1) == EVBDD_ZERO) {
+        return evbdd_bundle(EVBDD_TERMINAL, EVBDD_ZERO);
+    }
+
+    // All controls satisfied: row of the gate applied to (x0, x1)
+    if (cs[ci] == EVBDD_INVALID_VAR) {
+        if (gate_is_diagonal(gate)) {
+            QMDD x = row ? x1 : x0;
+            return evbdd_bundle(EVBDD_TARGET(x), wgt_mul(EVBDD_WEIGHT(x), gates[gate][3*row]));
+        }
+        QMDD t0 = evbdd_bundle(EVBDD_TARGET(x0), wgt_mul(EVBDD_WEIGHT(x0), gates[gate][2*row]));
+        QMDD t1 = evbdd_bundle(EVBDD_TARGET(x1), wgt_mul(EVBDD_WEIGHT(x1), gates[gate][2*row+1]));
+        return CALL(evbdd_plus, t0, t1);
+    }
+    BDDVAR c = QMDD_CTRL_VAR(cs[ci]);
+
+    // Factor out the weight of the first nonzero edge, so the cached result
+    // holds for all multiples of (x0, x1)
+    bool lead1 = (EVBDD_WEIGHT(x0) == EVBDD_ZERO);
+    AMP factor = lead1 ? EVBDD_WEIGHT(x1) : EVBDD_WEIGHT(x0);
+    EVBDD_TARG lead = lead1 ? EVBDD_TARGET(x1) : EVBDD_TARGET(x0);
+    QMDD other = lead1 ? x0 : x1;
+    AMP w_other = wgt_div(EVBDD_WEIGHT(other), factor);
+    if (w_other == EVBDD_ZERO) other = evbdd_bundle(EVBDD_TERMINAL, EVBDD_ZERO);
+    else other = evbdd_bundle(EVBDD_TARGET(other), w_other);
+    x0 = lead1 ? other : evbdd_bundle(lead, EVBDD_ONE);
+    x1 = lead1 ? evbdd_bundle(lead, EVBDD_ONE) : other;
+
+    // Get the (topvar of the) node with the lowest variable, at most c
+    BDDVAR var0 = UINT32_MAX, var1 = UINT32_MAX, var;
+    if (EVBDD_TARGET(x0) != EVBDD_TERMINAL) var0 = evbddnode_getvar(EVBDD_GETNODE(EVBDD_TARGET(x0)));
+    if (EVBDD_TARGET(x1) != EVBDD_TERMINAL) var1 = evbddnode_getvar(EVBDD_GETNODE(EVBDD_TARGET(x1)));
+    QMDD low0, high0, low1, high1, res;
+    evbdd_get_topvar(x0, (var1 < c) ? var1 : c, &var, &low0, &high0);
+    evbdd_get_topvar(x1, (var0 < c) ? var0 : c, &var, &low1, &high1);
+    assert(var <= c);
+
+    // Check cache (on the ID of the remaining controls)
+    uint64_t sample;
+    uint64_t opid = GATE_OPID_64(gate, QMDD_CTRL_TAIL_ID(cs, ci), 0, row | lead1<<1);
+    bool cachenow = evbdd_cachenow(EVBDD_CACHE_OP_CGATE, var, lead, &sample);
+    if (cachenow) {
+        if (evbdd_cache_get3(CACHE_QMDD_CGATE_PAIR, lead, other, opid, &res)) {
+            sylvan_stats_count(QMDD_CGATE_CACHED);
+            evbdd_cache_sample_hit(EVBDD_CACHE_OP_CGATE, var, sample);
+            AMP new_root_amp = wgt_mul(factor, EVBDD_WEIGHT(res));
+            return evbdd_bundle(EVBDD_TARGET(res), new_root_amp);
+        }
+    }
+
+    // Pass edge weights of x0 and x1 down
+    EVBDD_WGT w_in[4] = {EVBDD_WEIGHT(x0), EVBDD_WEIGHT(x0), EVBDD_WEIGHT(x1), EVBDD_WEIGHT(x1)};
+    EVBDD_WGT w_child[4] = {EVBDD_WEIGHT(low0), EVBDD_WEIGHT(high0), EVBDD_WEIGHT(low1), EVBDD_WEIGHT(high1)};
+    EVBDD_WGT w[4];
+    wgt_mul4(w_in, w_child, w);
+    QMDD e[4]; // e[2*ct + cv] for column ct of the target and value cv of var
+    e[0] = evbdd_bundle(EVBDD_TARGET(low0),  w[0]);
+    e[1] = evbdd_bundle(EVBDD_TARGET(high0), w[1]);
+    e[2] = evbdd_bundle(EVBDD_TARGET(low1),  w[2]);
+    e[3] = evbdd_bundle(EVBDD_TARGET(high1), w[3]);
+
+    QMDD low, high;
+    if (var < c) { // not at control qubit yet, recursive calls down
+        evbdd_refs_spawn(SPAWN(qmdd_cgate_pair_rec, e[1], e[3], gate, cs, ci, row));
+        low = evbdd_refs_push(CALL(qmdd_cgate_pair_rec, e[0], e[2], gate, cs, ci, row));
+        high = evbdd_refs_sync(SYNC(qmdd_cgate_pair_rec));
+        evbdd_refs_pop(1);
+    }
+    // var == c: the gate only acts on the branch where the control holds, on
+    // the other branch this row of the target is left as it is
+    else if (QMDD_CTRL_IS_NEG(cs[ci])) {
+        low = CALL(qmdd_cgate_pair_rec, e[0], e[2], gate, cs, ci+1, row);
+        high = e[2*row + 1];
+    }
+    else {
+        low = e[2*row];
+        high = CALL(qmdd_cgate_pair_rec, e[1], e[3], gate, cs, ci+1, row);
+    }
+    res = evbdd_makenode(var, low, high);
+
+    // Store result for (x0, x1) with the factor taken out
+    if (cachenow) {
+        if (evbdd_cache_put3(CACHE_QMDD_CGATE_PAIR, lead, other, opid, res)) {
+            sylvan_stats_count(QMDD_CGATE_CACHEDPUT);
+        }
+    }
+    evbdd_cache_sample_miss(EVBDD_CACHE_OP_CGATE, var, sample);
+    AMP new_root_amp = wgt_mul(factor, EVBDD_WEIGHT(res));
+    return evbdd_bundle(EVBDD_TARGET(res), new_root_amp);
+}
+
 TASK_IMPL_6(QMDD, qmdd_cgate_range_rec, QMDD, q, gate_id_t, gate, BDDVAR, c_first, BDDVAR, c_last, BDDVAR, t, BDDVAR, k)
 {
     // Past last control (done with "control part" of controlled gate)
@@ -522,12 +829,14 @@ TASK_IMPL_6(QMDD, qmdd_cgate_range_rec, QMDD, q, gate_id_t, gate, BDDVAR, c_firs
 
     // Check cache
     QMDD res;
-    bool cachenow = ((k % granularity) == 0);
+    uint64_t sample;
+    bool cachenow = evbdd_cachenow(EVBDD_CACHE_OP_CGATE, k, EVBDD_TARGET(q), &sample);
     if (cachenow) {
-        if (cache_get3(CACHE_QMDD_CGATE_RANGE, sylvan_false, EVBDD_TARGET(q),
-                       GATE_OPID_64(gate, c_first, c_last, k, t, 0),
+        if (evbdd_cache_get3(CACHE_QMDD_CGATE_RANGE, QMDD_PARAM_PACK_40(0, c_first, c_last), EVBDD_TARGET(q),
+                       GATE_OPID_64(gate, k, t, 0),
                        &res)) {
             sylvan_stats_count(QMDD_CGATE_CACHED);
+            evbdd_cache_sample_hit(EVBDD_CACHE_OP_CGATE, k, sample);
             // Multiply root amp of result with the input root amp
             AMP new_root_amp = wgt_mul(EVBDD_WEIGHT(q), EVBDD_WEIGHT(res));
             res = evbdd_bundle(EVBDD_TARGET(res), new_root_amp);
@@ -566,18 +875,214 @@ TASK_IMPL_6(QMDD, qmdd_cgate_range_rec, QMDD, q, gate_id_t, gate, BDDVAR, c_firs
 
     // Store not yet "root normalized" result in cache
     if (cachenow) {
-        if (cache_put3(CACHE_QMDD_CGATE_RANGE, sylvan_false, EVBDD_TARGET(q),
-                       GATE_OPID_64(gate, c_first, c_last, k, t, 0),
+        if (evbdd_cache_put3(CACHE_QMDD_CGATE_RANGE, QMDD_PARAM_PACK_40(0, c_first, c_last), EVBDD_TARGET(q),
+                       GATE_OPID_64(gate, k, t, 0),
                        res)) {
             sylvan_stats_count(QMDD_CGATE_CACHEDPUT);
         }
     }
+    evbdd_cache_sample_miss(EVBDD_CACHE_OP_CGATE, k, sample);
     // Multiply root amp of result with the input root amp
     AMP new_root_amp = wgt_mul(EVBDD_WEIGHT(q), EVBDD_WEIGHT(res));
     res = evbdd_bundle(EVBDD_TARGET(res), new_root_amp);
     return res;
 }
 
+/* Wrapper for applying two-qubit gates (optionally with a control qubit). */
+TASK_IMPL_5(QMDD, qmdd_gate2, QMDD, qmdd, uint32_t, gate2, BDDVAR, c, BDDVAR, q1, BDDVAR, q2)
+{
+    assert(q1 != q2 && "two-qubit gate requires two different qubits");
+    assert(gate2 < qmdd_get_max_gates2());
+    BDDVAR qa = (q1 < q2) ? q1 : q2;
+    BDDVAR qb = (q1 < q2) ? q2 : q1;
+    assert((c == EVBDD_INVALID_VAR || c < qa) && "ctrl < qubits required");
+
+    qmdd_do_before_gate(&qmdd);
+    evbdd_refs_push(qmdd);
+    QMDD res = qmdd_gate2_rec(qmdd, gate2, c, qa, qb, q1 > q2);
+    evbdd_refs_pop(1);
+    return res;
+}
+
+// Entry (r, c) of two-qubit gate k, for (qb, qa) instead of (qa, qb) if flip
+static inline AMP
+gate2_entry(uint32_t k, uint32_t r, uint32_t c, bool flip)
+{
+    if (flip) {
+        r = (r >> 1) | ((r & 1) << 1);
+        c = (c >> 1) | ((c & 1) << 1);
+    }
+    return gates2[k][4*r + c];
+}
+
+TASK_IMPL_6(QMDD, qmdd_gate2_rec, QMDD, q, uint32_t, gate2, BDDVAR, c, BDDVAR, qa, BDDVAR, qb, uint32_t, flip)
+{
+    // Trivial cases
+    if (EVBDD_WEIGHT(q) == EVBDD_ZERO) return q;
+
+    BDDVAR var;
+    QMDD res, low, high;
+    BDDVAR next = (c != EVBDD_INVALID_VAR) ? c : qa;
+    evbdd_get_topvar(q, next, &var, &low, &high);
+    assert(var <= next);
+
+    // Check cache
+    uint64_t sample;
+    bool cachenow = evbdd_cachenow(EVBDD_CACHE_OP_GATE, var, EVBDD_TARGET(q), &sample);
+    if (cachenow) {
+        if (evbdd_cache_get3(CACHE_QMDD_GATE2, QMDD_PARAM_PACK_40(0, c, 0), EVBDD_TARGET(q),
+                       GATE_OPID_64(gate2, qa, qb, flip),
+                       &res)) {
+            sylvan_stats_count(QMDD_GATE_CACHED);
+            evbdd_cache_sample_hit(EVBDD_CACHE_OP_GATE, var, sample);
+            // Multiply root of res with root of input qmdd
+            AMP new_root_amp = wgt_mul(EVBDD_WEIGHT(q), EVBDD_WEIGHT(res));
+            res = evbdd_bundle(EVBDD_TARGET(res), new_root_amp);
+            return res;
+        }
+    }
+
+    // If current node is the control qubit, control on q_c = |1> (high edge)
+    if (var == c) {
+        high = CALL(qmdd_gate2_rec, high, gate2, EVBDD_INVALID_VAR, qa, qb, flip);
+    }
+    // At qa: row 0 and row 1 of qa both depend on both children (or only on
+    // their own child, for diagonal gates)
+    else if (var == qa) {
+        QMDD zero = evbdd_bundle(EVBDD_TERMINAL, EVBDD_ZERO);
+        bool diag = gate2_is_diagonal(gate2);
+        evbdd_refs_spawn(SPAWN(qmdd_gate2_pair_rec, diag ? zero : low, high, gate2, qb, 1 | flip<<1));
+        QMDD row0 = evbdd_refs_push(CALL(qmdd_gate2_pair_rec, low, diag ? zero : high, gate2, qb, 0 | flip<<1));
+        high = evbdd_refs_sync(SYNC(qmdd_gate2_pair_rec));
+        low = row0;
+        evbdd_refs_pop(1);
+    }
+    // Not at qa (or the control) yet, recursive calls down
+    else {
+        evbdd_refs_spawn(SPAWN(qmdd_gate2_rec, high, gate2, c, qa, qb, flip));
+        low = evbdd_refs_push(CALL(qmdd_gate2_rec, low, gate2, c, qa, qb, flip));
+        high = evbdd_refs_sync(SYNC(qmdd_gate2_rec));
+        evbdd_refs_pop(1);
+    }
+    res = evbdd_makenode(var, low, high);
+
+    // Store not yet "root normalized" result in cache
+    if (cachenow) {
+        if (evbdd_cache_put3(CACHE_QMDD_GATE2, QMDD_PARAM_PACK_40(0, c, 0), EVBDD_TARGET(q),
+                       GATE_OPID_64(gate2, qa, qb, flip),
+                       res)) {
+            sylvan_stats_count(QMDD_GATE_CACHEDPUT);
+        }
+    }
+    evbdd_cache_sample_miss(EVBDD_CACHE_OP_GATE, var, sample);
+    // Multiply root amp of res with input root amp
+    AMP new_root_amp = wgt_mul(EVBDD_WEIGHT(q), EVBDD_WEIGHT(res));
+    res = evbdd_bundle(EVBDD_TARGET(res), new_root_amp);
+    return res;
+}
+
+TASK_IMPL_5(QMDD, qmdd_gate2_pair_rec, QMDD, x0, QMDD, x1, uint32_t, gate2, BDDVAR, qb, uint32_t, row)
+{
+    // Trivial cases
+    if (EVBDD_WEIGHT(x0) == EVBDD_ZERO && EVBDD_WEIGHT(x1) == EVBDD_ZERO) {
+        return evbdd_bundle(EVBDD_TERMINAL, EVBDD_ZERO);
+    }
+
+    // Factor out the weight of the first nonzero edge, so the cached result
+    // holds for all multiples of (x0, x1)
+    bool lead1 = (EVBDD_WEIGHT(x0) == EVBDD_ZERO);
+    AMP factor = lead1 ? EVBDD_WEIGHT(x1) : EVBDD_WEIGHT(x0);
+    EVBDD_TARG lead = lead1 ? EVBDD_TARGET(x1) : EVBDD_TARGET(x0);
+    QMDD other = lead1 ? x0 : x1;
+    AMP w_other = wgt_div(EVBDD_WEIGHT(other), factor);
+    if (w_other == EVBDD_ZERO) other = evbdd_bundle(EVBDD_TERMINAL, EVBDD_ZERO);
+    else other = evbdd_bundle(EVBDD_TARGET(other), w_other);
+    x0 = lead1 ? other : evbdd_bundle(lead, EVBDD_ONE);
+    x1 = lead1 ? evbdd_bundle(lead, EVBDD_ONE) : other;
+
+    // Get the (topvar of the) node with the lowest variable, at most qb
+    BDDVAR var0 = UINT32_MAX, var1 = UINT32_MAX, var;
+    if (EVBDD_TARGET(x0) != EVBDD_TERMINAL) var0 = evbddnode_getvar(EVBDD_GETNODE(EVBDD_TARGET(x0)));
+    if (EVBDD_TARGET(x1) != EVBDD_TERMINAL) var1 = evbddnode_getvar(EVBDD_GETNODE(EVBDD_TARGET(x1)));
+    QMDD low0, high0, low1, high1, res;
+    evbdd_get_topvar(x0, (var1 < qb) ? var1 : qb, &var, &low0, &high0);
+    evbdd_get_topvar(x1, (var0 < qb) ? var0 : qb, &var, &low1, &high1);
+    assert(var <= qb);
+
+    // Check cache
+    uint64_t sample;
+    uint8_t x = row | lead1<<2;
+    bool cachenow = evbdd_cachenow(EVBDD_CACHE_OP_GATE, var, lead, &sample);
+    if (cachenow) {
+        if (evbdd_cache_get3(CACHE_QMDD_GATE2_PAIR, lead, other, GATE_OPID_64(gate2, 0, qb, x), &res)) {
+            sylvan_stats_count(QMDD_GATE_CACHED);
+            evbdd_cache_sample_hit(EVBDD_CACHE_OP_GATE, var, sample);
+            AMP new_root_amp = wgt_mul(factor, EVBDD_WEIGHT(res));
+            return evbdd_bundle(EVBDD_TARGET(res), new_root_amp);
+        }
+    }
+
+    // Pass edge weights of x0 and x1 down
+    EVBDD_WGT w_in[4] = {EVBDD_WEIGHT(x0), EVBDD_WEIGHT(x0), EVBDD_WEIGHT(x1), EVBDD_WEIGHT(x1)};
+    EVBDD_WGT w_child[4] = {EVBDD_WEIGHT(low0), EVBDD_WEIGHT(high0), EVBDD_WEIGHT(low1), EVBDD_WEIGHT(high1)};
+    EVBDD_WGT w[4];
+    wgt_mul4(w_in, w_child, w);
+    QMDD e[4]; // e[2*ca + cb] for column ca of qa and column cb of qb
+    e[0] = evbdd_bundle(EVBDD_TARGET(low0),  w[0]);
+    e[1] = evbdd_bundle(EVBDD_TARGET(high0), w[1]);
+    e[2] = evbdd_bundle(EVBDD_TARGET(low1),  w[2]);
+    e[3] = evbdd_bundle(EVBDD_TARGET(high1), w[3]);
+
+    QMDD low, high;
+    if (var < qb) { // not at qb yet, recursive calls down
+        evbdd_refs_spawn(SPAWN(qmdd_gate2_pair_rec, e[1], e[3], gate2, qb, row));
+        low = evbdd_refs_push(CALL(qmdd_gate2_pair_rec, e[0], e[2], gate2, qb, row));
+        high = evbdd_refs_sync(SYNC(qmdd_gate2_pair_rec));
+        evbdd_refs_pop(1);
+    }
+    else if (gate2_is_diagonal(gate2)) { // var == qb: only rescale column (ra, rb)
+        uint32_t ra = row & 1;
+        bool flip = (row >> 1) & 1;
+        AMP u0 = gate2_entry(gate2, 2*ra, 2*ra, flip);
+        AMP u1 = gate2_entry(gate2, 2*ra + 1, 2*ra + 1, flip);
+        low  = evbdd_bundle(EVBDD_TARGET(e[2*ra]),   wgt_mul(EVBDD_WEIGHT(e[2*ra]),   u0));
+        high = evbdd_bundle(EVBDD_TARGET(e[2*ra+1]), wgt_mul(EVBDD_WEIGHT(e[2*ra+1]), u1));
+    }
+    else { // var == qb: row (ra, rb) is the sum over all columns (ca, cb)
+        uint32_t ra = row & 1;
+        bool flip = (row >> 1) & 1;
+        QMDD t[2][4];
+        for (uint32_t rb = 0; rb < 2; rb++) {
+            for (uint32_t k = 0; k < 4; k++) {
+                AMP u = gate2_entry(gate2, 2*ra + rb, k, flip);
+                t[rb][k] = evbdd_bundle(EVBDD_TARGET(e[k]), wgt_mul(EVBDD_WEIGHT(e[k]), u));
+            }
+        }
+        evbdd_refs_spawn(SPAWN(evbdd_plus, t[1][2], t[1][3]));
+        evbdd_refs_spawn(SPAWN(evbdd_plus, t[1][0], t[1][1]));
+        evbdd_refs_spawn(SPAWN(evbdd_plus, t[0][2], t[0][3]));
+        QMDD s00 = evbdd_refs_push(CALL(evbdd_plus, t[0][0], t[0][1]));
+        QMDD s01 = evbdd_refs_push(evbdd_refs_sync(SYNC(evbdd_plus)));
+        QMDD s10 = evbdd_refs_push(evbdd_refs_sync(SYNC(evbdd_plus)));
+        QMDD s11 = evbdd_refs_push(evbdd_refs_sync(SYNC(evbdd_plus)));
+        evbdd_refs_spawn(SPAWN(evbdd_plus, s10, s11));
+        low = evbdd_refs_push(CALL(evbdd_plus, s00, s01));
+        high = evbdd_refs_sync(SYNC(evbdd_plus));
+        evbdd_refs_pop(5);
+    }
+    res = evbdd_makenode(var, low, high);
+
+    // Store result for (x0, x1) with the factor taken out
+    if (cachenow) {
+        if (evbdd_cache_put3(CACHE_QMDD_GATE2_PAIR, lead, other, GATE_OPID_64(gate2, 0, qb, x), res)) {
+            sylvan_stats_count(QMDD_GATE_CACHEDPUT);
+        }
+    }
+    evbdd_cache_sample_miss(EVBDD_CACHE_OP_GATE, var, sample);
+    AMP new_root_amp = wgt_mul(factor, EVBDD_WEIGHT(res));
+    return evbdd_bundle(EVBDD_TARGET(res), new_root_amp);
+}
+
 /******************************</Applying gates>*******************************/
 
 
@@ -691,8 +1196,8 @@ TASK_IMPL_6(QMDD, qmdd_ccircuit, QMDD, qmdd, circuit_id_t, circ_id, BDDVAR*, cs,
     QMDD res;
     bool cachenow = 1;
     if (cachenow) {
-        if (cache_get3(CACHE_QMDD_SUBCIRC, GATE_OPID_40(0, ci, 0), qmdd, 
-                       GATE_OPID_64(circ_id, cs[0], cs[1], cs[2], t1, t2),
+        if (evbdd_cache_get3(CACHE_QMDD_SUBCIRC, QMDD_PARAM_PACK_40(ci, cs[1], cs[2]), qmdd, 
+                       GATE_OPID_64(t2, cs[0], t1, circ_id), // (t2 instead of a gateid)
                        &res)) {
             return res;
         }
@@ -734,8 +1239,8 @@ TASK_IMPL_6(QMDD, qmdd_ccircuit, QMDD, qmdd, circuit_id_t, circ_id, BDDVAR*, cs,
     
     // Add to cache, return
     if (cachenow) {
-        cache_put3(CACHE_QMDD_SUBCIRC, GATE_OPID_40(0, ci, 0), qmdd, 
-                   GATE_OPID_64(circ_id, cs[0], cs[1], cs[2], t1, t2), 
+        evbdd_cache_put3(CACHE_QMDD_SUBCIRC, QMDD_PARAM_PACK_40(ci, cs[1], cs[2]), qmdd, 
+                   GATE_OPID_64(t2, cs[0], t1, circ_id), 
                    res);
     }
     return res;
@@ -964,10 +1469,10 @@ TASK_IMPL_3(double, qmdd_unnormed_prob, QMDD, qmdd, BDDVAR, topvar, BDDVAR, nvar
     // Look in cache
     bool cachenow = 1;
     if (cachenow) {
-        uint64_t prob_bits;
-        if (cache_get3(CACHE_QMDD_PROB, sylvan_false, qmdd, QMDD_PARAM_PACK_16(topvar, nvars), &prob_bits)) {
+        EVBDD prob_bits;
+        if (evbdd_cache_get3(CACHE_QMDD_PROB, sylvan_false, qmdd, QMDD_PARAM_PACK_32(topvar, nvars), &prob_bits)) {
             sylvan_stats_count(QMDD_PROB_CACHED);
-            double_hack_t container = (double_hack_t) prob_bits;
+            double_hack_t container = (double_hack_t) (uint64_t) prob_bits;
             return container.as_double;
         }
     }
@@ -989,7 +1494,7 @@ TASK_IMPL_3(double, qmdd_unnormed_prob, QMDD, qmdd, BDDVAR, topvar, BDDVAR, nvar
     // Put in cache and return
     if (cachenow) {
         double_hack_t container = (double_hack_t) prob_res;
-        if (cache_put3(CACHE_QMDD_PROB, sylvan_false, qmdd, QMDD_PARAM_PACK_16(topvar, nvars), container.as_int))
+        if (evbdd_cache_put3(CACHE_QMDD_PROB, sylvan_false, qmdd, QMDD_PARAM_PACK_32(topvar, nvars), container.as_int))
             sylvan_stats_count(QMDD_PROB_CACHEDPUT);
     }
     return prob_res;
@@ -1002,7 +1507,7 @@ qmdd_get_amplitude(QMDD q, bool *x, BDDVAR nqubits)
     // so we temporarily reverse x.
     reverse_bit_array(x, nqubits);
     complex_t res;
-    weight_value(evbdd_getvalue(q, x), &res);
+    weight_value_complex(evbdd_getvalue(q, x), &res);
     reverse_bit_array(x, nqubits);
     return res;
 }
@@ -1011,7 +1516,7 @@ double
 qmdd_amp_to_prob(AMP a)
 {
     complex_t c;
-    weight_value(a, &c);
+    weight_value_complex(a, &c);
     double abs = flt_sqrt( c.r*c.r + c.i*c.i );
     return (abs*abs);
 }
@@ -1022,7 +1527,7 @@ qmdd_amp_from_prob(double a)
     complex_t c;
     c.r = flt_sqrt(a);
     c.i = 0;
-    return weight_lookup(&c);
+    return weight_lookup_complex(&c);
 }
 
 double qmdd_fidelity(QMDD a, QMDD b, BDDVAR nvars)
@@ -1030,7 +1535,7 @@ double qmdd_fidelity(QMDD a, QMDD b, BDDVAR nvars)
     // c = <a|b>
     AMP prod = evbdd_inner_product(a, b, nvars);
     complex_t c;
-    weight_value(prod, &c);
+    weight_value_complex(prod, &c);
 
     // fid = |c|^2 = |c.r + c.i|^2 = sqrt(c.r^2 + c.i^2)^2 = c.r^2 + c.i^2
     double fid = c.r*c.r + c.i*c.i;
@@ -1049,6 +1554,12 @@ QMDD
 qmdd_remove_global_phase(QMDD qmdd)
 {
     // Remove global phase by replacing amp of qmdd with absolute value of amp
+    // (if the absolute value can be represented, e.g. with exact edge weights
+    // it often can't, in which case the phase is kept)
+    complex_t c;
+    weight_value_complex(EVBDD_WEIGHT(qmdd), &c);
+    c = cmake(flt_sqrt(c.r*c.r + c.i*c.i), 0.0);
+    if (!weight_representable(&c)) return qmdd;
     AMP abs = wgt_abs(EVBDD_WEIGHT(qmdd));
     QMDD res = evbdd_bundle(EVBDD_TARGET(qmdd), abs);
     return res;
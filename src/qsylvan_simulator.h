@@ -63,6 +63,16 @@ class QSimulator()
 */
 
 void qsylvan_init_simulator(size_t min_tablesize, size_t max_tablesize, double wgt_tab_tolerance, int edge_weigth_backend, int norm_strat);
+
+/**
+ * Same as qsylvan_init_simulator(), but with the given edge_weight_type_t 
+ * instead of WGT_COMPLEX_128. With WGT_DOUBLE only gates with real matrices
+ * can be applied (e.g. X, Z, H, Ry, and controlled versions of these). With
+ * WGT_RATIONAL_128 only gates with Clifford+T entries can be applied (e.g. H,
+ * S, T, sqrtX, and controlled versions of these), and intermediate 
+ * measurements need the square roots of their probabilities to be exact.
+ */
+void qsylvan_init_simulator_wgt(size_t min_tablesize, size_t max_tablesize, double wgt_tab_tolerance, int edge_weight_type, int edge_weigth_backend, int norm_strat);
 void qsylvan_init_defaults(size_t wgt_tab_size);
 
 /*****************************</Initialization>********************************/
@@ -257,16 +267,46 @@ double qmdd_fidelity(QMDD a, QMDD b, BDDVAR nvars);
 
 /*******************************<Applying gates>*******************************/
 
-// For now we have at most 3 control qubits
+// Max number of control qubits of qmdd_cgate3() and qmdd_ccircuit() (see
+// qmdd_mcgate() for more)
 #define MAX_CONTROLS 3
 
+/**
+ * Marks control qubit c as controlling on |0> instead of |1>, in the controls
+ * of qmdd_mcgate() and qmdd_cgate_rec().
+ */
+#define QMDD_CTRL_NEG_FLAG ((BDDVAR)1 << 31)
+#define QMDD_CTRL_NEG(c) ((c) | QMDD_CTRL_NEG_FLAG)
+#define QMDD_CTRL_VAR(c) ((c) & ~QMDD_CTRL_NEG_FLAG)
+#define QMDD_CTRL_IS_NEG(c) (((c) & QMDD_CTRL_NEG_FLAG) != 0)
+
+/**
+ * Interns a list of controls (as for qmdd_cgate_rec()), so that the results of
+ * controlled gates can be cached per list. Returns the registered copy, which
+ * stays valid until more than qmdd_get_max_ctrl_lists() controls (including
+ * one terminator per list) have been interned. At that point all lists are
+ * forgotten at once, together with the cached results which refer to them.
+ */
+BDDVAR *qmdd_ctrl_list_intern(const BDDVAR *cs);
+
+/**
+ * Forget all interned control lists. Called when the simulator is
+ * (re-)initialized.
+ */
+void qmdd_ctrl_lists_reset();
+
+/* Set the size of the control list registry (at most 2^16 controls). */
+void qmdd_set_max_ctrl_lists(uint32_t max);
+uint32_t qmdd_get_max_ctrl_lists();
+
 /* Applies given (single qubit) gate to |q>. */
 #define qmdd_gate(qmdd,gate,target) (RUN(qmdd_gate,qmdd,gate,target))
 TASK_DECL_3(QMDD, qmdd_gate, QMDD, gate_id_t, BDDVAR);
 
 /**
- * Applies given controlled gate to |q>. When controls !<= target, the total
- * number of qubits needs to be passed as last argument.
+ * Applies given controlled gate to |q>. The controls can come before or after
+ * the target. (An optional last argument, the total number of qubits, is no
+ * longer needed and ignored.)
 */
 #define qmdd_cgate(state,gate,c,t,...) _qmdd_cgate(state,gate,c,EVBDD_INVALID_VAR,EVBDD_INVALID_VAR,t,(0, ##__VA_ARGS__))
 #define qmdd_cgate2(state,gate,c1,c2,t,...) (_qmdd_cgate(state,gate,c1,c2,EVBDD_INVALID_VAR,t,(0, ##__VA_ARGS__)))
@@ -274,6 +314,15 @@ TASK_DECL_3(QMDD, qmdd_gate, QMDD, gate_id_t, BDDVAR);
 QMDD _qmdd_cgate(QMDD state, gate_id_t gate, BDDVAR c1, BDDVAR c2, BDDVAR c3, BDDVAR t, BDDVAR n);
 TASK_DECL_4(QMDD, qmdd_cgate, QMDD, gate_id_t, BDDVAR*, BDDVAR);
 
+/**
+ * Applies given gate to |q>, controlled on the 'nc' qubits in 'cs' (in any
+ * order), in a single pass over the QMDD. Controls marked with QMDD_CTRL_NEG()
+ * control on |0>, the others on |1>. Any number of them can come after the
+ * target. (An optional last argument, the total number of qubits, is ignored.)
+ */
+#define qmdd_mcgate(state,gate,cs,nc,t,...) (_qmdd_mcgate(state,gate,cs,nc,t,(0, ##__VA_ARGS__)))
+QMDD _qmdd_mcgate(QMDD state, gate_id_t gate, const BDDVAR *cs, uint32_t nc, BDDVAR t, BDDVAR n);
+
 /* Applies given controlled gate to |q>. */
 #define qmdd_cgate_range(qmdd,gate,c_first,c_last,t) (RUN(qmdd_cgate_range,qmdd,gate,c_first,c_last,t))
 TASK_DECL_5(QMDD, qmdd_cgate_range, QMDD, gate_id_t, BDDVAR, BDDVAR, BDDVAR);
@@ -285,11 +334,22 @@ TASK_DECL_5(QMDD, qmdd_cgate_range, QMDD, gate_id_t, BDDVAR, BDDVAR, BDDVAR);
 TASK_DECL_3(QMDD, qmdd_gate_rec, QMDD, gate_id_t, BDDVAR);
 
 /**
- * Recursive implementation of applying controlled gates
+ * Recursive implementation of applying controlled gates, with the controls in
+ * 'cs' sorted by qubit (possibly marked with QMDD_CTRL_NEG()) and terminated by
+ * EVBDD_INVALID_VAR. The task itself takes a list interned with
+ * qmdd_ctrl_list_intern().
  */
-#define qmdd_cgate_rec(q,gate,cs,t) (RUN(qmdd_cgate_rec,q,gate,cs,0,t))
+#define qmdd_cgate_rec(q,gate,cs,t) (RUN(qmdd_cgate_rec,q,gate,qmdd_ctrl_list_intern(cs),0,t))
 TASK_DECL_5(QMDD, qmdd_cgate_rec, QMDD, gate_id_t, BDDVAR*, uint32_t, BDDVAR);
 
+/**
+ * Below the target of a controlled gate of which the remaining controls come
+ * after the target: computes row 'row' of the target from its
+ * low and high edges x0 and x1, i.e. u_row0 x0 + u_row1 x1 where the controls
+ * hold and x_row elsewhere.
+ */
+TASK_DECL_6(QMDD, qmdd_cgate_pair_rec, QMDD, QMDD, gate_id_t, BDDVAR*, uint32_t, uint32_t);
+
 /**
  * Recursive implementation of applying controlled gates where the controlles 
  * are defined by a range 'c_first' through 'c_last'.
@@ -297,6 +357,36 @@ TASK_DECL_5(QMDD, qmdd_cgate_rec, QMDD, gate_id_t, BDDVAR*, uint32_t, BDDVAR);
 #define qmdd_cgate_range_rec(q,gate,c_first,c_last,t) (RUN(qmdd_cgate_range_rec,q,gate,c_first,c_last,t,0))
 TASK_DECL_6(QMDD, qmdd_cgate_range_rec, QMDD, gate_id_t, BDDVAR, BDDVAR, BDDVAR, BDDVAR);
 
+/**
+ * Applies the two-qubit gate 'gate2' (see GATE2ID_custom()) to qubits q1 and
+ * q2 of |q> in a single pass over the QMDD. Row (and column) 2*x1 + x2 of the
+ * gate matrix corresponds to q1 = x1 and q2 = x2. The qubits can be given in
+ * any order and don't need to be adjacent.
+ */
+#define qmdd_gate2(qmdd,gate2,q1,q2) (RUN(qmdd_gate2,qmdd,gate2,EVBDD_INVALID_VAR,q1,q2))
+
+/**
+ * Applies the two-qubit gate 'gate2' to qubits q1 and q2 of |q>, controlled on
+ * qubit c, which has to come before both q1 and q2.
+ */
+#define qmdd_controlled_gate2(qmdd,gate2,c,q1,q2) (RUN(qmdd_gate2,qmdd,gate2,c,q1,q2))
+TASK_DECL_5(QMDD, qmdd_gate2, QMDD, uint32_t, BDDVAR, BDDVAR, BDDVAR);
+
+/**
+ * Recursive implementation of applying two-qubit gates to qubits qa < qb, with
+ * the rows and columns of the gate for (qb, qa) instead of (qa, qb) if 'flip'
+ * is set.
+ */
+#define qmdd_gate2_rec(q,gate2,c,qa,qb,flip) (RUN(qmdd_gate2_rec,q,gate2,c,qa,qb,flip))
+TASK_DECL_6(QMDD, qmdd_gate2_rec, QMDD, uint32_t, BDDVAR, BDDVAR, BDDVAR, uint32_t);
+
+/**
+ * Below qubit qa of a two-qubit gate: computes row (row & 1) of qa of the gate
+ * from the low (x0) and high (x1) children of a node of qa, in a single pass
+ * over both. Bit 1 of 'row' is the 'flip' of qmdd_gate2_rec.
+ */
+TASK_DECL_5(QMDD, qmdd_gate2_pair_rec, QMDD, QMDD, uint32_t, BDDVAR, uint32_t);
+
 /******************************</Applying gates>*******************************/
 
 
@@ -62,6 +62,52 @@ static uint32_t*          cache_status;
 
 static _Atomic(uint64_t)  next_opid;
 
+/**
+ * Every operation class has an epoch (generation), which is stored in the
+ * status of the entries put in the cache. Entries of an older epoch are never
+ * returned, so bumping the epoch of a class clears all its entries in O(1).
+ * The epoch has 8 bits, so when it wraps around, the entries of the class are
+ * actually removed (which only costs a scan of the cache every 256 clears).
+ */
+static _Atomic(uint32_t)  cache_epochs[CACHE_N_OPCLASSES];
+
+// class of each of the fixed operation ids (in sylvan_int.h)
+static uint8_t            cache_opclasses[512];
+
+// which entries of each class to keep during gc, see cache_set_gc_keep()
+static cache_keep_cb      cache_gc_keep[CACHE_N_OPCLASSES];
+
+static void
+cache_init_opclasses()
+{
+    for (int op=0; op<512; op++) {
+        if (op < 20) cache_opclasses[op] = CACHE_OPCLASS_BDD;
+        else if (op < 40) cache_opclasses[op] = CACHE_OPCLASS_LDD;
+        else if (op < 70) cache_opclasses[op] = CACHE_OPCLASS_MTBDD;
+        else if (op < 80) cache_opclasses[op] = CACHE_OPCLASS_EVBDD;
+        else if (op < 90) cache_opclasses[op] = CACHE_OPCLASS_WGT;
+        else if (op < 100) cache_opclasses[op] = CACHE_OPCLASS_QMDD;
+        else cache_opclasses[op] = CACHE_OPCLASS_ZDD;
+    }
+}
+
+/**
+ * The class of the operation of which `a` (the first key) has the id in its
+ * high bits (below the complement bit).
+ */
+static inline cache_opclass_t
+cache_opclass(uint64_t a)
+{
+    const uint64_t op = (a >> 40) & 0x7fffff;
+    return op < 512 ? (cache_opclass_t)cache_opclasses[op] : CACHE_OPCLASS_CUSTOM;
+}
+
+static inline uint32_t
+cache_epoch(uint64_t a)
+{
+    return atomic_load_explicit(&cache_epochs[cache_opclass(a)], memory_order_relaxed);
+}
+
 uint64_t
 cache_next_opid()
 {
@@ -69,8 +115,47 @@ cache_next_opid()
 }
 
 // status: 0x80000000 - bitlock
-//         0x7fff0000 - hash (part of the 64-bit hash not used to position)
-//         0x0000ffff - tag (every put increases tag field)
+//         0x40000000 - part of a 2-part (cache6) entry
+//         0x3ffe0000 - hash (part of the 64-bit hash not used to position)
+//         0x00010000 - referenced since put (only in set-associative mode)
+//         0x0000ff00 - epoch of the operation class when the entry was put
+//         0x000000ff - tag (every put increases tag field)
+
+/**
+ * The cache is direct-mapped (every key has one bucket) or 2- or 4-way
+ * set-associative: a key can then be in any bucket of the aligned set of 2 or
+ * 4 buckets around its own bucket, i.e. in the same cache line of statuses and
+ * at most 2 cache lines of entries. Hits mark the entry as referenced, and
+ * cache_put replaces (in this order) the entry with the same key, an empty or
+ * cleared entry, or an entry which was not referenced since it was put. If all
+ * entries of the set were referenced, these bits are reset and the entry in the
+ * bucket of the key is replaced (not-recently-used replacement).
+ *
+ * 2-part (cache6) entries and cache_remap always use the bucket of the key,
+ * which is in the set, so these work in all modes.
+ */
+static int                cache_ways = CACHE_WAYS;
+
+/**
+ * Lookups and hits of cache_get (and cache_get6) for a sample of the keys
+ * (those with 6 bits of their hash, which are not used for the position, equal
+ * to 0), for the adaptive resizing of the cache. Sampling keeps the shared
+ * counters cold.
+ */
+static _Atomic(uint64_t)  cache_sample_lookups;
+static _Atomic(uint64_t)  cache_sample_hits;
+
+#define cache_sampled(hash) ((((hash) >> 42) & (CACHE_SAMPLE_RATE-1)) == 0)
+
+/**
+ * Whether the entry in bucket i is of the current epoch of its class (for
+ * the second half of a 2-part entry this is meaningless, but harmless).
+ */
+static inline int
+cache_is_current(size_t i)
+{
+    return ((cache_status[i] >> 8) & 0xff) == cache_epoch(cache_table[i].a);
+}
 
 /* Rotating 64-bit FNV-1a hash */
 static uint64_t
@@ -111,19 +196,25 @@ cache_get6(uint64_t a, uint64_t b, uint64_t c, uint64_t d, uint64_t e, uint64_t
     _Atomic(uint64_t) *s_bucket = (_Atomic(uint64_t)*)cache_status + (hash % cache_size)/2;
     cache6_entry_t bucket = (cache6_entry_t)cache_table + (hash % cache_size)/2;
 #endif
+    const int sampled = cache_sampled(hash);
+    if (sampled) atomic_fetch_add_explicit(&cache_sample_lookups, 1, memory_order_relaxed);
+    sylvan_stats_count(OPCACHE_LOOKUP);
     // can be relaxed, we check again afterwards
     const uint64_t s = atomic_load_explicit(s_bucket, memory_order_relaxed);
-    // abort if locked or second part of 2-part entry or if different hash
-    uint64_t x = ((hash>>32) & 0x7fff0000) | 0x04000000;
+    // abort if locked or not a 2-part entry or if different hash or epoch
+    uint64_t x = ((hash>>32) & 0x3ffe0000) | 0x40000000 | (cache_epoch(a) << 8);
     x = x | (x<<32);
-    if ((s & 0xffff0000ffff0000) != x) return 0;
+    if ((s & 0xfffeff00fffeff00) != x) return 0;
     // abort if key different
     if (bucket->a != a || bucket->b != b || bucket->c != c) return 0;
     if (bucket->d != d || bucket->e != e || bucket->f != f) return 0;
     *res1 = bucket->res;
     if (res2) *res2 = bucket->res2;
     // abort if status field changed after compiler_barrier()
-    return atomic_load_explicit(s_bucket, memory_order_acquire) == s ? 1 : 0;
+    if (atomic_load_explicit(s_bucket, memory_order_acquire) != s) return 0;
+    if (sampled) atomic_fetch_add_explicit(&cache_sample_hits, 1, memory_order_relaxed);
+    sylvan_stats_count(OPCACHE_HIT);
+    return 1;
 }
 
 int
@@ -142,10 +233,10 @@ cache_put6(uint64_t a, uint64_t b, uint64_t c, uint64_t d, uint64_t e, uint64_t
     // abort if locked
     if (s & 0x8000000080000000LL) return 0;
     // create new
-    uint64_t new_s = ((hash>>32) & 0x7fff0000) | 0x04000000;
+    uint64_t new_s = ((hash>>32) & 0x3ffe0000) | 0x40000000 | (cache_epoch(a) << 8);
     new_s |= (new_s<<32);
-    new_s |= (((s>>32)+1)&0xffff)<<32;
-    new_s |= (s+1)&0xffff;
+    new_s |= (((s>>32)+1)&0xff)<<32;
+    new_s |= (s+1)&0xff;
     // use cas to claim bucket
     if (!atomic_compare_exchange_weak(s_bucket, &s, new_s | 0x8000000080000000LL)) return 0;
     // cas succesful: write data
@@ -162,27 +253,92 @@ cache_put6(uint64_t a, uint64_t b, uint64_t c, uint64_t d, uint64_t e, uint64_t
     return 1;
 }
 
-int
-cache_get(uint64_t a, uint64_t b, uint64_t c, uint64_t *res)
+/**
+ * Look for key (a, b, c) in bucket i, where `expected` has the hash and epoch
+ * bits of the status of the entry.
+ */
+static inline int
+cache_get_bucket(size_t i, uint64_t a, uint64_t b, uint64_t c, uint32_t expected, uint64_t *res)
 {
-    const uint64_t hash = cache_hash(a, b, c);
-#if CACHE_MASK
-    _Atomic(uint32_t) *s_bucket = (_Atomic(uint32_t)*)cache_status + (hash & cache_mask);
-    cache_entry_t bucket = cache_table + (hash & cache_mask);
-#else
-    _Atomic(uint32_t) *s_bucket = (_Atomic(uint32_t)*)cache_status + (hash % cache_size);
-    cache_entry_t bucket = cache_table + (hash % cache_size);
-#endif
+    _Atomic(uint32_t) *s_bucket = (_Atomic(uint32_t)*)cache_status + i;
+    cache_entry_t bucket = cache_table + i;
     const uint32_t s = atomic_load_explicit(s_bucket, memory_order_relaxed);
     // abort if locked or if part of a 2-part cache entry
     if (s & 0xc0000000) return 0;
-    // abort if different hash
-    if ((s ^ (hash>>32)) & 0x3fff0000) return 0;
+    // abort if different hash or entry of an older epoch
+    if ((s ^ expected) & 0x3ffeff00) return 0;
     // abort if key different
     if (bucket->a != a || bucket->b != b || bucket->c != c) return 0;
     *res = bucket->res;
-    // abort if status field changed after compiler_barrier()
-    return atomic_load_explicit(s_bucket, memory_order_acquire) == s ? 1 : 0;
+    // abort if status field changed after compiler_barrier() (other than the
+    // referenced bit, which other threads may set)
+    if ((atomic_load_explicit(s_bucket, memory_order_acquire) ^ s) & ~0x00010000) return 0;
+    if (cache_ways > 1 && !(s & 0x00010000)) {
+        // mark as referenced (if this fails, the entry was replaced or is
+        // already marked)
+        uint32_t old = s;
+        atomic_compare_exchange_strong(s_bucket, &old, s | 0x00010000);
+    }
+    return 1;
+}
+
+int
+cache_get(uint64_t a, uint64_t b, uint64_t c, uint64_t *res)
+{
+    const uint64_t hash = cache_hash(a, b, c);
+#if CACHE_MASK
+    const size_t i = hash & cache_mask;
+#else
+    const size_t i = hash % cache_size;
+#endif
+    const uint32_t expected = ((hash>>32) & 0x3ffe0000) | (cache_epoch(a) << 8);
+    const int sampled = cache_sampled(hash);
+    if (sampled) atomic_fetch_add_explicit(&cache_sample_lookups, 1, memory_order_relaxed);
+    sylvan_stats_count(OPCACHE_LOOKUP);
+    if (cache_ways == 1) {
+        if (!cache_get_bucket(i, a, b, c, expected, res)) return 0;
+    } else {
+        const size_t set = i & ~(size_t)(cache_ways-1);
+        int w;
+        for (w=0; w<cache_ways; w++) {
+            if (cache_get_bucket(set+w, a, b, c, expected, res)) break;
+        }
+        if (w == cache_ways) return 0;
+    }
+    if (sampled) atomic_fetch_add_explicit(&cache_sample_hits, 1, memory_order_relaxed);
+    sylvan_stats_count(OPCACHE_HIT);
+    return 1;
+}
+
+/**
+ * Choose the bucket of the set of bucket i (in set-associative mode) in which
+ * cache_put stores key (a, b, c).
+ */
+static size_t
+cache_choose_way(size_t i, uint64_t a, uint64_t b, uint64_t c)
+{
+    const size_t set = i & ~(size_t)(cache_ways-1);
+    size_t empty = SIZE_MAX, unreferenced = SIZE_MAX;
+    for (int w=0; w<cache_ways; w++) {
+        const size_t j = set + w;
+        const uint32_t s = atomic_load_explicit((_Atomic(uint32_t)*)cache_status + j, memory_order_relaxed);
+        if (s == 0 || !cache_is_current(j)) {
+            if (empty == SIZE_MAX) empty = j;
+            continue;
+        }
+        if (s & 0x80000000) continue;
+        // (racy, but at worst the same key ends up in two buckets)
+        if (cache_table[j].a == a && cache_table[j].b == b && cache_table[j].c == c) return j;
+        if (!(s & 0x00010000) && unreferenced == SIZE_MAX) unreferenced = j;
+    }
+    if (empty != SIZE_MAX) return empty;
+    if (unreferenced != SIZE_MAX) return unreferenced;
+    // all entries were referenced: give them all a second chance, and replace
+    // the one in the bucket of the key
+    for (int w=0; w<cache_ways; w++) {
+        atomic_fetch_and((_Atomic(uint32_t)*)cache_status + set + w, ~(uint32_t)0x00010000);
+    }
+    return i;
 }
 
 int
@@ -190,20 +346,21 @@ cache_put(uint64_t a, uint64_t b, uint64_t c, uint64_t res)
 {
     const uint64_t hash = cache_hash(a, b, c);
 #if CACHE_MASK
-    _Atomic(uint32_t) *s_bucket = (_Atomic(uint32_t)*)cache_status + (hash & cache_mask);
-    cache_entry_t bucket = cache_table + (hash & cache_mask);
+    size_t i = hash & cache_mask;
 #else
-    _Atomic(uint32_t) *s_bucket = (_Atomic(uint32_t)*)cache_status + (hash % cache_size);
-    cache_entry_t bucket = cache_table + (hash % cache_size);
+    size_t i = hash % cache_size;
 #endif
+    if (cache_ways > 1) i = cache_choose_way(i, a, b, c);
+    _Atomic(uint32_t) *s_bucket = (_Atomic(uint32_t)*)cache_status + i;
+    cache_entry_t bucket = cache_table + i;
     uint32_t s = atomic_load_explicit(s_bucket, memory_order_relaxed);
     // abort if locked
     if (s & 0x80000000) return 0;
     // abort if hash identical -> no: in iscasmc this occasionally causes timeouts?!
-    const uint32_t hash_mask = (hash>>32) & 0x3fff0000;
+    const uint32_t hash_mask = (hash>>32) & 0x3ffe0000;
     // if ((s & 0x7fff0000) == hash_mask) return 0;
-    // use cas to claim bucket
-    const uint32_t new_s = ((s+1) & 0x0000ffff) | hash_mask;
+    // use cas to claim bucket (new entries are not referenced yet)
+    const uint32_t new_s = ((s+1) & 0x000000ff) | (cache_epoch(a) << 8) | hash_mask;
     if (!atomic_compare_exchange_weak(s_bucket, &s, new_s | 0x80000000)) return 0;
     // cas succesful: write data
     bucket->a = a;
@@ -237,6 +394,11 @@ cache_create(size_t _cache_size, size_t _max_size)
         exit(1);
     }
 
+    if (cache_size % cache_ways != 0) {
+        fprintf(stderr, "cache_create: Table size must be a multiple of the associativity!\n");
+        exit(1);
+    }
+
     cache_table = (cache_entry_t)alloc_aligned(cache_max * sizeof(struct cache_entry));
     cache_status = (uint32_t*)alloc_aligned(cache_max * sizeof(uint32_t));
     if (cache_table == 0 || cache_status == 0) {
@@ -245,6 +407,7 @@ cache_create(size_t _cache_size, size_t _max_size)
     }
 
     next_opid = 512LL << 40;
+    cache_init_opclasses();
 }
 
 void
@@ -254,12 +417,146 @@ cache_free()
     free_aligned(cache_status, cache_max * sizeof(uint32_t));
 }
 
+void
+cache_clear_opclass(cache_opclass_t opclass)
+{
+    const uint32_t epoch = (atomic_load(&cache_epochs[opclass]) + 1) & 0xff;
+    if (epoch == 0) {
+        // the epoch wraps around, so entries of older epochs with the same
+        // value would become valid again: remove all entries of the class
+        for (size_t i=0; i<cache_size; i++) {
+            if (cache_status[i] == 0) continue;
+            if (cache_opclass(cache_table[i].a) != opclass) continue;
+            memset(cache_table + i, 0, sizeof(struct cache_entry));
+            cache_status[i] = 0;
+        }
+    }
+    atomic_store(&cache_epochs[opclass], epoch);
+}
+
 void
 cache_clear()
 {
-    // a bit silly, but this works just fine, and does not require writing 0 everywhere...
-    cache_free();
-    cache_create(cache_size, cache_max);
+    for (int c=0; c<CACHE_N_OPCLASSES; c++) {
+        cache_clear_opclass((cache_opclass_t)c);
+    }
+}
+
+size_t
+cache_clear_filter(cache_filter_cb filter, void *ctx)
+{
+    // Dropping an entry is always safe: at worst it turns a future hit into a
+    // miss. This includes the halves of 2-part (cache6) entries, which are
+    // simply both invalidated when either half is dropped.
+    size_t removed = 0;
+    for (size_t i=0; i<cache_size; i++) {
+        if (cache_status[i] == 0) continue;
+        cache_entry_t bucket = cache_table + i;
+        if (filter(bucket->a, bucket->b, bucket->c, ctx)) {
+            // reset to the same state as a freshly allocated bucket
+            memset(bucket, 0, sizeof(struct cache_entry));
+            cache_status[i] = 0;
+            removed++;
+        }
+    }
+    return removed;
+}
+
+void
+cache_set_gc_keep(cache_opclass_t opclass, cache_keep_cb keep)
+{
+    cache_gc_keep[opclass] = keep;
+}
+
+size_t
+cache_gc_filter_range(size_t first, size_t last)
+{
+    if (last > cache_size) last = cache_size;
+    size_t kept = 0;
+    for (size_t i=first; i<last; i++) {
+        const uint32_t s = cache_status[i];
+        if (s == 0) continue;
+        cache_entry_t bucket = cache_table + i;
+        if (!(s & 0x40000000) && cache_is_current(i)) {
+            cache_keep_cb keep = cache_gc_keep[cache_opclass(bucket->a)];
+            if (keep != NULL && keep(bucket->a, bucket->b, bucket->c, bucket->res)) {
+                kept++;
+                continue;
+            }
+        }
+        // cleared, part of a 2-part entry, or not kept
+        memset(bucket, 0, sizeof(struct cache_entry));
+        cache_status[i] = 0;
+    }
+    return kept;
+}
+
+size_t
+cache_remap(cache_remap_cb remap, void *ctx)
+{
+    // Bitmap of the buckets which already contain a rewritten entry, which
+    // should not be passed to the callback a second time.
+    uint64_t *remapped = calloc((cache_size + 63) / 64, sizeof(uint64_t));
+    if (remapped == NULL) {
+        fprintf(stderr, "cache_remap: Unable to allocate memory: %s!\n", strerror(errno));
+        exit(1);
+    }
+
+    size_t kept = 0;
+    for (size_t i=0; i<cache_size; i++) {
+        if (remapped[i/64] & (1ULL << (i%64))) continue;
+        const uint32_t s = cache_status[i];
+        if (s == 0) continue;
+        const int current = cache_is_current(i);
+
+        // take the entry out of its bucket
+        uint64_t a = cache_table[i].a, b = cache_table[i].b;
+        uint64_t c = cache_table[i].c, res = cache_table[i].res;
+        memset(cache_table + i, 0, sizeof(struct cache_entry));
+        cache_status[i] = 0;
+
+        if (s & 0x40000000) continue; // part of a 2-part entry
+        if (!current) continue; // cleared
+        if (!remap(&a, &b, &c, &res, ctx)) continue;
+
+        // put it (back) in the bucket for its (new) key, as cache_put does
+        const uint64_t hash = cache_hash(a, b, c);
+#if CACHE_MASK
+        const size_t j = hash & cache_mask;
+#else
+        const size_t j = hash % cache_size;
+#endif
+        if (!(remapped[j/64] & (1ULL << (j%64)))) kept++;
+        cache_table[j].a = a;
+        cache_table[j].b = b;
+        cache_table[j].c = c;
+        cache_table[j].res = res;
+        cache_status[j] = ((s+1) & 0x000000ff) | (cache_epoch(a) << 8) | ((hash>>32) & 0x3ffe0000);
+        remapped[j/64] |= (1ULL << (j%64));
+    }
+
+    free(remapped);
+    return kept;
+}
+
+void
+cache_set_associativity(int ways)
+{
+    if (ways != 1 && ways != 2 && ways != 4) {
+        fprintf(stderr, "cache_set_associativity: associativity must be 1, 2 or 4!\n");
+        exit(1);
+    }
+    if (cache_table != NULL && cache_size % ways != 0) {
+        fprintf(stderr, "cache_set_associativity: Table size must be a multiple of the associativity!\n");
+        exit(1);
+    }
+    cache_ways = ways;
+}
+
+int
+cache_get_associativity()
+{
+    return cache_ways;
 }
 
 void
@@ -270,6 +567,70 @@ cache_setsize(size_t size)
     cache_create(size, cache_max);
 }
 
+void
+cache_grow(size_t new_size)
+{
+#if CACHE_MASK
+    if (__builtin_popcountll(new_size) != 1 || new_size > cache_max) {
+        fprintf(stderr, "cache_grow: Table size must be a power of 2 and <= max size!\n");
+        exit(1);
+    }
+    if (new_size <= cache_size) return;
+
+    // Every entry moves from its bucket i (in the set of its old bucket) to
+    // the same way of the set of its new bucket, which is either i or a bucket
+    // beyond the old size (and thus empty).
+    const size_t old_size = cache_size;
+    cache_size = new_size;
+    cache_mask = new_size - 1;
+    for (size_t i=0; i<old_size; i++) {
+        const uint32_t s = cache_status[i];
+        if (s == 0) continue;
+        cache_entry_t bucket = cache_table + i;
+        if (!(s & 0x40000000) && cache_is_current(i)) {
+            const uint64_t hash = cache_hash(bucket->a, bucket->b, bucket->c);
+            const size_t j = ((hash & cache_mask) & ~(size_t)(cache_ways-1)) | (i & (cache_ways-1));
+            if (j == i) continue;
+            cache_table[j] = *bucket;
+            cache_status[j] = s;
+        }
+        // moved, cleared or part of a 2-part entry (whose halves are in a
+        // fixed pair of buckets)
+        memset(bucket, 0, sizeof(struct cache_entry));
+        cache_status[i] = 0;
+    }
+#else
+    cache_setsize(new_size);
+#endif
+}
+
+void
+cache_sample(uint64_t *lookups, uint64_t *hits)
+{
+    *lookups = atomic_load_explicit(&cache_sample_lookups, memory_order_relaxed);
+    *hits = atomic_load_explicit(&cache_sample_hits, memory_order_relaxed);
+}
+
+void
+cache_sample_reset()
+{
+    atomic_store(&cache_sample_lookups, 0);
+    atomic_store(&cache_sample_hits, 0);
+}
+
+double
+cache_estimate_used(size_t n)
+{
+    if (n >= cache_size) return (double)cache_getused() / cache_size;
+    const size_t stride = cache_size / n;
+    size_t used = 0;
+    for (size_t k=0; k<n; k++) {
+        const size_t i = k * stride;
+        if (cache_status[i] && cache_is_current(i)) used++;
+    }
+    return (double)used / n;
+}
+
 size_t
 cache_getsize()
 {
@@ -283,7 +644,7 @@ cache_getused()
     for (size_t i=0;i<cache_size;i++) {
         uint32_t s = cache_status[i];
         if (s & 0x80000000) fprintf(stderr, "cache_getuser: cache in use during cache_getused()\n");
-        if (s) result++;
+        if (s && cache_is_current(i)) result++;
     }
     return result;
 }
@@ -113,12 +113,128 @@ void cache_create(size_t _cache_size, size_t _max_size);
 
 void cache_free(void);
 
+/**
+ * Classes of operations, by the ranges of operation ids in sylvan_int.h. The
+ * cached results of a class can be cleared without clearing the others, e.g.
+ * results which depend on edge weight indices but not BDD results.
+ */
+typedef enum cache_opclass {
+    CACHE_OPCLASS_BDD,      // 0-19
+    CACHE_OPCLASS_LDD,      // 20-39
+    CACHE_OPCLASS_MTBDD,    // 40-69
+    CACHE_OPCLASS_EVBDD,    // 70-79
+    CACHE_OPCLASS_WGT,      // 80-89
+    CACHE_OPCLASS_QMDD,     // 90-99
+    CACHE_OPCLASS_ZDD,      // 100-511
+    CACHE_OPCLASS_CUSTOM,   // ids from cache_next_opid()
+    CACHE_N_OPCLASSES
+} cache_opclass_t;
+
+/**
+ * Clear all cache entries. This takes constant time: the entries are not
+ * removed, but are of an older epoch than their operation class after this.
+ */
 void cache_clear(void);
 
+/**
+ * Clear the cache entries of the given operation class (in constant time).
+ * Must not be called while other workers are using the cache.
+ */
+void cache_clear_opclass(cache_opclass_t opclass);
+
+/**
+ * Callback for cache_clear_filter. Receives the key (a, b, c) of a cache entry
+ * (with the operation id in the high bits of a) and returns 1 if the entry
+ * should be removed.
+ */
+typedef int (*cache_filter_cb)(uint64_t a, uint64_t b, uint64_t c, void *ctx);
+
+/**
+ * Remove all cache entries for which the filter returns 1, keeping all other
+ * entries. Unlike cache_clear(), this scans the entire cache, so it should
+ * only be used when a small subset of the cached results becomes invalid.
+ * Must not be called while other workers are using the cache.
+ * Returns the number of removed entries.
+ */
+size_t cache_clear_filter(cache_filter_cb filter, void *ctx);
+
+/**
+ * Callback for cache_gc_filter_range. Receives the key (a, b, c) and result of
+ * a cache entry and returns 1 if the entry is still valid after garbage
+ * collection, i.e. if all nodes it refers to are marked.
+ */
+typedef int (*cache_keep_cb)(uint64_t a, uint64_t b, uint64_t c, uint64_t res);
+
+/**
+ * Set the callback which decides which entries of the given operation class
+ * survive garbage collection (NULL, the default, removes all of them).
+ */
+void cache_set_gc_keep(cache_opclass_t opclass, cache_keep_cb keep);
+
+/**
+ * Remove the entries in buckets first, ..., last-1 (last is capped at the size
+ * of the cache) which are not kept by the callback of their class. 2-part
+ * (cache6) entries are always removed. Disjoint ranges can be filtered in
+ * parallel, but not while other workers are using the cache.
+ * Returns the number of kept entries.
+ */
+size_t cache_gc_filter_range(size_t first, size_t last);
+
+/**
+ * Callback for cache_remap. Receives pointers to the key (a, b, c) and result
+ * of a cache entry, which it may rewrite in place. Returns 1 if the (rewritten)
+ * entry should be kept, 0 if it should be removed.
+ */
+typedef int (*cache_remap_cb)(uint64_t *a, uint64_t *b, uint64_t *c, uint64_t *res, void *ctx);
+
+/**
+ * Rewrite every cache entry with the given callback (each entry is passed to it
+ * exactly once), and move entries whose key changed to their new bucket. This
+ * is for when the identifiers of the things in the cache change, but the
+ * results themselves remain valid. Entries which end up in the same bucket
+ * replace each other, and 2-part (cache6) entries are always removed.
+ * Must not be called while other workers are using the cache.
+ * Returns the number of kept entries.
+ */
+size_t cache_remap(cache_remap_cb remap, void *ctx);
+
+/**
+ * Set the associativity of the cache: 1 (direct-mapped, the default, see
+ * CACHE_WAYS), 2 or 4. With 2 or 4 ways, a result can be stored in any bucket
+ * of an aligned set of 2 or 4 buckets, so fewer results are lost to collisions,
+ * at the cost of probing the whole set on a miss. Entries stay valid when this
+ * is changed, but entries outside the bucket of their key are no longer found
+ * when the associativity is lowered.
+ * Must not be called while other workers are using the cache.
+ */
+void cache_set_associativity(int ways);
+
+int cache_get_associativity(void);
+
 void cache_setsize(size_t size);
 
 size_t cache_getused(void);
 
+/**
+ * Grow the cache to the given size (at most the max size), keeping its entries
+ * (except 2-part entries). Must not be called while other workers are using
+ * the cache.
+ */
+void cache_grow(size_t new_size);
+
+/**
+ * Number of lookups and hits of cache_get (and cache_get6) since the last
+ * cache_sample_reset(), for a sample of 1 in CACHE_SAMPLE_RATE keys.
+ */
+#define CACHE_SAMPLE_RATE 64
+void cache_sample(uint64_t *lookups, uint64_t *hits);
+void cache_sample_reset(void);
+
+/**
+ * Estimate the fraction of used buckets from n buckets spread over the cache.
+ */
+double cache_estimate_used(size_t n);
+
 size_t cache_getsize(void);
 
 size_t cache_getmaxsize(void);
@@ -44,6 +44,18 @@ sylvan_gc_disable()
     gc_enabled = 0;
 }
 
+/**
+ * Whether garbage collection keeps the cache entries of which all nodes are
+ * marked, or clears the whole operation cache.
+ */
+static int gc_keep_cache = SYLVAN_GC_KEEP_CACHE;
+
+void
+sylvan_gc_set_keep_cache(int enabled)
+{
+    gc_keep_cache = enabled;
+}
+
 /**
  * This variable is used for a cas flag so only one gc runs at one time
  */
@@ -104,6 +116,12 @@ VOID_TASK_IMPL_0(sylvan_clear_cache)
    cache_clear();
 }
 
+void
+sylvan_set_cache_associativity(int ways)
+{
+    cache_set_associativity(ways);
+}
+
 /**
  * Clear the nodes table and mark all referenced nodes.
  *
@@ -178,7 +196,7 @@ VOID_TASK_IMPL_0(sylvan_gc_aggressive_resize)
     if (cache_size < cache_max) {
         size_t new_size = next_size(cache_size);
         if (new_size > cache_max) new_size = cache_max;
-        cache_setsize(new_size);
+        cache_grow(new_size);
     }
 }
 
@@ -203,12 +221,102 @@ VOID_TASK_IMPL_0(sylvan_gc_normal_resize)
             if (cache_size < cache_max) {
                 new_size = next_size(cache_size);
                 if (new_size > cache_max) new_size = cache_max;
-                cache_setsize(new_size);
+                cache_grow(new_size);
             }
         }
     }
 }
 
+/**
+ * Adaptive resizing of the operation cache between garbage collections.
+ *
+ * The resize hooks above only grow the cache during garbage collection, so a
+ * computation which never collects garbage keeps the initial cache size.
+ * sylvan_cache_adapt() (called before every QMDD gate and EVBDD multiplication)
+ * looks at a window of about as many lookups as the cache has buckets, and
+ * doubles the cache (keeping its entries) if most of these lookups missed and
+ * the cache is nearly full, up to the max size and the memory budget. If the
+ * hit rate does not improve by at least CACHE_ADAPT_MIN_GAIN after growing, the
+ * misses are not due to lack of space, and the cache is not grown again until
+ * the next garbage collection.
+ */
+#define CACHE_ADAPT_MISS_RATE   0.5
+#define CACHE_ADAPT_USED        0.75
+#define CACHE_ADAPT_MIN_GAIN    0.01
+#define CACHE_ADAPT_SAMPLES     4096
+
+static int cache_adaptive = SYLVAN_CACHE_ADAPTIVE;
+static size_t cache_budget = 0;
+static int cache_adapt_stalled = 0;
+static double cache_adapt_prev_hit_rate = -1; // of the window before the last growth
+
+void
+sylvan_set_cache_adaptive(int enabled, size_t budget)
+{
+    cache_adaptive = enabled;
+    cache_budget = budget;
+    cache_adapt_stalled = 0;
+    cache_adapt_prev_hit_rate = -1;
+}
+
+static void
+sylvan_cache_adapt_reset()
+{
+    cache_sample_reset();
+    cache_adapt_stalled = 0;
+    cache_adapt_prev_hit_rate = -1;
+}
+
+void
+sylvan_cache_adapt()
+{
+    if (!cache_adaptive || cache_adapt_stalled) return;
+
+    uint64_t lookups, hits;
+    cache_sample(&lookups, &hits);
+    const size_t size = cache_getsize();
+    if (lookups * CACHE_SAMPLE_RATE < size) return; // window not complete yet
+    cache_sample_reset();
+
+    const double hit_rate = (double)hits / lookups;
+    if (cache_adapt_prev_hit_rate >= 0) {
+        const double prev = cache_adapt_prev_hit_rate;
+        cache_adapt_prev_hit_rate = -1;
+        if (hit_rate < prev + CACHE_ADAPT_MIN_GAIN) {
+            sylvan_stats_count(OPCACHE_ADAPT_STALL);
+            cache_adapt_stalled = 1;
+            return;
+        }
+    }
+
+    if (1.0 - hit_rate < CACHE_ADAPT_MISS_RATE || cache_estimate_used(CACHE_ADAPT_SAMPLES) < CACHE_ADAPT_USED) {
+        sylvan_stats_count(OPCACHE_ADAPT_KEEP);
+        return;
+    }
+
+    const size_t new_size = next_size(size);
+    if (new_size > cache_getmaxsize() || (cache_budget != 0 && new_size * 36 > cache_budget)) {
+        sylvan_stats_count(OPCACHE_ADAPT_LIMIT);
+        return;
+    }
+
+    cache_grow(new_size);
+    cache_adapt_prev_hit_rate = hit_rate;
+    sylvan_stats_count(OPCACHE_ADAPT_GROW);
+}
+
+/**
+ * Remove the cache entries in buckets first, ..., first+count-1 which refer to
+ * unmarked nodes (in parallel). Returns the number of kept entries.
+ */
+TASK_2(size_t, sylvan_gc_filter_cache, size_t, first, size_t, count)
+{
+    if (count <= (1 << 16)) return cache_gc_filter_range(first, first + count);
+    SPAWN(sylvan_gc_filter_cache, first, count / 2);
+    size_t kept = CALL(sylvan_gc_filter_cache, first + count / 2, count - count / 2);
+    return kept + SYNC(sylvan_gc_filter_cache);
+}
+
 /**
  * Actual implementation of garbage collection
  */
@@ -222,17 +330,25 @@ VOID_TASK_0(sylvan_gc_go)
         WRAP(e->cb);
     }
 
-    /*
-     * This simply clears the cache.
-     * Alternatively, we could implement for example some strategy
-     * where part of the cache is cleared and part is marked
-     */
-    CALL(sylvan_clear_cache);
-
-    CALL(sylvan_clear_and_mark);
+    if (gc_keep_cache) {
+        /*
+         * Marking does not change the indices of marked nodes, so cache
+         * entries of which all nodes are marked are still valid afterwards.
+         */
+        CALL(sylvan_clear_and_mark);
+        size_t kept = CALL(sylvan_gc_filter_cache, 0, cache_getsize());
+        sylvan_stats_add(SYLVAN_GC_CACHE_KEPT, kept);
+    } else {
+        /*
+         * This simply clears the cache.
+         */
+        CALL(sylvan_clear_cache);
+        CALL(sylvan_clear_and_mark);
+    }
 
     // call hooks for resizing and all that
     WRAP(main_hook);
+    sylvan_cache_adapt_reset();
 
     CALL(sylvan_rehash_all);
 
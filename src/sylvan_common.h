@@ -138,6 +138,15 @@ VOID_TASK_DECL_0(sylvan_gc);
 void sylvan_gc_enable(void);
 void sylvan_gc_disable(void);
 
+/**
+ * Choose whether garbage collection clears the whole operation cache (0), or
+ * only removes the entries which refer to nodes that are not marked (1, the
+ * default, see SYLVAN_GC_KEEP_CACHE). Entries are only kept for operation
+ * classes which say which of their fields are nodes (cache_set_gc_keep), which
+ * are currently the EVBDD and QMDD operations.
+ */
+void sylvan_gc_set_keep_cache(int enabled);
+
 /**
  * Test if garbage collection must happen now.
  * This is just a call to the Lace framework to see if NEWFRAME has been used.
@@ -151,6 +160,29 @@ void sylvan_gc_disable(void);
 VOID_TASK_DECL_0(sylvan_clear_cache);
 #define sylvan_clear_cache() RUN(sylvan_clear_cache)
 
+/**
+ * Set the associativity of the operation cache: 1 (direct-mapped), 2 or 4.
+ * Can be called before or after sylvan_init_package, but not while other
+ * workers are running operations.
+ */
+void sylvan_set_cache_associativity(int ways);
+
+/**
+ * Enable/disable growing the operation cache between garbage collections when
+ * it misses often and is nearly full (SYLVAN_CACHE_ADAPTIVE is the default).
+ * The cache grows up to its max size, and up to `budget` bytes (36 bytes per
+ * bucket) unless `budget` is 0.
+ */
+void sylvan_set_cache_adaptive(int enabled, size_t budget);
+
+/**
+ * Grow the operation cache if the lookups since the last call warrant it (see
+ * sylvan_set_cache_adaptive). Only call this between top-level operations,
+ * i.e. when no worker uses the cache. The decisions are counted in the
+ * OPCACHE_ADAPT_* statistics.
+ */
+void sylvan_cache_adapt(void);
+
 /**
  * Clear the nodes table (data part) and mark all nodes with the marking mechanisms.
  */
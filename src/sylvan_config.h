@@ -3,6 +3,68 @@
 #define CACHE_MASK 1
 #endif
 
+/**
+ * Default associativity of the operation cache: 1 (direct-mapped), 2 or 4, see
+ * cache_set_associativity().
+ */
+#ifndef CACHE_WAYS
+#define CACHE_WAYS 1
+#endif
+
+/**
+ * Grow the operation cache between garbage collections based on its hit rate
+ * and occupancy, see sylvan_set_cache_adaptive().
+ */
+#ifndef SYLVAN_CACHE_ADAPTIVE
+#define SYLVAN_CACHE_ADAPTIVE 1
+#endif
+
+/**
+ * Keep the operation cache entries of which all nodes survive garbage
+ * collection, see sylvan_gc_set_keep_cache().
+ */
+#ifndef SYLVAN_GC_KEEP_CACHE
+#define SYLVAN_GC_KEEP_CACHE 1
+#endif
+
+/**
+ * Tune the levels at which the results of the EVBDD/QMDD operations are cached
+ * during a run, see evbdd_set_caching_autotune().
+ */
+#ifndef EVBDD_CACHE_AUTOTUNE
+#define EVBDD_CACHE_AUTOTUNE 0
+#endif
+
+/**
+ * Apply diagonal (phase) gates by rescaling the low and high edges at the
+ * target, instead of summing the products with all four gate entries.
+ */
+#ifndef QMDD_FAST_DIAGONAL_GATES
+#define QMDD_FAST_DIAGONAL_GATES 1
+#endif
+
+/**
+ * Layout of the EVBDD edges and nodes: 33 bits for the index of an edge weight
+ * and 30 bits for the index of a node if set, 23 and 40 bits otherwise. The
+ * edge weight table (with the pinned weights) has to fit in the first, and the
+ * nodes table in the second. Edge weight tables of up to 2^23 entries fit in
+ * the default layout.
+ */
+#ifndef SYLVAN_EVBDD_LARGE_WGT_INDICES
+#define SYLVAN_EVBDD_LARGE_WGT_INDICES 0
+#endif
+
+/**
+ * 128 bit EVBDD edges instead of 64 bit ones, with 32 bits for the index of an
+ * edge weight and 38 bits for the index of a node (this overrides
+ * SYLVAN_EVBDD_LARGE_WGT_INDICES). The nodes stay 16 bytes, but results of
+ * EVBDD and QMDD operations take two cache buckets, and are not kept in the
+ * cache when garbage collection runs.
+ */
+#ifndef SYLVAN_EVBDD_WIDE_EDGES
+#define SYLVAN_EVBDD_WIDE_EDGES 0
+#endif
+
 /* Nodes table: use bitmasks for module (size must be power of 2!) */
 #ifndef LLMSSET_MASK
 #define LLMSSET_MASK 1
@@ -33,3 +95,38 @@
 #ifndef SYLVAN_AGGRESSIVE_RESIZE
 #define SYLVAN_AGGRESSIVE_RESIZE 1
 #endif
+
+/**
+ * Specialise the edge weight arithmetic at compile time for the default
+ * configuration (WGT_COMPLEX_128 weights in a COMP_HASHMAP), so that value
+ * retrieval, arithmetic and table lookup inline into wgt_add, wgt_mul, etc.
+ * Other configurations still use the runtime function pointers.
+ */
+#ifndef SYLVAN_WGT_COMPLEX_INLINE
+#define SYLVAN_WGT_COMPLEX_INLINE 1
+#endif
+
+/**
+ * Number of entries (power of 2) of the per-worker cache of complex edge weight
+ * lookups in front of the shared edge weight table. 0 disables the cache.
+ */
+#ifndef SYLVAN_WGT_L0_CACHE_SIZE
+#define SYLVAN_WGT_L0_CACHE_SIZE 256
+#endif
+
+/**
+ * Default number of entries (power of 2) of the cache of edge weight operation
+ * results, see wgt_cache_set_size(). An entry takes 24 bytes.
+ */
+#ifndef SYLVAN_WGT_CACHE_SIZE
+#define SYLVAN_WGT_CACHE_SIZE (1ULL << 20)
+#endif
+
+/**
+ * Number of edge weight indices reserved for pinned weights (constants and
+ * gate entries), which keep their index across edge weight gc. Must be a power
+ * of 2, and at most 2^16.
+ */
+#ifndef SYLVAN_WGT_PINNED_SIZE
+#define SYLVAN_WGT_PINNED_SIZE 1024
+#endif
@@ -1,21 +1,22 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <sylvan_edge_weights.h>
 #include <sylvan_edge_weights_complex.h>
+#include <sylvan_edge_weights_real.h>
+#include <sylvan_edge_weights_rational.h>
 #include <sylvan_int.h>
+#include <sylvan_align.h>
+
+#if SYLVAN_WGT_COMPLEX_INLINE
+#include <edge_weight_storage/cmap_int.h>
+#endif
 
 
 void *wgt_storage; // TODO: move to source file?
 void *wgt_storage_new;
 
-EVBDD_WGT EVBDD_ZERO;
-EVBDD_WGT EVBDD_ONE;
-EVBDD_WGT EVBDD_MIN_ONE;
-EVBDD_WGT EVBDD_IMG;
-EVBDD_WGT EVBDD_MIN_IMG;
-EVBDD_WGT EVBDD_SQRT_TWO;
-
 void sylvan_init_edge_weights(size_t min_tablesize, size_t max_tablesize, double tol, edge_weight_type_t edge_weight_type, wgt_storage_backend_t backend);
 void init_edge_weight_functions(edge_weight_type_t edge_weight_type);
 void init_edge_weight_storage(size_t size, double tol, wgt_storage_backend_t backend, void **wgt_store);
@@ -23,7 +24,13 @@ void (*init_wgt_table_entries)(); // set by sylvan_init_evbdd
 uint64_t sylvan_get_edge_weight_table_size();
 double sylvan_edge_weights_tolerance();
 uint64_t sylvan_edge_weights_count_entries();
+uint64_t sylvan_edge_weights_count_near_duplicates();
 void sylvan_edge_weights_free();
+static void wgt_l0_invalidate();
+static void wgt_pinned_reset();
+static void wgt_pinned_fill(void *wgt_store);
+static void wgt_cache_create();
+static void wgt_cache_free();
 
 /******************<Interface for different edge_weight_types>*****************/
 
@@ -50,30 +57,76 @@ wgt_get_low_L2normed_f	wgt_get_low_L2normed;
 
 weight_fprint_f 		weight_fprint;
 
+weight_representable_f  weight_representable;
+weight_lookup_complex_f weight_lookup_complex;
+weight_value_complex_f  weight_value_complex;
+
 /**********************<Managing the edge weight table>************************/
 
 // Table parameters
 static const double default_tolerance = 1e-14;
 static double tolerance;
 static wgt_storage_backend_t wgt_backend;
+static edge_weight_type_t wgt_type;
 size_t table_size; // current
 size_t min_tablesize; // initial
 size_t max_tablesize; // maximum
 
+// True iff the configuration is complex weights stored in a cmap, for which
+// the arithmetic below has a compile-time specialised path.
+static bool wgt_complex_hashmap = false;
+
 void sylvan_init_edge_weights(size_t _min_tablesize, size_t _max_tablesize, double tol,
                               edge_weight_type_t edge_weight_type, wgt_storage_backend_t backend)
 {
     min_tablesize = _min_tablesize;
     max_tablesize = _max_tablesize;
     init_edge_weight_functions(edge_weight_type);
+    wgt_pinned_reset();
+    init_one_zero();
+    // A resizable storage grows by itself (without changing the indices of the
+    // weights), so it can be created at its maximum size. Weight GC is then
+    // only needed to reclaim dead weights once it gets full.
+    if (wgt_storage_is_resizable(backend)) {
+        min_tablesize = max_tablesize;
+    }
+    init_edge_weight_storage_gc(); // before the pinned weights are added
+    wgt_cache_create();
     init_edge_weight_storage(min_tablesize, tol, backend, &wgt_storage);
-    init_edge_weight_storage_gc();
+    wgt_complex_hashmap = (SYLVAN_WGT_COMPLEX_INLINE && 
+                           edge_weight_type == WGT_COMPLEX_128 && 
+                           backend == COMP_HASHMAP);
 }
 
 void init_edge_weight_functions(edge_weight_type_t edge_weight_type)
 {
+    wgt_type = edge_weight_type;
     switch (edge_weight_type)
     {
+    case WGT_DOUBLE:
+        weight_malloc       = (weight_malloc_f) &weight_real_malloc;
+        _weight_value       = (_weight_value_f) &_weight_real_value;
+        weight_lookup       = (weight_lookup_f) &weight_real_lookup;
+        _weight_lookup_ptr  = (_weight_lookup_ptr_f) &_weight_real_lookup_ptr;
+        init_one_zero       = (init_one_zero_f) &init_real_one_zero;
+        weight_abs          = (weight_abs_f) &weight_real_abs;
+        weight_neg          = (weight_neg_f) &weight_real_neg;
+        weight_conj         = (weight_conj_f) &weight_real_conj;
+        weight_sqr          = (weight_sqr_f) &weight_real_sqr;
+        weight_add          = (weight_add_f) &weight_real_add;
+        weight_sub          = (weight_sub_f) &weight_real_sub;
+        weight_mul          = (weight_mul_f) &weight_real_mul;
+        weight_div          = (weight_div_f) &weight_real_div;
+        weight_eq           = (weight_eq_f) &weight_real_eq;
+        weight_eps_close    = (weight_eps_close_f) &weight_real_eps_close;
+        weight_greater      = (weight_greater_f) &weight_real_greater;
+        wgt_norm_L2         = (wgt_norm_L2_f) &wgt_real_norm_L2;
+        wgt_get_low_L2normed= (wgt_get_low_L2normed_f) &wgt_real_get_low_L2normed;
+        weight_fprint       = (weight_fprint_f) &weight_real_fprint;
+        weight_representable= &weight_real_representable;
+        weight_lookup_complex = &weight_real_lookup_complex;
+        weight_value_complex  = &weight_real_value_complex;
+        break;
     case WGT_COMPLEX_128:
         weight_malloc       = (weight_malloc_f) &weight_complex_malloc;
         _weight_value       = (_weight_value_f) &_weight_complex_value;
@@ -94,6 +147,33 @@ void init_edge_weight_functions(edge_weight_type_t edge_weight_type)
         wgt_norm_L2         = (wgt_norm_L2_f) &wgt_complex_norm_L2;
         wgt_get_low_L2normed= (wgt_get_low_L2normed_f) &wgt_complex_get_low_L2normed;
         weight_fprint       = (weight_fprint_f) &weight_complex_fprint;
+        weight_representable= &weight_complex_representable;
+        weight_lookup_complex = &weight_complex_lookup;
+        weight_value_complex  = &weight_complex_value;
+        break;
+    case WGT_RATIONAL_128:
+        weight_malloc       = (weight_malloc_f) &weight_rational_malloc;
+        _weight_value       = (_weight_value_f) &_weight_rational_value;
+        weight_lookup       = (weight_lookup_f) &weight_rational_lookup;
+        _weight_lookup_ptr  = (_weight_lookup_ptr_f) &_weight_rational_lookup_ptr;
+        init_one_zero       = (init_one_zero_f) &init_rational_one_zero;
+        weight_abs          = (weight_abs_f) &weight_rational_abs;
+        weight_neg          = (weight_neg_f) &weight_rational_neg;
+        weight_conj         = (weight_conj_f) &weight_rational_conj;
+        weight_sqr          = (weight_sqr_f) &weight_rational_sqr;
+        weight_add          = (weight_add_f) &weight_rational_add;
+        weight_sub          = (weight_sub_f) &weight_rational_sub;
+        weight_mul          = (weight_mul_f) &weight_rational_mul;
+        weight_div          = (weight_div_f) &weight_rational_div;
+        weight_eq           = (weight_eq_f) &weight_rational_eq;
+        weight_eps_close    = (weight_eps_close_f) &weight_rational_eps_close;
+        weight_greater      = (weight_greater_f) &weight_rational_greater;
+        wgt_norm_L2         = (wgt_norm_L2_f) &wgt_rational_norm_L2;
+        wgt_get_low_L2normed= (wgt_get_low_L2normed_f) &wgt_rational_get_low_L2normed;
+        weight_fprint       = (weight_fprint_f) &weight_rational_fprint;
+        weight_representable= &weight_rational_representable;
+        weight_lookup_complex = &weight_rational_lookup_complex;
+        weight_value_complex  = &weight_rational_value_complex;
         break;
     default:
         printf("ERROR: Unrecognized weight type = %d\n", edge_weight_type);
@@ -110,13 +190,26 @@ init_edge_weight_storage(size_t size, double tol, wgt_storage_backend_t backend,
     table_size = size;
     wgt_backend = backend;
 
-    init_wgt_storage_functions(backend);
+    if (wgt_type == WGT_DOUBLE) {
+        init_real_wgt_storage_functions(backend);
+    } else if (wgt_type == WGT_RATIONAL_128) {
+        init_exact_wgt_storage_functions(backend);
+    } else {
+        init_wgt_storage_functions(backend);
+    }
 
-    // create actual table
-    *wgt_store = wgt_store_create(table_size, tolerance);
+    // create actual table (cached lookups refer to the table it replaces)
+    *wgt_store = wgt_store_create(wgt_table_store_size(table_size), tolerance);
+    wgt_l0_invalidate();
 
-    // Set EVBDD_WGT values for 1, 0 (and -1)
-    init_one_zero(*wgt_store);
+    // Put the pinned weights (0, 1, -1, ...) in it
+    wgt_pinned_fill(*wgt_store);
+}
+
+edge_weight_type_t
+sylvan_get_edge_weight_type()
+{
+    return wgt_type;
 }
 
 uint64_t
@@ -131,16 +224,28 @@ sylvan_edge_weights_tolerance() // accuracy, eps
     return wgt_store_get_tol();
 }
 
+TASK_DECL_3(uint64_t, wgt_count_entries_par, void*, uint64_t, uint64_t);
+
 uint64_t
 sylvan_edge_weights_count_entries()
 {
-    return wgt_store_num_entries(wgt_storage);
+    // (a table is never larger than table_size, and the count of a smaller
+    // one stops at its end)
+    return RUN(wgt_count_entries_par, wgt_storage, 0, table_size);
+}
+
+uint64_t
+sylvan_edge_weights_count_near_duplicates()
+{
+    return wgt_store_num_near_duplicates(wgt_storage);
 }
 
 void
 sylvan_edge_weights_free()
 {
     wgt_store_free(wgt_storage);
+    quit_edge_weight_storage_gc();
+    wgt_cache_free();
 }
 
 /*********************</Managing the edge weight table>************************/
@@ -149,69 +254,386 @@ sylvan_edge_weights_free()
 
 
 
+/***************************<Pinned edge weights>******************************/
+
+// Values of the pinned weights. These are also stored in every edge weight
+// table, and for every table a small map from the references of the pinned
+// values in the table to their pinned index makes lookups of them return the
+// pinned index. The map entries are (ref + 1) << 16 | pinned index (0 if
+// empty).
+static weight_space_t wgt_pinned_values[WGT_PINNED_SIZE];
+static bool wgt_pinned_set[WGT_PINNED_SIZE]; // (e.g. not EVBDD_IMG for WGT_DOUBLE)
+static uint64_t wgt_pinned_n = WGT_NUM_CONSTANTS;
+static bool wgt_pinning = false;           // pin new weights in wgt_storage
+static bool wgt_pinning_overflow = false;  // not all of them could be pinned
+static bool wgt_gc_init_entries = false;   // init_wgt_table_entries() for gc
+
+#define WGT_PIN_MAP_SIZE (2 * WGT_PINNED_SIZE)
+typedef struct wgt_pin_map {
+    uint64_t entries[WGT_PIN_MAP_SIZE];
+} wgt_pin_map_t;
+
+static wgt_pin_map_t wgt_pin_maps[2];
+static wgt_pin_map_t *wgt_pin_map     = &wgt_pin_maps[0]; // for wgt_storage
+static wgt_pin_map_t *wgt_pin_map_new = &wgt_pin_maps[1]; // for wgt_storage_new
+
+static size_t
+wgt_value_size()
+{
+    switch (wgt_type) {
+        case WGT_DOUBLE:        return sizeof(fl_t);
+        case WGT_RATIONAL_128:  return sizeof(qomega_t);
+        default:                return sizeof(complex_t);
+    }
+}
+
+static inline uint64_t
+wgt_pin_map_hash(uint64_t ref)
+{
+    uint64_t h = ref * 0x9E3779B97F4A7C15ULL;
+    return (h ^ (h >> 32)) & (WGT_PIN_MAP_SIZE - 1);
+}
+
+static void
+wgt_pin_map_put(wgt_pin_map_t *map, uint64_t ref, EVBDD_WGT a)
+{
+    uint64_t h = wgt_pin_map_hash(ref);
+    while (map->entries[h] != 0) {
+        // (a value within tolerance of an earlier pinned value)
+        if ((map->entries[h] >> 16) == ref + 1) return;
+        h = (h + 1) & (WGT_PIN_MAP_SIZE - 1);
+    }
+    map->entries[h] = (ref + 1) << 16 | a;
+}
+
+static inline bool
+wgt_pin_map_get(const wgt_pin_map_t *map, uint64_t ref, EVBDD_WGT *a)
+{
+    uint64_t h = wgt_pin_map_hash(ref);
+    for (;;) {
+        uint64_t e = map->entries[h];
+        if (e == 0) return false;
+        if ((e >> 16) == ref + 1) {
+            *a = e & 0xffff;
+            return true;
+        }
+        h = (h + 1) & (WGT_PIN_MAP_SIZE - 1);
+    }
+}
+
+static void
+wgt_pinned_reset()
+{
+    memset(wgt_pinned_set, 0, sizeof(wgt_pinned_set));
+    wgt_pinned_n = WGT_NUM_CONSTANTS;
+    wgt_pinning_overflow = false;
+}
+
+static void
+wgt_pinned_fill(void *wgt_store)
+{
+    wgt_pin_map_t *map = (wgt_store == wgt_storage_new) ? wgt_pin_map_new : wgt_pin_map;
+    memset(map, 0, sizeof(wgt_pin_map_t));
+    for (EVBDD_WGT a = 0; a < wgt_pinned_n; a++) {
+        if (!wgt_pinned_set[a]) continue;
+        uint64_t ref;
+        int present = wgt_store_find_or_put(wgt_store, &wgt_pinned_values[a], &ref);
+        if (present == -1) {
+            fprintf(stderr, "Amplitude table full!\n");
+            exit(1);
+        } else if (present == 0) {
+            wgt_table_gc_inc_entries();
+        }
+        wgt_pin_map_put(map, ref, a);
+    }
+}
+
+static EVBDD_WGT
+wgt_pin_new(uint64_t ref)
+{
+    if (wgt_pinned_n == WGT_PINNED_SIZE) {
+        wgt_pinning_overflow = true;
+        return ref + WGT_PINNED_SIZE;
+    }
+    EVBDD_WGT a = wgt_pinned_n++;
+    wgt_pin(a, wgt_store_get(wgt_storage, ref));
+    wgt_pin_map_put(wgt_pin_map, ref, a);
+    return a;
+}
+
+static inline EVBDD_WGT
+wgt_from_store_ref_inline(void *wgt_store, uint64_t ref)
+{
+    EVBDD_WGT a;
+    const wgt_pin_map_t *map = (wgt_store == wgt_storage_new) ? wgt_pin_map_new : wgt_pin_map;
+    if (wgt_pin_map_get(map, ref, &a)) return a;
+    if (wgt_pinning && wgt_store == wgt_storage) return wgt_pin_new(ref);
+    return ref + WGT_PINNED_SIZE;
+}
+
+EVBDD_WGT
+wgt_from_store_ref(void *wgt_store, uint64_t ref)
+{
+    return wgt_from_store_ref_inline(wgt_store, ref);
+}
+
+void
+wgt_pin(EVBDD_WGT a, const void *value)
+{
+    memcpy(&wgt_pinned_values[a], value, wgt_value_size());
+    wgt_pinned_set[a] = true;
+}
+
+const weight_space_t *
+wgt_pinned_value(EVBDD_WGT a)
+{
+    return &wgt_pinned_values[a];
+}
+
+uint64_t
+wgt_pinned_count()
+{
+    return wgt_pinned_n;
+}
+
+void
+wgt_set_pinning(bool on)
+{
+    wgt_pinning = on;
+}
+
+bool
+wgt_table_gc_entries_pinned()
+{
+    return wgt_gc_init_entries && !wgt_pinning_overflow;
+}
+
+/**************************</Pinned edge weights>******************************/
+
+
+
+
+
+/**********************<Per-worker cache of weight lookups>********************/
+
+// Small direct-mapped cache per worker from (the exact bits of) complex values
+// to their index in the edge weight table, in front of the shared table. Hot
+// values (1/sqrt(2), +-i, gate entries, ...) are then found without hashing
+// into, and sharing cache lines of, the shared table. Since the table returns
+// the same index for the same value until it is replaced, entries are only
+// valid for the current epoch, which is bumped whenever a new table is set up.
+typedef struct wgt_l0_entry {
+    complex_t val;
+    EVBDD_WGT wgt;
+    uint64_t  epoch; // 0 for empty entries
+} wgt_l0_entry_t;
+
+DECLARE_THREAD_LOCAL(wgt_l0_cache, wgt_l0_entry_t*); // allocated on first use
+static uint64_t wgt_l0_epoch = 1;
+
+static void
+wgt_l0_invalidate()
+{
+    wgt_l0_epoch++;
+}
+
+static inline wgt_l0_entry_t *
+wgt_l0_entry(const complex_t *a)
+{
+    LOCALIZE_THREAD_LOCAL(wgt_l0_cache, wgt_l0_entry_t*);
+    if (wgt_l0_cache == NULL) {
+        wgt_l0_cache = calloc(SYLVAN_WGT_L0_CACHE_SIZE, sizeof(wgt_l0_entry_t));
+        if (wgt_l0_cache == NULL) {
+            fprintf(stderr, "wgt_l0_entry: unable to allocate weight cache\n");
+            exit(1);
+        }
+        SET_THREAD_LOCAL(wgt_l0_cache, wgt_l0_cache);
+    }
+    uint64_t w[sizeof(complex_t) / sizeof(uint64_t)];
+    memcpy(w, a, sizeof(w));
+    uint64_t h = 0;
+    for (size_t k = 0; k < sizeof(w) / sizeof(uint64_t); k++) {
+        h = (h ^ w[k]) * 0x9E3779B97F4A7C15ULL;
+    }
+    return &wgt_l0_cache[(h ^ (h >> 32)) & (SYLVAN_WGT_L0_CACHE_SIZE - 1)];
+}
+
+static inline bool
+wgt_l0_get_inline(const complex_t *a, EVBDD_WGT *res)
+{
+#if SYLVAN_WGT_L0_CACHE_SIZE
+    sylvan_stats_count(WGT_L0_LOOKUP);
+    wgt_l0_entry_t *e = wgt_l0_entry(a);
+    if (e->epoch == wgt_l0_epoch && memcmp(&e->val, a, sizeof(complex_t)) == 0) {
+        sylvan_stats_count(WGT_L0_HIT);
+        *res = e->wgt;
+        return true;
+    }
+#endif
+    (void) a;
+    (void) res;
+    return false;
+}
+
+static inline void
+wgt_l0_put_inline(const complex_t *a, EVBDD_WGT wgt)
+{
+#if SYLVAN_WGT_L0_CACHE_SIZE
+    wgt_l0_entry_t *e = wgt_l0_entry(a);
+    e->val   = *a;
+    e->wgt   = wgt;
+    e->epoch = wgt_l0_epoch;
+#endif
+    (void) a;
+    (void) wgt;
+}
+
+bool
+wgt_l0_get(const complex_t *a, EVBDD_WGT *res)
+{
+    return wgt_l0_get_inline(a, res);
+}
+
+void
+wgt_l0_put(const complex_t *a, EVBDD_WGT wgt)
+{
+    wgt_l0_put_inline(a, wgt);
+}
+
+/*********************</Per-worker cache of weight lookups>********************/
+
+
+
+
+
 /*************************<GC of edge weight table>****************************/
 
-// Keep estimate for number of entries for gc purposes
-size_t table_entries_est;
-DECLARE_THREAD_LOCAL(table_entries_local, size_t); // these are added to _est
-static const uint64_t table_entries_local_buffer = 1000; // every 1000 entries
+// Number of entries in the edge weight table (the new one during gc), for
+// deciding when to gc. Every worker counts the weights it adds in its own
+// shard (a cache line of its own, so counting is a plain increment), and the
+// count is the sum of all shards. The last shard is for threads which are not
+// Lace workers, which add to it atomically.
+typedef struct wgt_entries_shard_s {
+    _Atomic(uint64_t) entries;
+    char pad[LINE_SIZE - sizeof(uint64_t)];
+} wgt_entries_shard_t;
+
+static wgt_entries_shard_t *wgt_entries_shards = NULL;
+static unsigned int wgt_entries_n_shards = 0;
+
+// Buckets counted by a single task of the parallel count
+static const uint64_t wgt_count_entries_grain = 1ULL << 16;
+
+VOID_TASK_0(wgt_table_entries_reset_perthread)
+{
+    atomic_store_explicit(&wgt_entries_shards[__lace_worker->worker].entries, 0, memory_order_relaxed);
+}
+
+VOID_TASK_0(wgt_table_entries_reset)
+{
+    TOGETHER(wgt_table_entries_reset_perthread);
+    atomic_store(&wgt_entries_shards[wgt_entries_n_shards - 1].entries, 0);
+}
 
 void
 init_edge_weight_storage_gc()
 {
-    LOCALIZE_THREAD_LOCAL(table_entries_local, size_t);
-    // NOTE: the sum of the local counters sometimes exceeds the actual total
-    // number of entries (when just counting the global value with atomic adds
-    // after every insert). This might be because 'ctable_entries_local = 0' 
-    // doesn't set it to 0 for all threads. Since it's only an estimate it is
-    // not a huge issue though.
-    // TODO: figure out how to get lace to handle this counting better
-    table_entries_est = 0;
-    table_entries_local = 0;
-    (void) table_entries_local;
+    if (wgt_entries_shards == NULL) {
+        wgt_entries_n_shards = lace_workers() + 1;
+        wgt_entries_shards = alloc_aligned(wgt_entries_n_shards * sizeof(wgt_entries_shard_t));
+        if (wgt_entries_shards == NULL) {
+            fprintf(stderr, "init_edge_weight_storage_gc: unable to allocate entry counters\n");
+            exit(1);
+        }
+    }
+    RUN(wgt_table_entries_reset);
+}
+
+void
+quit_edge_weight_storage_gc()
+{
+    if (wgt_entries_shards != NULL) {
+        free_aligned(wgt_entries_shards, wgt_entries_n_shards * sizeof(wgt_entries_shard_t));
+        wgt_entries_shards = NULL;
+        wgt_entries_n_shards = 0;
+    }
 }
 
 uint64_t
-wgt_table_entries_estimate()
+wgt_table_entries()
+{
+    uint64_t entries = 0;
+    for (unsigned int i = 0; i < wgt_entries_n_shards; i++) {
+        entries += atomic_load_explicit(&wgt_entries_shards[i].entries, memory_order_relaxed);
+    }
+    return entries;
+}
+
+void
+wgt_table_gc_inc_entries()
 {
-    return table_entries_est;
+    WorkerP *w = lace_get_worker();
+    if (w != NULL) {
+        _Atomic(uint64_t) *entries = &wgt_entries_shards[w->worker].entries;
+        atomic_store_explicit(entries, atomic_load_explicit(entries, memory_order_relaxed) + 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add(&wgt_entries_shards[wgt_entries_n_shards - 1].entries, 1);
+    }
 }
 
-void wgt_table_gc_inc_entries_estimate()
+TASK_IMPL_3(uint64_t, wgt_count_entries_par, void*, store, uint64_t, first, uint64_t, count)
 {
-    LOCALIZE_THREAD_LOCAL(table_entries_local, size_t);
-    table_entries_local += 1;
-    if (table_entries_local >= table_entries_local_buffer) {
-        __sync_fetch_and_add(&table_entries_est, table_entries_local);
-        table_entries_local = 0;
+    if (count <= wgt_count_entries_grain) {
+        return wgt_store_num_entries_range(store, first, first + count);
     }
+    uint64_t half = count / 2;
+    SPAWN(wgt_count_entries_par, store, first + half, count - half);
+    uint64_t entries = CALL(wgt_count_entries_par, store, first, half);
+    return entries + SYNC(wgt_count_entries_par);
 }
 
+// Old -> new index of the weights moved to the new table during gc, stored as
+// new index + 1 (0 if not moved). Indexed by reference in the old table (so
+// not for pinned weights), so it is allocated with calloc and only the pages
+// containing moved weights are used.
+static EVBDD_WGT *wgt_gc_remap = NULL;
+
 void
 wgt_table_gc_init_new(void (*init_wgt_table_entries)())
 {
-    // init new (empty) edge weight storage (double previous size if under max_size)
+    wgt_gc_remap = calloc(table_size, sizeof(EVBDD_WGT));
+    if (wgt_gc_remap == NULL) {
+        fprintf(stderr, "wgt_table_gc_init_new: unable to allocate remap table\n");
+        exit(1);
+    }
+
+    // the counters now count the entries of the new table
+    RUN(wgt_table_entries_reset);
+
+    // init new edge weight storage, which only contains the pinned weights 
+    // (double previous size if under max_size)
     table_size = 2*table_size;
     if (table_size > max_tablesize) {
         table_size = max_tablesize;
     }
     init_edge_weight_storage(table_size, tolerance, wgt_backend, &wgt_storage_new);
 
-    // reset estimate entries counters
-    LOCALIZE_THREAD_LOCAL(table_entries_local, size_t);
-    table_entries_est = 0;
-    table_entries_local = 0;
-    (void) table_entries_local;
-
     // Fill new with initial values (temp rename to wgt_store because
-    // init_wgt_table_entries initializes wgt_storage, not wgt_storage_new)
+    // init_wgt_table_entries initializes wgt_storage, not wgt_storage_new).
+    // If these were all pinned, only the ones added later (e.g. dynamic gates)
+    // need to be initialized again, see wgt_table_gc_entries_pinned().
     void *wgt_store_tmp = wgt_storage;
     wgt_storage = wgt_storage_new;
     if (init_wgt_table_entries != NULL) {
+        wgt_gc_init_entries = true;
         init_wgt_table_entries();
+        wgt_gc_init_entries = false;
     }
     wgt_storage_new = wgt_storage;  // wgt_store_new now has initial values
     wgt_storage = wgt_store_tmp;    // wgt_storage now has the old values
+
+    // cached lookups of the initial values refer to the new table
+    wgt_l0_invalidate();
 }
 
 void
@@ -220,19 +642,43 @@ wgt_table_gc_delete_old()
     // delete  old (full) table + set new as current
     wgt_store_free(wgt_storage);
     wgt_storage = wgt_storage_new;
+    wgt_storage_new = NULL; // (or lookups in wgt_storage would use the new pin map)
+    *wgt_pin_map = *wgt_pin_map_new;
+    wgt_l0_invalidate();
+    free(wgt_gc_remap);
+    wgt_gc_remap = NULL;
 }
 
 EVBDD_WGT
 wgt_table_gc_keep(EVBDD_WGT a)
 {
+    // pinned weights are in the new table already (with the same index)
+    if (wgt_is_pinned(a)) return a;
+    uint64_t ref = a - WGT_PINNED_SIZE;
+    if (wgt_gc_remap[ref] != 0) return wgt_gc_remap[ref] - 1;
+
     // move from current (old) to new
-    weight_t wa = weight_malloc();
+    weight_space_t sa;
+    weight_t wa = &sa;
     _weight_value(wgt_storage, a, wa);
     EVBDD_WGT res = _weight_lookup_ptr(wa, wgt_storage_new);
-    free(wa);
+    wgt_gc_remap[ref] = res + 1;
     return res;
 }
 
+bool
+wgt_table_gc_remapped(EVBDD_WGT a, EVBDD_WGT *res)
+{
+    if (wgt_is_pinned(a)) {
+        *res = a;
+        return true;
+    }
+    uint64_t ref = a - WGT_PINNED_SIZE;
+    if (wgt_gc_remap[ref] == 0) return false;
+    *res = wgt_gc_remap[ref] - 1;
+    return true;
+}
+
 /************************</GC of edge weight table>****************************/
 
 
@@ -243,6 +689,7 @@ wgt_table_gc_keep(EVBDD_WGT a)
 
 static bool CACHE_WGT_OPS = true;
 static bool CACHE_INV_OPS = true;
+static bool BATCH_WGT_OPS = true;
 
 void
 wgt_set_inverse_chaching(bool on)
@@ -250,6 +697,12 @@ wgt_set_inverse_chaching(bool on)
     CACHE_INV_OPS = on;
 }
 
+void
+wgt_set_batched_lookups(bool on)
+{
+    BATCH_WGT_OPS = on;
+}
+
 static void
 order_inputs(EVBDD_WGT *a, EVBDD_WGT *b) 
 {
@@ -259,11 +712,171 @@ order_inputs(EVBDD_WGT *a, EVBDD_WGT *b)
     *b = y;
 }
 
+typedef enum wgt_op {
+    WGT_OP_ABS,
+    WGT_OP_NEG,
+    WGT_OP_CONJ,
+    WGT_OP_ADD,
+    WGT_OP_SUB,
+    WGT_OP_MUL,
+    WGT_OP_DIV,
+} wgt_op_t;
+
+/**
+ * The results of weight operations are not stored in the operation cache,
+ * where they would evict the (more valuable) results of operations on nodes,
+ * but in a cache of their own. An entry takes 24 bytes: the key holds a lock
+ * bit, a tag which every put increases, the operation and the first operand
+ * (edge weights have at most 33 bits), followed by the second operand and the
+ * result. As in the operation cache, a get checks that the key did not change
+ * while it read the entry, and a put which finds the entry locked gives up.
+ */
+typedef struct wgt_cache_entry {
+    _Atomic(uint64_t) key;
+    _Atomic(uint64_t) b;
+    _Atomic(uint64_t) res;
+} wgt_cache_entry_t;
+
+#define WGT_CACHE_LOCK      0x8000000000000000ULL
+#define WGT_CACHE_TAG       0x7ffffff000000000ULL
+#define WGT_CACHE_TAG_ONE   0x0000001000000000ULL
+#define WGT_CACHE_KEY       0x0000000fffffffffULL
+
+static wgt_cache_entry_t *wgt_cache = NULL;
+static size_t wgt_cache_size = SYLVAN_WGT_CACHE_SIZE; // power of 2
+static int wgt_cache_shift;
+
+static void
+wgt_cache_create()
+{
+    wgt_cache = alloc_aligned(wgt_cache_size * sizeof(wgt_cache_entry_t));
+    if (wgt_cache == NULL) {
+        fprintf(stderr, "wgt_cache_create: unable to allocate %zu entries\n", wgt_cache_size);
+        exit(1);
+    }
+    wgt_cache_shift = 64 - __builtin_ctzll(wgt_cache_size);
+}
+
+static void
+wgt_cache_free()
+{
+    if (wgt_cache != NULL) {
+        free_aligned(wgt_cache, wgt_cache_size * sizeof(wgt_cache_entry_t));
+        wgt_cache = NULL;
+    }
+}
+
+void
+wgt_cache_set_size(size_t size)
+{
+    if (size < 2 || __builtin_popcountll(size) != 1) {
+        fprintf(stderr, "wgt_cache_set_size: size must be a power of 2 (and at least 2)\n");
+        exit(1);
+    }
+    bool created = (wgt_cache != NULL);
+    wgt_cache_free();
+    wgt_cache_size = size;
+    if (created) wgt_cache_create();
+}
+
+size_t
+wgt_cache_getsize()
+{
+    return wgt_cache_size;
+}
+
+size_t
+wgt_cache_getused()
+{
+    if (wgt_cache == NULL) return 0;
+    size_t used = 0;
+    for (size_t i = 0; i < wgt_cache_size; i++) {
+        if (atomic_load_explicit(&wgt_cache[i].key, memory_order_relaxed) & WGT_CACHE_KEY) used++;
+    }
+    return used;
+}
+
+void
+wgt_cache_clear()
+{
+    memset(wgt_cache, 0, wgt_cache_size * sizeof(wgt_cache_entry_t));
+}
+
+static inline uint64_t
+wgt_cache_key(wgt_op_t op, EVBDD_WGT a)
+{
+    return ((uint64_t)op << 33) | a;
+}
+
+static inline wgt_cache_entry_t *
+wgt_cache_bucket(uint64_t key, EVBDD_WGT b)
+{
+    const uint64_t h = (key ^ (b << 29) ^ (b >> 35)) * 0x9e3779b97f4a7c15ULL;
+    return &wgt_cache[h >> wgt_cache_shift];
+}
+
+static inline bool
+wgt_cache_get(wgt_op_t op, EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT *res)
+{
+    const uint64_t key = wgt_cache_key(op, a);
+    wgt_cache_entry_t *e = wgt_cache_bucket(key, b);
+    const uint64_t k = atomic_load_explicit(&e->key, memory_order_acquire);
+    // (a locked entry does not match)
+    if ((k & (WGT_CACHE_LOCK | WGT_CACHE_KEY)) != key) return false;
+    if (atomic_load_explicit(&e->b, memory_order_relaxed) != b) return false;
+    *res = atomic_load_explicit(&e->res, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&e->key, memory_order_relaxed) == k;
+}
+
+static inline bool
+wgt_cache_put(wgt_op_t op, EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT res)
+{
+    const uint64_t key = wgt_cache_key(op, a);
+    wgt_cache_entry_t *e = wgt_cache_bucket(key, b);
+    uint64_t k = atomic_load_explicit(&e->key, memory_order_relaxed);
+    if (k & WGT_CACHE_LOCK) return false;
+    const uint64_t tag = (k + WGT_CACHE_TAG_ONE) & WGT_CACHE_TAG;
+    if (!atomic_compare_exchange_strong(&e->key, &k, WGT_CACHE_LOCK | tag)) return false;
+    atomic_store_explicit(&e->b, b, memory_order_relaxed);
+    atomic_store_explicit(&e->res, res, memory_order_relaxed);
+    atomic_store_explicit(&e->key, tag | key, memory_order_release);
+    return true;
+}
+
+void
+wgt_cache_remap()
+{
+    // Move the entries of which all weights are (still) in use to a new cache,
+    // with their new indices. Only to be called during gc of the edge weight
+    // table, after all weights in use have been moved.
+    wgt_cache_entry_t *old = wgt_cache;
+    wgt_cache_create();
+    for (size_t i = 0; i < wgt_cache_size; i++) {
+        const uint64_t k = atomic_load_explicit(&old[i].key, memory_order_relaxed);
+        if ((k & WGT_CACHE_KEY) == 0) continue;
+        wgt_op_t op = (wgt_op_t)((k & WGT_CACHE_KEY) >> 33);
+        EVBDD_WGT a = k & ((1ULL << 33) - 1);
+        EVBDD_WGT b = atomic_load_explicit(&old[i].b, memory_order_relaxed);
+        EVBDD_WGT res = atomic_load_explicit(&old[i].res, memory_order_relaxed);
+        if (!wgt_table_gc_remapped(a, &a) || !wgt_table_gc_remapped(b, &b) ||
+            !wgt_table_gc_remapped(res, &res)) continue;
+        // (add and mul order their operands by index)
+        if ((op == WGT_OP_ADD || op == WGT_OP_MUL) && a < b) {
+            EVBDD_WGT tmp = a;
+            a = b;
+            b = tmp;
+        }
+        wgt_cache_put(op, a, b, res);
+    }
+    free_aligned(old, wgt_cache_size * sizeof(wgt_cache_entry_t));
+}
+
 static bool
 cache_get_add(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT *res)
 {
     order_inputs(&a, &b);
-    if (cache_get3(CACHE_WGT_ADD, a, b, sylvan_false, res)) {
+    if (wgt_cache_get(WGT_OP_ADD, a, b, res)) {
         sylvan_stats_count(WGT_ADD_CACHED);
         return true;
     }
@@ -274,7 +887,7 @@ static void
 cache_put_add(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT res)
 {
     order_inputs(&a, &b);
-    if (cache_put3(CACHE_WGT_ADD, a, b, sylvan_false, res)) {
+    if (wgt_cache_put(WGT_OP_ADD, a, b, res)) {
         sylvan_stats_count(WGT_ADD_CACHEDPUT);
     }
 }
@@ -282,7 +895,7 @@ cache_put_add(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT res)
 static void
 cache_put_sub(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT res)
 {
-    if (cache_put3(CACHE_WGT_SUB, a, b, sylvan_false, res)) {
+    if (wgt_cache_put(WGT_OP_SUB, a, b, res)) {
         sylvan_stats_count(WGT_SUB_CACHEDPUT);
     }
 }
@@ -290,7 +903,7 @@ cache_put_sub(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT res)
 static bool
 cache_get_sub(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT *res)
 {
-    if (cache_get3(CACHE_WGT_SUB, a, b, sylvan_false, res)) {
+    if (wgt_cache_get(WGT_OP_SUB, a, b, res)) {
         sylvan_stats_count(WGT_SUB_CACHED);
         return true;
     }
@@ -301,15 +914,15 @@ static void
 cache_put_mul(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT res)
 {
     order_inputs(&a, &b);
-    if (cache_put3(CACHE_WGT_MUL, a, b, sylvan_false, res)) {
+    if (wgt_cache_put(WGT_OP_MUL, a, b, res)) {
         sylvan_stats_count(WGT_MUL_CACHEDPUT);
     }
     if (CACHE_INV_OPS) {
         // put inverse as well (empirically seems not so beneficial)
-        if (cache_put3(CACHE_WGT_DIV, res, b, sylvan_false, a)) {
+        if (wgt_cache_put(WGT_OP_DIV, res, b, a)) {
             sylvan_stats_count(WGT_DIV_CACHEDPUT);
         }
-        if (cache_put3(CACHE_WGT_DIV, res, a, sylvan_false, b)) {
+        if (wgt_cache_put(WGT_OP_DIV, res, a, b)) {
             sylvan_stats_count(WGT_DIV_CACHEDPUT);
         }
     }
@@ -319,7 +932,7 @@ static bool
 cache_get_mul(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT *res)
 {
     order_inputs(&a, &b);
-    if (cache_get3(CACHE_WGT_MUL, a, b, sylvan_false, res)) {
+    if (wgt_cache_get(WGT_OP_MUL, a, b, res)) {
         sylvan_stats_count(WGT_MUL_CACHED);
         return true;
     }
@@ -329,13 +942,13 @@ cache_get_mul(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT *res)
 static void
 cache_put_div(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT res)
 {
-    if (cache_put3(CACHE_WGT_DIV, a, b, sylvan_false, res)) {
+    if (wgt_cache_put(WGT_OP_DIV, a, b, res)) {
         sylvan_stats_count(WGT_DIV_CACHEDPUT);
     }
     if (CACHE_INV_OPS) {
         // put inverse as well (empirically seems beneficial)
         order_inputs(&b, &res);
-        if (cache_put3(CACHE_WGT_MUL, b, res, sylvan_false, a)) {
+        if (wgt_cache_put(WGT_OP_MUL, b, res, a)) {
             sylvan_stats_count(WGT_MUL_CACHEDPUT);
         }
     }
@@ -344,7 +957,7 @@ cache_put_div(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT res)
 static bool
 cache_get_div(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT *res)
 {
-    if (cache_get3(CACHE_WGT_DIV, a, b, sylvan_false, res)) {
+    if (wgt_cache_get(WGT_OP_DIV, a, b, res)) {
         sylvan_stats_count(WGT_DIV_CACHED);
         return true;
     }
@@ -359,6 +972,98 @@ cache_get_div(EVBDD_WGT a, EVBDD_WGT b, EVBDD_WGT *res)
 
 /*********************<Arithmetic functions on EVBDD_WGT's>*********************/
 
+#if SYLVAN_WGT_COMPLEX_INLINE
+static inline EVBDD_WGT
+wgt_complex_hashmap_lookup(complex_t *a)
+{
+    EVBDD_WGT cached;
+    if (wgt_l0_get_inline(a, &cached)) return cached;
+
+    uint64_t ref;
+    int present = cmap_find_or_put_inline(wgt_storage, a, &ref);
+    if (present == 0) {
+        wgt_table_gc_inc_entries();
+    } else if (present == -1) {
+        fprintf(stderr, "Amplitude table full!\n");
+        exit(1);
+    }
+    EVBDD_WGT res = wgt_from_store_ref_inline(wgt_storage, ref);
+    wgt_l0_put_inline(a, res);
+    return res;
+}
+
+static inline complex_t *
+wgt_complex_hashmap_get(EVBDD_WGT a)
+{
+    if (wgt_is_pinned(a)) return &wgt_pinned_values[a].complex_128;
+    return cmap_get_inline(wgt_storage, a - WGT_PINNED_SIZE);
+}
+#endif
+
+/**
+ * Computes a <op> b (b is ignored for unary operations) and looks up the
+ * result in the edge weight table. Since 'op' is a constant at every call
+ * site, this reduces to a single operation. For complex weights in a cmap
+ * (when compiled with SYLVAN_WGT_COMPLEX_INLINE) value retrieval, arithmetic
+ * and table lookup are all inlined, other configurations go through the
+ * edge weight interface function pointers.
+ */
+static inline EVBDD_WGT
+wgt_compute(EVBDD_WGT a, EVBDD_WGT b, wgt_op_t op)
+{
+#if SYLVAN_WGT_COMPLEX_INLINE
+    if (wgt_complex_hashmap) {
+        complex_t ca = *wgt_complex_hashmap_get(a);
+        complex_t cb = (op >= WGT_OP_ADD) ? *wgt_complex_hashmap_get(b) : ca;
+        switch (op) {
+            case WGT_OP_ABS:  weight_complex_abs_inline(&ca); break;
+            case WGT_OP_NEG:  weight_complex_neg_inline(&ca); break;
+            case WGT_OP_CONJ: weight_complex_conj_inline(&ca); break;
+            case WGT_OP_ADD:  weight_complex_add_inline(&ca, &cb); break;
+            case WGT_OP_SUB:  weight_complex_sub_inline(&ca, &cb); break;
+            case WGT_OP_MUL:  weight_complex_mul_inline(&ca, &cb); break;
+            case WGT_OP_DIV:  weight_complex_div_inline(&ca, &cb); break;
+        }
+        return wgt_complex_hashmap_lookup(&ca);
+    }
+#endif
+    weight_space_t sa, sb;
+    weight_t wa = &sa;
+    weight_t wb = &sb;
+    weight_value(a, wa);
+    if (op >= WGT_OP_ADD) weight_value(b, wb);
+    switch (op) {
+        case WGT_OP_ABS:  weight_abs(wa); break;
+        case WGT_OP_NEG:  weight_neg(wa); break;
+        case WGT_OP_CONJ: weight_conj(wa); break;
+        case WGT_OP_ADD:  weight_add(wa, wb); break;
+        case WGT_OP_SUB:  weight_sub(wa, wb); break;
+        case WGT_OP_MUL:  weight_mul(wa, wb); break;
+        case WGT_OP_DIV:  weight_div(wa, wb); break;
+    }
+    return weight_lookup_ptr(wa);
+}
+
+/**
+ * Returns true iff |a| > |b|.
+ */
+static inline bool
+wgt_greater(EVBDD_WGT a, EVBDD_WGT b)
+{
+#if SYLVAN_WGT_COMPLEX_INLINE
+    if (wgt_complex_hashmap) {
+        return weight_complex_greater_inline(wgt_complex_hashmap_get(a),
+                                             wgt_complex_hashmap_get(b));
+    }
+#endif
+    weight_space_t sa, sb;
+    weight_t wa = &sa;
+    weight_t wb = &sb;
+    weight_value(a, wa);
+    weight_value(b, wb);
+    return weight_greater(wa, wb);
+}
+
 EVBDD_WGT
 wgt_abs(EVBDD_WGT a)
 {
@@ -366,15 +1071,7 @@ wgt_abs(EVBDD_WGT a)
     if (a == EVBDD_ZERO || a == EVBDD_ONE) return a;
     if (a == EVBDD_MIN_ONE) return EVBDD_ONE;
 
-    EVBDD_WGT res;
-
-    weight_t w = weight_malloc();
-    weight_value(a, w);
-    weight_abs(w);
-    res = weight_lookup_ptr(w);
-    free(w);
-
-    return res;
+    return wgt_compute(a, a, WGT_OP_ABS);
 }
 
 EVBDD_WGT 
@@ -385,15 +1082,7 @@ wgt_neg(EVBDD_WGT a)
     if (a == EVBDD_ONE) return EVBDD_MIN_ONE;
     if (a == EVBDD_MIN_ONE) return EVBDD_ONE;
 
-    EVBDD_WGT res;
-
-    weight_t w = weight_malloc();
-    weight_value(a, w);
-    weight_neg(w);
-    res = weight_lookup_ptr(w);
-    free(w);
-
-    return res; 
+    return wgt_compute(a, a, WGT_OP_NEG);
 }
 
 EVBDD_WGT 
@@ -402,15 +1091,7 @@ wgt_conj(EVBDD_WGT a)
     // special cases
     if (a == EVBDD_ZERO || a == EVBDD_ONE || a == EVBDD_MIN_ONE) return a;
 
-    EVBDD_WGT res;
-
-    weight_t w = weight_malloc();
-    weight_value(a, w);
-    weight_conj(w);
-    res = weight_lookup_ptr(w);
-    free(w);
-
-    return res; 
+    return wgt_compute(a, a, WGT_OP_CONJ);
 }
 
 EVBDD_WGT
@@ -419,6 +1100,7 @@ wgt_add(EVBDD_WGT a, EVBDD_WGT b)
     // special cases
     if (a == EVBDD_ZERO) return b;
     if (b == EVBDD_ZERO) return a;
+    sylvan_stats_count(WGT_ADD);
 
     // check cache
     EVBDD_WGT res;
@@ -427,14 +1109,7 @@ wgt_add(EVBDD_WGT a, EVBDD_WGT b)
     }
 
     // compute and lookup result in edge weight table
-    weight_t wa = weight_malloc();
-    weight_t wb = weight_malloc();
-    weight_value(a, wa);
-    weight_value(b, wb);
-    weight_add(wa, wb);
-    res = weight_lookup_ptr(wa);
-    free(wa);
-    free(wb);
+    res = wgt_compute(a, b, WGT_OP_ADD);
 
     // insert in cache
     if (CACHE_WGT_OPS) {
@@ -449,6 +1124,7 @@ wgt_sub(EVBDD_WGT a, EVBDD_WGT b)
     // special cases
     if (b == EVBDD_ZERO) return a;
     if (a == EVBDD_ZERO) return wgt_neg(b);
+    sylvan_stats_count(WGT_SUB);
 
     // check cache
     EVBDD_WGT res;
@@ -457,14 +1133,7 @@ wgt_sub(EVBDD_WGT a, EVBDD_WGT b)
     }
 
     // compute and lookup result in edge weight table
-    weight_t wa = weight_malloc();
-    weight_t wb = weight_malloc();
-    weight_value(a, wa);
-    weight_value(b, wb);
-    weight_sub(wa, wb);
-    res = weight_lookup_ptr(wa);
-    free(wa);
-    free(wb);
+    res = wgt_compute(a, b, WGT_OP_SUB);
 
     // insert in cache
     if (CACHE_WGT_OPS) {
@@ -480,6 +1149,7 @@ wgt_mul(EVBDD_WGT a, EVBDD_WGT b)
     if (a == EVBDD_ONE) return b;
     if (b == EVBDD_ONE) return a;
     if (a == EVBDD_ZERO || b == EVBDD_ZERO) return EVBDD_ZERO;
+    sylvan_stats_count(WGT_MUL);
 
     // check cache
     EVBDD_WGT res;
@@ -488,14 +1158,7 @@ wgt_mul(EVBDD_WGT a, EVBDD_WGT b)
     }
 
     // compute and lookup result in edge weight table
-    weight_t wa = weight_malloc();
-    weight_t wb = weight_malloc();
-    weight_value(a, wa);
-    weight_value(b, wb);
-    weight_mul(wa, wb);
-    res = weight_lookup_ptr(wa);
-    free(wa);
-    free(wb);
+    res = wgt_compute(a, b, WGT_OP_MUL);
 
     // insert in cache
     if (CACHE_WGT_OPS) {
@@ -504,6 +1167,94 @@ wgt_mul(EVBDD_WGT a, EVBDD_WGT b)
     return res;
 }
 
+void
+wgt_mul4(const EVBDD_WGT *a, const EVBDD_WGT *b, EVBDD_WGT *res)
+{
+    // special cases and cached products
+    int todo[4];
+    int n = 0;
+    for (int k = 0; k < 4; k++) {
+        if (a[k] == EVBDD_ONE) res[k] = b[k];
+        else if (b[k] == EVBDD_ONE) res[k] = a[k];
+        else if (a[k] == EVBDD_ZERO || b[k] == EVBDD_ZERO) res[k] = EVBDD_ZERO;
+        else {
+            sylvan_stats_count(WGT_MUL);
+            if (CACHE_WGT_OPS && cache_get_mul(a[k], b[k], &res[k])) continue;
+            todo[n++] = k;
+        }
+    }
+    if (n == 0) return;
+
+    if (n == 1 || !BATCH_WGT_OPS || wgt_type != WGT_COMPLEX_128) {
+        for (int j = 0; j < n; j++) {
+            int k = todo[j];
+            res[k] = wgt_compute(a[k], b[k], WGT_OP_MUL);
+            if (CACHE_WGT_OPS) cache_put_mul(a[k], b[k], res[k]);
+        }
+        return;
+    }
+
+    // compute the remaining products together ...
+    complex_t ca[4], cb[4];
+    for (int j = 0; j < 4; j++) {
+        if (j >= n) {
+            ca[j] = cb[j] = cone();
+            continue;
+        }
+        int k = todo[j];
+#if SYLVAN_WGT_COMPLEX_INLINE
+        if (wgt_complex_hashmap) {
+            ca[j] = *wgt_complex_hashmap_get(a[k]);
+            cb[j] = *wgt_complex_hashmap_get(b[k]);
+            continue;
+        }
+#endif
+        weight_value(a[k], &ca[j]);
+        weight_value(b[k], &cb[j]);
+    }
+    weight_complex_mul4_inline(ca, cb);
+
+    // ... and look up the ones which are not in the per-worker cache together,
+    // so that the table accesses overlap
+    complex_t cm[4];
+    int miss[4];
+    int m = 0;
+    for (int j = 0; j < n; j++) {
+        int k = todo[j];
+        if (wgt_l0_get_inline(&ca[j], &res[k])) {
+            if (CACHE_WGT_OPS) cache_put_mul(a[k], b[k], res[k]);
+        } else {
+            cm[m] = ca[j];
+            miss[m++] = k;
+        }
+    }
+    if (m == 0) return;
+
+    uint64_t refs[4];
+    int found[4];
+#if SYLVAN_WGT_COMPLEX_INLINE
+    if (wgt_complex_hashmap) {
+        cmap_find_or_put_batch_inline(wgt_storage, cm, m, refs, found);
+    } else {
+        wgt_store_find_or_put_batch(wgt_storage, cm, m, refs, found);
+    }
+#else
+    wgt_store_find_or_put_batch(wgt_storage, cm, m, refs, found);
+#endif
+    for (int j = 0; j < m; j++) {
+        if (found[j] == -1) {
+            fprintf(stderr, "Amplitude table full!\n");
+            exit(1);
+        } else if (found[j] == 0) {
+            wgt_table_gc_inc_entries();
+        }
+        int k = miss[j];
+        res[k] = wgt_from_store_ref_inline(wgt_storage, refs[j]);
+        wgt_l0_put_inline(&cm[j], res[k]);
+        if (CACHE_WGT_OPS) cache_put_mul(a[k], b[k], res[k]);
+    }
+}
+
 EVBDD_WGT
 wgt_div(EVBDD_WGT a, EVBDD_WGT b)
 {
@@ -511,6 +1262,7 @@ wgt_div(EVBDD_WGT a, EVBDD_WGT b)
     if (a == b)         return EVBDD_ONE;
     if (a == EVBDD_ZERO) return EVBDD_ZERO;
     if (b == EVBDD_ONE)  return a;
+    sylvan_stats_count(WGT_DIV);
 
     // check cache
     EVBDD_WGT res;
@@ -519,14 +1271,7 @@ wgt_div(EVBDD_WGT a, EVBDD_WGT b)
     }
 
     // compute and lookup result in edge weight table
-    weight_t wa = weight_malloc();
-    weight_t wb = weight_malloc();
-    weight_value(a, wa);
-    weight_value(b, wb);
-    weight_div(wa, wb);
-    res = weight_lookup_ptr(wa);
-    free(wa);
-    free(wb);
+    res = wgt_compute(a, b, WGT_OP_DIV);
 
     // insert in cache
     if (CACHE_WGT_OPS) {
@@ -546,32 +1291,28 @@ wgt_div(EVBDD_WGT a, EVBDD_WGT b)
 bool
 wgt_eq(EVBDD_WGT a, EVBDD_WGT b)
 {
-    weight_t wa = weight_malloc();
-    weight_t wb = weight_malloc();
+    weight_space_t sa, sb;
+    weight_t wa = &sa;
+    weight_t wb = &sb;
 
     weight_value(a, wa);
     weight_value(b, wb);
     bool res = weight_eq(wa, wb);
 
-    free(wa);
-    free(wb);
-
     return res;
 }
 
 bool
 wgt_eps_close(EVBDD_WGT a, EVBDD_WGT b, double eps)
 {
-    weight_t wa = weight_malloc();
-    weight_t wb = weight_malloc();
+    weight_space_t sa, sb;
+    weight_t wa = &sa;
+    weight_t wb = &sb;
 
     weight_value(a, wa);
     weight_value(b, wb);
     bool res = weight_eps_close(wa, wb, eps);
 
-    free(wa);
-    free(wb);
-
     return res;
 }
 
@@ -618,12 +1359,7 @@ wgt_norm_max(EVBDD_WGT *low, EVBDD_WGT *high)
     }
 
     // Normalize using the absolute greatest value
-    weight_t wl = weight_malloc();
-    weight_t wh = weight_malloc();
-    weight_value(*low,  wl);
-    weight_value(*high, wh);
-
-    if (weight_greater(wh, wl)) {
+    if (wgt_greater(*high, *low)) {
         // high greater than low, divide both by high
         *low = wgt_div(*low, *high);
         norm  = *high;
@@ -636,8 +1372,6 @@ wgt_norm_max(EVBDD_WGT *low, EVBDD_WGT *high)
         *low  = EVBDD_ONE;
     }
 
-    free(wl);
-    free(wh);
     return norm;
 }
 
@@ -664,10 +1398,11 @@ wgt_norm_min(EVBDD_WGT *low, EVBDD_WGT *high)
     }
 
     // Normalize using the absolute smallest value
-    weight_t wl = weight_malloc();
-    weight_t wh = weight_malloc();
-    weight_t wl_abs = weight_malloc();
-    weight_t wh_abs = weight_malloc();
+    weight_space_t sl, sh, sl_abs, sh_abs;
+    weight_t wl = &sl;
+    weight_t wh = &sh;
+    weight_t wl_abs = &sl_abs;
+    weight_t wh_abs = &sh_abs;
     weight_value(*low,  wl);
     weight_value(*high, wh);
     weight_value(*low,  wl_abs);
@@ -696,10 +1431,6 @@ wgt_norm_min(EVBDD_WGT *low, EVBDD_WGT *high)
         *low  = EVBDD_ONE;
     }
 
-    free(wl);
-    free(wh);
-    free(wl_abs);
-    free(wh_abs);
     return norm;
 }
 
@@ -713,10 +1444,10 @@ wgt_norm_min(EVBDD_WGT *low, EVBDD_WGT *high)
 
 void wgt_fprint(FILE *stream, EVBDD_WGT a)
 {
-    weight_t w = weight_malloc();
+    weight_space_t s;
+    weight_t w = &s;
     weight_value(a, w);
     weight_fprint(stream, w);
-    free(w);
 }
 
 /************************<Printing & utility functions>************************/
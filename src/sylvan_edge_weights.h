@@ -4,15 +4,40 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <edge_weight_storage/wgt_storage_interface.h>
+#include <sylvan_config.h>
 
 typedef uint64_t EVBDD_WGT;  // EVBDD edge weights (indices to table entries)
 
-extern EVBDD_WGT EVBDD_ONE;
-extern EVBDD_WGT EVBDD_ZERO;
-extern EVBDD_WGT EVBDD_MIN_ONE;
+/**
+ * Edge weights [0, WGT_PINNED_SIZE) are pinned: they keep their index across
+ * edge weight gc. These are the constants below, followed by the weights
+ * looked up by init_wgt_table_entries when the edge weights are initialized
+ * (i.e. the entries of the static gates). All other weights are stored at
+ * index - WGT_PINNED_SIZE in the edge weight table.
+ */
+#define WGT_PINNED_SIZE SYLVAN_WGT_PINNED_SIZE
+
+#define EVBDD_ZERO          ((EVBDD_WGT) 0)
+#define EVBDD_ONE           ((EVBDD_WGT) 1)
+#define EVBDD_MIN_ONE       ((EVBDD_WGT) 2)
+#define EVBDD_IMG           ((EVBDD_WGT) 3) // (not with WGT_DOUBLE)
+#define EVBDD_MIN_IMG       ((EVBDD_WGT) 4) // (not with WGT_DOUBLE)
+#define EVBDD_INV_SQRT_TWO  ((EVBDD_WGT) 5) // 1/sqrt(2)
+#define WGT_NUM_CONSTANTS   6
 
 typedef void *weight_t;
 
+/**
+ * Storage for a single edge weight value, large enough for any of the 
+ * edge_weight_type_t's. Used to keep intermediate values of the edge weight
+ * arithmetic on the stack instead of allocating them with weight_malloc().
+ */
+typedef union weight_space {
+    fl_t      real;
+    complex_t complex_128;
+    qomega_t  rational_128;
+} weight_space_t;
+
 typedef enum edge_weight_type {
     WGT_DOUBLE,
     WGT_COMPLEX_128,
@@ -33,9 +58,14 @@ extern void init_edge_weight_functions(edge_weight_type_t edge_weight_type);
 extern void init_edge_weight_storage(size_t size, double tol, wgt_storage_backend_t backend, void **wgt_store);
 extern void (*init_wgt_table_entries)(); // set by sylvan_init_evbdd
 
+extern edge_weight_type_t sylvan_get_edge_weight_type();
 extern uint64_t sylvan_get_edge_weight_table_size();
 extern double sylvan_edge_weights_tolerance();
 extern uint64_t sylvan_edge_weights_count_entries();
+// Number of stored edge weights which are within tolerance of another stored
+// edge weight, i.e. near-duplicates which break node sharing (always 0 for 
+// COMP_TOLERANT_HASHMAP, as long as there is a single worker)
+extern uint64_t sylvan_edge_weights_count_near_duplicates();
 extern void sylvan_edge_weights_free();
 
 /*********************</Managing the edge weight table>************************/
@@ -44,14 +74,72 @@ extern void sylvan_edge_weights_free();
 
 
 
+/***************************<Pinned edge weights>******************************/
+
+static inline bool
+wgt_is_pinned(EVBDD_WGT a)
+{
+    return a < WGT_PINNED_SIZE;
+}
+
+/**
+ * Number of weights stored in an edge weight table of `size`. The stored
+ * weights get the indices after the pinned ones, so a table of a power of 2
+ * size leaves room for the pinned weights, such that all indices stay below
+ * `size` (i.e. a table of 2^23 weights needs 23 bit indices). The room is
+ * rounded up to the 256 buckets of a probe line of the hash tables.
+ */
+#define WGT_PINNED_ROOM ((WGT_PINNED_SIZE + 255) & ~255ULL)
+
+static inline uint64_t
+wgt_table_store_size(uint64_t size)
+{
+    bool pow2 = (size & (size - 1)) == 0;
+    return (pow2 && size >= 4 * WGT_PINNED_ROOM) ? size - WGT_PINNED_ROOM : size;
+}
+
+// Upper bound (exclusive) on the edge weight indices with a table of `size`
+static inline uint64_t
+wgt_index_bound(uint64_t size)
+{
+    return wgt_table_store_size(size) + WGT_PINNED_SIZE;
+}
+
+// Sets the value of pinned weight `a` (used by init_one_zero)
+extern void wgt_pin(EVBDD_WGT a, const void *value);
+// Value of pinned weight `a`
+extern const weight_space_t *wgt_pinned_value(EVBDD_WGT a);
+// Number of pinned weights
+extern uint64_t wgt_pinned_count();
+// EVBDD_WGT of the value at table reference `ref` of `wgt_store`
+extern EVBDD_WGT wgt_from_store_ref(void *wgt_store, uint64_t ref);
+// While on, new weights in the table are pinned (as long as there is space)
+extern void wgt_set_pinning(bool on);
+// True iff init_wgt_table_entries is called for edge weight gc, and all
+// weights it looked up at initialization are pinned (and so still valid)
+extern bool wgt_table_gc_entries_pinned();
+
+/**************************</Pinned edge weights>******************************/
+
+
+
+
+
 /*************************<GC of edge weight table>****************************/
 
 extern void init_edge_weight_storage_gc();
-extern uint64_t wgt_table_entries_estimate();
-extern void wgt_table_gc_inc_entries_estimate();
+extern void quit_edge_weight_storage_gc();
+// Number of entries in the edge weight table (the new one during gc). This is
+// exact, and cheaper than sylvan_edge_weights_count_entries().
+extern uint64_t wgt_table_entries();
+// To be called by the thread which added an entry to the edge weight table
+extern void wgt_table_gc_inc_entries();
 extern void wgt_table_gc_init_new(void (*init_wgt_table_entries)());
 extern void wgt_table_gc_delete_old();
 extern EVBDD_WGT wgt_table_gc_keep(EVBDD_WGT a);
+// true iff `a` was already moved to the new table (by wgt_table_gc_keep), in
+// which case its new index is written to `res`
+extern bool wgt_table_gc_remapped(EVBDD_WGT a, EVBDD_WGT *res);
 
 /************************</GC of edge weight table>****************************/
 
@@ -66,7 +154,7 @@ typedef void (*_weight_value_f)(void *wgt_store, EVBDD_WGT a, weight_t res);
 typedef EVBDD_WGT (*weight_lookup_f)(weight_t a);
 typedef EVBDD_WGT (*_weight_lookup_ptr_f)(weight_t a, void *wgt_store);
 
-typedef void (*init_one_zero_f)(void *wgt_store);
+typedef void (*init_one_zero_f)(); // pins the constants EVBDD_ZERO, etc.
 
 /* Arithmetic operations on edge weights */
 typedef void (*weight_abs_f)(weight_t a); // a <-- |a|
@@ -87,6 +175,12 @@ typedef EVBDD_WGT (*wgt_get_low_L2normed_f)(EVBDD_WGT high);
 
 typedef void (*weight_fprint_f)(FILE *stream, weight_t a);
 
+/* Exchange of values as complex_t, independent of the edge_weight_type (for 
+   e.g. gate matrices and amplitudes) */
+typedef bool (*weight_representable_f)(complex_t *a); // true iff a can be stored as weight
+typedef EVBDD_WGT (*weight_lookup_complex_f)(complex_t *a);
+typedef void (*weight_value_complex_f)(EVBDD_WGT a, complex_t *res);
+
 
 
 extern weight_malloc_f 		weight_malloc;
@@ -112,6 +206,10 @@ extern wgt_get_low_L2normed_f		wgt_get_low_L2normed;
 
 extern weight_fprint_f 		weight_fprint;
 
+extern weight_representable_f   weight_representable;
+extern weight_lookup_complex_f  weight_lookup_complex;
+extern weight_value_complex_f   weight_value_complex;
+
 
 #define weight_lookup_ptr(a) _weight_lookup_ptr(a, wgt_storage)
 #define weight_value(a, res) _weight_value(wgt_storage, a, res)
@@ -126,6 +224,19 @@ extern weight_fprint_f 		weight_fprint;
 /********************<For caching arithmetic operations>***********************/
 
 void wgt_set_inverse_chaching(bool on);
+// whether wgt_mul4() computes and looks up its products together (default on)
+void wgt_set_batched_lookups(bool on);
+
+// The results of weight operations have a cache of their own, separate from
+// the operation cache, of SYLVAN_WGT_CACHE_SIZE entries unless set otherwise
+// (power of 2, can be set before or after initialization, which clears it)
+void wgt_cache_set_size(size_t size);
+size_t wgt_cache_getsize();
+size_t wgt_cache_getused();
+void wgt_cache_clear();
+// rewrite the cached results with the new edge weight indices during gc of the
+// edge weight table (after wgt_table_gc_keep() for all weights in use)
+void wgt_cache_remap();
 
 /*******************</For caching arithmetic operations>***********************/
 
@@ -143,6 +254,9 @@ EVBDD_WGT wgt_add(EVBDD_WGT a, EVBDD_WGT b); // returns a + b
 EVBDD_WGT wgt_sub(EVBDD_WGT a, EVBDD_WGT b); // returns a - b
 EVBDD_WGT wgt_mul(EVBDD_WGT a, EVBDD_WGT b); // returns a * b
 EVBDD_WGT wgt_div(EVBDD_WGT a, EVBDD_WGT b); // returns a / b
+// res[k] <-- a[k] * b[k] for k = 0..3 (for complex weights the products which
+// are not cached are computed together and looked up in the table together)
+void wgt_mul4(const EVBDD_WGT *a, const EVBDD_WGT *b, EVBDD_WGT *res);
 
 /********************</Arithmetic functions on EVBDD_WGT's>*********************/
 
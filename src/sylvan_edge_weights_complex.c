@@ -36,10 +36,8 @@ weight_complex_malloc()
 void
 _weight_complex_value(void *wgt_store, EVBDD_WGT a, complex_t *res)
 {
-    if (a == EVBDD_ZERO)         *res = czero();
-    else if (a == EVBDD_ONE)     *res = cone();
-    else if (a == EVBDD_MIN_ONE) *res = cmone();
-    *res = *(complex_t*)(wgt_store_get(wgt_store, a));
+    if (wgt_is_pinned(a)) *res = wgt_pinned_value(a)->complex_128;
+    else *res = *(complex_t*)(wgt_store_get(wgt_store, a - WGT_PINNED_SIZE));
 }
 
 EVBDD_WGT
@@ -49,12 +47,17 @@ _weight_complex_lookup_ptr(complex_t *a, void *wgt_store)
     uint64_t res;
     bool success;
 
+    // (only lookups in the current table go through the per-worker cache)
+    EVBDD_WGT cached;
+    bool current = (wgt_store == wgt_storage);
+    if (current && wgt_l0_get(a, &cached)) return cached;
+
     int present = wgt_store_find_or_put(wgt_store, a, &res);
     if (present == -1) {
         success = false;
     } else if (present == 0) { 
         success = true;
-        wgt_table_gc_inc_entries_estimate();
+        wgt_table_gc_inc_entries();
     } else {
         success = true;
     }
@@ -63,7 +66,9 @@ _weight_complex_lookup_ptr(complex_t *a, void *wgt_store)
         fprintf(stderr, "Amplitude table full!\n");
         exit(1);
     }
-    return (EVBDD_WGT) res; 
+    EVBDD_WGT wgt = wgt_from_store_ref(wgt_store, res);
+    if (current) wgt_l0_put(a, wgt);
+    return wgt;
 }
 
 EVBDD_WGT
@@ -73,32 +78,33 @@ weight_complex_lookup(complex_t *a)
 }
 
 void
-init_complex_one_zero(void *wgt_store)
+init_complex_one_zero()
 {
     complex_t a;
-    a = cone();     EVBDD_ONE     = _weight_complex_lookup_ptr(&a, wgt_store);
-    a = czero();    EVBDD_ZERO    = _weight_complex_lookup_ptr(&a, wgt_store);
-    a = cmone();    EVBDD_MIN_ONE = _weight_complex_lookup_ptr(&a, wgt_store);
+    a = cone();                         wgt_pin(EVBDD_ONE, &a);
+    a = czero();                        wgt_pin(EVBDD_ZERO, &a);
+    a = cmone();                        wgt_pin(EVBDD_MIN_ONE, &a);
+    a = cmake(0.0, 1.0);                wgt_pin(EVBDD_IMG, &a);
+    a = cmake(0.0, -1.0);               wgt_pin(EVBDD_MIN_IMG, &a);
+    a = cmake(1.0/flt_sqrt(2.0), 0.0);  wgt_pin(EVBDD_INV_SQRT_TWO, &a);
 }
 
 void
 weight_complex_abs(complex_t *a)
 {
-    a->r = flt_sqrt( (a->r*a->r) + (a->i*a->i) );
-    a->i = 0.0;
+    weight_complex_abs_inline(a);
 }
 
 void
 weight_complex_neg(complex_t *a)
 {
-    a->r = -(a->r);
-    a->i = -(a->i);
+    weight_complex_neg_inline(a);
 }
 
 void
 weight_complex_conj(complex_t *a)
 {
-    a->i = -(a->i);
+    weight_complex_conj_inline(a);
 }
 
 void
@@ -110,42 +116,25 @@ weight_complex_sqr(complex_t *a)
 void
 weight_complex_add(complex_t *a, complex_t *b)
 {
-    a->r = a->r + b->r;
-    a->i = a->i + b->i;
+    weight_complex_add_inline(a, b);
 }
 
 void
 weight_complex_sub(complex_t *a, complex_t *b)
 {
-    a->r = a->r - b->r;
-    a->i = a->i - b->i;
+    weight_complex_sub_inline(a, b);
 }
 
 void
 weight_complex_mul(complex_t *a, complex_t *b)
 {
-    complex_t tmp;
-    tmp.r = a->r * b->r - a->i * b->i;
-    tmp.i = a->r * b->i + a->i * b->r;
-    a->r = tmp.r;
-    a->i = tmp.i;
+    weight_complex_mul_inline(a, b);
 }
 
 void
 weight_complex_div(complex_t *a, complex_t *b)
 {
-    complex_t tmp;
-    fl_t denom;
-    if (b->i == 0.0) {
-        tmp.r = a->r / b->r;
-        tmp.i = a->i / b->r;
-    } else {
-        denom = b->r * b->r + b->i * b->i;
-        tmp.r = (a->r * b->r + a->i * b->i) / denom;
-        tmp.i = (a->i * b->r - a->r * b->i) / denom;
-    }
-    a->r = tmp.r;
-    a->i = tmp.i;
+    weight_complex_div_inline(a, b);
 }
 
 bool
@@ -163,7 +152,7 @@ weight_complex_eps_close(complex_t *a, complex_t *b, double eps)
 bool
 weight_complex_greater(complex_t *a, complex_t *b)
 {
-    return ( (a->r*a->r + a->i*a->i) > (b->r*b->r + b->i*b->i) );
+    return weight_complex_greater_inline(a, b);
 }
 
 EVBDD_WGT
@@ -254,4 +243,17 @@ weight_complex_fprint(FILE *stream, complex_t *a)
         fprintf(stream, "%.*Lfi", digits, (long double) a->i);
 }
 
+bool
+weight_complex_representable(complex_t *a)
+{
+    (void) a;
+    return true;
+}
+
+void
+weight_complex_value(EVBDD_WGT a, complex_t *res)
+{
+    _weight_complex_value(wgt_storage, a, res);
+}
+
 /*****************</Implementation of edge_weights interface>******************/
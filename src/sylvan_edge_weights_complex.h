@@ -5,6 +5,97 @@
 #include "edge_weight_storage/flt.h"
 
 
+/*********************<Inline complex arithmetic on values>********************/
+
+// Used by the interface functions below, and inlined directly in the edge
+// weight arithmetic when SYLVAN_WGT_COMPLEX_INLINE is enabled.
+
+static inline void
+weight_complex_abs_inline(complex_t *a)
+{
+    a->r = flt_sqrt( (a->r*a->r) + (a->i*a->i) );
+    a->i = 0.0;
+}
+
+static inline void
+weight_complex_neg_inline(complex_t *a)
+{
+    a->r = -(a->r);
+    a->i = -(a->i);
+}
+
+static inline void
+weight_complex_conj_inline(complex_t *a)
+{
+    a->i = -(a->i);
+}
+
+static inline void
+weight_complex_add_inline(complex_t *a, complex_t *b)
+{
+    a->r = a->r + b->r;
+    a->i = a->i + b->i;
+}
+
+static inline void
+weight_complex_sub_inline(complex_t *a, complex_t *b)
+{
+    a->r = a->r - b->r;
+    a->i = a->i - b->i;
+}
+
+static inline void
+weight_complex_mul_inline(complex_t *a, complex_t *b)
+{
+    complex_t tmp;
+    tmp.r = a->r * b->r - a->i * b->i;
+    tmp.i = a->r * b->i + a->i * b->r;
+    a->r = tmp.r;
+    a->i = tmp.i;
+}
+
+static inline void
+weight_complex_div_inline(complex_t *a, complex_t *b)
+{
+    complex_t tmp;
+    fl_t denom;
+    if (b->i == 0.0) {
+        tmp.r = a->r / b->r;
+        tmp.i = a->i / b->r;
+    } else {
+        denom = b->r * b->r + b->i * b->i;
+        tmp.r = (a->r * b->r + a->i * b->i) / denom;
+        tmp.i = (a->i * b->r - a->r * b->i) / denom;
+    }
+    a->r = tmp.r;
+    a->i = tmp.i;
+}
+
+// a[k] <-- a[k] * b[k] for k = 0..3, with the real and imaginary parts computed
+// in separate loops, which the compiler can vectorise
+static inline void
+weight_complex_mul4_inline(complex_t *a, const complex_t *b)
+{
+    fl_t r[4], i[4];
+    for (int k = 0; k < 4; k++) r[k] = a[k].r * b[k].r - a[k].i * b[k].i;
+    for (int k = 0; k < 4; k++) i[k] = a[k].r * b[k].i + a[k].i * b[k].r;
+    for (int k = 0; k < 4; k++) {
+        a[k].r = r[k];
+        a[k].i = i[k];
+    }
+}
+
+static inline bool
+weight_complex_greater_inline(complex_t *a, complex_t *b)
+{
+    return ( (a->r*a->r + a->i*a->i) > (b->r*b->r + b->i*b->i) );
+}
+
+/********************</Inline complex arithmetic on values>********************/
+
+
+
+
 /******************<Implementation of edge_weights interface>******************/
 
 complex_t *weight_complex_malloc();
@@ -12,7 +103,12 @@ void _weight_complex_value(void *wgt_store, EVBDD_WGT a, complex_t *res);
 EVBDD_WGT weight_complex_lookup(complex_t *a);
 EVBDD_WGT _weight_complex_lookup_ptr(complex_t *a, void *wgt_store);
 
-void init_complex_one_zero(void *wgt_store);
+// per-worker cache of lookups in the current edge weight table (see
+// sylvan_edge_weights.c)
+bool wgt_l0_get(const complex_t *a, EVBDD_WGT *res);
+void wgt_l0_put(const complex_t *a, EVBDD_WGT wgt);
+
+void init_complex_one_zero();
 
 void weight_complex_abs(complex_t *a);
 void weight_complex_neg(complex_t *a);
@@ -31,19 +127,22 @@ EVBDD_WGT wgt_complex_get_low_L2normed(EVBDD_WGT high);
 
 void weight_complex_fprint(FILE *stream, complex_t *a);
 
+bool weight_complex_representable(complex_t *a);
+void weight_complex_value(EVBDD_WGT a, complex_t *res);
+
 
 static inline EVBDD_WGT
 complex_lookup_angle(fl_t theta, fl_t mag)
 {
 	complex_t c = cmake_angle(theta, mag);
-	return weight_lookup(&c);
+	return weight_lookup_complex(&c);
 }
 
 static inline EVBDD_WGT
 complex_lookup(fl_t r, fl_t i)
 {
 	complex_t c = cmake(r, i);
-	return weight_lookup(&c);
+	return weight_lookup_complex(&c);
 }
 
 /*****************</Implementation of edge_weights interface>******************/
@@ -0,0 +1,480 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sylvan_edge_weights_rational.h"
+
+// Complex values are converted to exact weights by searching for a
+// representation (d + s/sqrt(2)) / 2^j of both the real and imaginary part,
+// with 2^j <= max_den and values at most match_tolerance apart.
+static const int64_t max_den = 1 << 10;
+static const double match_tolerance = 1e-9;
+
+// Intermediate results are computed with 128 bit coefficients, and only need
+// to fit in 64 bits after reducing them to canonical form.
+typedef __int128 i128_t;
+typedef unsigned __int128 u128_t;
+
+typedef struct qomega_wide_s {
+    i128_t den;
+    i128_t c[4];
+} qomega_wide_t;
+
+
+/*************************<Exact arithmetic in Q(w)>***************************/
+
+static void
+qomega_overflow()
+{
+    fprintf(stderr, "Exact edge weight overflow (coefficients exceed 64 bits)\n");
+    exit(1);
+}
+
+static inline i128_t
+mul128(i128_t a, i128_t b)
+{
+    i128_t res;
+    if (__builtin_mul_overflow(a, b, &res)) qomega_overflow();
+    return res;
+}
+
+static inline i128_t
+add128(i128_t a, i128_t b)
+{
+    i128_t res;
+    if (__builtin_add_overflow(a, b, &res)) qomega_overflow();
+    return res;
+}
+
+static inline u128_t
+abs128(i128_t a)
+{
+    return (a < 0) ? -(u128_t)a : (u128_t)a;
+}
+
+static inline u128_t
+gcd128(u128_t a, u128_t b)
+{
+    while (b != 0) {
+        u128_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static inline void
+qomega_set_zero(qomega_t *a)
+{
+    a->den = 1;
+    a->c[0] = a->c[1] = a->c[2] = a->c[3] = 0;
+}
+
+static inline bool
+qomega_is_zero(const qomega_t *a)
+{
+    return (a->c[0] == 0 && a->c[1] == 0 && a->c[2] == 0 && a->c[3] == 0);
+}
+
+/**
+ * Reduces `w` to canonical form (den > 0, gcd of all coefficients 1) and
+ * writes it to `res`, aborting if it doesn't fit in 64 bit coefficients.
+ */
+static void
+qomega_narrow(const qomega_wide_t *w, qomega_t *res)
+{
+    if (w->c[0] == 0 && w->c[1] == 0 && w->c[2] == 0 && w->c[3] == 0) {
+        qomega_set_zero(res);
+        return;
+    }
+    u128_t g = abs128(w->den);
+    for (int k = 0; k < 4; k++) g = gcd128(g, abs128(w->c[k]));
+    i128_t sign = (w->den < 0) ? -1 : 1;
+
+    i128_t den = w->den / (i128_t)g * sign;
+    if (den > INT64_MAX) qomega_overflow();
+    res->den = (int64_t) den;
+    for (int k = 0; k < 4; k++) {
+        i128_t c = w->c[k] / (i128_t)g * sign;
+        if (c > INT64_MAX || c <= INT64_MIN) qomega_overflow();
+        res->c[k] = (int64_t) c;
+    }
+}
+
+// a <-- a * b, with w^4 = -1
+static void
+qomega_mul(qomega_t *a, const qomega_t *b)
+{
+    const int64_t *x = a->c;
+    const int64_t *y = b->c;
+    qomega_wide_t w;
+    w.den  = mul128(a->den, b->den);
+    w.c[0] = add128(add128(mul128(x[0], y[0]), -mul128(x[1], y[3])),
+                    add128(-mul128(x[2], y[2]), -mul128(x[3], y[1])));
+    w.c[1] = add128(add128(mul128(x[0], y[1]),  mul128(x[1], y[0])),
+                    add128(-mul128(x[2], y[3]), -mul128(x[3], y[2])));
+    w.c[2] = add128(add128(mul128(x[0], y[2]),  mul128(x[1], y[1])),
+                    add128( mul128(x[2], y[0]), -mul128(x[3], y[3])));
+    w.c[3] = add128(add128(mul128(x[0], y[3]),  mul128(x[1], y[2])),
+                    add128( mul128(x[2], y[1]),  mul128(x[3], y[0])));
+    qomega_narrow(&w, a);
+}
+
+// a <-- a + b
+static void
+qomega_add(qomega_t *a, const qomega_t *b)
+{
+    // common denominator lcm(a.den, b.den)
+    i128_t g  = (i128_t) gcd128(a->den, b->den);
+    i128_t fa = b->den / g;
+    i128_t fb = a->den / g;
+    qomega_wide_t w;
+    w.den = mul128(a->den, fa);
+    for (int k = 0; k < 4; k++) {
+        w.c[k] = add128(mul128(a->c[k], fa), mul128(b->c[k], fb));
+    }
+    qomega_narrow(&w, a);
+}
+
+static inline void
+qomega_neg(qomega_t *a)
+{
+    for (int k = 0; k < 4; k++) a->c[k] = -a->c[k];
+}
+
+// complex conjugate: w -> w^7 = -w^3
+static inline void
+qomega_conj(qomega_t *a)
+{
+    int64_t c1 = a->c[1];
+    a->c[1] = -a->c[3];
+    a->c[2] = -a->c[2];
+    a->c[3] = -c1;
+}
+
+// automorphism sqrt(2) -> -sqrt(2): w -> w^5 = -w
+static inline void
+qomega_sigma(qomega_t *a)
+{
+    a->c[1] = -a->c[1];
+    a->c[3] = -a->c[3];
+}
+
+// a <-- |a|^2, an element of Q(sqrt(2)), i.e. (c[0] + c[1] sqrt(2)) / den
+static inline void
+qomega_norm_sqr(qomega_t *a)
+{
+    qomega_t a_conj = *a;
+    qomega_conj(&a_conj);
+    qomega_mul(a, &a_conj);
+}
+
+// a <-- 1/a (a != 0)
+static void
+qomega_inv(qomega_t *a)
+{
+    // 1/a = conj(a) sigma(m) / (m sigma(m)), with m = a conj(a) in Q(sqrt(2))
+    // and m sigma(m) in Q
+    qomega_t m = *a;
+    qomega_norm_sqr(&m);
+    qomega_t m_sigma = m;
+    qomega_sigma(&m_sigma);
+    qomega_t n = m;
+    qomega_mul(&n, &m_sigma);
+
+    qomega_conj(a);
+    qomega_mul(a, &m_sigma);
+
+    // divide by n = n.c[0] / n.den
+    qomega_wide_t w;
+    w.den = mul128(a->den, n.c[0]);
+    for (int k = 0; k < 4; k++) w.c[k] = mul128(a->c[k], n.den);
+    qomega_narrow(&w, a);
+}
+
+// sign of (p + q sqrt(2))
+static inline int
+qsqrt2_sign(int64_t p, int64_t q)
+{
+    if (p >= 0 && q >= 0) return (p != 0 || q != 0);
+    if (p <= 0 && q <= 0) return -1;
+    i128_t p2 = (i128_t)p * p;
+    i128_t q2 = 2 * ((i128_t)q * q);
+    if (p > 0) return (p2 > q2) ? 1 : -1;
+    else       return (q2 > p2) ? 1 : -1;
+}
+
+static inline complex_t
+qomega_to_complex(const qomega_t *a)
+{
+    fl_t s = flt_sqrt(2.0) / 2.0;
+    complex_t res;
+    res.r = ((fl_t)a->c[0] + ((fl_t)a->c[1] - (fl_t)a->c[3]) * s) / (fl_t)a->den;
+    res.i = ((fl_t)a->c[2] + ((fl_t)a->c[1] + (fl_t)a->c[3]) * s) / (fl_t)a->den;
+    return res;
+}
+
+/**
+ * Finds integers d, s with |x - (d + s/sqrt(2))| < match_tolerance and
+ * |s| <= s_max, preferring small |s|.
+ */
+static bool
+match_sqrt2(double x, int64_t s_max, int64_t *d, int64_t *s)
+{
+    for (int64_t k = 0; k <= s_max; k++) {
+        for (int64_t sign = 1; sign >= -1; sign -= 2) {
+            double y = x - (double)(sign * k) * M_SQRT1_2;
+            double y_round = round(y);
+            if (fabs(y - y_round) < match_tolerance) {
+                *d = (int64_t) y_round;
+                *s = sign * k;
+                return true;
+            }
+            if (k == 0) break;
+        }
+    }
+    return false;
+}
+
+/**
+ * Converts `a` to an exact value, if it is (close to) a value
+ * (d + s/sqrt(2) + i (b + t/sqrt(2))) / 2^j with 2^j <= max_den.
+ */
+static bool
+qomega_from_complex(const complex_t *a, qomega_t *res)
+{
+    double r = (double) a->r;
+    double i = (double) a->i;
+    if (!(fabs(r) < (1 << 20) && fabs(i) < (1 << 20))) return false;
+    for (int64_t den = 1; den <= max_den; den *= 2) {
+        int64_t d, s, b, t;
+        double R = r * den;
+        double I = i * den;
+        if (!match_sqrt2(R, 4*den + 2*(int64_t)fabs(R), &d, &s)) continue;
+        if (!match_sqrt2(I, 4*den + 2*(int64_t)fabs(I), &b, &t)) continue;
+        if ((s - t) % 2 != 0) continue; // needs a larger denominator
+        // s/sqrt(2) + i t/sqrt(2) = c1 w + c3 w^3 with c1 - c3 = s, c1 + c3 = t
+        qomega_wide_t w;
+        w.den  = den;
+        w.c[0] = d;
+        w.c[1] = (s + t) / 2;
+        w.c[2] = b;
+        w.c[3] = (t - s) / 2;
+        qomega_narrow(&w, res);
+        return true;
+    }
+    return false;
+}
+
+/************************</Exact arithmetic in Q(w)>***************************/
+
+
+
+
+/*****************<Implementation of edge_weights interface>*******************/
+
+qomega_t *
+weight_rational_malloc()
+{
+    qomega_t *res = malloc(sizeof(qomega_t));
+    return res;
+}
+
+void
+_weight_rational_value(void *wgt_store, EVBDD_WGT a, qomega_t *res)
+{
+    if (wgt_is_pinned(a)) *res = wgt_pinned_value(a)->rational_128;
+    else *res = *(qomega_t*)(wgt_store_get(wgt_store, a - WGT_PINNED_SIZE));
+}
+
+EVBDD_WGT
+_weight_rational_lookup_ptr(qomega_t *a, void *wgt_store)
+{
+    uint64_t res;
+    int present = wgt_store_find_or_put(wgt_store, a, &res);
+    if (present == -1) {
+        fprintf(stderr, "Amplitude table full!\n");
+        exit(1);
+    } else if (present == 0) {
+        wgt_table_gc_inc_entries();
+    }
+    return wgt_from_store_ref(wgt_store, res);
+}
+
+EVBDD_WGT
+weight_rational_lookup(qomega_t *a)
+{
+    return _weight_rational_lookup_ptr(a, wgt_storage);
+}
+
+void
+init_rational_one_zero()
+{
+    qomega_t a;
+    qomega_set_zero(&a);
+    a.c[0] =  1;    wgt_pin(EVBDD_ONE, &a);
+    a.c[0] =  0;    wgt_pin(EVBDD_ZERO, &a);
+    a.c[0] = -1;    wgt_pin(EVBDD_MIN_ONE, &a);
+    complex_t c;
+    c = cmake(0.0, 1.0);                qomega_from_complex(&c, &a);  wgt_pin(EVBDD_IMG, &a);
+    c = cmake(0.0, -1.0);               qomega_from_complex(&c, &a);  wgt_pin(EVBDD_MIN_IMG, &a);
+    c = cmake(1.0/flt_sqrt(2.0), 0.0);  qomega_from_complex(&c, &a);  wgt_pin(EVBDD_INV_SQRT_TWO, &a);
+}
+
+void
+weight_rational_abs(qomega_t *a)
+{
+    if (qomega_is_zero(a)) return;
+
+    // |a| is real, so if it is in Q(w) it is in Q(sqrt(2)). Find a candidate
+    // from the floating point value, and check that its square is |a|^2.
+    complex_t c = qomega_to_complex(a);
+    c = cmake(flt_sqrt(c.r*c.r + c.i*c.i), 0.0);
+    qomega_t abs, abs_sqr, norm_sqr = *a;
+    qomega_norm_sqr(&norm_sqr);
+    if (qomega_from_complex(&c, &abs)) {
+        abs_sqr = abs;
+        qomega_mul(&abs_sqr, &abs);
+        if (memcmp(&abs_sqr, &norm_sqr, sizeof(qomega_t)) == 0) {
+            *a = abs;
+            return;
+        }
+    }
+    fprintf(stderr, "The magnitude %.3lf of an exact edge weight is not exact, use complex edge weights (WGT_COMPLEX_128) instead\n",
+            (double) c.r);
+    exit(1);
+}
+
+void
+weight_rational_neg(qomega_t *a)
+{
+    qomega_neg(a);
+}
+
+void
+weight_rational_conj(qomega_t *a)
+{
+    qomega_conj(a);
+}
+
+void
+weight_rational_sqr(qomega_t *a)
+{
+    qomega_t b = *a;
+    qomega_mul(a, &b);
+}
+
+void
+weight_rational_add(qomega_t *a, qomega_t *b)
+{
+    qomega_add(a, b);
+}
+
+void
+weight_rational_sub(qomega_t *a, qomega_t *b)
+{
+    qomega_t b_neg = *b;
+    qomega_neg(&b_neg);
+    qomega_add(a, &b_neg);
+}
+
+void
+weight_rational_mul(qomega_t *a, qomega_t *b)
+{
+    qomega_mul(a, b);
+}
+
+void
+weight_rational_div(qomega_t *a, qomega_t *b)
+{
+    qomega_t b_inv = *b;
+    qomega_inv(&b_inv);
+    qomega_mul(a, &b_inv);
+}
+
+bool
+weight_rational_eq(qomega_t *a, qomega_t *b)
+{
+    // canonical form, so equal iff bits are equal
+    return (memcmp(a, b, sizeof(qomega_t)) == 0);
+}
+
+bool
+weight_rational_eps_close(qomega_t *a, qomega_t *b, double eps)
+{
+    complex_t ca = qomega_to_complex(a);
+    complex_t cb = qomega_to_complex(b);
+    return ( (flt_abs(ca.r - cb.r) <= eps) && (flt_abs(ca.i - cb.i) <= eps) );
+}
+
+bool
+weight_rational_greater(qomega_t *a, qomega_t *b)
+{
+    // exact sign of |a|^2 - |b|^2 = (c[0] + c[1] sqrt(2)) / den
+    qomega_t diff = *a;
+    qomega_t b_sqr = *b;
+    qomega_norm_sqr(&diff);
+    qomega_norm_sqr(&b_sqr);
+    qomega_neg(&b_sqr);
+    qomega_add(&diff, &b_sqr);
+    return (qsqrt2_sign(diff.c[0], diff.c[1]) > 0);
+}
+
+EVBDD_WGT
+wgt_rational_norm_L2(EVBDD_WGT *low, EVBDD_WGT *high)
+{
+    (void) low;
+    (void) high;
+    fprintf(stderr, "L2 normalization is not supported with exact edge weights\n");
+    exit(1);
+}
+
+EVBDD_WGT
+wgt_rational_get_low_L2normed(EVBDD_WGT high)
+{
+    (void) high;
+    fprintf(stderr, "L2 normalization is not supported with exact edge weights\n");
+    exit(1);
+}
+
+void
+weight_rational_fprint(FILE *stream, qomega_t *a)
+{
+    complex_t c = qomega_to_complex(a);
+    int digits = 3;
+    if(c.r >= 0)
+        fprintf(stream, " ");
+    fprintf(stream, "%.*Lf", digits, (long double) c.r);
+    if (c.i > 0)
+        fprintf(stream, "+%.*Lfi", digits, (long double) c.i);
+    if (c.i < 0)
+        fprintf(stream, "%.*Lfi", digits, (long double) c.i);
+}
+
+bool
+weight_rational_representable(complex_t *a)
+{
+    qomega_t q;
+    return qomega_from_complex(a, &q);
+}
+
+EVBDD_WGT
+weight_rational_lookup_complex(complex_t *a)
+{
+    qomega_t q;
+    if (!qomega_from_complex(a, &q)) {
+        fprintf(stderr, "Edge weight %.3lf%+.3lfi is not exact (not a Clifford+T value), use complex edge weights (WGT_COMPLEX_128) instead\n",
+                (double) a->r, (double) a->i);
+        exit(1);
+    }
+    return weight_rational_lookup(&q);
+}
+
+void
+weight_rational_value_complex(EVBDD_WGT a, complex_t *res)
+{
+    qomega_t q;
+    weight_value(a, &q);
+    *res = qomega_to_complex(&q);
+}
+
+/*****************</Implementation of edge_weights interface>******************/
@@ -0,0 +1,47 @@
+#ifndef WGT_RATIONAL_H
+#define WGT_RATIONAL_H
+
+#include "sylvan_edge_weights.h"
+#include "edge_weight_storage/flt.h"
+
+
+/******************<Implementation of edge_weights interface>******************/
+
+// Edge weights of type WGT_RATIONAL_128: exact elements of Q(w), w = e^(i pi/4)
+// (see qomega_t). Enough for circuits with only Clifford+T gates, which then
+// don't suffer from rounding errors. Arithmetic is on 64 bit coefficients,
+// the simulation is aborted if these overflow. The magnitude of a weight is
+// generally not in Q(w), so NORM_MIN and NORM_L2 are not supported, and
+// wgt_abs() only works for weights with an exact magnitude.
+
+qomega_t *weight_rational_malloc();
+void _weight_rational_value(void *wgt_store, EVBDD_WGT a, qomega_t *res);
+EVBDD_WGT weight_rational_lookup(qomega_t *a);
+EVBDD_WGT _weight_rational_lookup_ptr(qomega_t *a, void *wgt_store);
+
+void init_rational_one_zero();
+
+void weight_rational_abs(qomega_t *a);
+void weight_rational_neg(qomega_t *a);
+void weight_rational_conj(qomega_t *a);
+void weight_rational_sqr(qomega_t *a);
+void weight_rational_add(qomega_t *a, qomega_t *b);
+void weight_rational_sub(qomega_t *a, qomega_t *b);
+void weight_rational_mul(qomega_t *a, qomega_t *b);
+void weight_rational_div(qomega_t *a, qomega_t *b);
+bool weight_rational_eq(qomega_t *a, qomega_t *b);
+bool weight_rational_eps_close(qomega_t *a, qomega_t *b, double eps);
+bool weight_rational_greater(qomega_t *a, qomega_t *b);
+
+EVBDD_WGT wgt_rational_norm_L2(EVBDD_WGT *low, EVBDD_WGT *high);
+EVBDD_WGT wgt_rational_get_low_L2normed(EVBDD_WGT high);
+
+void weight_rational_fprint(FILE *stream, qomega_t *a);
+
+bool weight_rational_representable(complex_t *a);
+EVBDD_WGT weight_rational_lookup_complex(complex_t *a);
+void weight_rational_value_complex(EVBDD_WGT a, complex_t *res);
+
+/*****************</Implementation of edge_weights interface>******************/
+
+#endif
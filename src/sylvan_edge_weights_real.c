@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "sylvan_edge_weights_real.h"
+
+// Imaginary parts smaller than this (or than the table tolerance) are treated
+// as 0 when converting complex values to real edge weights, e.g. the rounding
+// error in cmake_angle(pi, 1).
+static const double imag_tolerance = 1e-14;
+
+
+/*****************<Implementation of edge_weights interface>*******************/
+
+fl_t *
+weight_real_malloc()
+{
+    fl_t *res = malloc(sizeof(fl_t));
+    return res;
+}
+
+void
+_weight_real_value(void *wgt_store, EVBDD_WGT a, fl_t *res)
+{
+    if (wgt_is_pinned(a)) *res = wgt_pinned_value(a)->real;
+    else *res = *(fl_t*)(wgt_store_get(wgt_store, a - WGT_PINNED_SIZE));
+}
+
+EVBDD_WGT
+_weight_real_lookup_ptr(fl_t *a, void *wgt_store)
+{
+    uint64_t res;
+    int present = wgt_store_find_or_put(wgt_store, a, &res);
+    if (present == -1) {
+        fprintf(stderr, "Amplitude table full!\n");
+        exit(1);
+    } else if (present == 0) {
+        wgt_table_gc_inc_entries();
+    }
+    return wgt_from_store_ref(wgt_store, res);
+}
+
+EVBDD_WGT
+weight_real_lookup(fl_t *a)
+{
+    return _weight_real_lookup_ptr(a, wgt_storage);
+}
+
+void
+init_real_one_zero()
+{
+    // (+-i are not real, so EVBDD_IMG and EVBDD_MIN_IMG are not used)
+    fl_t a;
+    a =  1.0;                   wgt_pin(EVBDD_ONE, &a);
+    a =  0.0;                   wgt_pin(EVBDD_ZERO, &a);
+    a = -1.0;                   wgt_pin(EVBDD_MIN_ONE, &a);
+    a =  1.0/flt_sqrt(2.0);     wgt_pin(EVBDD_INV_SQRT_TWO, &a);
+}
+
+void
+weight_real_abs(fl_t *a)
+{
+    *a = flt_abs(*a);
+}
+
+void
+weight_real_neg(fl_t *a)
+{
+    *a = -(*a);
+}
+
+void
+weight_real_conj(fl_t *a)
+{
+    (void) a; // real values are their own conjugate
+}
+
+void
+weight_real_sqr(fl_t *a)
+{
+    *a = (*a) * (*a);
+}
+
+void
+weight_real_add(fl_t *a, fl_t *b)
+{
+    *a = *a + *b;
+}
+
+void
+weight_real_sub(fl_t *a, fl_t *b)
+{
+    *a = *a - *b;
+}
+
+void
+weight_real_mul(fl_t *a, fl_t *b)
+{
+    *a = (*a) * (*b);
+}
+
+void
+weight_real_div(fl_t *a, fl_t *b)
+{
+    *a = (*a) / (*b);
+}
+
+bool
+weight_real_eq(fl_t *a, fl_t *b)
+{
+    return (*a == *b);
+}
+
+bool
+weight_real_eps_close(fl_t *a, fl_t *b, double eps)
+{
+    return (flt_abs(*a - *b) <= eps);
+}
+
+bool
+weight_real_greater(fl_t *a, fl_t *b)
+{
+    return (flt_abs(*a) > flt_abs(*b));
+}
+
+EVBDD_WGT
+wgt_real_norm_L2(EVBDD_WGT *low, EVBDD_WGT *high)
+{
+    // normalize such that low^2 + high^2 = 1, and low >= 0
+
+    // Deal with cases where one weight is 0 (both 0 shouldn't end up here)
+    if (*low == EVBDD_ZERO) {
+        EVBDD_WGT res = *high;
+        *high = EVBDD_ONE;
+        return res;
+    }
+    else if (*high == EVBDD_ZERO){
+        EVBDD_WGT res = *low;
+        *low = EVBDD_ONE;
+        return res;
+    }
+
+    fl_t a, b;
+    weight_value(*low, &a);
+    weight_value(*high, &b);
+
+    // For real values the "phase" is only a sign, which is put in the norm
+    fl_t norm = flt_sqrt(a*a + b*b);
+    if (a < 0) norm = -norm;
+    a = a / norm;
+    b = b / norm;
+
+    *low  = weight_real_lookup(&a);
+    *high = weight_real_lookup(&b);
+    return weight_real_lookup(&norm);
+}
+
+EVBDD_WGT
+wgt_real_get_low_L2normed(EVBDD_WGT high)
+{
+    // Get low from high, assuming low^2 + high^2 = 1, and low >= 0:
+    // a = sqrt(1 - b^2)
+    if (high == EVBDD_ZERO) return EVBDD_ONE;
+    if (high == EVBDD_ONE || high == EVBDD_MIN_ONE) return EVBDD_ZERO;
+
+    fl_t b;
+    weight_value(high, &b);
+    fl_t mag_b = b*b;
+    if (mag_b > 1.0) {
+        if (mag_b > 1.0 + 1e-6 && mag_b <= 1.1) {
+            printf("Warning: |b| = %.15lf > 1.0\n", (double) mag_b);
+            printf("Continuing with |b| = 1.0\n");
+        } else if (mag_b > 1.1) {
+            printf("Value error in L2 norm: |b| = %.15lf > 1.0\n", (double) mag_b);
+            exit(1);
+        }
+        mag_b = 1.0;
+    }
+    fl_t a = flt_sqrt(1.0 - mag_b);
+    return weight_real_lookup(&a);
+}
+
+void
+weight_real_fprint(FILE *stream, fl_t *a)
+{
+    int digits = 3;
+    if(*a >= 0)
+        fprintf(stream, " ");
+    fprintf(stream, "%.*Lf", digits, (long double) *a);
+}
+
+bool
+weight_real_representable(complex_t *a)
+{
+    double tol = wgt_store_get_tol();
+    if (tol < imag_tolerance) tol = imag_tolerance;
+    return (flt_abs(a->i) <= tol);
+}
+
+EVBDD_WGT
+weight_real_lookup_complex(complex_t *a)
+{
+    if (!weight_real_representable(a)) {
+        fprintf(stderr, "Edge weight %.3lf%+.3lfi is not real, use complex edge weights (WGT_COMPLEX_128) instead\n",
+                (double) a->r, (double) a->i);
+        exit(1);
+    }
+    fl_t r = a->r;
+    return weight_real_lookup(&r);
+}
+
+void
+weight_real_value_complex(EVBDD_WGT a, complex_t *res)
+{
+    fl_t r;
+    weight_value(a, &r);
+    *res = cmake(r, 0.0);
+}
+
+/*****************</Implementation of edge_weights interface>******************/
@@ -0,0 +1,43 @@
+#ifndef WGT_REAL_H
+#define WGT_REAL_H
+
+#include "sylvan_edge_weights.h"
+#include "edge_weight_storage/flt.h"
+
+
+/******************<Implementation of edge_weights interface>******************/
+
+// Edge weights of type WGT_DOUBLE: a single (real) fl_t per weight. Enough for
+// circuits with only real gates (e.g. X, Z, H, Ry, CZ, Toffoli).
+
+fl_t *weight_real_malloc();
+void _weight_real_value(void *wgt_store, EVBDD_WGT a, fl_t *res);
+EVBDD_WGT weight_real_lookup(fl_t *a);
+EVBDD_WGT _weight_real_lookup_ptr(fl_t *a, void *wgt_store);
+
+void init_real_one_zero();
+
+void weight_real_abs(fl_t *a);
+void weight_real_neg(fl_t *a);
+void weight_real_conj(fl_t *a);
+void weight_real_sqr(fl_t *a);
+void weight_real_add(fl_t *a, fl_t *b);
+void weight_real_sub(fl_t *a, fl_t *b);
+void weight_real_mul(fl_t *a, fl_t *b);
+void weight_real_div(fl_t *a, fl_t *b);
+bool weight_real_eq(fl_t *a, fl_t *b);
+bool weight_real_eps_close(fl_t *a, fl_t *b, double eps);
+bool weight_real_greater(fl_t *a, fl_t *b);
+
+EVBDD_WGT wgt_real_norm_L2(EVBDD_WGT *low, EVBDD_WGT *high);
+EVBDD_WGT wgt_real_get_low_L2normed(EVBDD_WGT high);
+
+void weight_real_fprint(FILE *stream, fl_t *a);
+
+bool weight_real_representable(complex_t *a);
+EVBDD_WGT weight_real_lookup_complex(complex_t *a);
+void weight_real_value_complex(EVBDD_WGT a, complex_t *res);
+
+/*****************</Implementation of edge_weights interface>******************/
+
+#endif
@@ -27,7 +27,6 @@
 static int granularity = 1; // operation cache access granularity
 
 
-bool larger_wgt_indices;
 int weight_norm_strat;
 EVBDD_WGT (*normalize_weights)(EVBDD_WGT *, EVBDD_WGT *);
 
@@ -346,12 +345,231 @@ evbdd_get_gc_wgt_table_thres()
 }
 
 
+/**
+ * Old -> new node map, filled while moving the protected EVBDDs to the new edge
+ * weight table. Since the weights inside the nodes get new indices, so do the
+ * nodes themselves. Each slot is a pair (old node, new node), where the old
+ * node has NODE_REMAP_PENDING set while the new node is being written. The map
+ * has a fixed size, nodes which don't fit are simply not in it.
+ */
+static _Atomic(uint64_t) *node_remap = NULL;
+static uint64_t node_remap_mask;
+static const uint64_t NODE_REMAP_PENDING = 0x8000000000000000;
+static const int node_remap_probes = 16;
+
+static void
+node_remap_create()
+{
+    // proportional to the cache, since only nodes in the cache have to be
+    // remapped after gc (the map also helps _fill_new_wgt_table though)
+    uint64_t size = 1ULL<<16;
+    while (size < 2*cache_getsize()) size <<= 1;
+    node_remap = calloc(2*size, sizeof(uint64_t));
+    if (node_remap == NULL) {
+        fprintf(stderr, "evbdd_gc_wgt_table: unable to allocate node remap table\n");
+        exit(1);
+    }
+    node_remap_mask = size - 1;
+}
+
+static void
+node_remap_free()
+{
+    free(node_remap);
+    node_remap = NULL;
+}
+
+/**
+ * Nodes in the node_remap can be freed by node table gc, so clear it then.
+ */
+VOID_TASK_0(evbdd_gc_clear_node_remap)
+{
+    if (node_remap != NULL) {
+        memset(node_remap, 0, 2*(node_remap_mask+1)*sizeof(uint64_t));
+    }
+}
+
+static inline uint64_t
+node_remap_hash(EVBDD_TARG old)
+{
+    uint64_t h = old * 0x9E3779B97F4A7C15ULL;
+    return (h ^ (h >> 32)) & node_remap_mask;
+}
+
+static void
+node_remap_put(EVBDD_TARG old, EVBDD_TARG new)
+{
+    uint64_t slot = node_remap_hash(old);
+    for (int k = 0; k < node_remap_probes; k++) {
+        uint64_t key = atomic_load_explicit(&node_remap[2*slot], memory_order_relaxed);
+        if (key == 0) {
+            if (atomic_compare_exchange_strong(&node_remap[2*slot], &key, old | NODE_REMAP_PENDING)) {
+                atomic_store_explicit(&node_remap[2*slot+1], new, memory_order_relaxed);
+                atomic_store_explicit(&node_remap[2*slot], old, memory_order_release);
+                return;
+            }
+        }
+        if ((key & ~NODE_REMAP_PENDING) == old) return; // already (being) added
+        slot = (slot + 1) & node_remap_mask;
+    }
+}
+
+static bool
+node_remap_get(EVBDD_TARG old, EVBDD_TARG *new)
+{
+    if (old == EVBDD_TERMINAL) {
+        *new = old;
+        return true;
+    }
+    uint64_t slot = node_remap_hash(old);
+    for (int k = 0; k < node_remap_probes; k++) {
+        uint64_t key = atomic_load_explicit(&node_remap[2*slot], memory_order_acquire);
+        if (key == old) {
+            *new = atomic_load_explicit(&node_remap[2*slot+1], memory_order_relaxed);
+            return true;
+        }
+        if (key == 0) return false;
+        slot = (slot + 1) & node_remap_mask;
+    }
+    return false;
+}
+
+/**
+ * How the (low 40 bits of) a, b, c, and res of a cache entry are remapped
+ * after gc of the edge weight table, and which of them have to be marked for
+ * the entry to survive gc of the nodes table.
+ */
+typedef enum cache_field {
+    FIELD_KEEP, // anything which is not an edge weight or EVBDD
+    FIELD_WGT,  // edge weight
+    FIELD_TARG, // EVBDD target (node)
+    FIELD_EDGE, // EVBDD (target + weight)
+} cache_field_t;
+// (With SYLVAN_EVBDD_WIDE_EDGES the entries with edges take two buckets, which
+// are not kept by gc, so those layouts are only used for 64 bit edges.)
+
+static bool
+cache_field_layout(uint64_t opid, cache_field_t layout[4])
+{
+    static const cache_field_t gate[4]    = {FIELD_KEEP, FIELD_TARG, FIELD_KEEP, FIELD_EDGE};
+    static const cache_field_t subcirc[4] = {FIELD_KEEP, FIELD_EDGE, FIELD_KEEP, FIELD_EDGE};
+    static const cache_field_t prob[4]    = {FIELD_KEEP, FIELD_EDGE, FIELD_KEEP, FIELD_KEEP};
+    static const cache_field_t plus[4]    = {FIELD_KEEP, FIELD_EDGE, FIELD_EDGE, FIELD_EDGE};
+    static const cache_field_t mult[4]    = {FIELD_KEEP, FIELD_TARG, FIELD_TARG, FIELD_EDGE};
+    static const cache_field_t repl[4]    = {FIELD_TARG, FIELD_TARG, FIELD_KEEP, FIELD_TARG};
+    static const cache_field_t incv[4]    = {FIELD_TARG, FIELD_KEEP, FIELD_KEEP, FIELD_TARG};
+    static const cache_field_t order[4]   = {FIELD_TARG, FIELD_KEEP, FIELD_KEEP, FIELD_KEEP};
+    static const cache_field_t pair[4]    = {FIELD_TARG, FIELD_EDGE, FIELD_KEEP, FIELD_EDGE};
+
+    const cache_field_t *l;
+    if (opid == CACHE_QMDD_GATE || opid == CACHE_QMDD_CGATE ||
+        opid == CACHE_QMDD_CGATE_RANGE ||
+        opid == CACHE_QMDD_GATE2)                         l = gate;
+    else if (opid == CACHE_QMDD_GATE2_PAIR ||
+             opid == CACHE_QMDD_CGATE_PAIR)               l = pair;
+    else if (opid == CACHE_QMDD_SUBCIRC)                  l = subcirc;
+    else if (opid == CACHE_QMDD_PROB)                     l = prob;
+    else if (opid == CACHE_EVBDD_PLUS)                    l = plus;
+    else if (opid == CACHE_EVBDD_MATVEC_MULT ||
+             opid == CACHE_EVBDD_MATMAT_MULT)             l = mult;
+    else if (opid == CACHE_EVBDD_REPLACE_TERMINAL)        l = repl;
+    else if (opid == CACHE_EVBDD_INC_VARS)                l = incv;
+    else if (opid == CACHE_EVBDD_IS_ORDERED)              l = order;
+    else return false; // unknown (or packed, like INPROD): drop
+    memcpy(layout, l, 4*sizeof(cache_field_t));
+    return true;
+}
+
+static bool
+remap_cache_field(uint64_t *x, cache_field_t field)
+{
+    EVBDD_TARG t;
+    EVBDD_WGT w;
+    switch (field) {
+    case FIELD_KEEP:
+        return true;
+    case FIELD_WGT:
+        if (!wgt_table_gc_remapped(*x, &w)) w = wgt_table_gc_keep(*x);
+        *x = w;
+        return true;
+    case FIELD_TARG:
+        return node_remap_get(*x, x);
+    case FIELD_EDGE:
+        if (!node_remap_get(EVBDD_TARGET(*x), &t)) return false;
+        w = EVBDD_WEIGHT(*x);
+        if (!remap_cache_field(&w, FIELD_WGT)) return false;
+        *x = evbdd_bundle(t, w);
+        return true;
+    }
+    return false;
+}
+
+static int
+remap_cache_entry(uint64_t *a, uint64_t *b, uint64_t *c, uint64_t *res, void *ctx)
+{
+    const uint64_t dd_mask = (1ULL<<40) - 1;
+    uint64_t opid = *a & ~dd_mask;
+    uint64_t dd   = *a & dd_mask;
+    cache_field_t layout[4];
+    if (!cache_field_layout(opid, layout)) return 0;
+
+    // (All) nodes have to be in use, and the weights of the entry are moved to
+    // the new table along with them.
+    for (int k = 0; k < 4; k++) {
+        if (layout[k] == FIELD_TARG || layout[k] == FIELD_EDGE) {
+            EVBDD_TARG t;
+            uint64_t x = (k == 0) ? dd : (k == 1) ? *b : (k == 2) ? *c : *res;
+            if (layout[k] == FIELD_EDGE) x = EVBDD_TARGET(x);
+            if (!node_remap_get(x, &t)) return 0;
+        }
+    }
+    if (!remap_cache_field(&dd, layout[0])) return 0;
+    if (!remap_cache_field(b, layout[1])) return 0;
+    if (!remap_cache_field(c, layout[2])) return 0;
+    if (!remap_cache_field(res, layout[3])) return 0;
+    *a = dd | opid;
+
+    // evbdd_plus orders its operands by index
+    if (opid == CACHE_EVBDD_PLUS && *b > *c) {
+        uint64_t tmp = *b;
+        *b = *c;
+        *c = tmp;
+    }
+    (void)ctx;
+    return 1;
+}
+
+static inline bool
+cache_field_marked(uint64_t x, cache_field_t field)
+{
+    if (field == FIELD_KEEP || field == FIELD_WGT) return true;
+    EVBDD_TARG t = (field == FIELD_EDGE) ? EVBDD_TARGET(x) : x;
+    return t == EVBDD_TERMINAL || llmsset_is_marked(nodes, t);
+}
+
+/**
+ * Whether the cache entry of an EVBDD or QMDD operation is still valid after
+ * gc of the nodes table, i.e. whether all its nodes are marked.
+ */
+static int
+keep_cache_entry(uint64_t a, uint64_t b, uint64_t c, uint64_t res)
+{
+    const uint64_t dd_mask = (1ULL<<40) - 1;
+    cache_field_t layout[4];
+    if (!cache_field_layout(a & ~dd_mask, layout)) return 0;
+    return cache_field_marked(a & dd_mask, layout[0]) &&
+           cache_field_marked(b, layout[1]) &&
+           cache_field_marked(c, layout[2]) &&
+           cache_field_marked(res, layout[3]);
+}
+
 void
 evbdd_gc_wgt_table()
 {
     // gc edge weight table and keep wgts of protected EVBDDs (and update those)
     // 1. Create new edge weight table table
     wgt_table_gc_init_new(init_wgt_table_entries);
+    node_remap_create();
 
     // 2. Fill new table with wgts in protected EVBDDs and update those EVBDDs
     uint64_t *it = protect_iter(&evbdd_protected, 0, evbdd_protected.refs_size);
@@ -362,32 +580,42 @@ evbdd_gc_wgt_table()
         }
     }
 
-    // 3. Delete old edge weight table
-    wgt_table_gc_delete_old();
+    // 3. The same edge weights (and therefore nodes) now have different 
+    //    indices. Rewrite the cache entries of which all nodes have been moved
+    //    (with the old -> new maps from step 2) and drop the others.
+    //    The results of weight operations are kept if all their weights are
+    //    still in use (after the above).
+    cache_remap(remap_cache_entry, NULL);
+    wgt_cache_remap();
+    node_remap_free();
 
-    // 4. Any cache we migh have is now invalid because the same edge weights 
-    //    might now have different indices in the edge weight table
-    sylvan_clear_cache();
+    // 4. Delete old edge weight table
+    wgt_table_gc_delete_old();
 }
 
 TASK_IMPL_1(EVBDD, _fill_new_wgt_table, EVBDD, a)
 {
-    // Check cache
+    // Move weight from old to new table, get new index
+    EVBDD_WGT new_wgt = wgt_table_gc_keep(EVBDD_WEIGHT(a));
+
+    // If terminal, return
+    if (EVBDD_TARGET(a) == EVBDD_TERMINAL) return evbdd_bundle(EVBDD_TERMINAL, new_wgt);
+
+    // The new node doesn't depend on the weight on the edge to it
+    EVBDD_TARG new_node;
+    if (node_remap_get(EVBDD_TARGET(a), &new_node)) {
+        return evbdd_bundle(new_node, new_wgt);
+    }
+
+    // Check cache (for nodes which don't fit in the node_remap)
     EVBDD res;
     bool cachenow = 1;
     if (cachenow) {
-        if (cache_get3(CACHE_EVBDD_CLEAN_WGT_TABLE, 0LL, a, 0LL, &res)) {
+        if (evbdd_cache_get3(CACHE_EVBDD_CLEAN_WGT_TABLE, 0LL, a, 0LL, &res)) {
             return res;
         }
     }
 
-    // Move weight from old to new table, get new index
-    EVBDD_WGT new_wgt = wgt_table_gc_keep(EVBDD_WEIGHT(a));
-    a = evbdd_bundle(EVBDD_TARGET(a), new_wgt);
-
-    // If terminal, return
-    if (EVBDD_TARGET(a) == EVBDD_TERMINAL) return a;
-    
     // Recursive for children
     EVBDD low, high;
     evbddnode_t n = EVBDD_GETNODE(EVBDD_TARGET(a));
@@ -403,16 +631,19 @@ TASK_IMPL_1(EVBDD, _fill_new_wgt_table, EVBDD, a)
     // but none of the actual values.
     EVBDD_TARG ptr = _evbdd_makenode(evbddnode_getvar(n), EVBDD_TARGET(low), EVBDD_TARGET(high), EVBDD_WEIGHT(low), EVBDD_WEIGHT(high));
 
-    // Put in cache, return
+    // Put in node_remap (or cache), return
     res = evbdd_bundle(ptr, new_wgt);
-    if (cachenow) cache_put3(CACHE_EVBDD_CLEAN_WGT_TABLE, 0LL, a, 0LL, res);
+    node_remap_put(EVBDD_TARGET(a), ptr);
+    if (cachenow && !node_remap_get(EVBDD_TARGET(a), &new_node)) {
+        evbdd_cache_put3(CACHE_EVBDD_CLEAN_WGT_TABLE, 0LL, a, 0LL, res);
+    }
     return res;
 }
 
 bool
 evbdd_test_gc_wgt_table()
 {
-    uint64_t entries = wgt_table_entries_estimate();
+    uint64_t entries = wgt_table_entries();
     uint64_t size    = sylvan_get_edge_weight_table_size();
     return ( ((double)entries / (double)size) > wgt_table_gc_thres );
 }
@@ -433,6 +664,8 @@ static int evbdd_initialized = 0;
 static void
 evbdd_quit()
 {
+    cache_set_gc_keep(CACHE_OPCLASS_EVBDD, NULL);
+    cache_set_gc_keep(CACHE_OPCLASS_QMDD, NULL);
     refs_free(&evbdd_refs);
     if (evbdd_protected_created) {
         protect_free(&evbdd_protected);
@@ -445,23 +678,35 @@ evbdd_quit()
 
 void
 sylvan_init_evbdd(size_t min_wgt_tablesize, size_t max_wgt_tablesize,
-                 double wgt_tab_tolerance, int edge_weigth_backend, 
-                 int norm_strat, void *init_wgt_tab_entries)
+                 double wgt_tab_tolerance, int edge_weight_type,
+                 int edge_weigth_backend, int norm_strat,
+                 void *init_wgt_tab_entries)
 {
     if (evbdd_initialized) return;
     evbdd_initialized = 1;
 
-    int index_size = (int) ceil(log2(max_wgt_tablesize));
-    if (index_size > 33) {
-        fprintf(stderr,"max edge weight storage size is 2^33\n");
+    // (the indices of the weights in the table come after the pinned ones)
+    int index_size = (int) ceil(log2(wgt_index_bound(max_wgt_tablesize)));
+    if (index_size > EVBDD_WGT_BITS) {
+        fprintf(stderr, "max edge weight storage size is 2^%d (including %d pinned weights)%s\n",
+                EVBDD_WGT_BITS, WGT_PINNED_SIZE,
+                (SYLVAN_EVBDD_LARGE_WGT_INDICES || SYLVAN_EVBDD_WIDE_EDGES) ? "" :
+                ", build with SYLVAN_EVBDD_LARGE_WGT_INDICES or SYLVAN_EVBDD_WIDE_EDGES for larger tables");
+        exit(1);
+    }
+    if (llmsset_get_max_size(nodes) > (1ULL << EVBDD_PTR_BITS)) {
+        fprintf(stderr, "max nodes table size is 2^%d%s\n", EVBDD_PTR_BITS,
+                SYLVAN_EVBDD_WIDE_EDGES ? ", build without SYLVAN_EVBDD_WIDE_EDGES for larger tables" :
+                SYLVAN_EVBDD_LARGE_WGT_INDICES ? ", build without SYLVAN_EVBDD_LARGE_WGT_INDICES for larger tables" : "");
         exit(1);
     }
-    if (index_size > 23) larger_wgt_indices = true;
-    else larger_wgt_indices = false;
 
     sylvan_register_quit(evbdd_quit);
     sylvan_gc_add_mark(TASK(evbdd_gc_mark_external_refs));
     sylvan_gc_add_mark(TASK(evbdd_gc_mark_protected));
+    sylvan_gc_hook_pregc(TASK(evbdd_gc_clear_node_remap));
+    cache_set_gc_keep(CACHE_OPCLASS_EVBDD, keep_cache_entry);
+    cache_set_gc_keep(CACHE_OPCLASS_QMDD, keep_cache_entry);
 
     refs_create(&evbdd_refs, 1024);
     if (!evbdd_protected_created) {
@@ -469,15 +714,24 @@ sylvan_init_evbdd(size_t min_wgt_tablesize, size_t max_wgt_tablesize,
         evbdd_protected_created = 1;
     }
 
-    // TODO: pass edge weight type to sylvan_init_evbdd
+    // The magnitude of an exact edge weight is generally not exact
+    if (edge_weight_type == WGT_RATIONAL_128 && (norm_strat == NORM_MIN || norm_strat == NORM_L2)) {
+        fprintf(stderr, "Exact edge weights only support NORM_LOW and NORM_MAX normalization\n");
+        exit(1);
+    }
+
     if (min_wgt_tablesize > max_wgt_tablesize) min_wgt_tablesize = max_wgt_tablesize;
     sylvan_init_edge_weights(min_wgt_tablesize, max_wgt_tablesize, 
-                             wgt_tab_tolerance, WGT_COMPLEX_128, 
+                             wgt_tab_tolerance, edge_weight_type, 
                              edge_weigth_backend);
     
+    // The weights of the initial entries (e.g. the static gates) are pinned,
+    // so that they keep their index across edge weight gc
     init_wgt_table_entries = init_wgt_tab_entries;
     if (init_wgt_table_entries != NULL) {
+        wgt_set_pinning(true);
         init_wgt_table_entries();
+        wgt_set_pinning(false);
     }
 
     weight_norm_strat = norm_strat;
@@ -507,17 +761,177 @@ sylvan_init_evbdd(size_t min_wgt_tablesize, size_t max_wgt_tablesize,
 void
 sylvan_init_evbdd_defaults(size_t min_wgt_tablesize, size_t max_wgt_tablesize)
 {
-    sylvan_init_evbdd(min_wgt_tablesize, max_wgt_tablesize, -1, COMP_HASHMAP, NORM_LOW, NULL);
+    sylvan_init_evbdd(min_wgt_tablesize, max_wgt_tablesize, -1, WGT_COMPLEX_128, COMP_HASHMAP, NORM_LOW, NULL);
 }
 
 
+/*****************************</Initialization>********************************/
+
+
+
+
+
+/**************************<Caching granularity>*******************************/
+
+uint8_t evbdd_cache_skip[EVBDD_CACHE_N_OPS][EVBDD_CACHE_LEVELS]; // (all 0: cache at every level)
+bool evbdd_cache_tuning = EVBDD_CACHE_AUTOTUNE;
+__thread uint64_t evbdd_cache_calls = 0;
+
+static int op_granularity[EVBDD_CACHE_N_OPS] = {1, 1, 1, 1, 1, 1};
+static const char *cache_op_names[EVBDD_CACHE_N_OPS] = {
+    "gate", "cgate", "plus", "matvec", "matmat", "inprod"
+};
+
+/**
+ * A level is cached iff a lookup saves at least EVBDD_CACHE_TUNE_MIN_GAIN
+ * calls on average, i.e. iff the hit rate times the work of recomputing a
+ * result (including the call itself) is at least EVBDD_CACHE_TUNE_MIN_GAIN.
+ * The tuner only decides on levels with at least EVBDD_CACHE_TUNE_MIN_LOOKUPS
+ * sampled lookups, and afterwards halves their counters, so that later
+ * samples weigh more.
+ */
+#define EVBDD_CACHE_TUNE_WINDOW         4096
+#define EVBDD_CACHE_TUNE_MIN_LOOKUPS    32
+#define EVBDD_CACHE_TUNE_MIN_GAIN       1.0
+
+typedef struct cache_tune_counters {
+    _Atomic(uint64_t) lookups;
+    _Atomic(uint64_t) hits;
+    _Atomic(uint64_t) work; // recursive calls to recompute the misses
+} cache_tune_counters_t;
+
+static cache_tune_counters_t cache_tune[EVBDD_CACHE_N_OPS][EVBDD_CACHE_LEVELS];
+static _Atomic(uint64_t) cache_tune_samples = 0; // since the last decision
+
+static void
+check_cache_op(evbdd_cache_op_t op, const char *caller)
+{
+    if ((int)op < 0 || op >= EVBDD_CACHE_N_OPS) {
+        fprintf(stderr, "%s: invalid operation %d\n", caller, (int)op);
+        exit(1);
+    }
+}
+
 void
 evbdd_set_caching_granularity(int g)
 {
     granularity = g;
+    for (int op = 0; op < EVBDD_CACHE_N_OPS; op++) {
+        evbdd_set_op_caching_granularity((evbdd_cache_op_t)op, g);
+    }
 }
 
-/*****************************</Initialization>********************************/
+void
+evbdd_set_op_caching_granularity(evbdd_cache_op_t op, int g)
+{
+    check_cache_op(op, "evbdd_set_op_caching_granularity");
+    if (g < 1) {
+        fprintf(stderr, "evbdd_set_op_caching_granularity: granularity must be at least 1\n");
+        exit(1);
+    }
+    op_granularity[op] = g;
+    for (BDDVAR k = 0; k < EVBDD_CACHE_LEVELS; k++) {
+        evbdd_cache_skip[op][k] = ((k % g) != 0);
+    }
+}
+
+int
+evbdd_get_op_caching_granularity(evbdd_cache_op_t op)
+{
+    check_cache_op(op, "evbdd_get_op_caching_granularity");
+    return op_granularity[op];
+}
+
+void
+evbdd_set_caching_levels(evbdd_cache_op_t op, const char *levels)
+{
+    check_cache_op(op, "evbdd_set_caching_levels");
+    const size_t n = strlen(levels);
+    if (strspn(levels, "01") != n) {
+        fprintf(stderr, "evbdd_set_caching_levels: levels must be '0's and '1's\n");
+        exit(1);
+    }
+    for (BDDVAR k = 0; k < EVBDD_CACHE_LEVELS; k++) {
+        if (k < n) evbdd_cache_skip[op][k] = (levels[k] == '0');
+        else evbdd_cache_skip[op][k] = ((k % op_granularity[op]) != 0);
+    }
+}
+
+void
+evbdd_get_caching_levels(evbdd_cache_op_t op, char *levels, BDDVAR nlevels)
+{
+    check_cache_op(op, "evbdd_get_caching_levels");
+    for (BDDVAR k = 0; k < nlevels; k++) {
+        levels[k] = (k < EVBDD_CACHE_LEVELS && evbdd_cache_skip[op][k]) ? '0' : '1';
+    }
+    levels[nlevels] = '\0';
+}
+
+const char *
+evbdd_cache_op_name(evbdd_cache_op_t op)
+{
+    if ((int)op < 0 || op >= EVBDD_CACHE_N_OPS) return NULL;
+    return cache_op_names[op];
+}
+
+void
+evbdd_set_caching_autotune(bool enabled)
+{
+    evbdd_cache_tuning = enabled;
+    memset(cache_tune, 0, sizeof(cache_tune));
+    atomic_store(&cache_tune_samples, 0);
+}
+
+bool
+evbdd_get_caching_autotune()
+{
+    return evbdd_cache_tuning;
+}
+
+void
+evbdd_cache_tune_record(evbdd_cache_op_t op, BDDVAR level, bool hit, uint64_t work)
+{
+    cache_tune_counters_t *c = &cache_tune[op][level];
+    atomic_fetch_add_explicit(&c->lookups, 1, memory_order_relaxed);
+    if (hit) atomic_fetch_add_explicit(&c->hits, 1, memory_order_relaxed);
+    else atomic_fetch_add_explicit(&c->work, work, memory_order_relaxed);
+    atomic_fetch_add_explicit(&cache_tune_samples, 1, memory_order_relaxed);
+}
+
+void
+evbdd_caching_autotune()
+{
+    if (!evbdd_cache_tuning) return;
+    if (atomic_load_explicit(&cache_tune_samples, memory_order_relaxed) < EVBDD_CACHE_TUNE_WINDOW) return;
+    atomic_store(&cache_tune_samples, 0);
+
+    for (int op = 0; op < EVBDD_CACHE_N_OPS; op++) {
+        for (BDDVAR k = 0; k < EVBDD_CACHE_LEVELS; k++) {
+            cache_tune_counters_t *c = &cache_tune[op][k];
+            const uint64_t lookups = atomic_load_explicit(&c->lookups, memory_order_relaxed);
+            if (lookups < EVBDD_CACHE_TUNE_MIN_LOOKUPS) continue;
+            const uint64_t hits = atomic_load_explicit(&c->hits, memory_order_relaxed);
+            const uint64_t work = atomic_load_explicit(&c->work, memory_order_relaxed);
+
+            // (if all lookups hit there is no measure of the work, but caching
+            // is clearly worth it)
+            bool cache = true;
+            if (hits < lookups) {
+                const double saved = (double)hits / lookups * (1.0 + (double)work / (lookups - hits));
+                cache = (saved >= EVBDD_CACHE_TUNE_MIN_GAIN);
+            }
+            if (cache && evbdd_cache_skip[op][k]) sylvan_stats_count(EVBDD_CACHE_TUNE_ON);
+            if (!cache && !evbdd_cache_skip[op][k]) sylvan_stats_count(EVBDD_CACHE_TUNE_OFF);
+            evbdd_cache_skip[op][k] = !cache;
+
+            atomic_store_explicit(&c->lookups, lookups / 2, memory_order_relaxed);
+            atomic_store_explicit(&c->hits, hits / 2, memory_order_relaxed);
+            atomic_store_explicit(&c->work, work / 2, memory_order_relaxed);
+        }
+    }
+}
+
+/*************************</Caching granularity>*******************************/
 
 
 
@@ -559,6 +973,12 @@ evbdd_do_before_mult(EVBDD *a, EVBDD *b)
         evbdd_unprotect(a);
         evbdd_unprotect(b);
     }
+
+    // grow the operation cache if it is too small
+    sylvan_cache_adapt();
+
+    // adjust the levels at which results are cached
+    evbdd_caching_autotune();
 }
 
 static void
@@ -608,24 +1028,25 @@ TASK_IMPL_2(EVBDD, evbdd_plus, EVBDD, a, EVBDD, b)
     // Check cache
     EVBDD x, y;
     norm_commuting_cache_key(a, b, &x, &y); // (a+b) = (b+a) so normalize cache key
-    bool cachenow = ((topvar % granularity) == 0);
+    uint64_t sample;
+    bool cachenow = evbdd_cachenow(EVBDD_CACHE_OP_PLUS, topvar, x ^ (y << 1), &sample);
     if (cachenow) {
-        if (cache_get3(CACHE_EVBDD_PLUS, sylvan_false, x, y, &res)) {
+        if (evbdd_cache_get3(CACHE_EVBDD_PLUS, sylvan_false, x, y, &res)) {
             sylvan_stats_count(EVBDD_PLUS_CACHED);
+            evbdd_cache_sample_hit(EVBDD_CACHE_OP_PLUS, topvar, sample);
             return res;
         }
     }
 
     // If not base/terminal case, pass edge weight of current edge down
-    EVBDD_WGT wgt_la, wgt_ha, wgt_lb, wgt_hb;
-    wgt_la = wgt_mul(EVBDD_WEIGHT(a), EVBDD_WEIGHT(low_a));
-    wgt_ha = wgt_mul(EVBDD_WEIGHT(a), EVBDD_WEIGHT(high_a));
-    wgt_lb = wgt_mul(EVBDD_WEIGHT(b), EVBDD_WEIGHT(low_b));
-    wgt_hb = wgt_mul(EVBDD_WEIGHT(b), EVBDD_WEIGHT(high_b));
-    low_a  = evbdd_refs_push(evbdd_bundle(EVBDD_TARGET(low_a),  wgt_la));
-    high_a = evbdd_refs_push(evbdd_bundle(EVBDD_TARGET(high_a), wgt_ha));
-    low_b  = evbdd_refs_push(evbdd_bundle(EVBDD_TARGET(low_b),  wgt_lb));
-    high_b = evbdd_refs_push(evbdd_bundle(EVBDD_TARGET(high_b), wgt_hb));
+    EVBDD_WGT w_in[4] = {EVBDD_WEIGHT(a), EVBDD_WEIGHT(a), EVBDD_WEIGHT(b), EVBDD_WEIGHT(b)};
+    EVBDD_WGT w_child[4] = {EVBDD_WEIGHT(low_a), EVBDD_WEIGHT(high_a), EVBDD_WEIGHT(low_b), EVBDD_WEIGHT(high_b)};
+    EVBDD_WGT w[4]; // la, ha, lb, hb
+    wgt_mul4(w_in, w_child, w);
+    low_a  = evbdd_refs_push(evbdd_bundle(EVBDD_TARGET(low_a),  w[0]));
+    high_a = evbdd_refs_push(evbdd_bundle(EVBDD_TARGET(high_a), w[1]));
+    low_b  = evbdd_refs_push(evbdd_bundle(EVBDD_TARGET(low_b),  w[2]));
+    high_b = evbdd_refs_push(evbdd_bundle(EVBDD_TARGET(high_b), w[3]));
 
     // Recursive calls down
     evbdd_refs_spawn(SPAWN(evbdd_plus, high_a, high_b));
@@ -636,9 +1057,10 @@ TASK_IMPL_2(EVBDD, evbdd_plus, EVBDD, a, EVBDD, b)
     // Put in cache, return
     res = evbdd_makenode(topvar, low, high);
     if (cachenow) {
-        if (cache_put3(CACHE_EVBDD_PLUS, sylvan_false, x, y, res)) 
+        if (evbdd_cache_put3(CACHE_EVBDD_PLUS, sylvan_false, x, y, res)) 
             sylvan_stats_count(EVBDD_PLUS_CACHEDPUT);
     }
+    evbdd_cache_sample_miss(EVBDD_CACHE_OP_PLUS, topvar, sample);
     return res;
 }
 
@@ -682,10 +1104,12 @@ TASK_IMPL_4(EVBDD, evbdd_matvec_mult_rec, EVBDD, mat, EVBDD, vec, BDDVAR, nvars,
 
     // Check cache
     EVBDD res;
-    bool cachenow = ((nextvar % granularity) == 0);
+    uint64_t sample;
+    bool cachenow = evbdd_cachenow(EVBDD_CACHE_OP_MATVEC, nextvar, EVBDD_TARGET(mat) ^ (EVBDD_TARGET(vec) << 24), &sample);
     if (cachenow) {
-        if (cache_get3(CACHE_EVBDD_MATVEC_MULT, nextvar, EVBDD_TARGET(mat), EVBDD_TARGET(vec), &res)) {
+        if (evbdd_cache_get3(CACHE_EVBDD_MATVEC_MULT, nextvar, EVBDD_TARGET(mat), EVBDD_TARGET(vec), &res)) {
             sylvan_stats_count(EVBDD_MULT_CACHED);
+            evbdd_cache_sample_hit(EVBDD_CACHE_OP_MATVEC, nextvar, sample);
             // 6. multiply w/ product of root weights
             EVBDD_WGT prod = wgt_mul(EVBDD_WEIGHT(mat), EVBDD_WEIGHT(vec));
             EVBDD_WGT new_weight = wgt_mul(prod, EVBDD_WEIGHT(res));
@@ -704,10 +1128,14 @@ TASK_IMPL_4(EVBDD, evbdd_matvec_mult_rec, EVBDD, mat, EVBDD, vec, BDDVAR, nvars,
     evbdd_get_topvar(mat_high,2*nextvar+1, &var, &u01, &u11);
 
     // 2. propagate "in-between" weights of matrix EVBDD
-    u00 = evbdd_bundle(EVBDD_TARGET(u00), wgt_mul(EVBDD_WEIGHT(u00), EVBDD_WEIGHT(mat_low)));
-    u10 = evbdd_bundle(EVBDD_TARGET(u10), wgt_mul(EVBDD_WEIGHT(u10), EVBDD_WEIGHT(mat_low)));
-    u01 = evbdd_bundle(EVBDD_TARGET(u01), wgt_mul(EVBDD_WEIGHT(u01), EVBDD_WEIGHT(mat_high)));
-    u11 = evbdd_bundle(EVBDD_TARGET(u11), wgt_mul(EVBDD_WEIGHT(u11), EVBDD_WEIGHT(mat_high)));
+    EVBDD_WGT w_u[4] = {EVBDD_WEIGHT(u00), EVBDD_WEIGHT(u10), EVBDD_WEIGHT(u01), EVBDD_WEIGHT(u11)};
+    EVBDD_WGT w_mat[4] = {EVBDD_WEIGHT(mat_low), EVBDD_WEIGHT(mat_low), EVBDD_WEIGHT(mat_high), EVBDD_WEIGHT(mat_high)};
+    EVBDD_WGT w[4];
+    wgt_mul4(w_u, w_mat, w);
+    u00 = evbdd_bundle(EVBDD_TARGET(u00), w[0]);
+    u10 = evbdd_bundle(EVBDD_TARGET(u10), w[1]);
+    u01 = evbdd_bundle(EVBDD_TARGET(u01), w[2]);
+    u11 = evbdd_bundle(EVBDD_TARGET(u11), w[3]);
 
     // 3. recursive calls (4 tasks: SPAWN 3, CALL 1)
     // |u00 u01| |vec_low | = vec_low|u00| + vec_high|u01|
@@ -731,9 +1159,10 @@ TASK_IMPL_4(EVBDD, evbdd_matvec_mult_rec, EVBDD, mat, EVBDD, vec, BDDVAR, nvars,
 
     // Insert in cache (before multiplication w/ root weights)
     if (cachenow) {
-        if (cache_put3(CACHE_EVBDD_MATVEC_MULT, nextvar, EVBDD_TARGET(mat), EVBDD_TARGET(vec), res)) 
+        if (evbdd_cache_put3(CACHE_EVBDD_MATVEC_MULT, nextvar, EVBDD_TARGET(mat), EVBDD_TARGET(vec), res)) 
             sylvan_stats_count(EVBDD_MULT_CACHEDPUT);
     }
+    evbdd_cache_sample_miss(EVBDD_CACHE_OP_MATVEC, nextvar, sample);
 
     // 5. multiply w/ product of root weights
     EVBDD_WGT prod = wgt_mul(EVBDD_WEIGHT(mat), EVBDD_WEIGHT(vec));
@@ -761,10 +1190,12 @@ TASK_IMPL_4(EVBDD, evbdd_matmat_mult_rec, EVBDD, a, EVBDD, b, BDDVAR, nvars, BDD
 
     // Check cache
     EVBDD res;
-    bool cachenow = ((nextvar % granularity) == 0);
+    uint64_t sample;
+    bool cachenow = evbdd_cachenow(EVBDD_CACHE_OP_MATMAT, nextvar, EVBDD_TARGET(a) ^ (EVBDD_TARGET(b) << 24), &sample);
     if (cachenow) {
-        if (cache_get3(CACHE_EVBDD_MATMAT_MULT, nextvar, EVBDD_TARGET(a), EVBDD_TARGET(b), &res)) {
+        if (evbdd_cache_get3(CACHE_EVBDD_MATMAT_MULT, nextvar, EVBDD_TARGET(a), EVBDD_TARGET(b), &res)) {
             sylvan_stats_count(EVBDD_MULT_CACHED);
+            evbdd_cache_sample_hit(EVBDD_CACHE_OP_MATMAT, nextvar, sample);
             // 7. multiply w/ product of root weights
             EVBDD_WGT prod = wgt_mul(EVBDD_WEIGHT(a), EVBDD_WEIGHT(b));
             EVBDD_WGT new_weight = wgt_mul(prod, EVBDD_WEIGHT(res));
@@ -785,14 +1216,21 @@ TASK_IMPL_4(EVBDD, evbdd_matmat_mult_rec, EVBDD, a, EVBDD, b, BDDVAR, nvars, BDD
     evbdd_get_topvar(b_high,2*nextvar+1, &var, &b01, &b11);
 
     // 2. propagate "in-between" weights down
-    a00 = evbdd_bundle(EVBDD_TARGET(a00), wgt_mul(EVBDD_WEIGHT(a_low), EVBDD_WEIGHT(a00)));
-    a10 = evbdd_bundle(EVBDD_TARGET(a10), wgt_mul(EVBDD_WEIGHT(a_low), EVBDD_WEIGHT(a10)));
-    a01 = evbdd_bundle(EVBDD_TARGET(a01), wgt_mul(EVBDD_WEIGHT(a_high),EVBDD_WEIGHT(a01)));
-    a11 = evbdd_bundle(EVBDD_TARGET(a11), wgt_mul(EVBDD_WEIGHT(a_high),EVBDD_WEIGHT(a11)));
-    b00 = evbdd_bundle(EVBDD_TARGET(b00), wgt_mul(EVBDD_WEIGHT(b_low), EVBDD_WEIGHT(b00)));
-    b10 = evbdd_bundle(EVBDD_TARGET(b10), wgt_mul(EVBDD_WEIGHT(b_low), EVBDD_WEIGHT(b10)));
-    b01 = evbdd_bundle(EVBDD_TARGET(b01), wgt_mul(EVBDD_WEIGHT(b_high),EVBDD_WEIGHT(b01)));
-    b11 = evbdd_bundle(EVBDD_TARGET(b11), wgt_mul(EVBDD_WEIGHT(b_high),EVBDD_WEIGHT(b11)));
+    EVBDD_WGT w_a_in[4]  = {EVBDD_WEIGHT(a_low), EVBDD_WEIGHT(a_low), EVBDD_WEIGHT(a_high), EVBDD_WEIGHT(a_high)};
+    EVBDD_WGT w_a_out[4] = {EVBDD_WEIGHT(a00), EVBDD_WEIGHT(a10), EVBDD_WEIGHT(a01), EVBDD_WEIGHT(a11)};
+    EVBDD_WGT w_b_in[4]  = {EVBDD_WEIGHT(b_low), EVBDD_WEIGHT(b_low), EVBDD_WEIGHT(b_high), EVBDD_WEIGHT(b_high)};
+    EVBDD_WGT w_b_out[4] = {EVBDD_WEIGHT(b00), EVBDD_WEIGHT(b10), EVBDD_WEIGHT(b01), EVBDD_WEIGHT(b11)};
+    EVBDD_WGT wa[4], wb[4];
+    wgt_mul4(w_a_in, w_a_out, wa);
+    wgt_mul4(w_b_in, w_b_out, wb);
+    a00 = evbdd_bundle(EVBDD_TARGET(a00), wa[0]);
+    a10 = evbdd_bundle(EVBDD_TARGET(a10), wa[1]);
+    a01 = evbdd_bundle(EVBDD_TARGET(a01), wa[2]);
+    a11 = evbdd_bundle(EVBDD_TARGET(a11), wa[3]);
+    b00 = evbdd_bundle(EVBDD_TARGET(b00), wb[0]);
+    b10 = evbdd_bundle(EVBDD_TARGET(b10), wb[1]);
+    b01 = evbdd_bundle(EVBDD_TARGET(b01), wb[2]);
+    b11 = evbdd_bundle(EVBDD_TARGET(b11), wb[3]);
 
     // 3. recursive calls (8 tasks: SPAWN 7, CALL 1)
     // |a00 a01| |b00 b01| = b00|a00| + b10|a01| , b01|a00| + b11|a01|
@@ -835,9 +1273,10 @@ TASK_IMPL_4(EVBDD, evbdd_matmat_mult_rec, EVBDD, a, EVBDD, b, BDDVAR, nvars, BDD
 
     // Insert in cache
     if (cachenow) {
-        if (cache_put3(CACHE_EVBDD_MATMAT_MULT, nextvar, EVBDD_TARGET(a), EVBDD_TARGET(b), res)) 
+        if (evbdd_cache_put3(CACHE_EVBDD_MATMAT_MULT, nextvar, EVBDD_TARGET(a), EVBDD_TARGET(b), res)) 
             sylvan_stats_count(EVBDD_MULT_CACHEDPUT);
     }
+    evbdd_cache_sample_miss(EVBDD_CACHE_OP_MATMAT, nextvar, sample);
 
     // 6. multiply w/ product of root weights
     EVBDD_WGT prod = wgt_mul(EVBDD_WEIGHT(a), EVBDD_WEIGHT(b));
@@ -871,9 +1310,11 @@ TASK_IMPL_4(EVBDD_WGT, evbdd_inner_product, EVBDD, a, EVBDD, b, BDDVAR, nvars, B
     // Check cache
     // TODO: norm cache key? (<a|b> = <b|a>^\dagger)
     EVBDD_WGT res;
-    bool cachenow = ((topvar % granularity) == 0);
+    uint64_t sample;
+    bool cachenow = evbdd_cachenow(EVBDD_CACHE_OP_INPROD, topvar, EVBDD_TARGET(a) ^ (EVBDD_TARGET(b) << 24), &sample);
     if (cachenow) {
         if (cache_get4(CACHE_EVBDD_INPROD, EVBDD_TARGET(a), EVBDD_TARGET(b), nextvar, nvars, &res)) {
+            evbdd_cache_sample_hit(EVBDD_CACHE_OP_INPROD, topvar, sample);
             res = wgt_mul(res, EVBDD_WEIGHT(a));
             res = wgt_mul(res, wgt_conj(EVBDD_WEIGHT(b)));
             return res;
@@ -892,6 +1333,7 @@ TASK_IMPL_4(EVBDD_WGT, evbdd_inner_product, EVBDD, a, EVBDD, b, BDDVAR, nvars, B
     if (cachenow) {
         cache_put4(CACHE_EVBDD_INPROD, EVBDD_TARGET(a), EVBDD_TARGET(b), nextvar, nvars, res);
     }
+    evbdd_cache_sample_miss(EVBDD_CACHE_OP_INPROD, topvar, sample);
 
     // Multiply result with product of weights of a and (conjugate of) b
     // (Note that we can compute the complex conjugate of |b> by taking the 
@@ -909,10 +1351,11 @@ evbdd_increase_all_vars(EVBDD a, int k)
         return a;
     }
 
-    // Check cache
+    // Check cache (only the target of the result is cached)
     EVBDD res;
-    if (cache_get3(CACHE_EVBDD_INC_VARS, EVBDD_TARGET(a), k, 0, &res)) {
-        return evbdd_bundle(res, EVBDD_WEIGHT(a));
+    EVBDD_TARG res_ptr;
+    if (cache_get3(CACHE_EVBDD_INC_VARS, EVBDD_TARGET(a), k, 0, &res_ptr)) {
+        return evbdd_bundle(res_ptr, EVBDD_WEIGHT(a));
     }
 
     // Get node info
@@ -942,10 +1385,11 @@ evbdd_replace_terminal(EVBDD a, EVBDD_TARG b)
         return evbdd_bundle(b, EVBDD_WEIGHT(a));
     }
 
-    // Check cache
+    // Check cache (only the target of the result is cached)
     EVBDD res;
-    if (cache_get3(CACHE_EVBDD_REPLACE_TERMINAL, EVBDD_TARGET(a), b, 0, &res)) {
-        return evbdd_bundle(res, EVBDD_WEIGHT(a));
+    EVBDD_TARG res_ptr;
+    if (cache_get3(CACHE_EVBDD_REPLACE_TERMINAL, EVBDD_TARGET(a), b, 0, &res_ptr)) {
+        return evbdd_bundle(res_ptr, EVBDD_WEIGHT(a));
     }
 
     // Get node info
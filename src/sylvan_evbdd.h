@@ -9,12 +9,16 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#if SYLVAN_EVBDD_WIDE_EDGES
+typedef unsigned __int128 EVBDD; // see sylvan_evbdd_int.h for the layouts
+#else
 typedef uint64_t EVBDD;
+#endif
 typedef uint64_t EVBDD_WGT;  // Edge weight
 typedef uint64_t EVBDD_TARG; // Edge target
 
 static const EVBDD_TARG  EVBDD_TERMINAL = 1;
-static const BDDVAR     EVBDD_INVALID_VAR = UINT8_MAX;
+static const BDDVAR     EVBDD_INVALID_VAR = UINT16_MAX;
 
 typedef enum weight_norm_strategy {
     NORM_LOW,
@@ -116,14 +120,79 @@ TASK_DECL_1(EVBDD, _fill_new_wgt_table, EVBDD);
  * NOTE: this function doesn't currently check if the combination of table
  * sizes (edge weight table + node table) works in combination with using 
  * a real-table or complex-table.
+ * - edge_weight_type is one of the edge_weight_type_t's (WGT_COMPLEX_128,
+ *   WGT_DOUBLE or WGT_RATIONAL_128). WGT_RATIONAL_128 (exact) edge weights 
+ *   only support NORM_LOW and NORM_MAX, and backend COMP_HASHMAP.
  * - init_wgt_tab_entries() is a pointer to a function which is called after gc 
  *   of edge table. This can be used to reinitialize edge weight table values 
  *   outside of any EVBDD. Can be NULL.
  */
-void sylvan_init_evbdd(size_t min_wgt_tablesize, size_t max_wgt_tablesize, double wgt_tab_tolerance, int edge_weigth_backend, int norm_strat, void *init_wgt_tab_entries);
+void sylvan_init_evbdd(size_t min_wgt_tablesize, size_t max_wgt_tablesize, double wgt_tab_tolerance, int edge_weight_type, int edge_weigth_backend, int norm_strat, void *init_wgt_tab_entries);
 void sylvan_init_evbdd_defaults(size_t min_wgt_tablesize, size_t max_wgt_tablesize);
+
+/**
+ * The operations of which the results are only put in the operation cache at
+ * some levels (variables) of the DD. For the matrix multiplications and the
+ * inner product the level is the qubit, for the others it is the variable.
+ */
+typedef enum evbdd_cache_op {
+    EVBDD_CACHE_OP_GATE,    // qmdd_gate, qmdd_gate2
+    EVBDD_CACHE_OP_CGATE,   // qmdd_cgate, qmdd_cgate_range
+    EVBDD_CACHE_OP_PLUS,    // evbdd_plus
+    EVBDD_CACHE_OP_MATVEC,  // evbdd_matvec_mult
+    EVBDD_CACHE_OP_MATMAT,  // evbdd_matmat_mult
+    EVBDD_CACHE_OP_INPROD,  // evbdd_inner_product
+    EVBDD_CACHE_N_OPS
+} evbdd_cache_op_t;
+
+/**
+ * Only cache the results of (all operations) at levels which are a multiple
+ * of 'granularity' (default 1, i.e. at every level).
+ */
 void evbdd_set_caching_granularity(int granularity);
 
+/**
+ * Only cache the results of 'op' at levels which are a multiple of
+ * 'granularity'. This replaces the levels set with evbdd_set_caching_levels()
+ * or chosen by the auto-tuner.
+ */
+void evbdd_set_op_caching_granularity(evbdd_cache_op_t op, int granularity);
+int evbdd_get_op_caching_granularity(evbdd_cache_op_t op);
+
+/**
+ * Sets the levels at which the results of 'op' are cached from a string of
+ * '0's and '1's, of which character k is level k (e.g. as reported by
+ * evbdd_get_caching_levels()). Levels past the end of the string follow the
+ * granularity of 'op'. Levels from 256 on are always cached.
+ */
+void evbdd_set_caching_levels(evbdd_cache_op_t op, const char *levels);
+
+/**
+ * Writes the levels 0, ..., nlevels-1 at which the results of 'op' are cached
+ * to 'levels' as a '\0' terminated string of '0's and '1's ('levels' needs room
+ * for nlevels+1 characters).
+ */
+void evbdd_get_caching_levels(evbdd_cache_op_t op, char *levels, BDDVAR nlevels);
+
+/**
+ * Name of 'op' (e.g. "gate"), or NULL if 'op' is not an operation.
+ */
+const char *evbdd_cache_op_name(evbdd_cache_op_t op);
+
+/**
+ * Enables or disables (default, see EVBDD_CACHE_AUTOTUNE) tuning of the levels
+ * at which the results of each operation are cached. The tuner samples a
+ * fraction of the cache lookups of every operation at every level (also at
+ * levels which are not cached), and measures their hit rate and the amount of
+ * work (recursive calls) to recompute a missed result. Every
+ * EVBDD_CACHE_TUNE_WINDOW sampled lookups, evbdd_caching_autotune() (called
+ * before every QMDD gate and EVBDD multiplication) caches a level iff a lookup
+ * saves at least EVBDD_CACHE_TUNE_MIN_GAIN recursive calls on average.
+ */
+void evbdd_set_caching_autotune(bool enabled);
+bool evbdd_get_caching_autotune();
+void evbdd_caching_autotune();
+
 /*****************************</Initialization>********************************/
 
 
@@ -15,16 +15,82 @@
  * sylvan_init_evbdd().
  * TODO: Maybe handle this in a cleaner way than with global variables?
  */
-// using [wgts,ptr] [33,30] bits if set to true (default [23,40])
-extern bool larger_wgt_indices;
 extern int weight_norm_strat;
 extern EVBDD_WGT (*normalize_weights)(EVBDD_WGT *, EVBDD_WGT *);
 
 
+/**************************<Caching granularity>*******************************/
+
+/**
+ * Whether the result of an operation is cached at a level is looked up in
+ * evbdd_cache_skip (0 = cache), which has an entry for each of the first
+ * EVBDD_CACHE_LEVELS variables (below those results are always cached). When tuning is enabled, the lookups of which some bits of the
+ * hash of the key are 0 (1 in EVBDD_CACHE_TUNE_SAMPLE_RATE) are sampled. These
+ * are cached at every level, so that the tuner also sees the hit rate of
+ * levels which are currently not cached. Every operation with a cache lookup
+ * counts as one call in evbdd_cache_calls (of the worker), and the number of
+ * calls between a sampled miss and the put of its result is the work to
+ * recompute it. (Calls in subtasks which are stolen by other workers are not
+ * counted.)
+ */
+#define EVBDD_CACHE_LEVELS 256
+#define EVBDD_CACHE_TUNE_SAMPLE_RATE 64
+#define EVBDD_CACHE_NO_SAMPLE UINT64_MAX
+
+extern uint8_t evbdd_cache_skip[EVBDD_CACHE_N_OPS][EVBDD_CACHE_LEVELS];
+extern bool evbdd_cache_tuning;
+extern __thread uint64_t evbdd_cache_calls;
+
+void evbdd_cache_tune_record(evbdd_cache_op_t op, BDDVAR level, bool hit, uint64_t work);
+
+/**
+ * Returns whether to look up (and put) the result of 'op' at 'level' in the
+ * operation cache, where 'key' is (part of) the cache key. Sets 'sample' to
+ * pass to evbdd_cache_sample_hit/miss.
+ */
+static inline bool
+evbdd_cachenow(evbdd_cache_op_t op, BDDVAR level, uint64_t key, uint64_t *sample)
+{
+    *sample = EVBDD_CACHE_NO_SAMPLE;
+    if (level >= EVBDD_CACHE_LEVELS) return true;
+    if (evbdd_cache_tuning) {
+        evbdd_cache_calls++;
+        const uint64_t h = (key ^ ((uint64_t)op << 56)) * 0x9e3779b97f4a7c15ULL;
+        if (((h >> 40) & (EVBDD_CACHE_TUNE_SAMPLE_RATE - 1)) == 0) {
+            *sample = evbdd_cache_calls;
+            return true;
+        }
+    }
+    return !evbdd_cache_skip[op][level];
+}
+
+static inline void
+evbdd_cache_sample_hit(evbdd_cache_op_t op, BDDVAR level, uint64_t sample)
+{
+    if (sample != EVBDD_CACHE_NO_SAMPLE) evbdd_cache_tune_record(op, level, true, 0);
+}
+
+static inline void
+evbdd_cache_sample_miss(evbdd_cache_op_t op, BDDVAR level, uint64_t sample)
+{
+    if (sample != EVBDD_CACHE_NO_SAMPLE) {
+        evbdd_cache_tune_record(op, level, false, evbdd_cache_calls - sample);
+    }
+}
+
+/*************************</Caching granularity>*******************************/
+
+
 /*****************<Bit level manipulation of EVBDD / evbddnode_t>****************/
 
 /**
- * When edge weight table <= 2^23 (larger_wgt_indices = false)
+ * The number of bits of the edge weight index and of the node index in an edge
+ * is fixed at compile time by SYLVAN_EVBDD_LARGE_WGT_INDICES and
+ * SYLVAN_EVBDD_WIDE_EDGES (see sylvan_config.h), so that the layout does not
+ * have to be checked on every access to an edge or a node.
+ *
+ * SYLVAN_EVBDD_LARGE_WGT_INDICES = 0: [wgt,ptr] = [23,40] bits
+ * (edge weight table (with the pinned weights) <= 2^23, nodes table <= 2^40)
  * -----------------------------------------------------------------------------
  * EVBDD edge structure (64 bits)
  *       1 bit:  unused
@@ -37,10 +103,10 @@ extern EVBDD_WGT (*normalize_weights)(EVBDD_WGT *, EVBDD_WGT *);
  * 
  * 64 bits low:
  *       1 bit:  unused
- *       8 bits: variable/qubit number of this node
+ *      16 bits: variable/qubit number of this node
  *       1 bit:  if 0 (1) normalized WGT is on low (high)
  *       1 bit:  if 0 (1) normalized WGT is EVBDD_ZERO (EVBDD_ONE)
- *      13 bits: unused
+ *       5 bits: unused
  *      40 bits: low edge pointer to next node (EVBDD_TARG)
  * 64 bits high:
  *       1 bit:  marked/unmarked flag
@@ -49,39 +115,87 @@ extern EVBDD_WGT (*normalize_weights)(EVBDD_WGT *, EVBDD_WGT *);
  * -----------------------------------------------------------------------------
  * 
  * 
- * When edge weight table > 2^23 (larger_wgt_indices = true)
+ * SYLVAN_EVBDD_LARGE_WGT_INDICES = 1: [wgt,ptr] = [33,30] bits
+ * (edge weight table (with the pinned weights) <= 2^33, nodes table <= 2^30)
  * -----------------------------------------------------------------------------
  * EVBDD edge structure (64 bits)
  *       1 bit:  unused
- *      23 bits: index of edge weight in weight table (EVBDD_WGT)
- *      40 bits: index of next node in node table (EVBDD_TARG)
+ *      33 bits: index of edge weight in weight table (EVBDD_WGT)
+ *      30 bits: index of next node in node table (EVBDD_TARG)
  * 
  * EVBDD node structure (128 bits)
  * 64 bits low:
  *       1 bit:  unused
- *       8 bits: variable/qubit number of this node
+ *      16 bits: variable/qubit number of this node
  *       1 bit:  if 0 (1) normalized WGT is on low (high)
  *       1 bit:  if 0 (1) normalized WGT is EVBDD_ZERO (EVBDD_ONE)
- *      23 bits: unused
+ *      15 bits: unused
  *      30 bits: low edge pointer to next node (EVBDD_TARG)
  * 64 bits high:
  *       1 bit:  marked/unmarked flag
  *      33 bits: index of edge weight of high edge in ctable (EVBDD_WGT)
  *      30 bits: high edge pointer to next node (EVBDD_TARG)
  * -----------------------------------------------------------------------------
+ *
+ *
+ *
+ * SYLVAN_EVBDD_WIDE_EDGES = 1: [wgt,ptr] = [32,38] bits
+ * (edge weight table (with the pinned weights) <= 2^32, nodes table <= 2^38)
+ * -----------------------------------------------------------------------------
+ * EVBDD edge structure (128 bits)
+ *      32 bits: unused
+ *      32 bits: index of edge weight in weight table (EVBDD_WGT)
+ *      26 bits: unused
+ *      38 bits: index of next node in node table (EVBDD_TARG)
+ *
+ * EVBDD node structure (128 bits)
+ * 64 bits low:
+ *       1 bit:  unused
+ *      16 bits: variable/qubit number of this node
+ *       1 bit:  if 0 (1) normalized WGT is on low (high)
+ *       1 bit:  if 0 (1) normalized WGT is EVBDD_ZERO (EVBDD_ONE)
+ *       7 bits: highest bits of the index of the edge weight of high edge
+ *      38 bits: low edge pointer to next node (EVBDD_TARG)
+ * 64 bits high:
+ *       1 bit:  marked/unmarked flag
+ *      25 bits: lowest bits of the index of the edge weight of high edge
+ *      38 bits: high edge pointer to next node (EVBDD_TARG)
+ * -----------------------------------------------------------------------------
+ *
+ * The 16 bit variables allow QMDDs on up to 65534 qubits, and matrices (which
+ * use 2 variables per qubit) on up to 32767 qubits. The edges are 64 bit
+ * values, so the edge weight index and the node index together have 63 bits,
+ * unless they are 128 bit values (SYLVAN_EVBDD_WIDE_EDGES), which hold both
+ * indices in a word of their own. The nodes stay 16 bytes in all layouts.
  */
+#if SYLVAN_EVBDD_WIDE_EDGES
+#define EVBDD_WGT_BITS 32
+#define EVBDD_PTR_BITS 38
+#define EVBDD_WGT_SHIFT 64       // position of the weight in an edge
+#define EVBDD_NODE_WGT_HIGH 25   // bits of the weight in the high word of a node
+#elif SYLVAN_EVBDD_LARGE_WGT_INDICES
+#define EVBDD_WGT_BITS 33
+#define EVBDD_PTR_BITS 30
+#define EVBDD_WGT_SHIFT EVBDD_PTR_BITS
+#define EVBDD_NODE_WGT_HIGH EVBDD_WGT_BITS
+#else
+#define EVBDD_WGT_BITS 23
+#define EVBDD_PTR_BITS 40
+#define EVBDD_WGT_SHIFT EVBDD_PTR_BITS
+#define EVBDD_NODE_WGT_HIGH EVBDD_WGT_BITS
+#endif
+
 typedef struct __attribute__((packed)) evbddnode {
-    EVBDD low, high;
+    uint64_t low, high;
 } *evbddnode_t; // 16 bytes
 
-static const EVBDD evbdd_marked_mask  = 0x8000000000000000LL;
-static const EVBDD evbdd_var_mask_low = 0x7f80000000000000LL;
-static const EVBDD evbdd_wgt_pos_mask = 0x0040000000000000LL;
-static const EVBDD evbdd_wgt_val_mask = 0x0020000000000000LL;
-static const EVBDD evbdd_wgt_mask_23  = 0x7fffff0000000000LL;
-static const EVBDD evbdd_wgt_mask_33  = 0x7fffffffc0000000LL;
-static const EVBDD evbdd_ptr_mask_30  = 0x000000003fffffffLL;
-static const EVBDD evbdd_ptr_mask_40  = 0x000000ffffffffffLL;
+static const uint64_t evbdd_marked_mask  = 0x8000000000000000LL;
+static const uint64_t evbdd_var_mask_low = 0x7fff800000000000LL;
+static const uint64_t evbdd_wgt_pos_mask = 0x0000400000000000LL;
+static const uint64_t evbdd_wgt_val_mask = 0x0000200000000000LL;
+static const uint64_t evbdd_node_ptr_mask = (1ULL<<EVBDD_PTR_BITS)-1;
+static const EVBDD evbdd_wgt_mask     = ((EVBDD)((1ULL<<EVBDD_WGT_BITS)-1)) << EVBDD_WGT_SHIFT;
+static const EVBDD evbdd_ptr_mask     = (1ULL<<EVBDD_PTR_BITS)-1;
 
 
 /**
@@ -90,12 +204,7 @@ static const EVBDD evbdd_ptr_mask_40  = 0x000000ffffffffffLL;
 static inline EVBDD_WGT
 EVBDD_WEIGHT(EVBDD a)
 {
-    if (larger_wgt_indices) {
-        return (a & evbdd_wgt_mask_33) >> 30; // 33 bits
-    }
-    else {
-        return (a & evbdd_wgt_mask_23) >> 40; // 23 bits
-    }
+    return (EVBDD_WGT) ((a & evbdd_wgt_mask) >> EVBDD_WGT_SHIFT);
 }
 
 /**
@@ -104,12 +213,7 @@ EVBDD_WEIGHT(EVBDD a)
 static inline EVBDD_TARG
 EVBDD_TARGET(EVBDD a)
 {
-    if (larger_wgt_indices) {
-        return a & evbdd_ptr_mask_30; // 30 bits
-    }
-    else {
-        return a & evbdd_ptr_mask_40; // 40 bits
-    }
+    return (EVBDD_TARG) (a & evbdd_ptr_mask);
 }
 
 /**
@@ -118,7 +222,7 @@ EVBDD_TARGET(EVBDD a)
 static inline BDDVAR
 evbddnode_getvar(evbddnode_t n)
 {
-    return (BDDVAR) ((n->low & evbdd_var_mask_low) >> 55 ); // 8 bits
+    return (BDDVAR) ((n->low & evbdd_var_mask_low) >> 47 ); // 16 bits
 }
 
 /**
@@ -127,7 +231,7 @@ evbddnode_getvar(evbddnode_t n)
 static inline EVBDD_TARG
 evbddnode_getptrlow(evbddnode_t n)
 {
-    return (EVBDD_TARG) EVBDD_TARGET(n->low);
+    return (EVBDD_TARG) (n->low & evbdd_node_ptr_mask);
 }
 
 /**
@@ -136,7 +240,21 @@ evbddnode_getptrlow(evbddnode_t n)
 static inline EVBDD_TARG
 evbddnode_getptrhigh(evbddnode_t n)
 {
-    return (EVBDD_TARG) EVBDD_TARGET(n->high);
+    return (EVBDD_TARG) (n->high & evbdd_node_ptr_mask);
+}
+
+/**
+ * Gets the (only) edge weight index stored in <n>, of which the lowest
+ * EVBDD_NODE_WGT_HIGH bits are in its high word, and the others (if any) in
+ * its low word.
+ */
+static inline EVBDD_WGT
+evbddnode_getwgt(evbddnode_t n)
+{
+    const uint64_t mask_high = (1ULL << EVBDD_NODE_WGT_HIGH) - 1;
+    const uint64_t mask_low  = (1ULL << (EVBDD_WGT_BITS - EVBDD_NODE_WGT_HIGH)) - 1;
+    return ((n->high >> EVBDD_PTR_BITS) & mask_high) |
+           ((n->low >> EVBDD_PTR_BITS) & mask_low) << EVBDD_NODE_WGT_HIGH;
 }
 
 /**
@@ -169,20 +287,47 @@ EVBDD_GETNODE(EVBDD_TARG p)
 }
 
 /**
- * Packs a EVBDD_TARG and EVBDD_WGT into a single 64 bit EVBDD.
+ * Packs a EVBDD_TARG and EVBDD_WGT into a single EVBDD.
  */
 static inline EVBDD
 evbdd_bundle(EVBDD_TARG p, EVBDD_WGT a)
 {
-    if (larger_wgt_indices) {
-        assert (p <= 0x000000003ffffffe);   // avoid clash with sylvan_invalid
-        assert (a <= (1LL<<33));
-        return (a << 30 | p);
-    }else {
-        assert (p <= 0x000000fffffffffe);   // avoid clash with sylvan_invalid
-        assert (a <= (1<<23));
-        return (a << 40 | p);
-    }
+    assert (p < evbdd_ptr_mask);   // avoid clash with sylvan_invalid
+    assert (a < (1ULL<<EVBDD_WGT_BITS));
+    return ((EVBDD)a << EVBDD_WGT_SHIFT | p);
+}
+
+/**
+ * Operation cache for results and keys which are (full) EVBDD edges. Keys <a>
+ * and <opid> are 64 bit words (<opid> in the highest bits of <a>, as with
+ * cache_get3), <b> and <c> may be EVBDD edges. With 128 bit edges the entry
+ * takes two buckets, of which the first holds the same keys as a compact edge
+ * entry would (with the low words of <b> and <c>), so that the filters of
+ * cache_clear_filter see the same fields in both layouts.
+ */
+static inline int
+evbdd_cache_get3(uint64_t opid, uint64_t a, EVBDD b, EVBDD c, EVBDD *res)
+{
+#if SYLVAN_EVBDD_WIDE_EDGES
+    uint64_t res_lo, res_hi;
+    if (!cache_get6(a | opid, (uint64_t)b, (uint64_t)c, (uint64_t)(b >> 64),
+                    (uint64_t)(c >> 64), 0, &res_lo, &res_hi)) return 0;
+    *res = (EVBDD)res_hi << 64 | res_lo;
+    return 1;
+#else
+    return cache_get3(opid, a, b, c, res);
+#endif
+}
+
+static inline int
+evbdd_cache_put3(uint64_t opid, uint64_t a, EVBDD b, EVBDD c, EVBDD res)
+{
+#if SYLVAN_EVBDD_WIDE_EDGES
+    return cache_put6(a | opid, (uint64_t)b, (uint64_t)c, (uint64_t)(b >> 64),
+                      (uint64_t)(c >> 64), 0, (uint64_t)res, (uint64_t)(res >> 64));
+#else
+    return cache_put3(opid, a, b, c, res);
+#endif
 }
 
 static void __attribute__((unused))
@@ -190,21 +335,21 @@ evbddnode_unpack(evbddnode_t n, EVBDD_TARG *low, EVBDD_TARG *high, EVBDD_WGT *a,
 {
     *low  = evbddnode_getptrlow(n);
     *high = evbddnode_getptrhigh(n);
-    bool norm_pos = (n->low & evbdd_wgt_pos_mask) >> 54;
-    bool norm_val = (n->low & evbdd_wgt_val_mask) >> 53;
+    bool norm_pos = (n->low & evbdd_wgt_pos_mask) >> 46;
+    bool norm_val = (n->low & evbdd_wgt_val_mask) >> 45;
 
     if (weight_norm_strat == NORM_L2) {
-        *b = EVBDD_WEIGHT(n->high);
+        *b = evbddnode_getwgt(n);
         *a = wgt_get_low_L2normed(*b);
     }
     else {
         if (norm_pos == 0) { // low WGT is EVBDD_ZERO or EVBDD_ONE, high WGT in table
             *a = (norm_val == 0) ? EVBDD_ZERO : EVBDD_ONE;
-            *b = EVBDD_WEIGHT(n->high);
+            *b = evbddnode_getwgt(n);
         }
         else { // high WGT is EVBDD_ZERO or EVBDD_ONE, low WGT in table
             *b = (norm_val == 0) ? EVBDD_ZERO : EVBDD_ONE;
-            *a = EVBDD_WEIGHT(n->high);
+            *a = evbddnode_getwgt(n);
         }
     }
 }
@@ -258,13 +403,10 @@ evbddnode_pack(evbddnode_t n, BDDVAR var, EVBDD_TARG low, EVBDD_TARG high, EVBDD
     }
 
     // organize the bit structure of low and high
-    n->low  = ((uint64_t)var)<<55 | ((uint64_t)norm_pos)<<54 | ((uint64_t)norm_val)<<53 | low;
-    if (larger_wgt_indices) {
-        n->high = wgt_high<<30 | high;
-    }
-    else {
-        n->high = wgt_high<<40 | high;
-    }
+    assert(var < EVBDD_INVALID_VAR);
+    n->low  = ((uint64_t)var)<<47 | ((uint64_t)norm_pos)<<46 | ((uint64_t)norm_val)<<45 |
+              (wgt_high >> EVBDD_NODE_WGT_HIGH) << EVBDD_PTR_BITS | low;
+    n->high = (wgt_high & ((1ULL << EVBDD_NODE_WGT_HIGH) - 1)) << EVBDD_PTR_BITS | high;
 }
 
 static EVBDD_TARG __attribute__((unused))
@@ -47,7 +47,8 @@ extern "C" {
 extern llmsset_t nodes;
 
 /**
- * Macros for all operation identifiers for the operation cache
+ * Macros for all operation identifiers for the operation cache. The ranges
+ * (BDD, MDD, MTBDD, ...) are the operation classes of sylvan_cache.h.
  */
 
 // BDD operations
@@ -110,13 +111,14 @@ static const uint64_t CACHE_MTBDD_TENSOR            = (61LL<<40);
 static const uint64_t CACHE_EVBDD_PLUS               = (70LL<<40);
 static const uint64_t CACHE_EVBDD_MATVEC_MULT        = (71LL<<40);
 static const uint64_t CACHE_EVBDD_MATMAT_MULT        = (72LL<<40);
-static const uint64_t CACHE_EVBDD_INPROD             = (73LL<<30);
+static const uint64_t CACHE_EVBDD_INPROD             = (73LL<<40);
 static const uint64_t CACHE_EVBDD_REPLACE_TERMINAL   = (74LL<<40);
 static const uint64_t CACHE_EVBDD_INC_VARS           = (75LL<<40);
 static const uint64_t CACHE_EVBDD_CLEAN_WGT_TABLE    = (76LL<<40);
 static const uint64_t CACHE_EVBDD_IS_ORDERED         = (77LL<<40);
 
-// Operations on EVBDD edge weights
+// Operations on EVBDD edge weights (their results are not put in the operation
+// cache, but in a cache of their own, see wgt_cache_set_size())
 static const uint64_t CACHE_WGT_ADD                 = (80LL<<40);
 static const uint64_t CACHE_WGT_SUB                 = (81LL<<40);
 static const uint64_t CACHE_WGT_MUL                 = (82LL<<40);
@@ -128,6 +130,9 @@ static const uint64_t CACHE_QMDD_CGATE              = (91LL<<40);
 static const uint64_t CACHE_QMDD_CGATE_RANGE        = (92LL<<40);
 static const uint64_t CACHE_QMDD_SUBCIRC            = (93LL<<40);
 static const uint64_t CACHE_QMDD_PROB               = (94LL<<40);
+static const uint64_t CACHE_QMDD_GATE2              = (95LL<<40);
+static const uint64_t CACHE_QMDD_GATE2_PAIR         = (96LL<<40);
+static const uint64_t CACHE_QMDD_CGATE_PAIR         = (97LL<<40);
 
 // TODO: renumber
 
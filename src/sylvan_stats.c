@@ -36,7 +36,8 @@ pthread_key_t sylvan_stats_key;
 struct
 {
     int type; /* 0 for print line, 1 for simple counter, 2 for operation with CACHED and CACHEDPUT */
-              /* 3 for timer, 4 for report table data */
+              /* 3 for timer, 4 for report table data, 5 for counter as */
+              /* percentage of the counter before it, 6 for weight cache data */
     int id;
     const char *key;
 } sylvan_report_info[] =
@@ -48,6 +49,15 @@ struct
     {1, LDD_NODES_REUSED, "LDD nodes reused"},
     {1, LLMSSET_LOOKUP, "Lookup iterations"},
     {4, 0, NULL}, /* trigger to report unique nodes and operation cache */
+    {1, OPCACHE_LOOKUP, "Cache lookups"},
+    {1, OPCACHE_HIT, "Cache hits"},
+    {5, OPCACHE_HIT, "Cache hit rate"},
+    {1, OPCACHE_ADAPT_GROW, "Cache grown"},
+    {1, OPCACHE_ADAPT_KEEP, "Cache kept (hit rate)"},
+    {1, OPCACHE_ADAPT_LIMIT, "Cache kept (limit)"},
+    {1, OPCACHE_ADAPT_STALL, "Cache kept (no gain)"},
+    {1, EVBDD_CACHE_TUNE_ON, "Cache levels enabled"},
+    {1, EVBDD_CACHE_TUNE_OFF, "Cache levels disabled"},
 
     {0, 0, "Operation            Count            Cache get        Cache put"},
     {2, BDD_AND, "BDD and"},
@@ -115,8 +125,19 @@ struct
     {2, ZDD_ISOP, "zdd isop"},
     {2, ZDD_COVER_TO_BDD, "zdd cover_to_bdd"},
 
+    {0, 0, "Edge weights"},
+    {2, WGT_ADD, "Weight add"},
+    {2, WGT_SUB, "Weight sub"},
+    {2, WGT_MUL, "Weight mul"},
+    {2, WGT_DIV, "Weight div"},
+    {6, 0, NULL}, /* trigger to report weight operation cache */
+    {1, WGT_L0_LOOKUP, "L0 cache lookups"},
+    {1, WGT_L0_HIT, "L0 cache hits"},
+    {5, WGT_L0_HIT, "L0 cache hit rate"},
+
     {0, 0, "Garbage collection"},
     {1, SYLVAN_GC_COUNT, "GC executions"},
+    {1, SYLVAN_GC_CACHE_KEPT, "Cache entries kept"},
     {3, SYLVAN_GC, "Total time spent"},
 
     {-1, -1, NULL},
@@ -263,6 +284,14 @@ sylvan_stats_report(FILE *target)
             if (totals.timers[id] > 0) {
                 fprintf(target, "%-20s %'.6Lf sec.\n", sylvan_report_info[i].key, (long double)totals.timers[id]/1000000000);
             }
+        } else if (type == 5) {
+            if (totals.counters[id-1] > 0) {
+                fprintf(target, "%-20s %.2f%%\n", sylvan_report_info[i].key, 100.0*totals.counters[id]/totals.counters[id-1]);
+            }
+        } else if (type == 6) {
+            if (wgt_cache_getused() > 0) {
+                fprintf(target, "%-20s %'zu of %'zu buckets filled.\n", "Weight op cache", wgt_cache_getused(), wgt_cache_getsize());
+            }
         } else if (type == 4) {
             fprintf(target, "%-20s %'zu of %'zu buckets filled.\n", "Unique nodes table", llmsset_count_marked(nodes), llmsset_get_size(nodes));
             fprintf(target, "%-20s %'zu of %'zu buckets filled.\n", "Operation cache", cache_getused(), cache_getsize());
@@ -123,7 +123,18 @@ typedef enum {
 
     /* Other counters */
     SYLVAN_GC_COUNT,
+    SYLVAN_GC_CACHE_KEPT,
     LLMSSET_LOOKUP,
+    OPCACHE_LOOKUP,
+    OPCACHE_HIT,
+    OPCACHE_ADAPT_GROW,
+    OPCACHE_ADAPT_KEEP,
+    OPCACHE_ADAPT_LIMIT,
+    OPCACHE_ADAPT_STALL,
+    EVBDD_CACHE_TUNE_ON,
+    EVBDD_CACHE_TUNE_OFF,
+    WGT_L0_LOOKUP,
+    WGT_L0_HIT,
 
     SYLVAN_COUNTER_COUNTER
 } Sylvan_Counters;
@@ -94,6 +94,102 @@ test_cache()
         test_assert(res == 0 || val == arr[4*i+3]);
     }
 
+    /**
+     * Clearing the cache (per operation class)
+     */
+    cache_clear();
+    test_assert(cache_getused() == 0);
+    uint64_t val;
+    const uint64_t bdd_op = CACHE_BDD_AND | 123, qmdd_op = CACHE_QMDD_GATE | 123;
+    test_assert(cache_put(bdd_op, 1, 2, 3));
+    test_assert(cache_put(qmdd_op, 1, 2, 4));
+    cache_clear_opclass(CACHE_OPCLASS_QMDD);
+    test_assert(cache_get(bdd_op, 1, 2, &val) && val == 3);
+    test_assert(!cache_get(qmdd_op, 1, 2, &val));
+    test_assert(cache_getused() == 1);
+    test_assert(cache_put(qmdd_op, 1, 2, 5));
+    test_assert(cache_get(qmdd_op, 1, 2, &val) && val == 5);
+    // (entries do not come back when the epoch of their class wraps around)
+    for (int k=0; k<256; k++) cache_clear_opclass(CACHE_OPCLASS_QMDD);
+    test_assert(!cache_get(qmdd_op, 1, 2, &val));
+    test_assert(cache_get(bdd_op, 1, 2, &val) && val == 3);
+    cache_clear();
+    test_assert(!cache_get(bdd_op, 1, 2, &val));
+    test_assert(cache_getused() == 0);
+
+    /**
+     * Set-associative modes: same checks as above, and fewer entries are lost
+     * to collisions when the cache is half full
+     */
+    const size_t half = cache_getsize() / 2;
+    size_t retained[3] = {0};
+    for (int k=0; k<3; k++) {
+        cache_set_associativity(1 << k);
+        cache_clear();
+        for (size_t i=0; i<number_add; i++) {
+            test_assert(cache_put(arr[4*i], arr[4*i+1], arr[4*i+2], arr[4*i+3]));
+            int res = cache_get(arr[4*i], arr[4*i+1], arr[4*i+2], &val);
+            test_assert(res == 1);
+            test_assert(val == arr[4*i+3]);
+        }
+        count = 0;
+        for (size_t i=0; i<number_add; i++) {
+            int res = cache_get(arr[4*i], arr[4*i+1], arr[4*i+2], &val);
+            test_assert(res == 0 || val == arr[4*i+3]);
+            if (res) count++;
+        }
+        test_assert(count == cache_getused());
+
+        cache_clear();
+        for (size_t i=0; i<half; i++) cache_put(arr[4*i], arr[4*i+1], arr[4*i+2], arr[4*i+3]);
+        for (size_t i=0; i<half; i++) {
+            if (cache_get(arr[4*i], arr[4*i+1], arr[4*i+2], &val)) retained[k]++;
+        }
+    }
+    test_assert(retained[0] < retained[1] && retained[1] < retained[2]);
+
+    /**
+     * Growing the cache keeps its entries (in all modes)
+     */
+    const size_t max_size = cache_getsize();
+    for (int k=0; k<3; k++) {
+        cache_set_associativity(1 << k);
+        cache_setsize(max_size / 4);
+        for (size_t i=0; i<half; i++) cache_put(arr[4*i], arr[4*i+1], arr[4*i+2], arr[4*i+3]);
+        count = cache_getused();
+        cache_grow(max_size);
+        test_assert(cache_getsize() == max_size);
+        test_assert(cache_getused() == count);
+        size_t found = 0;
+        for (size_t i=0; i<half; i++) {
+            int res = cache_get(arr[4*i], arr[4*i+1], arr[4*i+2], &val);
+            test_assert(res == 0 || val == arr[4*i+3]);
+            if (res) found++;
+        }
+        test_assert(found == count);
+
+        // 2-part entries (of which the halves are a fixed pair of buckets)
+        // are dropped, all other entries are kept
+        cache_setsize(max_size / 4);
+        const uint64_t *arr6 = arr + 8*half;
+        for (size_t i=0; i<half/8; i++) {
+            cache_put6(arr6[8*i], arr6[8*i+1], arr6[8*i+2], arr6[8*i+3], arr6[8*i+4], arr6[8*i+5], arr6[8*i+6], arr6[8*i+7]);
+        }
+        for (size_t i=0; i<half/4; i++) cache_put(arr[4*i], arr[4*i+1], arr[4*i+2], arr[4*i+3]);
+        count = 0;
+        for (size_t i=0; i<half/4; i++) {
+            if (cache_get(arr[4*i], arr[4*i+1], arr[4*i+2], &val)) count++;
+        }
+        cache_grow(max_size);
+        test_assert(cache_getused() == count);
+        for (size_t i=0; i<half/8; i++) {
+            uint64_t val1, val2;
+            test_assert(!cache_get6(arr6[8*i], arr6[8*i+1], arr6[8*i+2], arr6[8*i+3], arr6[8*i+4], arr6[8*i+5], &val1, &val2));
+        }
+    }
+    cache_set_associativity(1);
+    cache_clear();
+
     /**
      * TODO: multithreaded test
      */
@@ -12,7 +12,6 @@
 bool VERBOSE = true;
 
 typedef uint64_t AMP; // <- this is also defined in qsylvan.h, but that is the QSylvan layer!
-typedef uint64_t QMDD;
 
 int test_complex_operations() // No influence on DD
 {
@@ -92,6 +91,34 @@ int test_complex_operations() // No influence on DD
     index4=wgt_mul(index1,index2);  weight_value(index4, &val4);
     test_assert(index3 == index4);  test_assert(weight_eq(&val3, &val4));
 
+    // the results are in a cache of their own, not in the operation cache
+    wgt_cache_clear();
+    test_assert(wgt_cache_getused() == 0);
+    test_assert(wgt_mul(index1, index2) == index3);
+    test_assert(wgt_cache_getused() > 0);
+    sylvan_clear_cache();
+    test_assert(wgt_cache_getused() > 0);
+    test_assert(wgt_mul(index2, index1) == index3);
+
+    // wgt_mul4 (products not in the cache, a cached product and special cases)
+    ref1 = cmake(0.1, 0.2);         index1 = weight_lookup(&ref1);
+    ref2 = cmake(-0.7, 0.3);        index2 = weight_lookup(&ref2);
+    ref3 = cmake(0.25, -1.5);       index3 = weight_lookup(&ref3);
+    for (int batched = 0; batched < 2; batched++) {
+        wgt_set_batched_lookups(batched);
+        EVBDD_WGT as[4] = {index1, index2, index3, EVBDD_ONE};
+        EVBDD_WGT bs[4] = {index2, index3, index1, index2};
+        EVBDD_WGT prods[4];
+        wgt_mul4(as, bs, prods);
+        for (int k = 0; k < 4; k++) {
+            weight_value(prods[k], &val4);
+            weight_value(as[k], &val1);     weight_value(bs[k], &val2);     weight_mul(&val1, &val2);
+            test_assert(weight_approx_eq(&val1, &val4));
+            test_assert(prods[k] == wgt_mul(as[k], bs[k]));
+        }
+    }
+    wgt_set_batched_lookups(true);
+
     // wgt_div
     ref1 = cmake(1.3,-0.7);         index1 = weight_lookup(&ref1);   weight_value(index1, &val1);
     ref2 = cmake(1.0, 0.0);         index2 = weight_lookup(&ref2);   weight_value(index2, &val2);
@@ -109,6 +136,32 @@ int test_complex_operations() // No influence on DD
     return 0;
 }
 
+int test_node_layout() // No influence on DD
+{
+    // the largest indices of the layout survive packing and unpacking (in the
+    // [32,38] layout the edge weight index is split over both words of a node)
+    if (weight_norm_strat == NORM_L2) return 0; // (would look up the low wgt)
+    struct evbddnode n;
+    EVBDD_TARG l, h, ptr_max = (1ULL << EVBDD_PTR_BITS) - 2;
+    EVBDD_WGT a, b, wgt_max = (1ULL << EVBDD_WGT_BITS) - 1;
+    BDDVAR var = EVBDD_INVALID_VAR - 1;
+    evbddnode_pack(&n, var, ptr_max, ptr_max - 1, EVBDD_ONE, wgt_max);
+    test_assert(evbddnode_getvar(&n) == var);
+    test_assert(evbddnode_getmark(&n) == 0);
+    evbddnode_unpack(&n, &l, &h, &a, &b);
+    test_assert(l == ptr_max && h == ptr_max - 1);
+    test_assert(a == EVBDD_ONE && b == wgt_max);
+    evbddnode_pack(&n, 0, 0, 1, wgt_max - 1, EVBDD_ZERO);
+    evbddnode_unpack(&n, &l, &h, &a, &b);
+    test_assert(l == 0 && h == 1 && a == wgt_max - 1 && b == EVBDD_ZERO);
+
+    QMDD e = evbdd_bundle(ptr_max, wgt_max);
+    test_assert(EVBDD_TARGET(e) == ptr_max && EVBDD_WEIGHT(e) == wgt_max);
+
+    if(VERBOSE) printf("node layout:                   ok\n");
+    return 0;
+}
+
 int test_basis_state_creation()
 {
     bool x[] = {0};
@@ -379,6 +432,7 @@ int run_qmdd_tests()
 
     // basics
     if (test_complex_operations()) return 1;
+    if (test_node_layout()) return 1;
     if (test_basis_state_creation()) return 1;
     if (test_vector_addition()) return 1;
     if (test_inner_product()) return 1;
@@ -415,12 +469,16 @@ int runtests()
     for (int backend = 0; backend < n_wgt_storage_types; backend++) {
         for (int norm_strat = 0; norm_strat < n_norm_strategies; norm_strat++) {
             if (test_with(backend, norm_strat, 11)) return 1;
-            if (backend == COMP_HASHMAP) {
-                // test with edge wgt index > 23 bits
+            if (SYLVAN_EVBDD_LARGE_WGT_INDICES && backend == COMP_HASHMAP) {
+                // test with edge wgt index > 23 bits (in the [33,30] layout)
                 if (test_with(backend, norm_strat, 24)) return 1;
             }
         }
     }
+    // a 2^23 edge weight table (the default of run_qasm_on_qmdd) with the
+    // pinned weights fits in 23 bit indices, i.e. also in the [23,40] layout
+    test_assert(wgt_index_bound(1LL<<23) == (1LL<<23));
+    if (test_with(COMP_HASHMAP, NORM_LOW, 23)) return 1;
     return 0;
 }
 
@@ -1,5 +1,6 @@
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #include "qsylvan.h"
@@ -746,11 +747,259 @@ int test_20qubit_circuit()
     return 0;
 }
 
+int test_real_weights()
+{
+    // Ry/CZ ansatz (only real gates) with WGT_DOUBLE edge weights
+    QMDD q, qref;
+    BDDVAR n = 6;
+    bool x6[] = {0,0,0,0,0,0};
+    fl_t theta[] = {0.3, -1.2, 2.5, 0.7, -0.1, 1.9};
+    complex_t a;
+
+    test_assert(sylvan_get_edge_weight_type() == WGT_DOUBLE);
+    test_assert(qmdd_gate_supported(GATEID_H));
+    test_assert(qmdd_gate_supported(GATEID_Z));
+    test_assert(qmdd_gate_supported(GATEID_Rk(1))); // Rk(1) = Z
+    test_assert(!qmdd_gate_supported(GATEID_Y));
+    test_assert(!qmdd_gate_supported(GATEID_S));
+    test_assert(!qmdd_gate_supported(GATEID_T));
+    test_assert(!qmdd_gate_supported(GATEID_Rk(2)));
+
+    qref = qmdd_create_basis_state(n, x6);
+    q    = qmdd_create_basis_state(n, x6);
+    for (BDDVAR k = 0; k < n; k++) q = qmdd_gate(q, GATEID_H, k);
+    a = qmdd_get_amplitude(q, x6, n);
+    test_assert(flt_abs(a.r - 0.125) < 1e-14 && a.i == 0.0);
+
+    for (BDDVAR k = 0; k < n; k++) q = qmdd_gate(q, GATEID_Ry(theta[k]), k);
+    for (BDDVAR k = 0; k < n-1; k++) q = qmdd_cgate(q, GATEID_Z, k, k+1);
+    q = qmdd_cgate2(q, GATEID_X, 0, 1, 2);
+    q = qmdd_gate(q, GATEID_X, 4);
+    test_assert(qmdd_is_unitvector(q, n));
+    test_assert(evbdd_is_ordered(q, n));
+    if (test_measure_random_state(q, n)) return 1;
+
+    // inverse
+    q = qmdd_gate(q, GATEID_X, 4);
+    q = qmdd_cgate2(q, GATEID_X, 0, 1, 2);
+    for (BDDVAR k = 0; k < n-1; k++) q = qmdd_cgate(q, GATEID_Z, k, k+1);
+    for (BDDVAR k = 0; k < n; k++) q = qmdd_gate(q, GATEID_Ry(-theta[k]), k);
+    test_assert(qmdd_is_unitvector(q, n));
+    for (BDDVAR k = 0; k < n; k++) q = qmdd_gate(q, GATEID_H, k);
+    test_assert(evbdd_equivalent(q, qref, n, false, VERBOSE));
+    test_assert(flt_abs(qmdd_fidelity(q, qref, n) - 1.0) < 1e-10);
+
+    if(VERBOSE) printf("qmdd real edge weights:    ok\n");
+    return 0;
+}
+
+int test_exact_weights()
+{
+    // Clifford+T circuit with WGT_RATIONAL_128 (exact) edge weights
+    QMDD q, q_prev, qref;
+    BDDVAR n = 6;
+    bool x6[] = {0,0,0,0,0,0};
+    complex_t a;
+
+    test_assert(sylvan_get_edge_weight_type() == WGT_RATIONAL_128);
+    test_assert(qmdd_gate_supported(GATEID_H));
+    test_assert(qmdd_gate_supported(GATEID_S));
+    test_assert(qmdd_gate_supported(GATEID_T));
+    test_assert(qmdd_gate_supported(GATEID_Y));
+    test_assert(qmdd_gate_supported(GATEID_sqrtX));
+    test_assert(qmdd_gate_supported(GATEID_Rk(3))); // Rk(3) = T
+    test_assert(!qmdd_gate_supported(GATEID_Rk(4)));
+
+    qref = qmdd_create_basis_state(n, x6);
+    q    = qmdd_create_basis_state(n, x6);
+    for (BDDVAR k = 0; k < n; k++) q = qmdd_gate(q, GATEID_H, k);
+    a = qmdd_get_amplitude(q, x6, n);
+    test_assert(flt_abs(a.r - 0.125) < 1e-14 && a.i == 0.0);
+
+    // T^8 = I holds exactly
+    q_prev = q;
+    for (int i = 0; i < 8; i++) q = qmdd_gate(q, GATEID_T, 0);
+    test_assert(q == q_prev);
+
+    for (BDDVAR k = 0; k < n; k++) q = qmdd_gate(q, GATEID_T, k);
+    for (BDDVAR k = 0; k < n-1; k++) q = qmdd_cgate(q, GATEID_X, k, k+1);
+    q = qmdd_gate(q, GATEID_H, 2);
+    q = qmdd_gate(q, GATEID_sqrtX, 3);
+    q = qmdd_cgate2(q, GATEID_Z, 0, 1, 4);
+    q = qmdd_gate(q, GATEID_S, 5);
+    q = qmdd_gate(q, GATEID_H, 5);
+    test_assert(qmdd_is_unitvector(q, n));
+    test_assert(evbdd_is_ordered(q, n));
+
+    // inverse, which gives exactly the initial state
+    q = qmdd_gate(q, GATEID_H, 5);
+    q = qmdd_gate(q, GATEID_Sdag, 5);
+    q = qmdd_cgate2(q, GATEID_Z, 0, 1, 4);
+    q = qmdd_gate(q, GATEID_sqrtXdag, 3);
+    q = qmdd_gate(q, GATEID_H, 2);
+    for (int k = n-2; k >= 0; k--) q = qmdd_cgate(q, GATEID_X, k, k+1);
+    for (BDDVAR k = 0; k < n; k++) q = qmdd_gate(q, GATEID_Tdag, k);
+    for (BDDVAR k = 0; k < n; k++) q = qmdd_gate(q, GATEID_H, k);
+    test_assert(q == qref);
+    test_assert(qmdd_fidelity(q, qref, n) == 1.0);
+
+    if(VERBOSE) printf("qmdd exact edge weights:   ok\n");
+    return 0;
+}
+
+int test_caching_levels()
+{
+    QMDD q, qref, qmat;
+    BDDVAR n = 8;
+    bool x8[] = {0,0,0,0,0,0,0,0};
+    char levels[9];
+
+    // levels past the given ones follow the granularity
+    evbdd_set_op_caching_granularity(EVBDD_CACHE_OP_GATE, 3);
+    test_assert(evbdd_get_op_caching_granularity(EVBDD_CACHE_OP_GATE) == 3);
+    evbdd_get_caching_levels(EVBDD_CACHE_OP_GATE, levels, n);
+    test_assert(strcmp(levels, "10010010") == 0);
+    evbdd_set_caching_levels(EVBDD_CACHE_OP_GATE, "0110");
+    evbdd_get_caching_levels(EVBDD_CACHE_OP_GATE, levels, n);
+    test_assert(strcmp(levels, "01100010") == 0);
+    evbdd_set_caching_granularity(1);
+    evbdd_get_caching_levels(EVBDD_CACHE_OP_GATE, levels, n);
+    test_assert(strcmp(levels, "11111111") == 0);
+    test_assert(strcmp(evbdd_cache_op_name(EVBDD_CACHE_OP_MATVEC), "matvec") == 0);
+    test_assert(evbdd_cache_op_name(EVBDD_CACHE_N_OPS) == NULL);
+
+    // the same circuit with results cached at all levels, at some levels, and
+    // with the levels tuned during the run
+    for (int run = 0; run < 3; run++) {
+        sylvan_clear_cache();
+        if (run == 1) {
+            evbdd_set_op_caching_granularity(EVBDD_CACHE_OP_GATE, 2);
+            evbdd_set_caching_levels(EVBDD_CACHE_OP_CGATE, "00110");
+            evbdd_set_caching_levels(EVBDD_CACHE_OP_PLUS, "0");
+            evbdd_set_op_caching_granularity(EVBDD_CACHE_OP_MATVEC, 4);
+        }
+        if (run == 2) {
+            evbdd_set_caching_granularity(1);
+            evbdd_set_caching_autotune(true);
+            test_assert(evbdd_get_caching_autotune());
+        }
+        q = qmdd_create_basis_state(n, x8);
+        for (BDDVAR k = 0; k < n; k++) q = qmdd_gate(q, GATEID_H, k);
+        for (BDDVAR k = 0; k < n-1; k++) q = qmdd_cgate(q, GATEID_X, k, k+1);
+        q = qmdd_cgate_range(q, GATEID_Z, 1, 4, 6);
+        q = qmdd_gate(q, GATEID_Z, 3);
+        q = qmdd_cgate2(q, GATEID_X, 0, 2, 7);
+        qmat = qmdd_create_single_qubit_gate(n, 5, GATEID_H);
+        q = evbdd_matvec_mult(qmat, q, n);
+        test_assert(evbdd_is_ordered(q, n));
+        test_assert(qmdd_is_unitvector(q, n));
+        if (run == 0) { qref = q; evbdd_protect(&qref); }
+        else test_assert(evbdd_equivalent(q, qref, n, false, VERBOSE));
+    }
+    evbdd_unprotect(&qref);
+    evbdd_set_caching_autotune(false);
+    evbdd_set_caching_granularity(1);
+
+    if(VERBOSE) printf("qmdd caching levels:       ok\n");
+    return 0;
+}
+
+static int current_norm_strat;
+
+int test_wide_registers()
+{
+    QMDD q, u;
+    BDDVAR n = 300;
+    bool x[300], y[300];
+    memset(x, 0, sizeof(x));
+
+    // controls and targets beyond 255 (which are 4 mod 256 here)
+    q = qmdd_create_basis_state(n, x);
+    q = qmdd_gate(q, GATEID_X, 3);
+    q = qmdd_cgate(q, GATEID_X, 3, 4);
+    q = qmdd_cgate(q, GATEID_X, 3, 260);
+    x[3] = 1; x[4] = 1; x[260] = 1;
+    test_assert(evbdd_is_ordered(q, n));
+    test_assert(evbdd_getvalue(q, x) == EVBDD_ONE);
+    q = qmdd_cgate2(q, GATEID_X, 4, 260, 299);
+    x[299] = 1;
+    test_assert(evbdd_getvalue(q, x) == EVBDD_ONE);
+    q = qmdd_cgate_range(q, GATEID_X, 259, 260, 270);
+    test_assert(evbdd_getvalue(q, x) == EVBDD_ONE);
+    q = qmdd_gate(q, GATEID_X, 259);
+    q = qmdd_cgate_range(q, GATEID_X, 259, 260, 270);
+    x[259] = 1; x[270] = 1;
+    test_assert(evbdd_getvalue(q, x) == EVBDD_ONE);
+    q = qmdd_circuit_swap(q, 5, 261);
+    test_assert(evbdd_getvalue(q, x) == EVBDD_ONE);
+    q = qmdd_circuit_swap(q, 4, 261);
+    x[4] = 0; x[261] = 1;
+    test_assert(evbdd_getvalue(q, x) == EVBDD_ONE);
+    test_assert(evbdd_countnodes(q) == n + 1);
+
+    // GHZ state
+    memset(x, 0, sizeof(x));
+    q = qmdd_create_basis_state(n, x);
+    q = qmdd_gate(q, GATEID_H, 0);
+    for (BDDVAR k = 0; k < n-1; k++) q = qmdd_cgate(q, GATEID_X, k, k+1);
+    test_assert(evbdd_is_ordered(q, n));
+    test_assert(fabs(qmdd_get_norm(q, n) - 1.0) < 1e-14);
+    memset(y, 1, sizeof(y));
+    test_assert(evbdd_getvalue(q, x) != EVBDD_ZERO);
+    test_assert(evbdd_getvalue(q, x) == evbdd_getvalue(q, y));
+    y[257] = 0;
+    test_assert(evbdd_getvalue(q, y) == EVBDD_ZERO);
+
+    // matrices on 2n variables (not with NORM_L2, which gives the identity
+    // parts of a 200 qubit matrix a root weight of 2^100)
+    if (current_norm_strat != NORM_L2) {
+        BDDVAR m = 200;
+        memset(x, 0, sizeof(x));
+        q = qmdd_create_basis_state(m, x);
+        u = qmdd_create_single_qubit_gate(m, 199, GATEID_X);
+        test_assert(evbdd_is_ordered(u, 2*m));
+        q = evbdd_matvec_mult(u, q, m);
+        x[199] = 1;
+        test_assert(evbdd_getvalue(q, x) == EVBDD_ONE);
+        test_assert(q == qmdd_gate(qmdd_create_all_zero_state(m), GATEID_X, 199));
+    }
+
+    if(VERBOSE) printf("qmdd wide registers:       ok\n");
+    return 0;
+}
+
 int run_qmdd_tests()
 {
     // we are not testing garbage collection
     sylvan_gc_disable();
 
+    if (sylvan_get_edge_weight_type() == WGT_RATIONAL_128) {
+        // only the circuits which consist of Clifford+T gates
+        if (test_swap_circuit()) return 1;
+        if (test_cswap_circuit()) return 1;
+        if (test_tensor_product()) return 1;
+        if (test_measurements()) return 1;
+        if (test_5qubit_circuit()) return 1;
+        if (test_10qubit_circuit()) return 1;
+        if (test_caching_levels()) return 1;
+        if (test_wide_registers()) return 1;
+        if (test_exact_weights()) return 1;
+        return 0;
+    }
+
+    if (sylvan_get_edge_weight_type() == WGT_DOUBLE) {
+        // only the circuits which consist of real gates
+        if (test_swap_circuit()) return 1;
+        if (test_tensor_product()) return 1;
+        if (test_measurements()) return 1;
+        if (test_5qubit_circuit()) return 1;
+        if (test_10qubit_circuit()) return 1;
+        if (test_caching_levels()) return 1;
+        if (test_wide_registers()) return 1;
+        if (test_real_weights()) return 1;
+        return 0;
+    }
+
     // circuits
     if (test_swap_circuit()) return 1;
     if (test_cswap_circuit()) return 1;
@@ -758,13 +1007,15 @@ int run_qmdd_tests()
     if (test_measurements()) return 1;
     if (test_5qubit_circuit()) return 1;
     if (test_10qubit_circuit()) return 1;
+    if (test_caching_levels()) return 1;
+    if (test_wide_registers()) return 1;
     //if (test_20qubit_circuit()) return 1;
     if (test_QFT()) return 1;
 
     return 0;
 }
 
-int test_with(int wgt_backend, int norm_strat, int wgt_indx_bits) 
+int test_with(int wgt_type, int wgt_backend, int norm_strat, int wgt_indx_bits) 
 {
     // Standard Lace initialization
     int workers = 1;
@@ -774,12 +1025,13 @@ int test_with(int wgt_backend, int norm_strat, int wgt_indx_bits)
     // Simple Sylvan initialization
     sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<16, 1LL<<16);
     sylvan_init_package();
-    qsylvan_init_simulator(1LL<<wgt_indx_bits, 1LL<<wgt_indx_bits, -1, 
-                           wgt_backend, norm_strat);
+    qsylvan_init_simulator_wgt(1LL<<wgt_indx_bits, 1LL<<wgt_indx_bits, -1, 
+                               wgt_type, wgt_backend, norm_strat);
     qmdd_set_testing_mode(true); // turn on internal sanity tests
+    current_norm_strat = norm_strat;
 
-    printf("wgt backend = %d, norm strat = %d, wgt indx bits = %d:\n", 
-            wgt_backend, norm_strat, wgt_indx_bits);
+    printf("wgt type = %d, wgt backend = %d, norm strat = %d, wgt indx bits = %d:\n", 
+            wgt_type, wgt_backend, norm_strat, wgt_indx_bits);
     int res = run_qmdd_tests();
 
     sylvan_quit();
@@ -789,15 +1041,26 @@ int test_with(int wgt_backend, int norm_strat, int wgt_indx_bits)
 
 int runtests()
 {
-    for (int backend = 0; backend < n_wgt_storage_types; backend++) {
-        for (int norm_strat = 0; norm_strat < n_norm_strategies; norm_strat++) {
-            if (test_with(backend, norm_strat, 11)) return 1;
-            if (backend == COMP_HASHMAP) {
-                // test with edge wgt index > 23 bits
-                if (test_with(backend, norm_strat, 24)) return 1;
+    int wgt_types[] = {WGT_COMPLEX_128, WGT_DOUBLE};
+    for (int t = 0; t < 2; t++) {
+        for (int backend = 0; backend < n_wgt_storage_types; backend++) {
+            for (int norm_strat = 0; norm_strat < n_norm_strategies; norm_strat++) {
+                if (test_with(wgt_types[t], backend, norm_strat, 11)) return 1;
+                if (SYLVAN_EVBDD_LARGE_WGT_INDICES && backend == COMP_HASHMAP) {
+                    // test with edge wgt index > 23 bits (in the [33,30] layout)
+                    if (test_with(wgt_types[t], backend, norm_strat, 24)) return 1;
+                }
             }
         }
     }
+    // exact edge weights (only in a hashmap, and normalized by low or max)
+    int exact_norm_strats[] = {NORM_LOW, NORM_MAX};
+    for (int i = 0; i < 2; i++) {
+        if (test_with(WGT_RATIONAL_128, COMP_HASHMAP, exact_norm_strats[i], 11)) return 1;
+        if (SYLVAN_EVBDD_LARGE_WGT_INDICES) {
+            if (test_with(WGT_RATIONAL_128, COMP_HASHMAP, exact_norm_strats[i], 24)) return 1;
+        }
+    }
     return 0;
 }
 
@@ -470,6 +470,53 @@ int test_pauli_rotation_gates()
     return 0;
 }
 
+int test_dynamic_gate_registry()
+{
+    QMDD qInit, qTest, qRef;
+    BDDVAR nqubits = 3, t = 1;
+    uint32_t id1, id2, id3;
+
+    qInit = qmdd_create_all_zero_state(nqubits);
+    qInit = qmdd_gate(qInit, GATEID_H, t);
+
+    // same parameters -> same gate ID, other gates don't invalidate it
+    id1 = GATEID_Rz(0.123);
+    id2 = GATEID_Ry(0.456);
+    id3 = GATEID_Rz(0.123);
+    test_assert(id1 == id3);
+    test_assert(id1 != id2);
+    test_assert(id1 >= num_static_gates && id2 >= num_static_gates);
+    test_assert(GATEID_Phase(0.789) == GATEID_Phase(0.789));
+
+    // same matrix through a different parametrization -> same gate ID
+    test_assert(GATEID_Rx(0.5) == GATEID_U(0.5, -flt_acos(0.0), flt_acos(0.0)));
+
+    // ID obtained earlier still refers to the same gate
+    qRef  = qmdd_gate(qInit, GATEID_Rz(0.123), t);
+    qTest = qmdd_gate(qInit, id1, t);
+    test_assert(qTest == qRef);
+
+    // recycling of gate IDs with a small registry
+    uint32_t max_dyn = qmdd_get_max_dynamic_gates();
+    qmdd_set_max_dynamic_gates(2);
+    id1 = GATEID_Ry(0.1);
+    qRef = qmdd_gate(qInit, id1, t); // cache result for id1
+    for (int k = 2; k < 10; k++) {
+        // each new angle recycles a gate ID
+        uint32_t id = GATEID_Ry(0.1*k);
+        test_assert(id >= num_static_gates && id < num_static_gates + 2);
+        qTest = qmdd_gate(qInit, id, t);
+        test_assert(qmdd_is_unitvector(qTest, nqubits));
+        test_assert(qTest != qRef); // no stale cache results for re-used ID
+    }
+    qTest = qmdd_gate(qInit, GATEID_Ry(0.1), t);
+    test_assert(qTest == qRef);
+    qmdd_set_max_dynamic_gates(max_dyn);
+
+    if(VERBOSE) printf("qmdd dynamic gates:        ok\n");
+    return 0;
+}
+
 int test_cx_gate()
 {
     QMDD qBell;
@@ -700,6 +747,213 @@ int test_controlled_range_gate()
     return 0;
 }
 
+static QMDD
+apply_multi_cgate_matrix(QMDD state, BDDVAR n, const BDDVAR *cs, uint32_t nc, BDDVAR t, gate_id_t gate)
+{
+    int c_options[n];
+    for (BDDVAR k = 0; k < n; k++) c_options[k] = -1;
+    for (uint32_t k = 0; k < nc; k++) c_options[QMDD_CTRL_VAR(cs[k])] = QMDD_CTRL_IS_NEG(cs[k]) ? 0 : 1;
+    c_options[t] = 2;
+    return evbdd_matvec_mult(qmdd_create_multi_cgate(n, c_options, gate), state, n);
+}
+
+int test_multi_controlled_gate()
+{
+    QMDD qInit, qTest, qRef;
+    BDDVAR nqubits = 7;
+
+    // some entangled state with complex amplitudes
+    qInit = qmdd_create_all_zero_state(nqubits);
+    for (BDDVAR k = 0; k < nqubits; k++) qInit = qmdd_gate(qInit, GATEID_H, k);
+    qInit = qmdd_gate(qInit, GATEID_T, 1);
+    qInit = qmdd_cgate(qInit, GATEID_X, 0, 3);
+    qInit = qmdd_cgate(qInit, GATEID_Ry(0.3), 2, 5);
+    qInit = qmdd_gate(qInit, GATEID_sqrtY, 4);
+    evbdd_protect(&qInit);
+
+    // up to 3 controls: same as qmdd_cgate3
+    BDDVAR cs3[] = {4, 1, 2};
+    qRef  = qmdd_cgate3(qInit, GATEID_Y, 1, 2, 4, 6);
+    qTest = qmdd_mcgate(qInit, GATEID_Y, cs3, 3, 6);
+    test_assert(qTest == qRef);
+
+    // C5X (unsorted controls)
+    BDDVAR cs5[] = {4, 0, 2, 1, 3};
+    qRef  = apply_multi_cgate_matrix(qInit, nqubits, cs5, 5, 6, GATEID_X);
+    qTest = qmdd_mcgate(qInit, GATEID_X, cs5, 5, 6);
+    test_assert(evbdd_equivalent(qRef, qTest, nqubits, false, false));
+
+    // same, with some controls on |0>, which equals conjugating them with X
+    BDDVAR cs5_neg[] = {QMDD_CTRL_NEG(1), 0, QMDD_CTRL_NEG(3), 4, 2};
+    qRef  = qmdd_gate(qInit, GATEID_X, 1);
+    qRef  = qmdd_gate(qRef, GATEID_X, 3);
+    qRef  = qmdd_mcgate(qRef, GATEID_X, cs5, 5, 6);
+    qRef  = qmdd_gate(qRef, GATEID_X, 1);
+    qRef  = qmdd_gate(qRef, GATEID_X, 3);
+    qTest = qmdd_mcgate(qInit, GATEID_X, cs5_neg, 5, 6);
+    test_assert(evbdd_equivalent(qRef, qTest, nqubits, false, false));
+    qRef  = apply_multi_cgate_matrix(qInit, nqubits, cs5_neg, 5, 6, GATEID_X);
+    test_assert(evbdd_equivalent(qRef, qTest, nqubits, false, false));
+
+    // control lists which only differ after the first three controls (in
+    // qubit or polarity), applied in turn (with the cache filled)
+    BDDVAR tails[][6] = {{0, 1, 2, 3, 4},
+                         {0, 1, 2, 3, 5},
+                         {0, 1, 2, 3, QMDD_CTRL_NEG(4)},
+                         {0, 1, 2, QMDD_CTRL_NEG(3), 4, 5}};
+    uint32_t ncs[] = {5, 5, 5, 6};
+    for (size_t k = 0; k < sizeof(ncs) / sizeof(ncs[0]); k++) {
+        qRef  = apply_multi_cgate_matrix(qInit, nqubits, tails[k], ncs[k], 6, GATEID_Z);
+        qTest = qmdd_mcgate(qInit, GATEID_Z, tails[k], ncs[k], 6);
+        test_assert(evbdd_equivalent(qRef, qTest, nqubits, false, false));
+    }
+
+    // a small control list registry: once it is full, the next list gets the
+    // IDs (and so the cache keys) of the forgotten ones, without their results
+    uint32_t max_ctrls = qmdd_get_max_ctrl_lists();
+    qmdd_set_max_ctrl_lists(6);
+    BDDVAR long_a[] = {0, 1, 2, 3, 4, EVBDD_INVALID_VAR};
+    BDDVAR long_b[] = {0, 1, 2, QMDD_CTRL_NEG(3), 5, EVBDD_INVALID_VAR};
+    BDDVAR *interned = qmdd_ctrl_list_intern(long_a);
+    test_assert(qmdd_ctrl_list_intern(long_a) == interned);
+    qRef  = apply_multi_cgate_matrix(qInit, nqubits, long_a, 5, 6, GATEID_Z);
+    qTest = qmdd_mcgate(qInit, GATEID_Z, long_a, 5, 6);
+    test_assert(evbdd_equivalent(qRef, qTest, nqubits, false, false));
+    test_assert(qmdd_ctrl_list_intern(long_b) == interned);
+    qRef  = apply_multi_cgate_matrix(qInit, nqubits, long_b, 5, 6, GATEID_Z);
+    qTest = qmdd_mcgate(qInit, GATEID_Z, long_b, 5, 6);
+    test_assert(evbdd_equivalent(qRef, qTest, nqubits, false, false));
+    qmdd_set_max_ctrl_lists(max_ctrls);
+
+    // controls after the target (up to 5 of them, some negated)
+    BDDVAR cs_after[][5] = {{5},
+                            {QMDD_CTRL_NEG(4)},
+                            {6, 2},
+                            {1, 4, QMDD_CTRL_NEG(6)},
+                            {QMDD_CTRL_NEG(6), 0, 5, QMDD_CTRL_NEG(1)},
+                            {4, 5, 6, 2},
+                            {QMDD_CTRL_NEG(4), 5, QMDD_CTRL_NEG(6)},
+                            {1, QMDD_CTRL_NEG(2), 4, QMDD_CTRL_NEG(5), 6}};
+    uint32_t ncs_after[] = {1, 1, 2, 3, 4, 4, 3, 5};
+    gate_id_t gates_after[] = {GATEID_X, GATEID_Y, GATEID_H, GATEID_T, GATEID_H, GATEID_Z, GATEID_Ry(0.4), GATEID_X};
+    for (size_t k = 0; k < sizeof(ncs_after) / sizeof(ncs_after[0]); k++) {
+        for (BDDVAR t = 0; t < 4; t++) {
+            bool valid = true;
+            for (uint32_t j = 0; j < ncs_after[k]; j++) valid &= QMDD_CTRL_VAR(cs_after[k][j]) != t;
+            if (!valid) continue;
+            qRef  = apply_multi_cgate_matrix(qInit, nqubits, cs_after[k], ncs_after[k], t, gates_after[k]);
+            qTest = qmdd_mcgate(qInit, gates_after[k], cs_after[k], ncs_after[k], t);
+            test_assert(evbdd_equivalent(qRef, qTest, nqubits, false, false));
+        }
+    }
+
+    evbdd_unprotect(&qInit);
+
+    if(VERBOSE) printf("qmdd multi-controlled:     ok\n");
+    return 0;
+}
+
+int test_two_qubit_gates()
+{
+    QMDD qInit, qTest, qRef;
+    BDDVAR nqubits = 5;
+    fl_t s = 1.0/flt_sqrt(2.0);
+    fl_t pi = 2.0 * flt_acos(0.0);
+
+    // some entangled state with complex amplitudes
+    qInit = qmdd_create_all_zero_state(nqubits);
+    for (BDDVAR k = 0; k < nqubits; k++) qInit = qmdd_gate(qInit, GATEID_H, k);
+    qInit = qmdd_gate(qInit, GATEID_T, 1);
+    qInit = qmdd_gate(qInit, GATEID_Ry(0.3), 3);
+    qInit = qmdd_cgate(qInit, GATEID_X, 0, 2);
+    qInit = qmdd_cgate(qInit, GATEID_Rz(0.7), 1, 4);
+    qInit = qmdd_gate(qInit, GATEID_sqrtY, 2);
+    evbdd_protect(&qInit);
+
+    // same matrix -> same ID
+    test_assert(GATE2ID_swap() == GATE2ID_swap());
+    test_assert(GATE2ID_Rxx(0.3) == GATE2ID_Rxx(0.3));
+    test_assert(GATE2ID_Rxx(0.3) != GATE2ID_swap());
+
+    // CX and (H (x) I) CX as 4x4 matrices, with the control on the first qubit
+    complex_t cx[16], hcx[16];
+    for (int k = 0; k < 16; k++) cx[k] = hcx[k] = czero();
+    for (uint32_t c = 0; c < 4; c++) {
+        uint32_t cp = (c & 2) ? c ^ 1 : c; // column c after CX
+        uint32_t a = cp >> 1, b = cp & 1;
+        cx[4*cp + c] = cmake(1.0, 0.0);
+        hcx[4*(0 + b) + c] = cmake(s, 0.0);
+        hcx[4*(2 + b) + c] = cmake(a ? -s : s, 0.0);
+    }
+
+    // adjacent and non-adjacent qubits, in both orders
+    BDDVAR pairs[][2] = {{1,2}, {2,1}, {0,3}, {4,1}, {3,4}};
+    for (size_t k = 0; k < sizeof(pairs) / sizeof(pairs[0]); k++) {
+        BDDVAR q1 = pairs[k][0], q2 = pairs[k][1];
+
+        qRef  = qmdd_circuit_swap(qInit, q1, q2);
+        qTest = qmdd_gate2(qInit, GATE2ID_swap(), q1, q2);
+        test_assert(evbdd_equivalent(qRef, qTest, nqubits, false, false));
+
+        qRef  = qmdd_cgate(qInit, GATEID_X, q1, q2, nqubits);
+        qTest = qmdd_gate2(qInit, GATE2ID_custom(cx), q1, q2);
+        test_assert(evbdd_equivalent(qRef, qTest, nqubits, false, false));
+
+        qRef  = qmdd_cgate(qInit, GATEID_X, q1, q2, nqubits);
+        qRef  = qmdd_gate(qRef, GATEID_H, q1);
+        qTest = qmdd_gate2(qInit, GATE2ID_custom(hcx), q1, q2);
+        test_assert(evbdd_equivalent(qRef, qTest, nqubits, false, false));
+        test_assert(qmdd_gate2(qInit, GATE2ID_custom(hcx), q1, q2) == qTest);
+
+        // Rxx equals its decomposition (from qelib1.inc) up to global phase
+        fl_t theta = 0.4 + 0.1*k;
+        qRef  = qmdd_gate(qInit, GATEID_U(pi/2.0, theta, 0), q1);
+        qRef  = qmdd_gate(qRef, GATEID_H, q2);
+        qRef  = qmdd_cgate(qRef, GATEID_X, q1, q2, nqubits);
+        qRef  = qmdd_gate(qRef, GATEID_Phase(-theta), q2);
+        qRef  = qmdd_cgate(qRef, GATEID_X, q1, q2, nqubits);
+        qRef  = qmdd_gate(qRef, GATEID_H, q2);
+        qRef  = qmdd_gate(qRef, GATEID_U(pi/2.0, -pi, pi-theta), q1);
+        qTest = qmdd_gate2(qInit, GATE2ID_Rxx(theta), q1, q2);
+        test_assert(flt_abs(qmdd_fidelity(qRef, qTest, nqubits) - 1.0) < 1e-9);
+
+        // diag(1, e^ib, e^ic, e^id) equals P(b) on q2, P(c) on q1 and a
+        // controlled P(d - b - c)
+        fl_t b = 0.3 + 0.1*k, c = 1.1, d = -0.4;
+        complex_t diag[16];
+        for (int j = 0; j < 16; j++) diag[j] = czero();
+        diag[0]  = cmake(1.0, 0.0);
+        diag[5]  = cmake(flt_cos(b), flt_sin(b));
+        diag[10] = cmake(flt_cos(c), flt_sin(c));
+        diag[15] = cmake(flt_cos(d), flt_sin(d));
+        qRef  = qmdd_gate(qInit, GATEID_Phase(b), q2);
+        qRef  = qmdd_gate(qRef, GATEID_Phase(c), q1);
+        qRef  = qmdd_cgate(qRef, GATEID_Phase(d - b - c), q1, q2, nqubits);
+        qTest = qmdd_gate2(qInit, GATE2ID_custom(diag), q1, q2);
+        test_assert(flt_abs(qmdd_fidelity(qRef, qTest, nqubits) - 1.0) < 1e-9);
+        bool x1[] = {1, 1, 1, 1, 1};
+        complex_t aRef, aTest;
+        weight_value(evbdd_getvalue(qRef, x1), &aRef);
+        weight_value(evbdd_getvalue(qTest, x1), &aTest);
+        test_assert(flt_abs(aRef.r - aTest.r) < 1e-9 && flt_abs(aRef.i - aTest.i) < 1e-9);
+    }
+
+    // controlled SWAP
+    BDDVAR c = 0, t1 = 3, t2 = 1;
+    qRef = qmdd_cgate2(qInit, GATEID_X, c, t1, t2, nqubits);
+    qRef = qmdd_cgate(qRef, GATEID_H, c, t1, nqubits);
+    qRef = qmdd_cgate2(qRef, GATEID_Z, c, t1, t2, nqubits);
+    qRef = qmdd_cgate(qRef, GATEID_H, c, t1, nqubits);
+    qRef = qmdd_cgate2(qRef, GATEID_X, c, t1, t2, nqubits);
+    qTest = qmdd_controlled_gate2(qInit, GATE2ID_swap(), c, t1, t2);
+    test_assert(evbdd_equivalent(qRef, qTest, nqubits, false, false));
+
+    evbdd_unprotect(&qInit);
+
+    if(VERBOSE) printf("qmdd two-qubit gates:      ok\n");
+    return 0;
+}
+
 int run_qmdd_tests()
 {
     // we are not testing garbage collection
@@ -710,10 +964,13 @@ int run_qmdd_tests()
     if (test_h_gate()) return 1;
     if (test_phase_gates()) return 1;
     if (test_pauli_rotation_gates()) return 1;
+    if (test_dynamic_gate_registry()) return 1;
     if (test_cx_gate()) return 1;
     if (test_cz_gate()) return 1;
     if (test_controlled_range_gate()) return 1;
     if (test_ccz_gate()) return 1;
+    if (test_multi_controlled_gate()) return 1;
+    if (test_two_qubit_gates()) return 1;
 
     return 0;
 }
@@ -747,8 +1004,8 @@ int runtests()
     for (int backend = 0; backend < n_wgt_storage_types; backend++) {
         for (int norm_strat = 0; norm_strat < n_norm_strategies; norm_strat++) {
             if (test_with(backend, norm_strat, 11)) return 1;
-            if (backend == COMP_HASHMAP) {
-                // test with edge wgt index > 23 bits
+            if (SYLVAN_EVBDD_LARGE_WGT_INDICES && backend == COMP_HASHMAP) {
+                // test with edge wgt index > 23 bits (in the [33,30] layout)
                 if (test_with(backend, norm_strat, 24)) return 1;
             }
         }
@@ -1,6 +1,8 @@
 #include <stdio.h>
 
 #include "qsylvan.h"
+#include <sylvan_int.h>
+#include <sylvan_edge_weights_complex.h>
 #include "test_assert.h"
 #include "../examples/grover.h"
 
@@ -69,6 +71,327 @@ int test_table_size_increase()
 }
 
 
+int test_resizable_table()
+{
+    // Standard Lace initialization
+    int workers = 1;
+    lace_start(workers, 0);
+
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<16, 1LL<<16);
+    sylvan_init_package();
+    qsylvan_init_simulator(min_wgt_tablesize, max_wgt_tablesize, -1, COMP_RESIZABLE_HASHMAP, NORM_MAX);
+    qmdd_set_testing_mode(true); // turn on internal sanity tests
+
+    // a resizable table is created at its maximum size
+    test_assert(sylvan_get_edge_weight_table_size() == max_wgt_tablesize);
+
+    // add more weights than fit in a table of min_wgt_tablesize, this should
+    // neither trigger gc, nor change the indices of existing weights
+    complex_t c = cmake(0.25, -0.5);
+    EVBDD_WGT first = weight_complex_lookup(&c);
+    QMDD q = qmdd_gate(qmdd_create_all_zero_state(3), GATEID_H, 0);
+    evbdd_protect(&q);
+    for (uint64_t k = 0; k < 2*min_wgt_tablesize; k++) {
+        c = cmake(1.0/(k+3), (fl_t)k);
+        weight_complex_lookup(&c);
+    }
+    test_assert(sylvan_edge_weights_count_entries() > min_wgt_tablesize);
+    test_assert(!evbdd_test_gc_wgt_table());
+    c = cmake(0.25, -0.5);
+    test_assert(weight_complex_lookup(&c) == first);
+    test_assert(qmdd_gate(qmdd_create_all_zero_state(3), GATEID_H, 0) == q);
+    evbdd_unprotect(&q);
+
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
+
+
+int test_wgt_table_entries()
+{
+    // Standard Lace initialization
+    int workers = 1;
+    lace_start(workers, 0);
+
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<16, 1LL<<16);
+    sylvan_init_package();
+
+    for (int backend = 0; backend < n_wgt_storage_types; backend++) {
+        qsylvan_init_simulator(min_wgt_tablesize, max_wgt_tablesize, -1, backend, NORM_MAX);
+
+        // the counted entries are exact, including the pinned weights
+        test_assert(wgt_table_entries() == sylvan_edge_weights_count_entries());
+        QMDD q = qmdd_create_all_zero_state(4);
+        q = qmdd_gate(q, GATEID_H, 0);
+        q = qmdd_gate(q, GATEID_T, 0);
+        q = qmdd_cgate(q, GATEID_X, 0, 1);
+        evbdd_protect(&q);
+        test_assert(wgt_table_entries() == sylvan_edge_weights_count_entries());
+
+        // gc triggers as soon as the table is filled beyond the threshold
+        uint64_t size = sylvan_get_edge_weight_table_size();
+        uint64_t limit = (uint64_t)(evbdd_get_gc_wgt_table_thres() * size);
+        complex_t c;
+        for (uint64_t k = 0; wgt_table_entries() < limit; k++) {
+            c = cmake(1.0/(k+3), (fl_t)k);
+            weight_complex_lookup(&c);
+        }
+        test_assert(wgt_table_entries() == sylvan_edge_weights_count_entries());
+        test_assert(!evbdd_test_gc_wgt_table());
+        c = cmake(-1.0/3.0, -1.0);
+        weight_complex_lookup(&c);
+        test_assert(evbdd_test_gc_wgt_table());
+
+        // after gc the entries of the new table are counted
+        evbdd_gc_wgt_table();
+        test_assert(!evbdd_test_gc_wgt_table());
+        test_assert(wgt_table_entries() == sylvan_edge_weights_count_entries());
+        test_assert(wgt_table_entries() < limit);
+        evbdd_unprotect(&q);
+
+        sylvan_quit();
+        sylvan_init_package();
+    }
+
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
+
+
+int test_gc_keeps_cache()
+{
+    // Standard Lace initialization
+    int workers = 1;
+    lace_start(workers, 0);
+
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<16, 1LL<<16);
+    sylvan_init_package();
+    qsylvan_init_simulator(min_wgt_tablesize, max_wgt_tablesize, -1, COMP_HASHMAP, NORM_MAX);
+    qmdd_set_testing_mode(true); // turn on internal sanity tests
+
+    BDDVAR nqubits = 6;
+    QMDD q = qmdd_create_all_zero_state(nqubits);
+    evbdd_protect(&q);
+    for (BDDVAR k = 0; k < nqubits; k++) {
+        q = qmdd_gate(q, GATEID_H, k);
+        q = qmdd_gate(q, GATEID_Ry(0.1*(k+1)), k);
+    }
+    q = qmdd_cgate(q, GATEID_Z, 0, 3);
+    QMDD r = qmdd_gate(q, GATEID_Rx(0.7), 4);
+    evbdd_protect(&r);
+
+    // cache entries for the protected QMDDs survive gc of the edge weight table
+    wgt_mul(EVBDD_WEIGHT(q), EVBDD_WEIGHT(r));
+    evbdd_gc_wgt_table();
+#if !SYLVAN_EVBDD_WIDE_EDGES // (entries with 128 bit edges are not kept)
+    test_assert(cache_getused() > 0);
+#endif
+
+    // (as do the results of weight operations, if their weights are in use)
+    test_assert(wgt_cache_getused() > 0);
+    complex_t vq, vr, vqr;
+    weight_value(EVBDD_WEIGHT(q), &vq);
+    weight_value(EVBDD_WEIGHT(r), &vr);
+    weight_value(wgt_mul(EVBDD_WEIGHT(q), EVBDD_WEIGHT(r)), &vqr);
+    weight_mul(&vq, &vr);
+    test_assert(weight_approx_eq(&vq, &vqr));
+
+    // and (re)using them gives the same results as before
+    test_assert(qmdd_gate(q, GATEID_Rx(0.7), 4) == r);
+    sylvan_clear_cache();
+    test_assert(qmdd_gate(q, GATEID_Rx(0.7), 4) == r);
+    evbdd_unprotect(&q);
+    evbdd_unprotect(&r);
+
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
+
+
+static QMDD
+run_random_gates(BDDVAR nqubits, int ngates)
+{
+    srand(7);
+    QMDD q = qmdd_create_all_zero_state(nqubits);
+    for (int g = 0; g < ngates; g++) {
+        BDDVAR t = rand() % nqubits;
+        if (rand() % 4 == 0) {
+            BDDVAR c = (t + 1 + rand() % (nqubits - 1)) % nqubits;
+            q = qmdd_cgate(q, GATEID_X, c, t, nqubits);
+        } else {
+            q = qmdd_gate(q, (rand() % 2) ? GATEID_H : GATEID_T, t);
+        }
+    }
+    return q;
+}
+
+int test_gc_keeps_node_cache()
+{
+    // Standard Lace initialization
+    int workers = 1;
+    lace_start(workers, 0);
+
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<16, 1LL<<16);
+    sylvan_init_package();
+    qsylvan_init_simulator(min_wgt_tablesize, max_wgt_tablesize, -1, COMP_HASHMAP, NORM_MAX);
+    qmdd_set_testing_mode(true); // turn on internal sanity tests
+
+    BDDVAR nqubits = 8;
+    QMDD q = run_random_gates(nqubits, 50);
+    evbdd_protect(&q);
+    QMDD r = qmdd_gate(q, GATEID_Rx(0.3), 2);
+    evbdd_protect(&r);
+
+    // entries of which all nodes are marked survive gc of the nodes table, and
+    // (re)using them gives the same result
+    sylvan_gc();
+#if !SYLVAN_EVBDD_WIDE_EDGES
+    test_assert(cache_getused() > 0);
+#endif
+    test_assert(qmdd_gate(q, GATEID_Rx(0.3), 2) == r);
+
+    // the same circuit with gc before every gate gives the same state
+    sylvan_clear_cache();
+    qmdd_set_periodic_gc_nodetable(1);
+    QMDD q_gc = run_random_gates(nqubits, 50);
+    qmdd_set_periodic_gc_nodetable(0);
+    test_assert(evbdd_equivalent(q, q_gc, nqubits, false, false));
+
+    // with the old behaviour the cache is cleared
+    sylvan_gc_set_keep_cache(0);
+    sylvan_gc();
+    test_assert(cache_getused() == 0);
+    sylvan_gc_set_keep_cache(SYLVAN_GC_KEEP_CACHE);
+    evbdd_unprotect(&q);
+    evbdd_unprotect(&r);
+
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
+
+
+int test_cache_adaptive_resize()
+{
+    // Standard Lace initialization
+    int workers = 1;
+    lace_start(workers, 0);
+
+    // the operation cache starts small, and there is no gc of the nodes table
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<10, 1LL<<16);
+    sylvan_init_package();
+    qsylvan_init_simulator(min_wgt_tablesize, max_wgt_tablesize, -1, COMP_HASHMAP, NORM_MAX);
+
+    // the cache grows while Grover runs (and the result is unaffected)
+    if (test_grover_gc()) return 1;
+    size_t grown = cache_getsize();
+    test_assert(grown > (1LL<<10) && grown <= (1LL<<16));
+
+    // but not beyond the memory budget
+    cache_setsize(1LL<<10);
+    sylvan_set_cache_adaptive(1, (1LL<<11) * 36);
+    if (test_grover_gc()) return 1;
+    test_assert(cache_getsize() <= (1LL<<11));
+
+    // and not at all when disabled
+    cache_setsize(1LL<<10);
+    sylvan_set_cache_adaptive(0, 0);
+    if (test_grover_gc()) return 1;
+    test_assert(cache_getsize() == (1LL<<10));
+    sylvan_set_cache_adaptive(SYLVAN_CACHE_ADAPTIVE, 0);
+
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
+
+
+int test_wgt_l0_cache_gc()
+{
+    // Standard Lace initialization
+    int workers = 1;
+    lace_start(workers, 0);
+
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<16, 1LL<<16);
+    sylvan_init_package();
+    qsylvan_init_simulator(min_wgt_tablesize, max_wgt_tablesize, -1, COMP_HASHMAP, NORM_MAX);
+
+    // a (dead) weight which is in the per-worker cache ...
+    complex_t c = cmake(0.123, 0.456);
+    complex_t v;
+    EVBDD_WGT w = weight_complex_lookup(&c);
+    test_assert(weight_complex_lookup(&c) == w);
+
+    // ... is not moved to the new table by gc, so the cached index is stale,
+    // and the lookup has to go to the new table again
+    evbdd_gc_wgt_table();
+    complex_t d = cmake(0.789, -0.1);
+    weight_complex_lookup(&d);
+    w = weight_complex_lookup(&c);
+    weight_value(w, &v);
+    test_assert(weight_eq(&v, &c));
+    test_assert(weight_complex_lookup(&c) == w);
+
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
+
+
+int test_pinned_weights()
+{
+    // Standard Lace initialization
+    int workers = 1;
+    lace_start(workers, 0);
+
+    sylvan_set_sizes(1LL<<25, 1LL<<25, 1LL<<16, 1LL<<16);
+    sylvan_init_package();
+    qsylvan_init_simulator(min_wgt_tablesize, max_wgt_tablesize, -1, COMP_HASHMAP, NORM_MAX);
+
+    // constants have fixed indices
+    complex_t c;
+    c = cmake(0.0, 1.0);                test_assert(weight_complex_lookup(&c) == EVBDD_IMG);
+    c = cmake(0.0, -1.0);               test_assert(weight_complex_lookup(&c) == EVBDD_MIN_IMG);
+    c = cmake(1.0/flt_sqrt(2.0), 0.0);  test_assert(weight_complex_lookup(&c) == EVBDD_INV_SQRT_TWO);
+    c = cmake(-1.0, 0.0);               test_assert(weight_complex_lookup(&c) == EVBDD_MIN_ONE);
+
+    // the entries of static gates are pinned, and keep their index across gc
+    EVBDD_WGT h = gates[GATEID_H][3];
+    EVBDD_WGT t = gates[GATEID_T][3];
+    EVBDD_WGT rk = gates[GATEID_Rk(20)][3];
+    test_assert(wgt_is_pinned(h) && wgt_is_pinned(t) && wgt_is_pinned(rk));
+    c = cmake(0.123, 0.456);
+    test_assert(!wgt_is_pinned(weight_complex_lookup(&c)));
+    for (int k = 0; k < 2; k++) {
+        evbdd_gc_wgt_table();
+        test_assert(gates[GATEID_H][3] == h);
+        test_assert(gates[GATEID_T][3] == t);
+        test_assert(gates[GATEID_Rk(20)][3] == rk);
+        c = cmake(-1.0/flt_sqrt(2.0), 0.0);
+        test_assert(weight_complex_lookup(&c) == h);
+        c = cmake(1.0/flt_sqrt(2.0), 1.0/flt_sqrt(2.0));
+        test_assert(weight_complex_lookup(&c) == t);
+    }
+
+    // (and so do the weights of QMDDs which only use those)
+    QMDD q = qmdd_create_all_zero_state(3);
+    q = qmdd_gate(q, GATEID_H, 0);
+    q = qmdd_gate(q, GATEID_T, 0);
+    evbdd_protect(&q);
+    QMDD q_before = q;
+    evbdd_gc_wgt_table();
+    test_assert(EVBDD_WEIGHT(q) == EVBDD_WEIGHT(q_before));
+    evbdd_unprotect(&q);
+
+    sylvan_quit();
+    lace_stop();
+    return 0;
+}
+
+
 int test_custom_gate_gc_protection()
 {
     // Standard Lace initialization
@@ -169,11 +492,19 @@ int test_with(int wgt_backend, int norm_strat)
 
 int runtests()
 {
-    int backend = COMP_HASHMAP;
-    for (int norm_strat = 0; norm_strat < n_norm_strategies; norm_strat++) {
-        if (test_with(backend, norm_strat)) return 1;
+    for (int backend = 0; backend < n_wgt_storage_types; backend++) {
+        for (int norm_strat = 0; norm_strat < n_norm_strategies; norm_strat++) {
+            if (test_with(backend, norm_strat)) return 1;
+        }
     }
     if (test_table_size_increase()) return 1;
+    if (test_resizable_table()) return 1;
+    if (test_wgt_table_entries()) return 1;
+    if (test_gc_keeps_cache()) return 1;
+    if (test_gc_keeps_node_cache()) return 1;
+    if (test_cache_adaptive_resize()) return 1;
+    if (test_wgt_l0_cache_gc()) return 1;
+    if (test_pinned_weights()) return 1;
     if (test_custom_gate_gc_protection()) return 1;
     return 0;
 }
@@ -710,6 +710,41 @@ TASK_0(int, test_zdd_isop_random)
     return 0;
 }
 
+/**
+ * ISOP results are cached in 2-part entries. Growing the cache drops these,
+ * without leaving halves of them behind, after which ISOP gives the same
+ * result again.
+ */
+TASK_0(int, test_zdd_isop_cache_grow)
+{
+    const size_t size = cache_getsize();
+    cache_setsize(size / 4);
+
+    BDD bdd_dom = mtbdd_fromarray((uint32_t[]){0,1,2,3,4,5,6,7,8,9,10,11}, 12);
+    MTBDD bdd_set = mtbdd_false;
+    for (int j=0; j<100; j++) {
+        uint8_t arr[12];
+        for (int k=0; k<12; k++) arr[k] = rng(0, 2);
+        bdd_set = sylvan_or(bdd_set, sylvan_cube(bdd_dom, arr));
+    }
+    MTBDD isop_bdd;
+    ZDD isop_zdd = zdd_isop(bdd_set, bdd_set, &isop_bdd);
+
+    const size_t used = cache_getused();
+    cache_grow(size);
+    test_assert(cache_getsize() == size);
+    test_assert(cache_getused() < used);
+
+    MTBDD isop_bdd2;
+    ZDD isop_zdd2 = zdd_isop(bdd_set, bdd_set, &isop_bdd2);
+    test_assert(isop_zdd2 == isop_zdd);
+    test_assert(isop_bdd2 == isop_bdd);
+    test_assert(isop_bdd == bdd_set);
+    test_assert(zdd_cover_to_bdd(isop_zdd) == bdd_set);
+
+    return 0;
+}
+
 TASK_0(int, test_zdd_read_write)
 {
     /**
@@ -789,6 +824,8 @@ TASK_0(int, runtests)
     if (CALL(test_zdd_isop_basic)) return 1;
     printf("test_zdd_isop_random...\n");
     for (int k=0; k<test_iterations; k++) if (CALL(test_zdd_isop_random)) return 1;
+    printf("test_zdd_isop_cache_grow...\n");
+    if (CALL(test_zdd_isop_cache_grow)) return 1;
 
     return 0;
 }